@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief This file implements the bloom filters declared in bloom.h.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "bloom.h"
+
+int bloom_init(struct bloom *bloom, unsigned long num_keys, double fpr)
+{
+    double bits_per_key;
+
+    if (num_keys < 1)
+    {
+        num_keys = 1;
+    }
+    if (fpr <= 0 || fpr >= 1)
+    {
+        fpr = 0.01;
+    }
+
+    // m = -n ln p / (ln 2)^2 bits, with k = (m / n) ln 2 hashes
+    bits_per_key = -log(fpr) / (M_LN2 * M_LN2);
+    bloom->num_bits = (unsigned long)(bits_per_key * num_keys) + 8;
+    bloom->num_hashes = (int)(bits_per_key * M_LN2 + 0.5);
+    if (bloom->num_hashes < 1)
+    {
+        bloom->num_hashes = 1;
+    }
+    if (bloom->num_hashes > 30)
+    {
+        bloom->num_hashes = 30;
+    }
+    bloom->bits = calloc((bloom->num_bits + 7) / 8, 1);
+    return bloom->bits ? 0 : -1;
+}
+
+void bloom_free(struct bloom *bloom)
+{
+    free(bloom->bits);
+    bloom->bits = NULL;
+    bloom->num_bits = 0;
+}
+
+void bloom_hash(const char *key, unsigned int hashes[2])
+{
+    unsigned int h1 = 2166136261u, h2 = 0x9747b28cu;
+    const unsigned char *c;
+
+    // FNV-1a, and a multiply-rotate hash seeded apart from it
+    for (c = (const unsigned char *)key; *c; c++)
+    {
+        h1 = (h1 ^ *c) * 16777619u;
+        h2 = (h2 ^ *c) * 0x5bd1e995u;
+        h2 = (h2 << 13) | (h2 >> 19);
+    }
+    h2 ^= h2 >> 15;
+    h2 *= 0x27d4eb2du;
+    h2 ^= h2 >> 16;
+
+    // An odd step visits every bit position before repeating
+    hashes[0] = h1;
+    hashes[1] = h2 | 1;
+}
+
+void bloom_add(struct bloom *bloom, const unsigned int hashes[2])
+{
+    unsigned long bit;
+    int i;
+
+    for (i = 0; i < bloom->num_hashes; i++)
+    {
+        bit = (hashes[0] + (unsigned long)i * hashes[1]) % bloom->num_bits;
+        bloom->bits[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+int bloom_may_contain(const struct bloom *bloom, const unsigned int hashes[2])
+{
+    unsigned long bit;
+    int i;
+
+    for (i = 0; i < bloom->num_hashes; i++)
+    {
+        bit = (hashes[0] + (unsigned long)i * hashes[1]) % bloom->num_bits;
+        if (!(bloom->bits[bit / 8] & (1 << (bit % 8))))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief This file declares the bloom filters the storage server keeps
+ * to skip reads for keys a table does not have.
+ *
+ * A filter answers "maybe" for every key added to it, and "no" for most
+ * others; how many get a wrong "maybe" is set when the filter is sized.
+ * Keys are hashed once into two values, and the k bits of a key are
+ * derived from those, so a filter can be filled from hashes saved before
+ * its size was known.
+ */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+/**
+ * @brief A bloom filter.
+ */
+struct bloom {
+	/// The bits, num_bits rounded up to whole bytes.
+	unsigned char *bits;
+
+	/// Number of bits.
+	unsigned long num_bits;
+
+	/// Bits set for every key.
+	int num_hashes;
+};
+
+/**
+ * @brief Size an empty filter.
+ *
+ * @param bloom The filter.
+ * @param num_keys Keys expected in it.
+ * @param fpr Wanted rate of false "maybe" answers, between 0 and 1.
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int bloom_init(struct bloom *bloom, unsigned long num_keys, double fpr);
+
+/**
+ * @brief Free the bits of a filter.
+ *
+ * @param bloom The filter.
+ */
+void bloom_free(struct bloom *bloom);
+
+/**
+ * @brief Hash a key for a filter.
+ *
+ * @param key The key.
+ * @param hashes Where to write the two hashes of the key.
+ */
+void bloom_hash(const char *key, unsigned int hashes[2]);
+
+/**
+ * @brief Add a key to a filter.
+ *
+ * @param bloom The filter.
+ * @param hashes The hashes of the key, from bloom_hash().
+ */
+void bloom_add(struct bloom *bloom, const unsigned int hashes[2]);
+
+/**
+ * @brief Check whether a filter may hold a key.
+ *
+ * @param bloom The filter.
+ * @param hashes The hashes of the key, from bloom_hash().
+ * @return Return 0 if the key was never added, 1 if it may have been.
+ */
+int bloom_may_contain(const struct bloom *bloom, const unsigned int hashes[2]);
+
+#endif
@@ -0,0 +1,1268 @@
+/**
+ * @file
+ * @brief This file implements the paged table files declared in btree.h.
+ *
+ * A leaf cell is a 1 byte key length, a 2 byte value length, the key and
+ * the value, with no terminators. An internal entry is the separator key,
+ * padded to MAX_KEY_LEN, then the child page; the child holds the keys
+ * not less than its separator and less than the next one, and the page
+ * in the header's link holds the keys less than the first separator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "btree.h"
+#include "bufferpool.h"
+#include "bloom.h"
+
+#define BTREE_MAGIC 0x42545231	///< First field of page 0.
+#define BTREE_HEADER 12	///< Bytes of the header of a tree page.
+#define BTREE_CELL_HEADER 3	///< Bytes before the key of a leaf cell.
+#define BTREE_ENTRY (MAX_KEY_LEN + 4)	///< Bytes of an internal entry.
+#define BTREE_MAX_ENTRIES ((BUFFER_PAGE_SIZE - BTREE_HEADER) / BTREE_ENTRY)	///< Entries of a full internal page.
+#define BTREE_MAX_CELLS (BUFFER_PAGE_SIZE / (2 + BTREE_CELL_HEADER + 1) + 1)	///< Cells of a full leaf, plus one.
+
+/**
+ * @brief Page 0 of a table file.
+ */
+struct btree_meta {
+	/// BTREE_MAGIC.
+	unsigned int magic;
+
+	/// Page number of the root.
+	unsigned int root;
+
+	/// Pages in the file, page 0 included.
+	unsigned int num_pages;
+};
+
+/**
+ * @brief The header of a tree page.
+ */
+struct btree_node {
+	/// 1 for a leaf, 0 for an internal page.
+	unsigned char leaf;
+	unsigned char unused;
+
+	/// Cells of a leaf, or entries of an internal page.
+	unsigned short num;
+
+	/// Leaves: offset of the lowest cell.
+	unsigned short cell_start;
+
+	/// Leaves: bytes of cells no slot points at any more.
+	unsigned short dead;
+
+	/// Leaves: the next leaf, 0 for the last; internal pages: the leftmost child.
+	unsigned int link;
+};
+
+/**
+ * @brief A leaf cell being moved during a split.
+ */
+struct btree_cell {
+	const unsigned char *key;
+	int key_len;
+	const unsigned char *value;
+	int value_len;
+};
+
+/**
+ * @brief An internal entry being moved during a split.
+ */
+struct btree_entry {
+	char key[MAX_KEY_LEN];
+	unsigned int child;
+};
+
+/**
+ * @brief The file of one table.
+ */
+struct btree_table {
+	/// The file.
+	int fd;
+
+	/// 1 to sync the file after every write.
+	int sync_always;
+
+	/// Taken shared by readers and exclusive by writers.
+	pthread_rwlock_t lock;
+
+	/// Filter of the keys, so most lookups of a missing key read no page.
+	/// Deleted keys stay in it until it is rebuilt.
+	struct bloom bloom;
+
+	/// Wanted false positive rate of the filter.
+	double bloom_fpr;
+
+	/// Keys the filter was sized for.
+	unsigned long bloom_capacity;
+
+	/// Keys in the table, and deleted keys still in the filter.
+	unsigned long num_keys;
+	unsigned long num_stale;
+};
+
+/**
+ * @brief Records of one leaf copied out of the tree, read one at a time.
+ */
+struct btree_cursor {
+	/// Table index.
+	int table;
+
+	/// Last key returned, or the first key wanted before any was.
+	char last[MAX_KEY_LEN];
+
+	/// 1 until a key is returned: a key equal to last is wanted.
+	int inclusive;
+
+	/// 1 once the last leaf has been copied.
+	int done;
+
+	/// Next slot of the copy to return.
+	int slot;
+
+	/// Copy of the current leaf.
+	unsigned char page[BUFFER_PAGE_SIZE];
+};
+
+static struct btree_table btree_tables[MAX_TABLES];
+
+/**
+ * @brief Slot array of a leaf.
+ *
+ * @param data the page
+ * @return the slots
+ */
+static unsigned short *leaf_slots(unsigned char *data)
+{
+    return (unsigned short *)(data + BTREE_HEADER);
+}
+
+/**
+ * @brief Read a leaf cell.
+ *
+ * @param data the page
+ * @param slot slot of the cell
+ * @param cell where to point at its key and value
+ * @return the bytes of the cell
+ */
+static int leaf_cell(unsigned char *data, int slot, struct btree_cell *cell)
+{
+    unsigned char *at = data + leaf_slots(data)[slot];
+    unsigned short value_len;
+
+    memcpy(&value_len, at + 1, 2);
+    cell->key_len = at[0];
+    cell->key = at + BTREE_CELL_HEADER;
+    cell->value_len = value_len;
+    cell->value = cell->key + cell->key_len;
+    return BTREE_CELL_HEADER + cell->key_len + cell->value_len;
+}
+
+/**
+ * @brief Compare the key of a leaf cell with a key.
+ *
+ * @param data the page
+ * @param slot slot of the cell
+ * @param key the key
+ * @return less than, equal to or greater than 0 as the cell's key sorts before, with or after key
+ */
+static int leaf_compare(unsigned char *data, int slot, const char *key)
+{
+    struct btree_cell cell;
+    char cell_key[MAX_KEY_LEN];
+
+    leaf_cell(data, slot, &cell);
+    memcpy(cell_key, cell.key, cell.key_len);
+    cell_key[cell.key_len] = '\0';
+    return strcmp(cell_key, key);
+}
+
+/**
+ * @brief Find the slot of a key in a leaf.
+ *
+ * @param data the page
+ * @param key the key
+ * @param found where to store 1 if the key is in the leaf
+ * @return the first slot whose key is not less than key
+ */
+static int leaf_search(unsigned char *data, const char *key, int *found)
+{
+    struct btree_node *node = (struct btree_node *)data;
+    int low = 0, high = node->num, mid, cmp;
+
+    *found = 0;
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        cmp = leaf_compare(data, mid, key);
+        if (cmp == 0)
+        {
+            *found = 1;
+            return mid;
+        }
+        if (cmp < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Free bytes between the slots and the cells of a leaf.
+ *
+ * @param data the page
+ * @return the bytes
+ */
+static int leaf_free(unsigned char *data)
+{
+    struct btree_node *node = (struct btree_node *)data;
+
+    return node->cell_start - (BTREE_HEADER + 2 * node->num);
+}
+
+/**
+ * @brief Make a page an empty leaf.
+ *
+ * @param data the page
+ * @param link the next leaf
+ * @return no return value
+ */
+static void leaf_init(unsigned char *data, unsigned int link)
+{
+    struct btree_node *node = (struct btree_node *)data;
+
+    memset(data, 0, BUFFER_PAGE_SIZE);
+    node->leaf = 1;
+    node->cell_start = BUFFER_PAGE_SIZE;
+    node->link = link;
+}
+
+/**
+ * @brief Add a cell to a leaf with room for it.
+ *
+ * @param data the page
+ * @param slot slot to give the cell; later cells move up one slot
+ * @param cell the cell
+ * @return no return value
+ */
+static void leaf_put(unsigned char *data, int slot, const struct btree_cell *cell)
+{
+    struct btree_node *node = (struct btree_node *)data;
+    unsigned short *slots = leaf_slots(data);
+    unsigned short value_len = cell->value_len;
+    unsigned char *at;
+
+    node->cell_start -= BTREE_CELL_HEADER + cell->key_len + cell->value_len;
+    at = data + node->cell_start;
+    at[0] = cell->key_len;
+    memcpy(at + 1, &value_len, 2);
+    memcpy(at + BTREE_CELL_HEADER, cell->key, cell->key_len);
+    memcpy(at + BTREE_CELL_HEADER + cell->key_len, cell->value, cell->value_len);
+    memmove(&slots[slot + 1], &slots[slot], (node->num - slot) * sizeof *slots);
+    slots[slot] = node->cell_start;
+    node->num++;
+}
+
+/**
+ * @brief Take a cell out of a leaf.
+ *
+ * @param data the page
+ * @param slot slot of the cell
+ * @return no return value
+ */
+static void leaf_remove(unsigned char *data, int slot)
+{
+    struct btree_node *node = (struct btree_node *)data;
+    unsigned short *slots = leaf_slots(data);
+    struct btree_cell cell;
+
+    node->dead += leaf_cell(data, slot, &cell);
+    memmove(&slots[slot], &slots[slot + 1], (node->num - slot - 1) * sizeof *slots);
+    node->num--;
+}
+
+/**
+ * @brief Fill a leaf with cells, in order.
+ *
+ * @param data the page
+ * @param cells the cells; they must not point into data
+ * @param num_cells number of cells
+ * @param link the next leaf
+ * @return no return value
+ */
+static void leaf_build(unsigned char *data, const struct btree_cell *cells, int num_cells, unsigned int link)
+{
+    int i;
+
+    leaf_init(data, link);
+    for (i = 0; i < num_cells; i++)
+    {
+        leaf_put(data, i, &cells[i]);
+    }
+}
+
+/**
+ * @brief Read the cells of a leaf from a copy of it.
+ *
+ * @param copy copy of the page
+ * @param cells where to point at the cells
+ * @return the bytes of the cells and their slots
+ */
+static int leaf_cells(unsigned char *copy, struct btree_cell *cells)
+{
+    struct btree_node *node = (struct btree_node *)copy;
+    int i, bytes = 0;
+
+    for (i = 0; i < node->num; i++)
+    {
+        bytes += 2 + leaf_cell(copy, i, &cells[i]);
+    }
+    return bytes;
+}
+
+/**
+ * @brief Point at an internal entry.
+ *
+ * @param data the page
+ * @param i index of the entry
+ * @return the entry's key, followed by its child
+ */
+static unsigned char *internal_entry(unsigned char *data, int i)
+{
+    return data + BTREE_HEADER + i * BTREE_ENTRY;
+}
+
+/**
+ * @brief Read the child of an internal entry.
+ *
+ * @param data the page
+ * @param i index of the entry, -1 for the leftmost child
+ * @return the child page
+ */
+static unsigned int internal_child_at(unsigned char *data, int i)
+{
+    unsigned int child;
+
+    if (i < 0)
+    {
+        return ((struct btree_node *)data)->link;
+    }
+    memcpy(&child, internal_entry(data, i) + MAX_KEY_LEN, 4);
+    return child;
+}
+
+/**
+ * @brief Count the entries of an internal page whose key is not greater than a key.
+ *
+ * @param data the page
+ * @param key the key
+ * @return the count; the child of the entry before it holds the key
+ */
+static int internal_search(unsigned char *data, const char *key)
+{
+    struct btree_node *node = (struct btree_node *)data;
+    int low = 0, high = node->num, mid;
+
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (strcmp((char *)internal_entry(data, mid), key) <= 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Fill an internal page with entries.
+ *
+ * @param data the page
+ * @param link the leftmost child
+ * @param entries the entries, in order
+ * @param num_entries number of entries
+ * @return no return value
+ */
+static void internal_build(unsigned char *data, unsigned int link, const struct btree_entry *entries, int num_entries)
+{
+    struct btree_node *node = (struct btree_node *)data;
+    int i;
+
+    memset(data, 0, BUFFER_PAGE_SIZE);
+    node->num = num_entries;
+    node->link = link;
+    for (i = 0; i < num_entries; i++)
+    {
+        memcpy(internal_entry(data, i), entries[i].key, MAX_KEY_LEN);
+        memcpy(internal_entry(data, i) + MAX_KEY_LEN, &entries[i].child, 4);
+    }
+}
+
+/**
+ * @brief Add a page to the end of a table file.
+ *
+ * @param t the table, locked exclusively
+ * @return the pinned frame of the zeroed page, NULL on error
+ */
+static struct buffer_frame *allocate_page(struct btree_table *t)
+{
+    struct buffer_frame *meta = buffer_pool_fetch(t->fd, 0), *frame = NULL;
+    struct btree_meta *m;
+
+    if (meta == NULL)
+    {
+        return NULL;
+    }
+    m = (struct btree_meta *)meta->data;
+    frame = buffer_pool_fetch(t->fd, m->num_pages);
+    if (frame)
+    {
+        m->num_pages++;
+        memset(frame->data, 0, BUFFER_PAGE_SIZE);
+        if (buffer_pool_write(meta) != 0)
+        {
+            buffer_pool_release(frame);
+            frame = NULL;
+        }
+    }
+    buffer_pool_release(meta);
+    return frame;
+}
+
+/**
+ * @brief Read the root page number of a table.
+ *
+ * @param t the table, locked
+ * @return the root, 0 on error
+ */
+static unsigned int root_page(struct btree_table *t)
+{
+    struct buffer_frame *meta = buffer_pool_fetch(t->fd, 0);
+    unsigned int root;
+
+    if (meta == NULL)
+    {
+        return 0;
+    }
+    root = ((struct btree_meta *)meta->data)->root;
+    buffer_pool_release(meta);
+    return root;
+}
+
+/**
+ * @brief Walk down to the leaf that holds a key.
+ *
+ * @param t the table, locked
+ * @param key the key
+ * @return the pinned frame of the leaf, NULL on error
+ */
+static struct buffer_frame *find_leaf(struct btree_table *t, const char *key)
+{
+    struct buffer_frame *frame, *child;
+    unsigned int page = root_page(t);
+
+    frame = page ? buffer_pool_fetch(t->fd, page) : NULL;
+    while (frame && !((struct btree_node *)frame->data)->leaf)
+    {
+        page = internal_child_at(frame->data, internal_search(frame->data, key) - 1);
+        child = buffer_pool_fetch(t->fd, page);
+        buffer_pool_release(frame);
+        frame = child;
+    }
+    return frame;
+}
+
+/**
+ * @brief Add a cell to a leaf, splitting it if it is full.
+ *
+ * @param t the table, locked exclusively
+ * @param frame the leaf
+ * @param cell the cell
+ * @param split_key where to copy the first key of the new leaf on a split
+ * @param split_page where to store the new leaf on a split
+ * @param added where to store 1 if the key was not in the leaf
+ * @return 0 on success, 1 on a split, -1 on error
+ */
+static int leaf_insert(struct btree_table *t, struct buffer_frame *frame, const struct btree_cell *cell,
+                       char split_key[MAX_KEY_LEN], unsigned int *split_page, int *added)
+{
+    struct btree_node *node = (struct btree_node *)frame->data;
+    struct btree_cell cells[BTREE_MAX_CELLS];
+    unsigned char copy[BUFFER_PAGE_SIZE];
+    char key[MAX_KEY_LEN];
+    struct buffer_frame *right;
+    int slot, found, need, total, left_bytes = 0, num_cells, num_left, status;
+
+    memcpy(key, cell->key, cell->key_len);
+    key[cell->key_len] = '\0';
+    slot = leaf_search(frame->data, key, &found);
+    *added = !found;
+    if (found)
+    {
+        leaf_remove(frame->data, slot);
+    }
+    need = 2 + BTREE_CELL_HEADER + cell->key_len + cell->value_len;
+    if (leaf_free(frame->data) < need && leaf_free(frame->data) + node->dead >= need)
+    {
+        // Squeeze out the dead cells
+        memcpy(copy, frame->data, BUFFER_PAGE_SIZE);
+        num_cells = node->num;
+        leaf_cells(copy, cells);
+        leaf_build(frame->data, cells, num_cells, node->link);
+    }
+    if (leaf_free(frame->data) >= need)
+    {
+        leaf_put(frame->data, slot, cell);
+        return buffer_pool_write(frame) == 0 ? 0 : -1;
+    }
+
+    // Split the cells, the new one included, in two halves by bytes
+    memcpy(copy, frame->data, BUFFER_PAGE_SIZE);
+    num_cells = node->num;
+    total = leaf_cells(copy, cells) + need;
+    memmove(&cells[slot + 1], &cells[slot], (num_cells - slot) * sizeof *cells);
+    cells[slot] = *cell;
+    num_cells++;
+    for (num_left = 0; num_left < num_cells - 1 && left_bytes < total / 2; num_left++)
+    {
+        left_bytes += 2 + BTREE_CELL_HEADER + cells[num_left].key_len + cells[num_left].value_len;
+    }
+    if (num_left == 0)
+    {
+        num_left = 1;
+    }
+    right = allocate_page(t);
+    if (right == NULL)
+    {
+        return -1;
+    }
+
+    // The new leaf is written first, so the file never links to a page it lacks
+    leaf_build(right->data, &cells[num_left], num_cells - num_left, node->link);
+    status = buffer_pool_write(right);
+    *split_page = right->page_num;
+    buffer_pool_release(right);
+    leaf_build(frame->data, cells, num_left, *split_page);
+    if (status != 0 || buffer_pool_write(frame) != 0)
+    {
+        return -1;
+    }
+    memcpy(split_key, cells[num_left].key, cells[num_left].key_len);
+    split_key[cells[num_left].key_len] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Add an entry to an internal page, splitting it if it is full.
+ *
+ * @param t the table, locked exclusively
+ * @param frame the page
+ * @param key the entry's key
+ * @param child the entry's child
+ * @param split_key where to copy the key moved up on a split
+ * @param split_page where to store the new page on a split
+ * @return 0 on success, 1 on a split, -1 on error
+ */
+static int internal_insert(struct btree_table *t, struct buffer_frame *frame, const char *key, unsigned int child,
+                           char split_key[MAX_KEY_LEN], unsigned int *split_page)
+{
+    struct btree_node *node = (struct btree_node *)frame->data;
+    struct btree_entry entries[BTREE_MAX_ENTRIES + 1];
+    struct buffer_frame *right;
+    int pos = internal_search(frame->data, key), i, num_entries = node->num, mid, status;
+
+    if (node->num < BTREE_MAX_ENTRIES)
+    {
+        memmove(internal_entry(frame->data, pos + 1), internal_entry(frame->data, pos), (node->num - pos) * BTREE_ENTRY);
+        memset(internal_entry(frame->data, pos), 0, MAX_KEY_LEN);
+        strcpy((char *)internal_entry(frame->data, pos), key);
+        memcpy(internal_entry(frame->data, pos) + MAX_KEY_LEN, &child, 4);
+        node->num++;
+        return buffer_pool_write(frame) == 0 ? 0 : -1;
+    }
+
+    for (i = 0; i < num_entries; i++)
+    {
+        memcpy(entries[i + (i >= pos)].key, internal_entry(frame->data, i), MAX_KEY_LEN);
+        entries[i + (i >= pos)].child = internal_child_at(frame->data, i);
+    }
+    memset(entries[pos].key, 0, MAX_KEY_LEN);
+    strcpy(entries[pos].key, key);
+    entries[pos].child = child;
+    num_entries++;
+
+    // The middle key moves up; its child becomes the new page's leftmost
+    mid = num_entries / 2;
+    right = allocate_page(t);
+    if (right == NULL)
+    {
+        return -1;
+    }
+    internal_build(right->data, entries[mid].child, &entries[mid + 1], num_entries - mid - 1);
+    status = buffer_pool_write(right);
+    *split_page = right->page_num;
+    buffer_pool_release(right);
+    internal_build(frame->data, node->link, entries, mid);
+    if (status != 0 || buffer_pool_write(frame) != 0)
+    {
+        return -1;
+    }
+    strcpy(split_key, entries[mid].key);
+    return 1;
+}
+
+/**
+ * @brief Insert a cell into the subtree under a page.
+ *
+ * @param t the table, locked exclusively
+ * @param page the page
+ * @param cell the cell
+ * @param split_key where to copy the separator of the new page if the page splits
+ * @param split_page where to store the new page if the page splits
+ * @param added where to store 1 if the key was not in the table
+ * @return 0 on success, 1 if the page split, -1 on error
+ */
+static int insert(struct btree_table *t, unsigned int page, const struct btree_cell *cell, char split_key[MAX_KEY_LEN],
+                  unsigned int *split_page, int *added)
+{
+    struct buffer_frame *frame = buffer_pool_fetch(t->fd, page);
+    char key[MAX_KEY_LEN], child_key[MAX_KEY_LEN];
+    unsigned int child_page;
+    int status;
+
+    if (frame == NULL)
+    {
+        return -1;
+    }
+    if (((struct btree_node *)frame->data)->leaf)
+    {
+        status = leaf_insert(t, frame, cell, split_key, split_page, added);
+    }
+    else
+    {
+        memcpy(key, cell->key, cell->key_len);
+        key[cell->key_len] = '\0';
+        page = internal_child_at(frame->data, internal_search(frame->data, key) - 1);
+        status = insert(t, page, cell, child_key, &child_page, added);
+        if (status == 1)
+        {
+            status = internal_insert(t, frame, child_key, child_page, split_key, split_page);
+        }
+    }
+    buffer_pool_release(frame);
+    return status;
+}
+
+/**
+ * @brief Sync a table file after a write if asked to.
+ *
+ * @param t the table
+ * @param status result of the write
+ * @return status, or -1 if the sync failed
+ */
+static int write_done(struct btree_table *t, int status)
+{
+    if (status == 0 && t->sync_always && fdatasync(t->fd) != 0)
+    {
+        return -1;
+    }
+    return status;
+}
+
+/**
+ * @brief Rebuild the filter of a table from its leaves, sized for twice
+ * its keys so it can grow before the next rebuild.
+ *
+ * @param t the table, locked exclusively or not yet shared
+ * @return 0 on success, -1 on error
+ */
+static int bloom_rebuild(struct btree_table *t)
+{
+    struct buffer_frame *leaf = find_leaf(t, ""), *next;
+    unsigned int (*hashes)[2] = NULL, (*grown)[2];
+    unsigned long num_keys = 0, max_keys = 0, i;
+    struct btree_cell cell;
+    struct bloom bloom;
+    char key[MAX_KEY_LEN];
+    unsigned int link;
+    int slot, status = leaf ? 0 : -1;
+
+    // The leftmost leaf and its links cover every key
+    while (leaf && status == 0)
+    {
+        for (slot = 0; slot < ((struct btree_node *)leaf->data)->num && status == 0; slot++)
+        {
+            if (num_keys == max_keys)
+            {
+                max_keys = max_keys * 2 + 1024;
+                grown = realloc(hashes, max_keys * sizeof *hashes);
+                if (grown == NULL)
+                {
+                    status = -1;
+                    break;
+                }
+                hashes = grown;
+            }
+            leaf_cell(leaf->data, slot, &cell);
+            memcpy(key, cell.key, cell.key_len);
+            key[cell.key_len] = '\0';
+            bloom_hash(key, hashes[num_keys++]);
+        }
+        link = ((struct btree_node *)leaf->data)->link;
+        next = link ? buffer_pool_fetch(t->fd, link) : NULL;
+        buffer_pool_release(leaf);
+        leaf = next;
+    }
+    if (leaf)
+    {
+        buffer_pool_release(leaf);
+    }
+    if (status == 0 && bloom_init(&bloom, num_keys * 2 > 1024 ? num_keys * 2 : 1024, t->bloom_fpr) != 0)
+    {
+        status = -1;
+    }
+    if (status == 0)
+    {
+        for (i = 0; i < num_keys; i++)
+        {
+            bloom_add(&bloom, hashes[i]);
+        }
+        bloom_free(&t->bloom);
+        t->bloom = bloom;
+        t->bloom_capacity = num_keys * 2 > 1024 ? num_keys * 2 : 1024;
+        t->num_keys = num_keys;
+        t->num_stale = 0;
+    }
+    free(hashes);
+    return status;
+}
+
+/**
+ * @brief Add a page to a list of pages.
+ *
+ * @param list the list, grown as needed
+ * @param num entries in the list
+ * @param max room in the list
+ * @param key the page's first key, "" if it has none
+ * @param page the page
+ * @return 0 on success, -1 if out of memory
+ */
+static int list_page(struct btree_entry **list, int *num, int *max, const char *key, unsigned int page)
+{
+    struct btree_entry *grown;
+
+    if (*num == *max)
+    {
+        grown = realloc(*list, (*max * 2 + 64) * sizeof **list);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        *list = grown;
+        *max = *max * 2 + 64;
+    }
+    memset((*list)[*num].key, 0, MAX_KEY_LEN);
+    strcpy((*list)[*num].key, key);
+    (*list)[(*num)++].child = page;
+    return 0;
+}
+
+/**
+ * @brief List the leaves of a table by following the leaf links.
+ *
+ * @param t the table, not yet shared
+ * @param leaves where to list the leaves, with their first keys
+ * @param num where to store the number of leaves
+ * @return 0 on success, -1 on error
+ */
+static int chain_leaves(struct btree_table *t, struct btree_entry **leaves, int *num)
+{
+    struct buffer_frame *leaf = find_leaf(t, ""), *next;
+    struct btree_cell cell;
+    char key[MAX_KEY_LEN];
+    unsigned int link;
+    int max = 0, status = leaf ? 0 : -1;
+
+    *num = 0;
+    while (leaf && status == 0)
+    {
+        key[0] = '\0';
+        if (((struct btree_node *)leaf->data)->num > 0)
+        {
+            leaf_cell(leaf->data, 0, &cell);
+            memcpy(key, cell.key, cell.key_len);
+            key[cell.key_len] = '\0';
+        }
+        status = list_page(leaves, num, &max, key, leaf->page_num);
+        link = ((struct btree_node *)leaf->data)->link;
+        next = link && status == 0 ? buffer_pool_fetch(t->fd, link) : NULL;
+        if (link && status == 0 && next == NULL)
+        {
+            status = -1;
+        }
+        buffer_pool_release(leaf);
+        leaf = next;
+    }
+    if (leaf)
+    {
+        buffer_pool_release(leaf);
+    }
+    return status;
+}
+
+/**
+ * @brief List the leaves of a subtree, in the order the internal pages give.
+ *
+ * @param t the table, not yet shared
+ * @param page the subtree's page
+ * @param height internal levels above the leaves
+ * @param leaves the list
+ * @param num entries in the list
+ * @param max room in the list
+ * @return 0 on success, -1 on error
+ */
+static int tree_leaves(struct btree_table *t, unsigned int page, int height, struct btree_entry **leaves, int *num,
+                       int *max)
+{
+    struct buffer_frame *frame;
+    int i, status = 0;
+
+    if (height == 0)
+    {
+        return list_page(leaves, num, max, "", page);
+    }
+    frame = buffer_pool_fetch(t->fd, page);
+    if (frame == NULL)
+    {
+        return -1;
+    }
+    if (((struct btree_node *)frame->data)->leaf)
+    {
+        status = list_page(leaves, num, max, "", page);
+    }
+    for (i = -1; !((struct btree_node *)frame->data)->leaf && i < ((struct btree_node *)frame->data)->num && status == 0; i++)
+    {
+        status = tree_leaves(t, internal_child_at(frame->data, i), height - 1, leaves, num, max);
+    }
+    buffer_pool_release(frame);
+    return status;
+}
+
+/**
+ * @brief Point a leaf at another next leaf.
+ *
+ * @param t the table, not yet shared
+ * @param page the leaf
+ * @param link the next leaf, 0 for none
+ * @return 0 on success, -1 on error
+ */
+static int relink_leaf(struct btree_table *t, unsigned int page, unsigned int link)
+{
+    struct buffer_frame *leaf = buffer_pool_fetch(t->fd, page);
+    int status;
+
+    if (leaf == NULL)
+    {
+        return -1;
+    }
+    ((struct btree_node *)leaf->data)->link = link;
+    status = buffer_pool_write(leaf);
+    buffer_pool_release(leaf);
+    return status == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Build new internal pages over a table's leaves and make their top the root.
+ *
+ * Empty leaves, but the first, are unlinked, as they have no key to
+ * separate them by. The old internal pages are left unused.
+ *
+ * @param t the table, not yet shared
+ * @param leaves the leaves in link order, with their first keys
+ * @param num_leaves number of leaves
+ * @return 0 on success, -1 on error
+ */
+static int rebuild_internal(struct btree_table *t, struct btree_entry *leaves, int num_leaves)
+{
+    struct buffer_frame *frame, *meta;
+    int i, num = 1, count, status = 0;
+
+    for (i = 1; i <= num_leaves && status == 0; i++)
+    {
+        if (i < num_leaves && leaves[i].key[0] == '\0')
+        {
+            continue;
+        }
+        // The kept leaf before must link straight to this one
+        if (i - 1 > 0 && leaves[i - 1].key[0] == '\0')
+        {
+            status = relink_leaf(t, leaves[num - 1].child, i < num_leaves ? leaves[i].child : 0);
+        }
+        if (i < num_leaves)
+        {
+            leaves[num++] = leaves[i];
+        }
+    }
+
+    // One level at a time, each page taking the first key of its first child up
+    while (num > 1 && status == 0)
+    {
+        for (i = 0; i * (BTREE_MAX_ENTRIES + 1) < num && status == 0; i++)
+        {
+            count = num - i * (BTREE_MAX_ENTRIES + 1);
+            if (count > BTREE_MAX_ENTRIES + 1)
+            {
+                count = BTREE_MAX_ENTRIES + 1;
+            }
+            frame = allocate_page(t);
+            if (frame == NULL)
+            {
+                status = -1;
+                break;
+            }
+            internal_build(frame->data, leaves[i * (BTREE_MAX_ENTRIES + 1)].child,
+                           &leaves[i * (BTREE_MAX_ENTRIES + 1) + 1], count - 1);
+            status = buffer_pool_write(frame);
+            leaves[i] = leaves[i * (BTREE_MAX_ENTRIES + 1)];
+            leaves[i].child = frame->page_num;
+            buffer_pool_release(frame);
+        }
+        num = i;
+    }
+
+    // The new root goes in last, so a crash before leaves the old tree
+    meta = status == 0 ? buffer_pool_fetch(t->fd, 0) : NULL;
+    if (meta == NULL)
+    {
+        return -1;
+    }
+    ((struct btree_meta *)meta->data)->root = leaves[0].child;
+    status = buffer_pool_write(meta);
+    buffer_pool_release(meta);
+    return write_done(t, status == 0 ? 0 : -1);
+}
+
+/**
+ * @brief Check that the internal pages reach every leaf, rebuilding them if not.
+ *
+ * A split writes the new page and the page it came from before the
+ * parent that points at it, so a crash in between leaves a leaf that
+ * only the leaf links reach. The links are always whole, and so are
+ * taken as the truth.
+ *
+ * @param t the table, not yet shared
+ * @return 0 on success, -1 on error
+ */
+static int repair_tree(struct btree_table *t)
+{
+    struct btree_entry *chain = NULL, *tree = NULL;
+    struct buffer_frame *frame, *child;
+    int num_chain, num_tree = 0, max_tree = 0, height = 0, i, status;
+
+    // Every leaf is as deep as the leftmost one
+    frame = buffer_pool_fetch(t->fd, root_page(t));
+    while (frame && !((struct btree_node *)frame->data)->leaf)
+    {
+        child = buffer_pool_fetch(t->fd, internal_child_at(frame->data, -1));
+        buffer_pool_release(frame);
+        frame = child;
+        height++;
+    }
+    if (frame == NULL)
+    {
+        return -1;
+    }
+    buffer_pool_release(frame);
+
+    status = chain_leaves(t, &chain, &num_chain);
+    if (status == 0)
+    {
+        status = tree_leaves(t, root_page(t), height, &tree, &num_tree, &max_tree);
+    }
+    for (i = 0; status == 0 && i < num_chain && num_tree == num_chain; i++)
+    {
+        if (tree[i].child != chain[i].child)
+        {
+            break;
+        }
+    }
+    if (status == 0 && (num_tree != num_chain || i < num_chain))
+    {
+        status = rebuild_internal(t, chain, num_chain);
+    }
+    free(chain);
+    free(tree);
+    return status;
+}
+
+int btree_open(int table, const char *path, int sync_always, double bloom_fpr)
+{
+    struct btree_table *t = &btree_tables[table];
+    struct buffer_frame *meta, *root;
+    struct btree_meta *m;
+    int status = 0;
+
+    pthread_rwlock_init(&t->lock, NULL);
+    t->sync_always = sync_always;
+    t->bloom_fpr = bloom_fpr;
+    t->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (t->fd == -1)
+    {
+        return -1;
+    }
+    meta = buffer_pool_fetch(t->fd, 0);
+    if (meta == NULL)
+    {
+        return -1;
+    }
+    m = (struct btree_meta *)meta->data;
+    if (m->magic == 0 && lseek(t->fd, 0, SEEK_END) == 0)
+    {
+        // A new file: page 1 is the root, an empty leaf
+        root = buffer_pool_fetch(t->fd, 1);
+        if (root == NULL)
+        {
+            buffer_pool_release(meta);
+            return -1;
+        }
+        leaf_init(root->data, 0);
+        status = buffer_pool_write(root);
+        buffer_pool_release(root);
+        m->magic = BTREE_MAGIC;
+        m->root = 1;
+        m->num_pages = 2;
+        status |= buffer_pool_write(meta);
+    }
+    if (m->magic != BTREE_MAGIC)
+    {
+        status = -1;
+    }
+    buffer_pool_release(meta);
+    if (status == 0)
+    {
+        status = repair_tree(t);
+    }
+    if (status == 0)
+    {
+        status = bloom_rebuild(t);
+    }
+    return status == 0 ? 0 : -1;
+}
+
+int btree_get(int table, const char *key, char value[MAX_VALUE_LEN])
+{
+    struct btree_table *t = &btree_tables[table];
+    struct buffer_frame *leaf = NULL;
+    struct btree_cell cell;
+    unsigned int hashes[2];
+    int slot, found = 0;
+
+    bloom_hash(key, hashes);
+    pthread_rwlock_rdlock(&t->lock);
+    if (bloom_may_contain(&t->bloom, hashes))
+    {
+        leaf = find_leaf(t, key);
+    }
+    if (leaf)
+    {
+        slot = leaf_search(leaf->data, key, &found);
+        if (found)
+        {
+            leaf_cell(leaf->data, slot, &cell);
+            memcpy(value, cell.value, cell.value_len);
+            value[cell.value_len] = '\0';
+        }
+        buffer_pool_release(leaf);
+    }
+    pthread_rwlock_unlock(&t->lock);
+    return found ? 0 : -1;
+}
+
+int btree_set(int table, const char *key, const char *value)
+{
+    struct btree_table *t = &btree_tables[table];
+    struct btree_entry entry;
+    struct buffer_frame *root, *meta;
+    struct btree_cell cell;
+    unsigned int root_num, split_page, hashes[2];
+    char split_key[MAX_KEY_LEN];
+    int status, added = 0;
+
+    cell.key = (const unsigned char *)key;
+    cell.key_len = strlen(key);
+    cell.value = (const unsigned char *)value;
+    cell.value_len = strlen(value);
+    if (cell.key_len >= MAX_KEY_LEN || cell.value_len >= MAX_VALUE_LEN)
+    {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&t->lock);
+    root_num = root_page(t);
+    status = root_num ? insert(t, root_num, &cell, split_key, &split_page, &added) : -1;
+    if (status == 1)
+    {
+        // The root split: a new root points at both halves
+        status = -1;
+        root = allocate_page(t);
+        if (root)
+        {
+            memset(entry.key, 0, MAX_KEY_LEN);
+            strcpy(entry.key, split_key);
+            entry.child = split_page;
+            internal_build(root->data, root_num, &entry, 1);
+            meta = buffer_pool_write(root) == 0 ? buffer_pool_fetch(t->fd, 0) : NULL;
+            if (meta)
+            {
+                ((struct btree_meta *)meta->data)->root = root->page_num;
+                status = buffer_pool_write(meta);
+                buffer_pool_release(meta);
+            }
+            buffer_pool_release(root);
+        }
+    }
+    if (status == 0 && added)
+    {
+        bloom_hash(key, hashes);
+        bloom_add(&t->bloom, hashes);
+        t->num_keys++;
+    }
+
+    // A filter holding more keys than it was sized for, or as many
+    // deleted keys as live ones, answers "maybe" too often
+    if (status == 0 && (t->num_keys > t->bloom_capacity || t->num_stale > t->num_keys + 1024))
+    {
+        bloom_rebuild(t);
+    }
+    status = write_done(t, status);
+    pthread_rwlock_unlock(&t->lock);
+    return status;
+}
+
+int btree_delete(int table, const char *key)
+{
+    struct btree_table *t = &btree_tables[table];
+    struct buffer_frame *leaf;
+    unsigned int hashes[2];
+    int slot, found = 0, status = -1;
+
+    bloom_hash(key, hashes);
+    pthread_rwlock_wrlock(&t->lock);
+    if (!bloom_may_contain(&t->bloom, hashes))
+    {
+        pthread_rwlock_unlock(&t->lock);
+        return 1;
+    }
+    leaf = find_leaf(t, key);
+    if (leaf)
+    {
+        slot = leaf_search(leaf->data, key, &found);
+        status = 1;
+        if (found)
+        {
+            leaf_remove(leaf->data, slot);
+            status = write_done(t, buffer_pool_write(leaf));
+            t->num_keys--;
+            t->num_stale++;
+        }
+        buffer_pool_release(leaf);
+    }
+    pthread_rwlock_unlock(&t->lock);
+    return status;
+}
+
+struct btree_cursor *btree_cursor_open(int table, const char *from)
+{
+    struct btree_cursor *cursor = calloc(1, sizeof *cursor);
+
+    if (cursor)
+    {
+        cursor->table = table;
+        snprintf(cursor->last, sizeof cursor->last, "%s", from);
+        cursor->inclusive = 1;
+    }
+    return cursor;
+}
+
+/**
+ * @brief Copy the first leaf with a key after the cursor's last key.
+ *
+ * @param cursor the cursor
+ * @return 1 if a leaf was copied, 0 at the end of the table
+ */
+static int cursor_fill(struct btree_cursor *cursor)
+{
+    struct btree_table *t = &btree_tables[cursor->table];
+    struct buffer_frame *leaf, *next;
+    int slot, found, filled = 0;
+    unsigned int link;
+
+    pthread_rwlock_rdlock(&t->lock);
+    leaf = find_leaf(t, cursor->last);
+    while (leaf && !filled)
+    {
+        slot = leaf_search(leaf->data, cursor->last, &found);
+        if (found && !cursor->inclusive)
+        {
+            slot++;
+        }
+        if (slot < ((struct btree_node *)leaf->data)->num)
+        {
+            memcpy(cursor->page, leaf->data, BUFFER_PAGE_SIZE);
+            cursor->slot = slot;
+            filled = 1;
+            break;
+        }
+
+        // Every key of the leaf is behind the cursor; go on with the next
+        link = ((struct btree_node *)leaf->data)->link;
+        next = link ? buffer_pool_fetch(t->fd, link) : NULL;
+        buffer_pool_release(leaf);
+        leaf = next;
+    }
+    if (leaf)
+    {
+        buffer_pool_release(leaf);
+    }
+    pthread_rwlock_unlock(&t->lock);
+    cursor->done = !filled;
+    return filled;
+}
+
+int btree_cursor_next(struct btree_cursor *cursor, char key[MAX_KEY_LEN], char value[MAX_VALUE_LEN])
+{
+    struct btree_cell cell;
+
+    if (cursor->slot >= ((struct btree_node *)cursor->page)->num && (cursor->done || !cursor_fill(cursor)))
+    {
+        return 0;
+    }
+    leaf_cell(cursor->page, cursor->slot++, &cell);
+    memcpy(key, cell.key, cell.key_len);
+    key[cell.key_len] = '\0';
+    memcpy(value, cell.value, cell.value_len);
+    value[cell.value_len] = '\0';
+    strcpy(cursor->last, key);
+    cursor->inclusive = 0;
+    return 1;
+}
+
+void btree_cursor_close(struct btree_cursor *cursor)
+{
+    free(cursor);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief This file declares the paged table files, used for every table
+ * when storage_policy is btree.
+ *
+ * A table file is a B+tree of BUFFER_PAGE_SIZE pages keyed on the record
+ * key. Page 0 holds the root page number and the page count. Leaf pages
+ * are slotted: an array of cell offsets, kept in key order, grows from
+ * the front of the page while the cells (key and value) grow from the
+ * back, and every leaf links to the next one for range scans. Internal
+ * pages hold fixed size entries of a separator key and a child page.
+ *
+ * Pages are read through the buffer pool, so the top of the tree and
+ * the hot leaves stay in memory across commands; a lookup reads at most
+ * one page per level. A bloom filter of the keys, built when the table
+ * is opened, answers most lookups of missing keys without reading a
+ * page. Every changed page is written back to the file before the write
+ * returns.
+ *
+ * A split writes the new page, then the page it came from, and only
+ * then the parent that points at it, so a crash in between can leave a
+ * leaf that only the leaf links reach. Opening the file checks that the
+ * internal pages reach the leaves in link order, and rebuilds them from
+ * the links if they do not. A page write is taken to be atomic.
+ */
+
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "utils.h"
+
+struct btree_cursor;
+
+/**
+ * @brief Open a table file, creating it if needed.
+ *
+ * A split cut short by a crash is repaired.
+ *
+ * @param table Table index.
+ * @param path Path of the table file.
+ * @param sync_always 1 to sync the file after every write.
+ * @param bloom_fpr False positive rate of the table's bloom filter.
+ * @return Return 0 on success, -1 if the file cannot be read or created.
+ */
+int btree_open(int table, const char *path, int sync_always, double bloom_fpr);
+
+/**
+ * @brief Read the value of a key.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param value Where to copy the value.
+ * @return Return 0 on success, -1 if the key is not in the table.
+ */
+int btree_get(int table, const char *key, char value[MAX_VALUE_LEN]);
+
+/**
+ * @brief Insert or update a record.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param value The value.
+ * @return Return 0 on success, -1 if the write failed.
+ */
+int btree_set(int table, const char *key, const char *value);
+
+/**
+ * @brief Delete a record.
+ *
+ * Leaves are not merged; a leaf left empty stays in the tree.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @return Return 0 on success, 1 if the key is not in the table, -1 if
+ * the write failed.
+ */
+int btree_delete(int table, const char *key);
+
+/**
+ * @brief Start reading the records of a table in key order.
+ *
+ * The cursor copies one leaf at a time, so writes may go on while it is
+ * open; it sees every record that was in the table throughout.
+ *
+ * @param table Table index.
+ * @param from First key to read, "" to start at the first key.
+ * @return Return the cursor, NULL if out of memory.
+ */
+struct btree_cursor *btree_cursor_open(int table, const char *from);
+
+/**
+ * @brief Read the next record of a cursor.
+ *
+ * @param cursor The cursor.
+ * @param key Where to copy the key.
+ * @param value Where to copy the value.
+ * @return Return 1 if a record was read, 0 at the end of the table.
+ */
+int btree_cursor_next(struct btree_cursor *cursor, char key[MAX_KEY_LEN], char value[MAX_VALUE_LEN]);
+
+/**
+ * @brief Free a cursor.
+ *
+ * @param cursor The cursor.
+ */
+void btree_cursor_close(struct btree_cursor *cursor);
+
+#endif
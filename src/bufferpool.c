@@ -0,0 +1,238 @@
+/**
+ * @file
+ * @brief This file implements the buffer pool declared in bufferpool.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "bufferpool.h"
+
+static struct buffer_frame *frames;
+static int num_frames;
+static struct buffer_frame **buckets;
+static unsigned int num_buckets;
+static int clock_hand;
+static struct buffer_pool_stats pool_stats;
+
+/// Protects the frames' bookkeeping, the buckets and the counters. Pages
+/// are read and written without it.
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Signalled when a page has been read.
+static pthread_cond_t page_loaded = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Hash bucket of a page.
+ *
+ * @param file the file
+ * @param page_num page number
+ * @return the bucket index
+ */
+static unsigned int bucket_of(int file, unsigned int page_num)
+{
+    return ((unsigned int)file * 2654435761u ^ page_num * 40503u) & (num_buckets - 1);
+}
+
+/**
+ * @brief Take a frame out of its hash bucket.
+ *
+ * @param frame the frame
+ * @return no return value
+ */
+static void bucket_remove(struct buffer_frame *frame)
+{
+    struct buffer_frame **link = &buckets[bucket_of(frame->file, frame->page_num)];
+
+    while (*link && *link != frame)
+    {
+        link = &(*link)->hash_next;
+    }
+    if (*link)
+    {
+        *link = frame->hash_next;
+    }
+}
+
+/**
+ * @brief Pick an unpinned frame to reuse, by the CLOCK algorithm.
+ *
+ * @return the frame, NULL if every frame is pinned
+ */
+static struct buffer_frame *clock_victim(void)
+{
+    struct buffer_frame *frame;
+    int i;
+
+    // Two turns clear every mark, so a third finds any unpinned frame
+    for (i = 0; i < 2 * num_frames + 1; i++)
+    {
+        frame = &frames[clock_hand];
+        clock_hand = (clock_hand + 1) % num_frames;
+        if (frame->pins > 0)
+        {
+            continue;
+        }
+        if (frame->referenced)
+        {
+            frame->referenced = 0;
+            continue;
+        }
+        return frame;
+    }
+    return NULL;
+}
+
+int buffer_pool_init(size_t budget)
+{
+    unsigned char *data;
+    int i;
+
+    num_frames = budget / BUFFER_PAGE_SIZE;
+    if (num_frames < BUFFER_POOL_MIN_FRAMES)
+    {
+        num_frames = BUFFER_POOL_MIN_FRAMES;
+    }
+    for (num_buckets = 1; num_buckets < 2 * (unsigned int)num_frames; num_buckets *= 2)
+    {
+    }
+    frames = calloc(num_frames, sizeof *frames);
+    buckets = calloc(num_buckets, sizeof *buckets);
+    if (frames == NULL || buckets == NULL || posix_memalign((void **)&data, BUFFER_PAGE_SIZE,
+                                                            (size_t)num_frames * BUFFER_PAGE_SIZE) != 0)
+    {
+        return -1;
+    }
+    for (i = 0; i < num_frames; i++)
+    {
+        frames[i].file = -1;
+        frames[i].data = data + (size_t)i * BUFFER_PAGE_SIZE;
+    }
+    pool_stats.frames = num_frames;
+    return 0;
+}
+
+struct buffer_frame *buffer_pool_fetch(int file, unsigned int page_num)
+{
+    struct buffer_frame *frame;
+    ssize_t got = 0, done = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    for (frame = buckets[bucket_of(file, page_num)]; frame; frame = frame->hash_next)
+    {
+        if (frame->file == file && frame->page_num == page_num)
+        {
+            break;
+        }
+    }
+    if (frame)
+    {
+        frame->pins++;
+        frame->referenced = 1;
+        while (frame->loading)
+        {
+            pthread_cond_wait(&page_loaded, &pool_lock);
+        }
+        // A failed read leaves the frame free
+        if (frame->file != file || frame->page_num != page_num)
+        {
+            frame->pins--;
+            pthread_mutex_unlock(&pool_lock);
+            return NULL;
+        }
+        pool_stats.hits++;
+        pthread_mutex_unlock(&pool_lock);
+        return frame;
+    }
+
+    frame = clock_victim();
+    if (frame == NULL)
+    {
+        pthread_mutex_unlock(&pool_lock);
+        return NULL;
+    }
+    if (frame->file != -1)
+    {
+        bucket_remove(frame);
+        pool_stats.evictions++;
+    }
+    pool_stats.misses++;
+    frame->file = file;
+    frame->page_num = page_num;
+    frame->pins = 1;
+    frame->referenced = 1;
+    frame->loading = 1;
+    frame->hash_next = buckets[bucket_of(file, page_num)];
+    buckets[bucket_of(file, page_num)] = frame;
+    pthread_mutex_unlock(&pool_lock);
+
+    // The frame is pinned and marked loading, so nobody else touches it
+    while (done < BUFFER_PAGE_SIZE)
+    {
+        got = pread(file, frame->data + done, BUFFER_PAGE_SIZE - done, (off_t)page_num * BUFFER_PAGE_SIZE + done);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            break;
+        }
+        done += got;
+    }
+    if (got >= 0)
+    {
+        memset(frame->data + done, 0, BUFFER_PAGE_SIZE - done);
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    frame->loading = 0;
+    if (got < 0)
+    {
+        bucket_remove(frame);
+        frame->file = -1;
+        frame->pins--;
+        frame = NULL;
+    }
+    pthread_cond_broadcast(&page_loaded);
+    pthread_mutex_unlock(&pool_lock);
+    return frame;
+}
+
+void buffer_pool_release(struct buffer_frame *frame)
+{
+    pthread_mutex_lock(&pool_lock);
+    frame->pins--;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int buffer_pool_write(struct buffer_frame *frame)
+{
+    ssize_t written;
+    size_t done = 0;
+
+    while (done < BUFFER_PAGE_SIZE)
+    {
+        written = pwrite(frame->file, frame->data + done, BUFFER_PAGE_SIZE - done,
+                         (off_t)frame->page_num * BUFFER_PAGE_SIZE + done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return -1;
+        }
+        done += written;
+    }
+    return 0;
+}
+
+void buffer_pool_get_stats(struct buffer_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool_lock);
+    *stats = pool_stats;
+    pthread_mutex_unlock(&pool_lock);
+}
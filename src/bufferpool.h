@@ -0,0 +1,110 @@
+/**
+ * @file
+ * @brief This file declares the buffer pool caching the pages of the
+ * paged table files.
+ *
+ * The pool holds a fixed number of page frames, sized from a byte budget
+ * and shared by every table. A page is fetched pinned and released when
+ * the caller is done with it; only unpinned frames are reused. Frames are
+ * picked for reuse by the CLOCK algorithm: a fetch marks a frame as
+ * referenced, and the clock hand clears the mark of every frame it passes,
+ * taking the first one that has no mark left.
+ *
+ * Changed pages are written back to their file when the caller asks, so
+ * a frame never holds a change the file lacks and can be dropped at once.
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+
+#define BUFFER_PAGE_SIZE 4096	///< Bytes of a page.
+#define BUFFER_POOL_MIN_FRAMES 64	///< Frames the pool holds whatever its budget.
+
+/**
+ * @brief A frame of the pool, holding one page.
+ */
+struct buffer_frame {
+	/// File the page belongs to, -1 while the frame is free.
+	int file;
+
+	/// Page number in the file.
+	unsigned int page_num;
+
+	/// Callers using the page; a pinned frame is never reused.
+	int pins;
+
+	/// Set by every fetch, cleared by the clock hand.
+	int referenced;
+
+	/// 1 while the page is being read; other fetches of it wait.
+	int loading;
+
+	/// Next frame in the same hash bucket.
+	struct buffer_frame *hash_next;
+
+	/// The page.
+	unsigned char *data;
+};
+
+/**
+ * @brief Counters of the pool, for logging.
+ */
+struct buffer_pool_stats {
+	/// Fetches answered from a frame.
+	unsigned long hits;
+
+	/// Fetches that read the page from its file.
+	unsigned long misses;
+
+	/// Pages dropped to make room.
+	unsigned long evictions;
+
+	/// Number of frames.
+	int frames;
+};
+
+/**
+ * @brief Set up the pool.
+ *
+ * @param budget Bytes of pages the pool may hold.
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int buffer_pool_init(size_t budget);
+
+/**
+ * @brief Fetch a page, reading it if it is not in the pool.
+ *
+ * A page past the end of its file reads as zeros.
+ *
+ * @param file The file.
+ * @param page_num Page number.
+ * @return Return the pinned frame, NULL if every frame is pinned or the
+ * page cannot be read.
+ */
+struct buffer_frame *buffer_pool_fetch(int file, unsigned int page_num);
+
+/**
+ * @brief Unpin a frame.
+ *
+ * @param frame The frame, from buffer_pool_fetch().
+ */
+void buffer_pool_release(struct buffer_frame *frame);
+
+/**
+ * @brief Write a pinned page back to its file.
+ *
+ * @param frame The frame.
+ * @return Return 0 on success, -1 on error.
+ */
+int buffer_pool_write(struct buffer_frame *frame);
+
+/**
+ * @brief Read the counters.
+ *
+ * @param stats Where to copy them.
+ */
+void buffer_pool_get_stats(struct buffer_pool_stats *stats);
+
+#endif
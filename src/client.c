@@ -12,6 +12,7 @@ FILE *fbulkLoad;
 FILE *metricsfile;
 
 #define MAX_METRICS 1000
+#define BULK_LOAD_BATCH 100 ///< Records sent per storage_bulk_load() call.
 
 // 676 Keys in Array
 
@@ -148,18 +149,25 @@ int main(int argc, char *argv[])
     char *bulkLoadLine1;
     char *bulkLoadLine2;
     char *bulkLoadLine3;
-    char *bulkLoadTemp;
+    char *bulkLoadTable;
+    char *bulkLoadKeys[BULK_LOAD_BATCH];
+    struct storage_record *bulkLoadRecords;
+    int bulkLoadCount;
 
     (bulkLoadLine1) = (char *)malloc( (100 + 1));
     (bulkLoadLine2) = (char *)malloc( (100 + 1));
     (bulkLoadLine3) = (char *)malloc( (100 + 1));
-    (bulkLoadTemp) = (char *)malloc( (100 + 1));
+    (bulkLoadTable) = (char *)malloc( (100 + 1));
+    for (g = 0; g < BULK_LOAD_BATCH; g++)
+    {
+        bulkLoadKeys[g] = (char *)malloc(MAX_KEY_LEN);
+    }
+    bulkLoadRecords = (struct storage_record *)malloc(BULK_LOAD_BATCH * sizeof(struct storage_record));
     size_t lengthBulkString;
 
     void *conn = NULL;
 
     bool stopLoad;
-    bool firstPass;
     time_t rawtime;
     struct tm *timeinfo;
     char timeStamp [50];
@@ -480,8 +488,8 @@ int main(int argc, char *argv[])
 
         case 7: // Bulk Load
 
-            firstPass = true;
             stopLoad = false;
+            bulkLoadCount = 0;
 
             printf("> \n");
             printf("> Bulk Load Selected \n");
@@ -509,43 +517,50 @@ int main(int argc, char *argv[])
                     return -1;
                 }
 
-                strcpy (bulkLoadTemp, bulkLoadLine2);
-
-                fgets(bulkLoadLine1, 100, fbulkLoad);
-                fgets(bulkLoadLine2, 100, fbulkLoad);
-                fgets(bulkLoadLine3, 100, fbulkLoad);
-
-                lengthBulkString = strlen(bulkLoadLine1) - 1;
-                if (bulkLoadLine1[lengthBulkString] == '\n')
-                    bulkLoadLine1[lengthBulkString] = NULL;
-                lengthBulkString = strlen(bulkLoadLine2) - 1;
-                if (bulkLoadLine2[lengthBulkString] == '\n')
-                    bulkLoadLine2[lengthBulkString] = NULL;
-                lengthBulkString = strlen(bulkLoadLine3) - 1;
-                if (bulkLoadLine3[lengthBulkString] == '\n')
-                    bulkLoadLine3[lengthBulkString] = NULL;
-
-                if ( (firstPass == false) && (strcmp(bulkLoadTemp, bulkLoadLine2) == 0) )
+                // A record is three lines: table, key and value
+                if (fgets(bulkLoadLine1, 100, fbulkLoad) == NULL || fgets(bulkLoadLine2, 100, fbulkLoad) == NULL ||
+                    fgets(bulkLoadLine3, 100, fbulkLoad) == NULL)
                     stopLoad = true;
 
-                if (firstPass == true)
-                    firstPass = false;
-
                 if (stopLoad == false)
                 {
-                    struct storage_record r;
-                    strncpy(r.value, bulkLoadLine3, sizeof r.value);
-                    status = storage_set(bulkLoadLine1, bulkLoadLine2, &r, conn);
+                    lengthBulkString = strlen(bulkLoadLine1) - 1;
+                    if (bulkLoadLine1[lengthBulkString] == '\n')
+                        bulkLoadLine1[lengthBulkString] = NULL;
+                    lengthBulkString = strlen(bulkLoadLine2) - 1;
+                    if (bulkLoadLine2[lengthBulkString] == '\n')
+                        bulkLoadLine2[lengthBulkString] = NULL;
+                    lengthBulkString = strlen(bulkLoadLine3) - 1;
+                    if (bulkLoadLine3[lengthBulkString] == '\n')
+                        bulkLoadLine3[lengthBulkString] = NULL;
+                }
+
+                // Send the records gathered once the batch is full, the table
+                // changes or the file ends
+                if ( (bulkLoadCount > 0) && ( (stopLoad == true) || (bulkLoadCount == BULK_LOAD_BATCH) ||
+                                             (strcmp(bulkLoadTable, bulkLoadLine1) != 0) ) )
+                {
+                    status = storage_bulk_load(bulkLoadTable, bulkLoadKeys, bulkLoadRecords, bulkLoadCount, conn);
                     if (status != 0)
                     {
-                        printf("storage_set failed. Error code: %d.\n", errno);
+                        printf("storage_bulk_load failed. Error code: %d.\n", errno);
                         storage_disconnect(conn);
                         if (LOGGING_CLIENT == 2)
                             fclose(fclientOut);
                         return status;
                     }
 
-                    printf("storage_set: successful.\n");
+                    printf("storage_bulk_load: %d records loaded.\n", bulkLoadCount);
+                    bulkLoadCount = 0;
+                }
+
+                if (stopLoad == false)
+                {
+                    strcpy(bulkLoadTable, bulkLoadLine1);
+                    strncpy(bulkLoadKeys[bulkLoadCount], bulkLoadLine2, MAX_KEY_LEN);
+                    bulkLoadKeys[bulkLoadCount][MAX_KEY_LEN - 1] = NULL;
+                    strncpy(bulkLoadRecords[bulkLoadCount].value, bulkLoadLine3, sizeof bulkLoadRecords[bulkLoadCount].value);
+                    bulkLoadCount = bulkLoadCount + 1;
                 }
 
             }
@@ -0,0 +1,726 @@
+/**
+ * @file
+ * @brief This file implements the append-only record log declared in
+ * disklog.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "disklog.h"
+#include "schema.h"
+
+/**
+ * @brief Where the latest line of a live key is.
+ */
+struct disk_log_entry {
+	/// Next entry in the same hash bucket.
+	struct disk_log_entry *next;
+
+	/// The key.
+	char key[MAX_KEY_LEN];
+
+	/// Offset of the line in the file.
+	off_t offset;
+
+	/// Length of the value.
+	int value_len;
+};
+
+/**
+ * @brief A write waiting in a batch.
+ */
+struct disk_log_write {
+	/// The key.
+	char key[MAX_KEY_LEN];
+
+	/// Offset of the line in the batch.
+	int offset;
+
+	/// Length of the value, -1 for a delete.
+	int value_len;
+
+	/// Where to store the result for the writer waiting on it.
+	int *result;
+};
+
+/**
+ * @brief Lines queued to be written together.
+ */
+struct disk_log_batch {
+	/// The lines, back to back.
+	char *lines;
+	int len;
+	int cap;
+
+	/// The writes the lines are for, in queue order.
+	struct disk_log_write *writes;
+	int num_writes;
+	int max_writes;
+};
+
+/**
+ * @brief The log of one table.
+ */
+struct disk_log {
+	/// The table file, opened for appending.
+	int fd;
+
+	/// Size of the file, where the next line goes.
+	off_t size;
+
+	/// The file mapped read only, map_len bytes from its start. The
+	/// mapping may run past the end of the file; only bytes before size
+	/// are ever read.
+	char *map;
+	size_t map_len;
+
+	/// Hash of the live keys.
+	struct disk_log_entry **buckets;
+	int num_buckets;
+	int num_keys;
+
+	/// Taken shared by readers and exclusive by writers and remaps.
+	pthread_rwlock_t lock;
+
+	/// 1 once the log is open.
+	int opened;
+
+	/// Guards the batches and the fields below.
+	pthread_mutex_t commit_lock;
+
+	/// Signalled each time a batch has been written.
+	pthread_cond_t committed;
+
+	/// The batch being filled and the one being written.
+	struct disk_log_batch batches[2];
+	int filling;
+
+	/// Number of the batch being filled, and of the last one written.
+	unsigned long filling_id;
+	unsigned long written_id;
+
+	/// 1 while a writer is writing a batch.
+	int flushing;
+
+	/// 1 if lines were written since the last periodic sync.
+	int unsynced;
+};
+
+static struct disk_log logs[MAX_TABLES];
+
+/// One of the DISK_LOG_SYNC_* constants.
+static int sync_policy;
+
+/// Milliseconds between periodic syncs.
+static int sync_interval_ms;
+
+/**
+ * @brief Find the link to the entry of a key.
+ *
+ * @param log the log
+ * @param key the key
+ * @return the link pointing at the entry, or at NULL if the key is not there
+ */
+static struct disk_log_entry **entry_link(struct disk_log *log, const char *key)
+{
+    struct disk_log_entry **link = &log->buckets[schema_hash(key) & (log->num_buckets - 1)];
+
+    while (*link && strcmp((*link)->key, key))
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/**
+ * @brief Double the buckets of a log once it holds more keys than buckets.
+ *
+ * @param log the log
+ * @return no return value
+ */
+static void grow_buckets(struct disk_log *log)
+{
+    struct disk_log_entry **buckets, *entry, *next;
+    int i, num_buckets = log->num_buckets * 2;
+
+    buckets = calloc(num_buckets, sizeof *buckets);
+    if (buckets == NULL)
+    {
+        // Longer chains, but still correct
+        return;
+    }
+    for (i = 0; i < log->num_buckets; i++)
+    {
+        for (entry = log->buckets[i]; entry; entry = next)
+        {
+            next = entry->next;
+            entry->next = buckets[schema_hash(entry->key) & (num_buckets - 1)];
+            buckets[schema_hash(entry->key) & (num_buckets - 1)] = entry;
+        }
+    }
+    free(log->buckets);
+    log->buckets = buckets;
+    log->num_buckets = num_buckets;
+}
+
+/**
+ * @brief Point the entry of a key at a new line, adding the key if it is new.
+ *
+ * @param log the log
+ * @param key the key
+ * @param offset offset of the line
+ * @param value_len length of the value
+ * @return 0 on success, -1 if out of memory
+ */
+static int index_set(struct disk_log *log, const char *key, off_t offset, int value_len)
+{
+    struct disk_log_entry **link = entry_link(log, key);
+
+    if (*link == NULL)
+    {
+        *link = calloc(1, sizeof **link);
+        if (*link == NULL)
+        {
+            return -1;
+        }
+        strcpy((*link)->key, key);
+        log->num_keys++;
+    }
+    (*link)->offset = offset;
+    (*link)->value_len = value_len;
+    if (log->num_keys > log->num_buckets)
+    {
+        grow_buckets(log);
+    }
+    return 0;
+}
+
+/**
+ * @brief Drop the entry of a key.
+ *
+ * @param log the log
+ * @param key the key
+ * @return 0 on success, -1 if the key is not there
+ */
+static int index_remove(struct disk_log *log, const char *key)
+{
+    struct disk_log_entry **link = entry_link(log, key), *entry = *link;
+
+    if (entry == NULL)
+    {
+        return -1;
+    }
+    *link = entry->next;
+    free(entry);
+    log->num_keys--;
+    return 0;
+}
+
+/**
+ * @brief Make the mapping of a log cover its file, mapping it again
+ * twice as large when the file has outgrown it.
+ *
+ * @param log the log, locked exclusively
+ * @return 0 on success, -1 if the file could not be mapped
+ */
+static int map_file(struct disk_log *log)
+{
+    size_t map_len = log->map_len ? log->map_len : DISK_LOG_MIN_MAP;
+    char *map;
+
+    if (log->map && (off_t)log->map_len >= log->size)
+    {
+        return 0;
+    }
+    while ((off_t)map_len < log->size)
+    {
+        map_len *= 2;
+    }
+    map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, log->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    if (log->map)
+    {
+        munmap(log->map, log->map_len);
+    }
+    log->map = map;
+    log->map_len = map_len;
+    return 0;
+}
+
+/**
+ * @brief Append lines to a log.
+ *
+ * @param log the log, locked exclusively
+ * @param line the lines, each with its newline
+ * @param len length of the lines
+ * @return the offset of the first line, or -1 if they could not be written
+ */
+static off_t append_line(struct disk_log *log, const char *line, int len)
+{
+    off_t offset = log->size;
+    ssize_t written;
+    int done = 0;
+
+    while (done < len)
+    {
+        written = write(log->fd, line + done, len - done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            // Cut the partial lines off so the next one starts clean
+            if (ftruncate(log->fd, offset) != 0)
+            {
+                log->size = lseek(log->fd, 0, SEEK_END);
+            }
+            return -1;
+        }
+        done += written;
+    }
+    log->size += len;
+    // Should this fail, reads past the old mapping fall back to pread()
+    map_file(log);
+    return offset;
+}
+
+/**
+ * @brief Write the batch being filled, and wake every writer waiting on it.
+ *
+ * @param log the log, with commit_lock held; it is released while the
+ * batch is written
+ * @return no return value
+ */
+static void write_batch(struct disk_log *log)
+{
+    struct disk_log_batch *batch = &log->batches[log->filling];
+    unsigned long id = log->filling_id;
+    off_t offset;
+    int i, *result;
+
+    // Writers coming in now fill the other batch
+    log->filling ^= 1;
+    log->filling_id++;
+    log->flushing = 1;
+    pthread_mutex_unlock(&log->commit_lock);
+
+    pthread_rwlock_wrlock(&log->lock);
+    offset = append_line(log, batch->lines, batch->len);
+    pthread_rwlock_unlock(&log->lock);
+
+    // The lines are synced before they are indexed, so no reader sees a
+    // write its writer is told failed
+    if (offset != -1 && sync_policy == DISK_LOG_SYNC_ALWAYS && fdatasync(log->fd) != 0)
+    {
+        // Cut the lines off, so they do not come back when the log is reopened
+        pthread_rwlock_wrlock(&log->lock);
+        if (ftruncate(log->fd, offset) == 0)
+        {
+            log->size = offset;
+        }
+        pthread_rwlock_unlock(&log->lock);
+        offset = -1;
+    }
+    else if (offset != -1)
+    {
+        __atomic_store_n(&log->unsynced, 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_rwlock_wrlock(&log->lock);
+    for (i = 0; i < batch->num_writes; i++)
+    {
+        result = batch->writes[i].result;
+        if (offset == -1)
+        {
+            *result = -1;
+        }
+        else if (batch->writes[i].value_len >= 0)
+        {
+            *result = index_set(log, batch->writes[i].key, offset + batch->writes[i].offset, batch->writes[i].value_len);
+        }
+        else
+        {
+            *result = index_remove(log, batch->writes[i].key) == 0 ? 0 : 1;
+        }
+    }
+    pthread_rwlock_unlock(&log->lock);
+
+    pthread_mutex_lock(&log->commit_lock);
+    batch->len = 0;
+    batch->num_writes = 0;
+    log->written_id = id;
+    log->flushing = 0;
+    pthread_cond_broadcast(&log->committed);
+}
+
+/**
+ * @brief Queue a line in the batch being filled.
+ *
+ * @param log the log, with commit_lock held
+ * @param key the key
+ * @param line the line, with its newline
+ * @param len length of the line
+ * @param value_len length of the value, -1 for a delete
+ * @param result where to store the result of the write once it is written
+ * @return 0 on success, -1 if out of memory
+ */
+static int queue_line(struct disk_log *log, const char *key, const char *line, int len, int value_len, int *result)
+{
+    struct disk_log_batch *batch = &log->batches[log->filling];
+    struct disk_log_write *queued;
+    void *grown;
+
+    if (batch->len + len > batch->cap)
+    {
+        grown = realloc(batch->lines, batch->cap * 2 + len);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        batch->lines = grown;
+        batch->cap = batch->cap * 2 + len;
+    }
+    if (batch->num_writes == batch->max_writes)
+    {
+        grown = realloc(batch->writes, (batch->max_writes * 2 + 1) * sizeof *batch->writes);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        batch->writes = grown;
+        batch->max_writes = batch->max_writes * 2 + 1;
+    }
+    queued = &batch->writes[batch->num_writes++];
+    strcpy(queued->key, key);
+    queued->offset = batch->len;
+    queued->value_len = value_len;
+    queued->result = result;
+    memcpy(batch->lines + batch->len, line, len);
+    batch->len += len;
+    return 0;
+}
+
+/**
+ * @brief Wait until the batch being filled is written.
+ *
+ * The first writer to find no batch being written writes the whole
+ * queue, so concurrent writers share one write() and one sync.
+ *
+ * @param log the log, with commit_lock held
+ * @return no return value
+ */
+static void wait_written(struct disk_log *log)
+{
+    unsigned long id = log->filling_id;
+
+    while (log->written_id < id)
+    {
+        if (log->flushing)
+        {
+            pthread_cond_wait(&log->committed, &log->commit_lock);
+        }
+        else
+        {
+            write_batch(log);
+        }
+    }
+}
+
+/**
+ * @brief Queue a line and wait until it is written.
+ *
+ * @param log the log
+ * @param key the key
+ * @param line the line, with its newline
+ * @param len length of the line
+ * @param value_len length of the value, -1 for a delete
+ * @return the result of the write, as disk_log_set() and disk_log_delete() return it
+ */
+static int commit(struct disk_log *log, const char *key, const char *line, int len, int value_len)
+{
+    int result = -1;
+
+    pthread_mutex_lock(&log->commit_lock);
+    if (queue_line(log, key, line, len, value_len, &result) == 0)
+    {
+        wait_written(log);
+    }
+    pthread_mutex_unlock(&log->commit_lock);
+    return result;
+}
+
+/**
+ * @brief Sync every log written to since the last pass, every sync_interval_ms.
+ *
+ * @param arg unused
+ * @return never returns
+ */
+static void *sync_logs(void *arg)
+{
+    struct timespec interval;
+    int i;
+
+    interval.tv_sec = sync_interval_ms / 1000;
+    interval.tv_nsec = (long)(sync_interval_ms % 1000) * 1000000;
+    for (;;)
+    {
+        nanosleep(&interval, NULL);
+        for (i = 0; i < MAX_TABLES; i++)
+        {
+            if (__atomic_load_n(&logs[i].opened, __ATOMIC_ACQUIRE) && __atomic_exchange_n(&logs[i].unsynced, 0, __ATOMIC_ACQ_REL))
+            {
+                fdatasync(logs[i].fd);
+            }
+        }
+    }
+    return arg;
+}
+
+/**
+ * @brief Check whether the last line of a table file, found without its
+ * newline, is a whole record rather than one cut short.
+ *
+ * A set line is whole if its key and value fit their columns. A delete
+ * line is whole only if it names a live key, so a set line cut before
+ * its colon is not taken for a delete.
+ *
+ * @param log the log, indexed up to the line
+ * @param line the line, without a newline
+ * @return 1 if the line is a whole record, 0 otherwise
+ */
+static int tail_is_record(struct disk_log *log, const char *line)
+{
+    const char *colon = strchr(line, ':');
+
+    if (colon)
+    {
+        return colon > line && colon - line < MAX_KEY_LEN && strlen(colon + 1) < MAX_VALUE_LEN;
+    }
+    return strlen(line) < MAX_KEY_LEN && *entry_link(log, line) != NULL;
+}
+
+int disk_log_init(int policy, int interval_ms)
+{
+    pthread_t thread;
+
+    sync_policy = policy;
+    sync_interval_ms = interval_ms;
+    if (policy == DISK_LOG_SYNC_PERIODIC)
+    {
+        if (pthread_create(&thread, NULL, sync_logs, NULL) != 0)
+        {
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+int disk_log_open(int table, const char *path)
+{
+    struct disk_log *log = &logs[table];
+    char line[DISK_LOG_LINE_LEN + 1];
+    char *colon;
+    FILE *file;
+    off_t offset = 0;
+    int len, unterminated = 0;
+
+    log->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (log->fd < 0)
+    {
+        return -1;
+    }
+    log->num_buckets = DISK_LOG_MIN_BUCKETS;
+    log->num_keys = 0;
+    log->buckets = calloc(log->num_buckets, sizeof *log->buckets);
+    pthread_rwlock_init(&log->lock, NULL);
+    pthread_mutex_init(&log->commit_lock, NULL);
+    pthread_cond_init(&log->committed, NULL);
+    memset(log->batches, 0, sizeof log->batches);
+    log->filling = 0;
+    log->filling_id = 1;
+    log->written_id = 0;
+    log->flushing = 0;
+    log->unsynced = 0;
+
+    // Replay the file once; later lines of a key replace earlier ones
+    file = fopen(path, "r");
+    while (file && fgets(line, sizeof line, file))
+    {
+        len = strlen(line);
+        unterminated = line[len - 1] != '\n';
+        if (unterminated)
+        {
+            // Only the last line of a file written by hand or cut short
+            // by a crash lacks its newline
+            if (getc(file) != EOF || !tail_is_record(log, line))
+            {
+                break;
+            }
+            line[len++] = '\n';
+            line[len] = '\0';
+        }
+        line[len - 1] = '\0';
+        colon = strchr(line, ':');
+        if (colon)
+        {
+            *colon = '\0';
+            index_set(log, line, offset, strlen(colon + 1));
+        }
+        else if (line[0] != '\0')
+        {
+            index_remove(log, line);
+        }
+        offset += len;
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    if (unterminated && offset > 0 && lseek(log->fd, 0, SEEK_END) == offset - 1)
+    {
+        // The last record is whole; give it its newline so the next
+        // line starts clean
+        if (write(log->fd, "\n", 1) != 1)
+        {
+            return -1;
+        }
+    }
+    if (ftruncate(log->fd, offset) != 0)
+    {
+        return -1;
+    }
+    log->size = offset;
+    log->map = NULL;
+    log->map_len = 0;
+    if (map_file(log) != 0)
+    {
+        return -1;
+    }
+    // Tables are opened while the sync thread runs
+    __atomic_store_n(&log->opened, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int disk_log_get(int table, const char *key, char value[MAX_VALUE_LEN])
+{
+    struct disk_log *log = &logs[table];
+    struct disk_log_entry *entry;
+    ssize_t got = -1;
+
+    pthread_rwlock_rdlock(&log->lock);
+    entry = *entry_link(log, key);
+    if (entry && (size_t)(entry->offset + strlen(key) + 1 + entry->value_len) <= log->map_len)
+    {
+        // Written lines are in the page cache the mapping reads from
+        memcpy(value, log->map + entry->offset + strlen(key) + 1, entry->value_len);
+        got = entry->value_len;
+    }
+    else if (entry)
+    {
+        got = pread(log->fd, value, entry->value_len, entry->offset + strlen(key) + 1);
+        got = (got == entry->value_len) ? got : -1;
+    }
+    pthread_rwlock_unlock(&log->lock);
+    if (got < 0)
+    {
+        return -1;
+    }
+    value[got] = '\0';
+    return 0;
+}
+
+int disk_log_set(int table, const char *key, const char *value)
+{
+    char line[DISK_LOG_LINE_LEN + 1];
+    int len;
+
+    len = snprintf(line, sizeof line, "%s:%s\n", key, value);
+    if (len >= (int)sizeof line)
+    {
+        return -1;
+    }
+    return commit(&logs[table], key, line, len, strlen(value));
+}
+
+int disk_log_set_batch(int table, char keys[][MAX_KEY_LEN], char values[][MAX_VALUE_LEN], int num_records)
+{
+    struct disk_log *log = &logs[table];
+    char line[DISK_LOG_LINE_LEN + 1];
+    int *results, i, len, status = 0;
+
+    results = malloc(num_records * sizeof *results);
+    if (results == NULL)
+    {
+        return -1;
+    }
+
+    // All the lines go in one batch, so they are written with one write()
+    // and synced once
+    pthread_mutex_lock(&log->commit_lock);
+    for (i = 0; i < num_records && status == 0; i++)
+    {
+        results[i] = -1;
+        len = snprintf(line, sizeof line, "%s:%s\n", keys[i], values[i]);
+        if (len >= (int)sizeof line || queue_line(log, keys[i], line, len, strlen(values[i]), &results[i]) != 0)
+        {
+            status = -1;
+        }
+    }
+    // Lines already queued must be written before results goes away
+    wait_written(log);
+    pthread_mutex_unlock(&log->commit_lock);
+
+    for (i = 0; i < num_records && status == 0; i++)
+    {
+        if (results[i] != 0)
+        {
+            status = -1;
+        }
+    }
+    free(results);
+    return status;
+}
+
+int disk_log_delete(int table, const char *key)
+{
+    struct disk_log *log = &logs[table];
+    char line[MAX_KEY_LEN + 1];
+    int found;
+
+    // Saves a line in the log for most deletes of missing keys; the
+    // batch checks again when it is written
+    pthread_rwlock_rdlock(&log->lock);
+    found = *entry_link(log, key) != NULL;
+    pthread_rwlock_unlock(&log->lock);
+    if (!found)
+    {
+        return 1;
+    }
+    return commit(log, key, line, snprintf(line, sizeof line, "%s\n", key), -1);
+}
+
+int disk_log_is_current(int table, const char *key, long offset)
+{
+    struct disk_log *log = &logs[table];
+    struct disk_log_entry *entry;
+    int current;
+
+    pthread_rwlock_rdlock(&log->lock);
+    entry = *entry_link(log, key);
+    current = entry && entry->offset == offset;
+    pthread_rwlock_unlock(&log->lock);
+    return current;
+}
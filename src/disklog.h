@@ -0,0 +1,116 @@
+/**
+ * @file
+ * @brief This file declares the append-only record log kept by the
+ * storage server for every table in on-disk mode.
+ *
+ * A table file is a log of "key:value" lines, the latest line of a key
+ * holding its value, and "key" lines (no colon) marking deletes. A write
+ * only appends a line. An in-memory hash maps every live key to the
+ * offset of its latest line; it is built from the file when the server
+ * starts. The file stays mapped in memory, so a GET copies the value
+ * straight out of the page cache, with no system call. The mapping is
+ * made twice as large whenever the file outgrows it.
+ *
+ * Writers arriving together are committed as one batch: the first of
+ * them writes every queued line with a single write(), and, with the
+ * always policy, a single fdatasync(), then all of them are answered.
+ * A batch is indexed, and so seen by readers, only once it is written
+ * and synced.
+ *
+ * Lines that are not the latest of a live key are dead. Readers going
+ * through the file in order skip them with disk_log_is_current().
+ */
+
+#ifndef DISKLOG_H
+#define DISKLOG_H
+
+#include "utils.h"
+
+#define DISK_LOG_SYNC_OS 0	///< Leave writing back to the OS.
+#define DISK_LOG_SYNC_ALWAYS 1	///< Sync every batch before answering its writers.
+#define DISK_LOG_SYNC_PERIODIC 2	///< Sync every few milliseconds from a background thread.
+
+#define DISK_LOG_MIN_BUCKETS 64	///< Hash buckets of an empty table, a power of two.
+#define DISK_LOG_MIN_MAP (1 << 20)	///< Bytes first mapped of a table file, a power of two.
+#define DISK_LOG_LINE_LEN (MAX_KEY_LEN + MAX_VALUE_LEN + 2)	///< Longest line of a table file, with its newline.
+
+/**
+ * @brief Set when writes are synced to disk.
+ *
+ * Call it once, before any log is opened.
+ *
+ * @param policy One of the DISK_LOG_SYNC_* constants.
+ * @param interval_ms Milliseconds between syncs with DISK_LOG_SYNC_PERIODIC.
+ * @return Return 0 on success, -1 if the sync thread cannot be started.
+ */
+int disk_log_init(int policy, int interval_ms);
+
+/**
+ * @brief Open the log of a table and index it.
+ *
+ * The file is created if needed. A line cut short by a crash at the end
+ * of the file is dropped; a whole record missing only its newline there
+ * is kept, and the newline is added.
+ *
+ * @param table Table index.
+ * @param path Path of the table file.
+ * @return Return 0 on success, -1 if the file cannot be opened or read.
+ */
+int disk_log_open(int table, const char *path);
+
+/**
+ * @brief Read the value of a key.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param value Where to copy the value.
+ * @return Return 0 on success, -1 if the key is not in the table.
+ */
+int disk_log_get(int table, const char *key, char value[MAX_VALUE_LEN]);
+
+/**
+ * @brief Insert or update a record.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param value The value; it must not hold a newline.
+ * @return Return 0 once the record is written (and synced, with the
+ * always policy), -1 if it could not be.
+ */
+int disk_log_set(int table, const char *key, const char *value);
+
+/**
+ * @brief Insert or update many records of a table at once.
+ *
+ * The records are queued together, so they are appended with a single
+ * write() and, with the always policy, a single fdatasync().
+ *
+ * @param table Table index.
+ * @param keys The keys.
+ * @param values The values; they must not hold a newline.
+ * @param num_records Number of records.
+ * @return Return 0 once every record is written, -1 if any could not be.
+ */
+int disk_log_set_batch(int table, char keys[][MAX_KEY_LEN], char values[][MAX_VALUE_LEN], int num_records);
+
+/**
+ * @brief Delete a record.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @return Return 0 on success, 1 if the key is not in the table, -1 if
+ * the delete could not be written.
+ */
+int disk_log_delete(int table, const char *key);
+
+/**
+ * @brief Check whether a line of a table file is the latest of a live key.
+ *
+ * @param table Table index.
+ * @param key The key of the line.
+ * @param offset Offset of the line in the file.
+ * @return Return 1 if it is, 0 if the line is dead.
+ */
+int disk_log_is_current(int table, const char *key, long offset);
+
+#endif
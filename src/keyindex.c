@@ -0,0 +1,368 @@
+/**
+ * @file
+ * @brief This file implements the ordered key index declared in
+ * keyindex.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "keyindex.h"
+
+/**
+ * @brief A node of the B+tree.
+ *
+ * An inner node with n keys has n + 1 children; every key under
+ * children[i + 1] is at least keys[i], every key under children[i] is
+ * less than keys[i]. The arrays have room for one more key than a node
+ * may keep, so an insert can go in before the node is split.
+ */
+struct key_index_node {
+	/// 1 for a leaf, 0 for an inner node.
+	int leaf;
+
+	/// Number of keys.
+	int num_keys;
+
+	/// Keys, in order.
+	char keys[KEY_INDEX_ORDER + 1][MAX_KEY_LEN];
+
+	/// Children of an inner node.
+	struct key_index_node *children[KEY_INDEX_ORDER + 2];
+
+	/// Neighbours of a leaf.
+	struct key_index_node *prev;
+	struct key_index_node *next;
+};
+
+/**
+ * @brief The index of one table.
+ */
+struct key_index {
+	/// Root of the tree, NULL while the table is empty.
+	struct key_index_node *root;
+
+	/// Taken shared by lookups and exclusive by inserts and removes.
+	pthread_rwlock_t lock;
+};
+
+static struct key_index indexes[MAX_TABLES];
+
+/**
+ * @brief Find the first key of a node that is not less than a key.
+ *
+ * @param node the node
+ * @param key the key
+ * @return the index of that key, num_keys if there is none
+ */
+static int lower_bound(const struct key_index_node *node, const char *key)
+{
+    int low = 0, high = node->num_keys, mid;
+
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (strcmp(node->keys[mid], key) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Find the child of an inner node a key belongs under.
+ *
+ * @param node the inner node
+ * @param key the key
+ * @return the index of the child
+ */
+static int child_index(const struct key_index_node *node, const char *key)
+{
+    int low = 0, high = node->num_keys, mid;
+
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (strcmp(node->keys[mid], key) <= 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Split a node that has one key too many.
+ *
+ * @param node the node
+ * @param separator where to write the key that goes up to the parent
+ * @return the new right half of the node
+ */
+static struct key_index_node *node_split(struct key_index_node *node, char separator[MAX_KEY_LEN])
+{
+    struct key_index_node *right = calloc(1, sizeof *right);
+    int half = node->num_keys / 2;
+
+    right->leaf = node->leaf;
+    if (node->leaf)
+    {
+        right->num_keys = node->num_keys - half;
+        memcpy(right->keys, node->keys[half], (size_t)right->num_keys * MAX_KEY_LEN);
+        node->num_keys = half;
+        strcpy(separator, right->keys[0]);
+
+        right->prev = node;
+        right->next = node->next;
+        if (node->next)
+        {
+            node->next->prev = right;
+        }
+        node->next = right;
+    }
+    else
+    {
+        // The middle key moves up rather than being copied
+        right->num_keys = node->num_keys - half - 1;
+        memcpy(right->keys, node->keys[half + 1], (size_t)right->num_keys * MAX_KEY_LEN);
+        memcpy(right->children, &node->children[half + 1], (size_t)(right->num_keys + 1) * sizeof right->children[0]);
+        strcpy(separator, node->keys[half]);
+        node->num_keys = half;
+    }
+    return right;
+}
+
+/**
+ * @brief Insert a key under a node.
+ *
+ * @param node the node
+ * @param key the key
+ * @param separator where to write the key that goes up to the parent if the node splits
+ * @param added set to 1 if the key was not there yet, left alone otherwise
+ * @return the new right half of the node if it split, NULL otherwise
+ */
+static struct key_index_node *node_insert(struct key_index_node *node, const char *key, char separator[MAX_KEY_LEN],
+                                          int *added)
+{
+    struct key_index_node *right;
+    char child_separator[MAX_KEY_LEN];
+    int i;
+
+    if (node->leaf)
+    {
+        i = lower_bound(node, key);
+        if (i < node->num_keys && !strcmp(node->keys[i], key))
+        {
+            return NULL;
+        }
+        memmove(node->keys[i + 1], node->keys[i], (size_t)(node->num_keys - i) * MAX_KEY_LEN);
+        strcpy(node->keys[i], key);
+        *added = 1;
+    }
+    else
+    {
+        i = child_index(node, key);
+        right = node_insert(node->children[i], key, child_separator, added);
+        if (right == NULL)
+        {
+            return NULL;
+        }
+        memmove(node->keys[i + 1], node->keys[i], (size_t)(node->num_keys - i) * MAX_KEY_LEN);
+        memmove(&node->children[i + 2], &node->children[i + 1], (size_t)(node->num_keys - i) * sizeof node->children[0]);
+        strcpy(node->keys[i], child_separator);
+        node->children[i + 1] = right;
+    }
+    node->num_keys++;
+    return node->num_keys > KEY_INDEX_ORDER ? node_split(node, separator) : NULL;
+}
+
+/**
+ * @brief Remove a key from under a node, freeing the nodes it empties.
+ *
+ * @param node the node
+ * @param key the key
+ * @return 1 if the node is now empty and has to be freed by its parent, 0 otherwise
+ */
+static int node_remove(struct key_index_node *node, const char *key)
+{
+    struct key_index_node *child;
+    int i;
+
+    if (node->leaf)
+    {
+        i = lower_bound(node, key);
+        if (i == node->num_keys || strcmp(node->keys[i], key))
+        {
+            return 0;
+        }
+        node->num_keys--;
+        memmove(node->keys[i], node->keys[i + 1], (size_t)(node->num_keys - i) * MAX_KEY_LEN);
+        return node->num_keys == 0;
+    }
+
+    i = child_index(node, key);
+    child = node->children[i];
+    if (!node_remove(child, key))
+    {
+        return 0;
+    }
+    if (child->leaf)
+    {
+        if (child->prev)
+        {
+            child->prev->next = child->next;
+        }
+        if (child->next)
+        {
+            child->next->prev = child->prev;
+        }
+    }
+    free(child);
+    if (node->num_keys == 0)
+    {
+        // That was the only child
+        return 1;
+    }
+
+    // Drop the child with the separator to its left, or to its right for the first child
+    node->num_keys--;
+    if (i == 0)
+    {
+        memmove(node->keys[0], node->keys[1], (size_t)node->num_keys * MAX_KEY_LEN);
+        memmove(&node->children[0], &node->children[1], (size_t)(node->num_keys + 1) * sizeof node->children[0]);
+    }
+    else
+    {
+        memmove(node->keys[i - 1], node->keys[i], (size_t)(node->num_keys - i + 1) * MAX_KEY_LEN);
+        memmove(&node->children[i], &node->children[i + 1], (size_t)(node->num_keys - i + 1) * sizeof node->children[0]);
+    }
+    return 0;
+}
+
+void key_index_init(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_TABLES; i++)
+    {
+        indexes[i].root = NULL;
+        pthread_rwlock_init(&indexes[i].lock, NULL);
+    }
+}
+
+int key_index_insert(int table, const char *key)
+{
+    struct key_index *index = &indexes[table];
+    struct key_index_node *right, *root;
+    char separator[MAX_KEY_LEN];
+    int added = 0;
+
+    pthread_rwlock_wrlock(&index->lock);
+    if (index->root == NULL)
+    {
+        index->root = calloc(1, sizeof *index->root);
+        index->root->leaf = 1;
+    }
+    right = node_insert(index->root, key, separator, &added);
+    if (right)
+    {
+        // The root split, the tree grows one level
+        root = calloc(1, sizeof *root);
+        root->num_keys = 1;
+        strcpy(root->keys[0], separator);
+        root->children[0] = index->root;
+        root->children[1] = right;
+        index->root = root;
+    }
+    pthread_rwlock_unlock(&index->lock);
+    return added;
+}
+
+void key_index_remove(int table, const char *key)
+{
+    struct key_index *index = &indexes[table];
+    struct key_index_node *root;
+
+    pthread_rwlock_wrlock(&index->lock);
+    if (index->root && node_remove(index->root, key))
+    {
+        free(index->root);
+        index->root = NULL;
+    }
+    while (index->root && !index->root->leaf && index->root->num_keys == 0)
+    {
+        // A root with a single child is not needed
+        root = index->root;
+        index->root = root->children[0];
+        free(root);
+    }
+    pthread_rwlock_unlock(&index->lock);
+}
+
+int key_index_range(int table, const char *from, const char *to, char keys[][MAX_KEY_LEN], int max_keys,
+                    char next[MAX_KEY_LEN])
+{
+    struct key_index *index = &indexes[table];
+    struct key_index_node *node;
+    int i, num_keys = 0;
+
+    next[0] = '\0';
+    pthread_rwlock_rdlock(&index->lock);
+    node = index->root;
+    while (node && !node->leaf)
+    {
+        node = node->children[child_index(node, from)];
+    }
+    i = node ? lower_bound(node, from) : 0;
+    for (; node; node = node->next, i = 0)
+    {
+        for (; i < node->num_keys; i++)
+        {
+            if (to[0] != '\0' && strcmp(node->keys[i], to) >= 0)
+            {
+                pthread_rwlock_unlock(&index->lock);
+                return num_keys;
+            }
+            if (num_keys == max_keys)
+            {
+                strcpy(next, node->keys[i]);
+                pthread_rwlock_unlock(&index->lock);
+                return num_keys;
+            }
+            strcpy(keys[num_keys++], node->keys[i]);
+        }
+    }
+    pthread_rwlock_unlock(&index->lock);
+    return num_keys;
+}
+
+void key_index_prefix_end(const char *prefix, char to[MAX_KEY_LEN])
+{
+    int len = strlen(prefix);
+
+    if (len >= MAX_KEY_LEN)
+    {
+        len = MAX_KEY_LEN - 1;
+    }
+    memcpy(to, prefix, len);
+
+    // Characters that cannot be incremented are dropped, then the last
+    // one left is incremented
+    while (len > 0 && (unsigned char)to[len - 1] == 0xff)
+    {
+        len--;
+    }
+    if (len > 0)
+    {
+        to[len - 1]++;
+    }
+    to[len] = '\0';
+}
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @brief This file declares the ordered key index kept by the storage
+ * server for every in-memory table.
+ *
+ * The index is a B+tree holding the keys of a table in strcmp() order,
+ * with its leaves linked left to right. Finding where a range starts
+ * costs O(log n) and every key after that O(1), so SCAN and PREFIX never
+ * look at keys outside the range they return. Nodes are only freed once
+ * they are empty; a half empty node is left as it is rather than merged.
+ */
+
+#ifndef KEYINDEX_H
+#define KEYINDEX_H
+
+#include "utils.h"
+
+#define KEY_INDEX_ORDER 32	///< Max keys in a node.
+
+/**
+ * @brief Set up an empty index for every table.
+ */
+void key_index_init(void);
+
+/**
+ * @brief Add a key to the index of a table.
+ *
+ * @param table Table index.
+ * @param key Key of a record being added to the table.
+ * @return 1 if the key was added, 0 if it was already there.
+ */
+int key_index_insert(int table, const char *key);
+
+/**
+ * @brief Remove a key from the index of a table.
+ *
+ * @param table Table index.
+ * @param key Key of a record just deleted from the table.
+ */
+void key_index_remove(int table, const char *key);
+
+/**
+ * @brief Copy the keys of a table in a range, in order.
+ *
+ * @param table Table index.
+ * @param from First key of the range, "" to start at the first key.
+ * @param to Key the range stops before, "" to run to the last key.
+ * @param keys Where to copy the keys.
+ * @param max_keys Max keys to copy.
+ * @param next Where to copy the first key in the range that was not
+ * copied, "" if all were.
+ * @return The number of keys copied.
+ */
+int key_index_range(int table, const char *from, const char *to, char keys[][MAX_KEY_LEN], int max_keys,
+		char next[MAX_KEY_LEN]);
+
+/**
+ * @brief Find the end of the range of the keys starting with a prefix.
+ *
+ * @param prefix The prefix.
+ * @param to Where to write the smallest key greater than every key with
+ * the prefix, "" if there is none.
+ */
+void key_index_prefix_end(const char *prefix, char to[MAX_KEY_LEN]);
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * @file
+ * @brief Benchmark of the server record layout.
+ *
+ * Runs the same key lookups against the old layout, where every record
+ * carried its value, key, metadata and mutex together, and against the
+ * current split of struct server_record and struct server_value. Cache
+ * misses are read from the hardware performance counters when the kernel
+ * allows it (see perf_event_open(2)); otherwise only the time is printed.
+ *
+ * Usage: layoutbench [rounds]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "utils.h"
+
+/**
+ * @brief The record layout used before the hot/cold split.
+ */
+struct interleaved_record {
+    char value[MAX_VALUE_LEN];
+    char key[MAX_KEY_LEN];
+    unsigned long metadata;
+    unsigned int seq;
+    pthread_mutex_t lock;
+};
+
+static struct interleaved_record old_tables[MAX_TABLES][MAX_RECORDS_PER_TABLE];
+static struct server_record new_tables[MAX_TABLES][MAX_RECORDS_PER_TABLE] __attribute__((aligned(64)));
+static struct server_value new_values[MAX_TABLES][MAX_RECORDS_PER_TABLE];
+
+/**
+ * @brief Open one hardware counter for the calling thread.
+ *
+ * @param type PERF_TYPE_* of the counter
+ * @param config event to count
+ * @return the counter's file descriptor, or -1 if it is not available
+ */
+static int counter_open(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief Read a counter opened with counter_open().
+ *
+ * @param fd counter file descriptor, may be -1
+ * @return the count, or 0 if the counter is not available
+ */
+static unsigned long long counter_read(int fd)
+{
+    unsigned long long count = 0;
+
+    if (fd < 0 || read(fd, &count, sizeof count) != sizeof count)
+    {
+        return 0;
+    }
+    return count;
+}
+
+/**
+ * @brief Look up every key of every table, old layout.
+ *
+ * @param rounds how many times to repeat the lookups
+ * @return number of keys found, so the loop is not optimized away
+ */
+static long lookup_interleaved(int rounds)
+{
+    char key[MAX_KEY_LEN];
+    long found = 0;
+    int r, t, i;
+
+    for (r = 0; r < rounds; r++)
+    {
+        for (t = 0; t < MAX_TABLES; t++)
+        {
+            // A miss walks the whole table, as key_exist() does before a SET
+            snprintf(key, sizeof key, "missing%d", r);
+            for (i = 0; i < MAX_RECORDS_PER_TABLE; i++)
+            {
+                if (!strcmp(old_tables[t][i].key, key))
+                {
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Look up every key of every table, current layout.
+ *
+ * @param rounds how many times to repeat the lookups
+ * @return number of keys found, so the loop is not optimized away
+ */
+static long lookup_split(int rounds)
+{
+    char key[MAX_KEY_LEN];
+    long found = 0;
+    int r, t, i;
+
+    for (r = 0; r < rounds; r++)
+    {
+        for (t = 0; t < MAX_TABLES; t++)
+        {
+            snprintf(key, sizeof key, "missing%d", r);
+            for (i = 0; i < MAX_RECORDS_PER_TABLE; i++)
+            {
+                if (!strcmp(new_tables[t][i].key, key))
+                {
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Time one lookup function and print its counters.
+ *
+ * @param name layout name to print
+ * @param lookup lookup function to run
+ * @param rounds passed to lookup
+ * @return no return value
+ */
+static void bench_layout(const char *name, long (*lookup)(int), int rounds)
+{
+    int fd_llc = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int fd_l1d = counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    struct timespec start, end;
+    long found;
+    double ms;
+
+    ioctl(fd_llc, PERF_EVENT_IOC_ENABLE, 0);
+    ioctl(fd_l1d, PERF_EVENT_IOC_ENABLE, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    found = lookup(rounds);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ioctl(fd_llc, PERF_EVENT_IOC_DISABLE, 0);
+    ioctl(fd_l1d, PERF_EVENT_IOC_DISABLE, 0);
+
+    ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    if (fd_llc < 0 || fd_l1d < 0)
+    {
+        printf("%-12s %10.1f %16s %16s  (%ld)\n", name, ms, "n/a", "n/a", found);
+    }
+    else
+    {
+        printf("%-12s %10.1f %16llu %16llu  (%ld)\n", name, ms,
+               counter_read(fd_l1d), counter_read(fd_llc), found);
+    }
+    if (fd_llc >= 0)
+    {
+        close(fd_llc);
+    }
+    if (fd_l1d >= 0)
+    {
+        close(fd_l1d);
+    }
+}
+
+/**
+ * @brief Fill both layouts with the same records and compare lookups.
+ */
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    int t, i;
+
+    for (t = 0; t < MAX_TABLES; t++)
+    {
+        for (i = 0; i < MAX_RECORDS_PER_TABLE; i++)
+        {
+            snprintf(old_tables[t][i].key, MAX_KEY_LEN, "key%d", i);
+            snprintf(old_tables[t][i].value, MAX_VALUE_LEN, "col %d", i);
+            pthread_mutex_init(&old_tables[t][i].lock, NULL);
+            snprintf(new_tables[t][i].key, MAX_KEY_LEN, "key%d", i);
+            snprintf(new_values[t][i].value, MAX_VALUE_LEN, "col %d", i);
+        }
+    }
+
+    printf("record bytes: interleaved %lu, split %lu hot + %lu cold\n",
+           (unsigned long)sizeof(struct interleaved_record),
+           (unsigned long)sizeof(struct server_record),
+           (unsigned long)sizeof(struct server_value));
+    printf("%d rounds of %d key lookups\n", rounds, MAX_TABLES);
+    printf("%-12s %10s %16s %16s\n", "layout", "ms", "L1D misses", "cache misses");
+    bench_layout("interleaved", lookup_interleaved, rounds);
+    bench_layout("split", lookup_split, rounds);
+    return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file
+ * @brief Benchmark of the record locking schemes in lockscheme.h.
+ *
+ * Writer threads update random records the way SET and UPDATE do, while
+ * scanner threads walk whole tables the way QUERY does. Each scheme runs
+ * for the same amount of time and the throughput of both sides is printed.
+ *
+ * Usage: lockbench [seconds] [writers] [scanners]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "utils.h"
+#include "lockscheme.h"
+
+#define BENCH_TABLES 4	///< Tables the benchmark spreads its records over.
+
+/**
+ * @brief The parts of a server record the benchmark touches.
+ */
+struct bench_record {
+    char key[MAX_KEY_LEN];
+    char value[MAX_VALUE_LEN];
+    unsigned int seq;
+};
+
+static struct bench_record records[BENCH_TABLES][MAX_RECORDS_PER_TABLE];
+static volatile int running;
+
+/**
+ * @brief Counters filled in by one benchmark thread.
+ */
+struct bench_thread {
+    pthread_t thread;
+    unsigned int rand_state;
+    unsigned long ops;
+};
+
+/**
+ * @brief Overwrite random records until told to stop.
+ *
+ * @param arg the thread's struct bench_thread
+ * @return no return value
+ */
+static void *bench_writer(void *arg)
+{
+    struct bench_thread *self = arg;
+    struct bench_record *record;
+    int table, slot;
+
+    while (running)
+    {
+        table = rand_r(&self->rand_state) % BENCH_TABLES;
+        slot = rand_r(&self->rand_state) % MAX_RECORDS_PER_TABLE;
+        record = &records[table][slot];
+
+        lock_record(table, slot);
+        __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        snprintf(record->value, sizeof record->value, "col %lu", self->ops);
+        __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELEASE);
+        unlock_record(table, slot);
+        self->ops++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Scan whole tables, copying every value, until told to stop.
+ *
+ * @param arg the thread's struct bench_thread
+ * @return no return value
+ */
+static void *bench_scanner(void *arg)
+{
+    struct bench_thread *self = arg;
+    struct bench_record *record;
+    char value[MAX_VALUE_LEN];
+    unsigned int seq;
+    int table, slot;
+
+    while (running)
+    {
+        table = rand_r(&self->rand_state) % BENCH_TABLES;
+        lock_table_scan(table);
+        for (slot = 0; slot < MAX_RECORDS_PER_TABLE; slot++)
+        {
+            record = &records[table][slot];
+            do
+            {
+                while ((seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE)) & 1)
+                {
+                    // writer in progress
+                }
+                memcpy(value, record->value, MAX_VALUE_LEN);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            }
+            while (__atomic_load_n(&record->seq, __ATOMIC_RELAXED) != seq);
+        }
+        unlock_table_scan(table);
+        self->ops++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run one scheme for a fixed time and print its throughput.
+ *
+ * The locks are sized for a full server (MAX_TABLES tables), so the
+ * reported footprint is what the server would allocate.
+ *
+ * @param scheme one of the LOCK_SCHEME_* constants
+ * @param seconds how long to run
+ * @param num_writers number of writer threads
+ * @param num_scanners number of scanner threads
+ * @return no return value
+ */
+static void bench_scheme(int scheme, int seconds, int num_writers, int num_scanners)
+{
+    struct bench_thread *threads = calloc(num_writers + num_scanners, sizeof(struct bench_thread));
+    unsigned long writes = 0, scans = 0;
+    int i;
+
+    if (threads == NULL || lock_scheme_init(scheme, MAX_TABLES, MAX_RECORDS_PER_TABLE, DEFAULT_LOCK_STRIPES) != 0)
+    {
+        printf("%-12s could not be set up\n", lock_scheme_name(scheme));
+        free(threads);
+        return;
+    }
+
+    running = 1;
+    for (i = 0; i < num_writers + num_scanners; i++)
+    {
+        threads[i].rand_state = i + 1;
+        pthread_create(&threads[i].thread, NULL, i < num_writers ? bench_writer : bench_scanner, &threads[i]);
+    }
+    sleep(seconds);
+    running = 0;
+    for (i = 0; i < num_writers + num_scanners; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+        if (i < num_writers)
+        {
+            writes += threads[i].ops;
+        }
+        else
+        {
+            scans += threads[i].ops;
+        }
+    }
+
+    printf("%-12s %12lu %14.0f %14.1f\n", lock_scheme_name(scheme),
+           (unsigned long)lock_scheme_footprint(),
+           (double)writes / seconds, (double)scans / seconds);
+    free(threads);
+}
+
+/**
+ * @brief Compare the per-row, striped and per-table schemes.
+ */
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 2;
+    int num_writers = argc > 2 ? atoi(argv[2]) : 4;
+    int num_scanners = argc > 3 ? atoi(argv[3]) : 2;
+
+    printf("%d writers, %d scanners, %d s per scheme\n", num_writers, num_scanners, seconds);
+    printf("%-12s %12s %14s %14s\n", "scheme", "lock bytes", "writes/s", "scans/s");
+    bench_scheme(LOCK_SCHEME_ROW, seconds, num_writers, num_scanners);
+    bench_scheme(LOCK_SCHEME_STRIPED, seconds, num_writers, num_scanners);
+    bench_scheme(LOCK_SCHEME_TABLE, seconds, num_writers, num_scanners);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file
+ * @brief This file implements the record locking schemes declared in
+ * lockscheme.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "lockscheme.h"
+
+/**
+ * @brief A mutex padded to its own cache line, so neighbouring stripes
+ * do not bounce the same line between cores.
+ */
+struct padded_mutex {
+    pthread_mutex_t lock;
+    char pad[64 - sizeof(pthread_mutex_t) % 64];
+};
+
+static int lock_scheme = LOCK_SCHEME_ROW;
+static int lock_slots_per_table;
+static int lock_num_stripes;
+static int lock_num_entries;
+
+/// LOCK_SCHEME_ROW: one mutex per slot, tables laid out one after another.
+static pthread_mutex_t *row_mutexes;
+
+/// LOCK_SCHEME_STRIPED: the shared pool.
+static struct padded_mutex *mutexes;
+
+/// LOCK_SCHEME_TABLE: one reader-writer lock per table.
+static pthread_rwlock_t *table_locks;
+
+int lock_scheme_init(int scheme, int num_tables, int slots_per_table, int num_stripes)
+{
+    int i;
+
+    lock_scheme = scheme;
+    lock_slots_per_table = slots_per_table;
+
+    if (scheme == LOCK_SCHEME_ROW)
+    {
+        lock_num_entries = num_tables * slots_per_table;
+        row_mutexes = malloc(lock_num_entries * sizeof(pthread_mutex_t));
+        if (row_mutexes == NULL)
+        {
+            return -1;
+        }
+        for (i = 0; i < lock_num_entries; i++)
+        {
+            pthread_mutex_init(&row_mutexes[i], NULL);
+        }
+    }
+    else if (scheme == LOCK_SCHEME_STRIPED)
+    {
+        lock_num_stripes = num_stripes > 0 ? num_stripes : DEFAULT_LOCK_STRIPES;
+        lock_num_entries = lock_num_stripes;
+        mutexes = malloc(lock_num_entries * sizeof(struct padded_mutex));
+        if (mutexes == NULL)
+        {
+            return -1;
+        }
+        for (i = 0; i < lock_num_entries; i++)
+        {
+            pthread_mutex_init(&mutexes[i].lock, NULL);
+        }
+    }
+    else if (scheme == LOCK_SCHEME_TABLE)
+    {
+        lock_num_entries = num_tables;
+        table_locks = malloc(lock_num_entries * sizeof(pthread_rwlock_t));
+        if (table_locks == NULL)
+        {
+            return -1;
+        }
+        for (i = 0; i < lock_num_entries; i++)
+        {
+            pthread_rwlock_init(&table_locks[i], NULL);
+        }
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+const char *lock_scheme_name(int scheme)
+{
+    switch (scheme)
+    {
+    case LOCK_SCHEME_ROW:
+        return "per-row";
+    case LOCK_SCHEME_STRIPED:
+        return "per-stripe";
+    case LOCK_SCHEME_TABLE:
+        return "per-table";
+    }
+    return "unknown";
+}
+
+size_t lock_scheme_footprint(void)
+{
+    switch (lock_scheme)
+    {
+    case LOCK_SCHEME_ROW:
+        return lock_num_entries * sizeof(pthread_mutex_t);
+    case LOCK_SCHEME_STRIPED:
+        return lock_num_entries * sizeof(struct padded_mutex);
+    case LOCK_SCHEME_TABLE:
+        return lock_num_entries * sizeof(pthread_rwlock_t);
+    }
+    return 0;
+}
+
+/**
+ * @brief Map a record slot onto its stripe.
+ *
+ * Consecutive slots land on consecutive stripes, so appends and the row
+ * shifts done by DELETE spread over the pool instead of piling up on one lock.
+ *
+ * @param table Table index.
+ * @param slot Record slot in the table.
+ * @return The stripe guarding the slot.
+ */
+static inline pthread_mutex_t *stripe_of(int table, int slot)
+{
+    unsigned int index = (unsigned int)(table * lock_slots_per_table + slot);
+    return &mutexes[index % lock_num_stripes].lock;
+}
+
+void lock_record(int table, int slot)
+{
+    if (lock_scheme == LOCK_SCHEME_ROW)
+    {
+        pthread_mutex_lock(&row_mutexes[table * lock_slots_per_table + slot]);
+    }
+    else if (lock_scheme == LOCK_SCHEME_STRIPED)
+    {
+        pthread_mutex_lock(stripe_of(table, slot));
+    }
+    else
+    {
+        pthread_rwlock_wrlock(&table_locks[table]);
+    }
+}
+
+void unlock_record(int table, int slot)
+{
+    if (lock_scheme == LOCK_SCHEME_ROW)
+    {
+        pthread_mutex_unlock(&row_mutexes[table * lock_slots_per_table + slot]);
+    }
+    else if (lock_scheme == LOCK_SCHEME_STRIPED)
+    {
+        pthread_mutex_unlock(stripe_of(table, slot));
+    }
+    else
+    {
+        pthread_rwlock_unlock(&table_locks[table]);
+    }
+}
+
+void lock_table_scan(int table)
+{
+    if (lock_scheme == LOCK_SCHEME_TABLE)
+    {
+        pthread_rwlock_rdlock(&table_locks[table]);
+    }
+}
+
+void unlock_table_scan(int table)
+{
+    if (lock_scheme == LOCK_SCHEME_TABLE)
+    {
+        pthread_rwlock_unlock(&table_locks[table]);
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief This file declares the locks writers take on table records.
+ *
+ * Point reads and scans never block writers; they copy records
+ * optimistically using the per-record sequence counter. The scheme
+ * chosen here only decides how writers exclude each other, and whether
+ * a scan may hold a table still while it runs.
+ */
+
+#ifndef LOCKSCHEME_H
+#define LOCKSCHEME_H
+
+#include <pthread.h>
+
+#define LOCK_SCHEME_ROW 0	///< One mutex per record slot.
+#define LOCK_SCHEME_STRIPED 1	///< A fixed pool of mutexes shared by hashing the slot.
+#define LOCK_SCHEME_TABLE 2	///< One reader-writer lock per table.
+
+#define DEFAULT_LOCK_STRIPES 1024	///< Stripes used when the config file omits lock_stripes.
+
+/**
+ * @brief Set up the locks for the chosen scheme.
+ *
+ * Only the locks the scheme needs are allocated, so the striped and
+ * per-table schemes do not pay for a mutex in every record.
+ *
+ * @param scheme One of the LOCK_SCHEME_* constants.
+ * @param num_tables Number of tables.
+ * @param slots_per_table Number of record slots in each table.
+ * @param num_stripes Size of the lock pool for LOCK_SCHEME_STRIPED.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int lock_scheme_init(int scheme, int num_tables, int slots_per_table, int num_stripes);
+
+/**
+ * @brief Get the name of a scheme, as written in the config file.
+ *
+ * @param scheme One of the LOCK_SCHEME_* constants.
+ * @return The scheme name.
+ */
+const char *lock_scheme_name(int scheme);
+
+/**
+ * @brief Get the memory taken by the locks of the current scheme.
+ *
+ * @return Size in bytes.
+ */
+size_t lock_scheme_footprint(void);
+
+/**
+ * @brief Take the writer lock covering one record slot.
+ *
+ * @param table Table index.
+ * @param slot Record slot in the table.
+ */
+void lock_record(int table, int slot);
+
+/**
+ * @brief Release the writer lock taken by lock_record().
+ *
+ * @param table Table index.
+ * @param slot Record slot in the table.
+ */
+void unlock_record(int table, int slot);
+
+/**
+ * @brief Keep writers out of a table for the length of a scan.
+ *
+ * Only LOCK_SCHEME_TABLE takes a lock here (the shared side of the
+ * table's reader-writer lock); the other schemes let scans run
+ * alongside writers.
+ *
+ * @param table Table index.
+ */
+void lock_table_scan(int table);
+
+/**
+ * @brief Release the lock taken by lock_table_scan().
+ *
+ * @param table Table index.
+ */
+void unlock_table_scan(int table);
+
+#endif
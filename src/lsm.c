@@ -0,0 +1,1958 @@
+/**
+ * @file
+ * @brief This file implements the LSM tree storage engine declared in
+ * lsm.h.
+ *
+ * Records are stored the same way in logs and SSTables: a 2 byte key
+ * length, a 4 byte value length (-1 for a delete), the key, then the
+ * value. An SSTable follows its records with the sparse index, its
+ * largest key, the bloom filter bits and a fixed size footer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "lsm.h"
+#include "bloom.h"
+
+#define LSM_RECORD_HEADER 6	///< Bytes before the key of a record.
+#define LSM_RECORD_MAX (LSM_RECORD_HEADER + MAX_KEY_LEN + MAX_VALUE_LEN)	///< Longest record.
+#define LSM_READ_BUFFER (64 * 1024)	///< Bytes an iterator reads from an SSTable at once.
+#define LSM_MAGIC 0x4c534d31	///< Last field of every SSTable.
+#define LSM_MEMTABLE_CHUNK 64	///< Memtable records an iterator copies at once.
+
+/**
+ * @brief A node of a memtable skiplist.
+ */
+struct lsm_node {
+	/// The key.
+	char *key;
+
+	/// The value, NULL for a delete.
+	char *value;
+
+	/// Next node at every height of the node.
+	struct lsm_node *next[LSM_SKIPLIST_HEIGHT];
+};
+
+/**
+ * @brief Writes not yet in an SSTable, sorted in a skiplist.
+ */
+struct memtable {
+	/// First node, with no key.
+	struct lsm_node head;
+
+	/// Height of the tallest node.
+	int height;
+
+	/// Bytes of keys and values held.
+	size_t bytes;
+
+	/// Log holding the same writes.
+	unsigned long log_number;
+
+	/// Seed for node heights.
+	unsigned int seed;
+
+	/// References held by the table and by iterators.
+	int refs;
+};
+
+/**
+ * @brief The end of an SSTable file.
+ */
+struct sstable_footer {
+	unsigned long long index_offset;
+	unsigned long long bloom_offset;
+	unsigned long long bloom_bits;
+	unsigned long long num_records;
+	unsigned int num_index;
+	unsigned int bloom_hashes;
+	unsigned int magic;
+	unsigned int unused;
+};
+
+/**
+ * @brief An open SSTable.
+ */
+struct sstable {
+	/// Number in its file name.
+	unsigned long number;
+
+	/// The file, and the length of its records.
+	int fd;
+	off_t data_len;
+
+	/// Sparse index: a key of every LSM_INDEX_INTERVAL records and its offset.
+	int num_index;
+	char (*index_keys)[MAX_KEY_LEN];
+	off_t *index_offsets;
+
+	/// Range of its keys.
+	char smallest[MAX_KEY_LEN];
+	char largest[MAX_KEY_LEN];
+
+	/// Bloom filter of its keys.
+	struct bloom bloom;
+
+	/// Size of the file.
+	off_t file_bytes;
+
+	/// References held by the table and by iterators; the file is
+	/// removed with the last one once it is obsolete.
+	int refs;
+	int obsolete;
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32];
+};
+
+/**
+ * @brief An SSTable being written.
+ */
+struct sstable_builder {
+	FILE *file;
+	unsigned long number;
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32];
+	off_t offset;
+	unsigned long num_records;
+	int num_index;
+	int max_index;
+	char (*index_keys)[MAX_KEY_LEN];
+	off_t *index_offsets;
+	unsigned int (*hashes)[2];
+	unsigned long max_hashes;
+	char largest[MAX_KEY_LEN];
+};
+
+/**
+ * @brief The LSM tree of one table.
+ */
+struct lsm_table {
+	/// Table name, for file names.
+	char name[MAX_TABLE_LEN];
+
+	/// 1 once the table is open.
+	int opened;
+
+	/// Taken shared by readers and exclusive by writers and to change
+	/// the memtables or SSTables.
+	pthread_rwlock_t lock;
+
+	/// The memtable taking writes, and the frozen one being written out.
+	struct memtable *mem;
+	struct memtable *imm;
+
+	/// The log of mem.
+	int log_fd;
+
+	/// SSTables of every level; level 0 oldest first, the others by key.
+	struct sstable **files[LSM_LEVELS];
+	int num_files[LSM_LEVELS];
+	int max_files[LSM_LEVELS];
+
+	/// Next number for a log or SSTable file.
+	unsigned long next_number;
+
+	/// Key the next merge out of each level starts after.
+	char compact_pointer[LSM_LEVELS][MAX_KEY_LEN];
+
+	/// 1 while a background thread writes out imm, or merges.
+	int flushing;
+	int compacting;
+
+	/// Writers waiting for imm to be written out.
+	pthread_mutex_t room_lock;
+	pthread_cond_t room;
+
+	/// Failed write outs of imm so far, under room_lock.
+	unsigned long flush_failures;
+};
+
+/**
+ * @brief Records read in order from a memtable or a run of SSTables.
+ */
+struct lsm_source {
+	/// Memtable read LSM_MEMTABLE_CHUNK records at a time under lock,
+	/// or NULL.
+	struct memtable *mem;
+	pthread_rwlock_t *lock;
+
+	/// Records of the memtable copied last, and whether more follow.
+	char *keys[LSM_MEMTABLE_CHUNK];
+	char *values[LSM_MEMTABLE_CHUNK];
+	int num_pairs;
+	int pair;
+	int more;
+
+	/// SSTables read one after the other, or NULL.
+	struct sstable **files;
+	int num_files;
+	int file;
+	off_t offset;
+	char *buf;
+	int buf_pos;
+	int buf_len;
+
+	/// The current record.
+	int valid;
+	char key[MAX_KEY_LEN];
+	char value[MAX_VALUE_LEN];
+	int deleted;
+};
+
+/**
+ * @brief Merged view of a table.
+ */
+struct lsm_iterator {
+	/// Sources, newest first.
+	struct lsm_source *sources;
+	int num_sources;
+
+	/// SSTables referenced by the sources.
+	struct sstable **refs;
+	int num_refs;
+};
+
+static struct lsm_table lsm_tables[MAX_TABLES];
+
+/// Data directory, with a trailing '/'.
+static char lsm_directory[MAX_PATH_LEN + 1];
+
+/// 1 to sync the log after every write.
+static int lsm_sync_always;
+
+/// False positive rate of the bloom filters of new SSTables.
+static double lsm_bloom_fpr;
+
+/// Wakes the background threads.
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static int work_pending;
+
+/**
+ * @brief Build the path of a file of a table.
+ *
+ * @param path where to write the path
+ * @param t the table
+ * @param number file number, 0 for the manifest
+ * @param suffix file type
+ * @return path
+ */
+static char *lsm_path(char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32], const struct lsm_table *t, unsigned long number,
+                      const char *suffix)
+{
+    if (number > 0)
+    {
+        snprintf(path, MAX_PATH_LEN + MAX_TABLE_LEN + 32, "%s%s_lsm_%lu.%s", lsm_directory, t->name, number, suffix);
+    }
+    else
+    {
+        snprintf(path, MAX_PATH_LEN + MAX_TABLE_LEN + 32, "%s%s_lsm_%s.txt", lsm_directory, t->name, suffix);
+    }
+    return path;
+}
+
+/**
+ * @brief Encode a record.
+ *
+ * @param buf where to write it, LSM_RECORD_MAX bytes
+ * @param key the key
+ * @param value the value, NULL for a delete
+ * @return the length of the record
+ */
+static int encode_record(char *buf, const char *key, const char *value)
+{
+    unsigned short key_len = strlen(key);
+    int value_len = value ? (int)strlen(value) : -1;
+
+    memcpy(buf, &key_len, 2);
+    memcpy(buf + 2, &value_len, 4);
+    memcpy(buf + LSM_RECORD_HEADER, key, key_len);
+    if (value_len > 0)
+    {
+        memcpy(buf + LSM_RECORD_HEADER + key_len, value, value_len);
+    }
+    return LSM_RECORD_HEADER + key_len + (value_len > 0 ? value_len : 0);
+}
+
+/**
+ * @brief Decode a record.
+ *
+ * @param buf the record
+ * @param len bytes available at buf
+ * @param key where to copy the key
+ * @param value where to copy the value, "" for a delete
+ * @param deleted where to store 1 for a delete, 0 otherwise
+ * @return the length of the record, 0 if it runs past len, -1 if it is damaged
+ */
+static int decode_record(const char *buf, int len, char key[MAX_KEY_LEN], char value[MAX_VALUE_LEN], int *deleted)
+{
+    unsigned short key_len;
+    int value_len;
+
+    if (len < LSM_RECORD_HEADER)
+    {
+        return 0;
+    }
+    memcpy(&key_len, buf, 2);
+    memcpy(&value_len, buf + 2, 4);
+    if (key_len >= MAX_KEY_LEN || value_len >= MAX_VALUE_LEN || value_len < -1)
+    {
+        return -1;
+    }
+    *deleted = value_len == -1;
+    if (value_len < 0)
+    {
+        value_len = 0;
+    }
+    if (len < LSM_RECORD_HEADER + key_len + value_len)
+    {
+        return 0;
+    }
+    memcpy(key, buf + LSM_RECORD_HEADER, key_len);
+    key[key_len] = '\0';
+    memcpy(value, buf + LSM_RECORD_HEADER + key_len, value_len);
+    value[value_len] = '\0';
+    return LSM_RECORD_HEADER + key_len + value_len;
+}
+
+/**
+ * @brief Write all of a buffer to a file.
+ *
+ * @param fd the file
+ * @param buf the bytes
+ * @param len number of bytes
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const char *buf, int len)
+{
+    ssize_t written;
+    int done = 0;
+
+    while (done < len)
+    {
+        written = write(fd, buf + done, len - done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return -1;
+        }
+        done += written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Wake the background threads.
+ *
+ * @return no return value
+ */
+static void wake_background(void)
+{
+    pthread_mutex_lock(&work_lock);
+    work_pending = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&work_lock);
+}
+
+/**
+ * @brief Make an empty memtable.
+ *
+ * @param log_number log holding its writes
+ * @return the memtable, NULL if out of memory
+ */
+static struct memtable *memtable_new(unsigned long log_number)
+{
+    struct memtable *mem = calloc(1, sizeof *mem);
+
+    if (mem)
+    {
+        mem->height = 1;
+        mem->refs = 1;
+        mem->log_number = log_number;
+        mem->seed = (unsigned int)log_number * 2654435761u;
+    }
+    return mem;
+}
+
+/**
+ * @brief Drop a reference to a memtable, freeing it and its nodes with
+ * the last one.
+ *
+ * @param mem the memtable
+ * @return no return value
+ */
+static void memtable_unref(struct memtable *mem)
+{
+    struct lsm_node *node, *next;
+
+    if (__atomic_sub_fetch(&mem->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    {
+        return;
+    }
+    for (node = mem->head.next[0]; node; node = next)
+    {
+        next = node->next[0];
+        free(node->key);
+        free(node->value);
+        free(node);
+    }
+    free(mem);
+}
+
+/**
+ * @brief Find the last node of every height with a key less than a key.
+ *
+ * @param mem the memtable
+ * @param key the key
+ * @param prev where to store the nodes, one per height
+ * @return the node with the key, NULL if there is none
+ */
+static struct lsm_node *memtable_seek(struct memtable *mem, const char *key, struct lsm_node *prev[LSM_SKIPLIST_HEIGHT])
+{
+    struct lsm_node *node = &mem->head;
+    int level;
+
+    for (level = mem->height - 1; level >= 0; level--)
+    {
+        while (node->next[level] && strcmp(node->next[level]->key, key) < 0)
+        {
+            node = node->next[level];
+        }
+        prev[level] = node;
+    }
+    node = node->next[0];
+    return (node && !strcmp(node->key, key)) ? node : NULL;
+}
+
+/**
+ * @brief Insert or replace a record in a memtable.
+ *
+ * @param mem the memtable
+ * @param key the key
+ * @param value the value, NULL for a delete
+ * @return 0 on success, -1 if out of memory
+ */
+static int memtable_put(struct memtable *mem, const char *key, const char *value)
+{
+    struct lsm_node *prev[LSM_SKIPLIST_HEIGHT], *node;
+    char *copy = NULL;
+    int level, height = 1;
+
+    if (value && (copy = strdup(value)) == NULL)
+    {
+        return -1;
+    }
+    node = memtable_seek(mem, key, prev);
+    if (node)
+    {
+        mem->bytes += (copy ? strlen(copy) : 0) - (node->value ? strlen(node->value) : 0);
+        free(node->value);
+        node->value = copy;
+        return 0;
+    }
+
+    // Each level up holds a quarter of the nodes below it
+    while (height < LSM_SKIPLIST_HEIGHT && (rand_r(&mem->seed) & 3) == 0)
+    {
+        height++;
+    }
+    node = calloc(1, sizeof *node - (LSM_SKIPLIST_HEIGHT - height) * sizeof node->next[0]);
+    if (node == NULL || (node->key = strdup(key)) == NULL)
+    {
+        free(node);
+        free(copy);
+        return -1;
+    }
+    node->value = copy;
+    for (level = mem->height; level < height; level++)
+    {
+        prev[level] = &mem->head;
+    }
+    if (height > mem->height)
+    {
+        mem->height = height;
+    }
+    for (level = 0; level < height; level++)
+    {
+        node->next[level] = prev[level]->next[level];
+        prev[level]->next[level] = node;
+    }
+    mem->bytes += sizeof *node + strlen(key) + (copy ? strlen(copy) : 0);
+    return 0;
+}
+
+/**
+ * @brief Drop a reference to an SSTable, removing it with the last one
+ * once it is obsolete.
+ *
+ * @param sst the SSTable
+ * @return no return value
+ */
+static void sstable_unref(struct sstable *sst)
+{
+    if (__atomic_sub_fetch(&sst->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    {
+        return;
+    }
+    close(sst->fd);
+    if (sst->obsolete)
+    {
+        unlink(sst->path);
+    }
+    bloom_free(&sst->bloom);
+    free(sst->index_keys);
+    free(sst->index_offsets);
+    free(sst);
+}
+
+/**
+ * @brief Open an SSTable, reading its index and bloom filter.
+ *
+ * @param t the table
+ * @param number number of the SSTable
+ * @return the SSTable with one reference, NULL if it cannot be read
+ */
+static struct sstable *sstable_open(struct lsm_table *t, unsigned long number)
+{
+    struct sstable_footer footer;
+    struct sstable *sst = calloc(1, sizeof *sst);
+    unsigned short key_len;
+    unsigned long long offset;
+    char *meta = NULL;
+    off_t meta_len;
+    int i, pos = 0;
+
+    if (sst == NULL)
+    {
+        return NULL;
+    }
+    sst->number = number;
+    sst->refs = 1;
+    sst->fd = open(lsm_path(sst->path, t, number, "sst"), O_RDONLY);
+    sst->file_bytes = sst->fd == -1 ? -1 : lseek(sst->fd, 0, SEEK_END);
+    if (sst->file_bytes < (off_t)sizeof footer ||
+        pread(sst->fd, &footer, sizeof footer, sst->file_bytes - sizeof footer) != sizeof footer ||
+        footer.magic != LSM_MAGIC || footer.index_offset > footer.bloom_offset ||
+        footer.bloom_offset + (footer.bloom_bits + 7) / 8 + sizeof footer != (unsigned long long)sst->file_bytes)
+    {
+        goto fail;
+    }
+
+    // Index, largest key and bloom bits are read in one go
+    sst->data_len = footer.index_offset;
+    meta_len = sst->file_bytes - sizeof footer - footer.index_offset;
+    meta = malloc(meta_len + 1);
+    sst->num_index = footer.num_index;
+    sst->index_keys = malloc((footer.num_index + 1) * sizeof *sst->index_keys);
+    sst->index_offsets = malloc((footer.num_index + 1) * sizeof *sst->index_offsets);
+    sst->bloom.num_bits = footer.bloom_bits;
+    sst->bloom.num_hashes = footer.bloom_hashes;
+    sst->bloom.bits = malloc((footer.bloom_bits + 7) / 8 + 1);
+    if (meta == NULL || sst->index_keys == NULL || sst->index_offsets == NULL || sst->bloom.bits == NULL ||
+        pread(sst->fd, meta, meta_len, footer.index_offset) != meta_len)
+    {
+        goto fail;
+    }
+    for (i = 0; i <= sst->num_index; i++)
+    {
+        // The entry after the last is the largest key, with no offset
+        memcpy(&key_len, meta + pos, 2);
+        if (key_len >= MAX_KEY_LEN || pos + 2 + key_len > meta_len)
+        {
+            goto fail;
+        }
+        memcpy(i < sst->num_index ? sst->index_keys[i] : sst->largest, meta + pos + 2, key_len);
+        (i < sst->num_index ? sst->index_keys[i] : sst->largest)[key_len] = '\0';
+        pos += 2 + key_len;
+        if (i < sst->num_index)
+        {
+            memcpy(&offset, meta + pos, 8);
+            sst->index_offsets[i] = offset;
+            pos += 8;
+        }
+    }
+    memcpy(sst->bloom.bits, meta + (footer.bloom_offset - footer.index_offset), (footer.bloom_bits + 7) / 8);
+    strcpy(sst->smallest, sst->num_index > 0 ? sst->index_keys[0] : "");
+    free(meta);
+    return sst;
+
+fail:
+    free(meta);
+    if (sst->fd != -1)
+    {
+        close(sst->fd);
+    }
+    free(sst->bloom.bits);
+    free(sst->index_keys);
+    free(sst->index_offsets);
+    free(sst);
+    return NULL;
+}
+
+/**
+ * @brief Look a key up in an SSTable.
+ *
+ * @param sst the SSTable
+ * @param key the key
+ * @param hashes the bloom hashes of the key
+ * @param value where to copy the value
+ * @param deleted where to store 1 if the SSTable holds a delete of the key
+ * @return 1 if the SSTable has the key, 0 if it does not, -1 on a read error
+ */
+static int sstable_get(struct sstable *sst, const char *key, const unsigned int hashes[2], char value[MAX_VALUE_LEN],
+                       int *deleted)
+{
+    char block[LSM_INDEX_INTERVAL * LSM_RECORD_MAX], found[MAX_KEY_LEN];
+    int low = 0, high = sst->num_index, mid, len, pos = 0, used;
+    off_t end;
+
+    if (sst->num_index == 0 || strcmp(key, sst->smallest) < 0 || strcmp(key, sst->largest) > 0 ||
+        !bloom_may_contain(&sst->bloom, hashes))
+    {
+        return 0;
+    }
+
+    // The last indexed key not greater than the key starts its block
+    while (high - low > 1)
+    {
+        mid = (low + high) / 2;
+        if (strcmp(sst->index_keys[mid], key) <= 0)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    end = low + 1 < sst->num_index ? sst->index_offsets[low + 1] : sst->data_len;
+    len = end - sst->index_offsets[low];
+    if (len > (int)sizeof block || pread(sst->fd, block, len, sst->index_offsets[low]) != len)
+    {
+        return -1;
+    }
+    while (pos < len)
+    {
+        used = decode_record(block + pos, len - pos, found, value, deleted);
+        if (used <= 0)
+        {
+            return -1;
+        }
+        if (!strcmp(found, key))
+        {
+            return 1;
+        }
+        pos += used;
+    }
+    return 0;
+}
+
+/**
+ * @brief Start writing an SSTable.
+ *
+ * @param t the table, locked exclusively to take a file number
+ * @param b the builder
+ * @return 0 on success, -1 if the file cannot be created
+ */
+static int builder_start(struct lsm_table *t, struct sstable_builder *b)
+{
+    memset(b, 0, sizeof *b);
+    b->number = t->next_number++;
+    b->file = fopen(lsm_path(b->path, t, b->number, "sst"), "w");
+    return b->file ? 0 : -1;
+}
+
+/**
+ * @brief Add the next record, in key order, to an SSTable being written.
+ *
+ * @param b the builder
+ * @param key the key
+ * @param value the value, NULL for a delete
+ * @return 0 on success, -1 on error
+ */
+static int builder_add(struct sstable_builder *b, const char *key, const char *value)
+{
+    char record[LSM_RECORD_MAX];
+    int len = encode_record(record, key, value);
+    void *grown;
+
+    if (b->num_records % LSM_INDEX_INTERVAL == 0)
+    {
+        if (b->num_index == b->max_index)
+        {
+            b->max_index = b->max_index * 2 + 16;
+            grown = realloc(b->index_keys, b->max_index * sizeof *b->index_keys);
+            if (grown == NULL)
+            {
+                return -1;
+            }
+            b->index_keys = grown;
+            grown = realloc(b->index_offsets, b->max_index * sizeof *b->index_offsets);
+            if (grown == NULL)
+            {
+                return -1;
+            }
+            b->index_offsets = grown;
+        }
+        strcpy(b->index_keys[b->num_index], key);
+        b->index_offsets[b->num_index++] = b->offset;
+    }
+    if (b->num_records == b->max_hashes)
+    {
+        b->max_hashes = b->max_hashes * 2 + 256;
+        grown = realloc(b->hashes, b->max_hashes * sizeof *b->hashes);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        b->hashes = grown;
+    }
+    bloom_hash(key, b->hashes[b->num_records]);
+    strcpy(b->largest, key);
+    b->num_records++;
+    b->offset += len;
+    return fwrite(record, len, 1, b->file) == 1 ? 0 : -1;
+}
+
+/**
+ * @brief Free what a builder holds, removing its file if it was not finished.
+ *
+ * @param b the builder
+ * @param remove 1 to remove the file
+ * @return no return value
+ */
+static void builder_free(struct sstable_builder *b, int remove)
+{
+    if (b->file)
+    {
+        fclose(b->file);
+        b->file = NULL;
+    }
+    if (remove)
+    {
+        unlink(b->path);
+    }
+    free(b->index_keys);
+    free(b->index_offsets);
+    free(b->hashes);
+}
+
+/**
+ * @brief Finish an SSTable: write its index, bloom filter and footer, sync
+ * it and open it.
+ *
+ * @param t the table
+ * @param b the builder
+ * @return the SSTable, NULL on error
+ */
+static struct sstable *builder_finish(struct lsm_table *t, struct sstable_builder *b)
+{
+    struct sstable_footer footer;
+    struct bloom bloom;
+    unsigned long i;
+    unsigned long long offset;
+    unsigned short key_len;
+    int status = 0;
+
+    memset(&footer, 0, sizeof footer);
+    footer.index_offset = b->offset;
+    footer.num_index = b->num_index;
+    footer.num_records = b->num_records;
+    for (i = 0; i < (unsigned long)b->num_index; i++)
+    {
+        key_len = strlen(b->index_keys[i]);
+        offset = b->index_offsets[i];
+        status |= fwrite(&key_len, 2, 1, b->file) != 1 || fwrite(b->index_keys[i], key_len, 1, b->file) != 1 - (key_len == 0) ||
+                  fwrite(&offset, 8, 1, b->file) != 1;
+        b->offset += 2 + key_len + 8;
+    }
+    key_len = strlen(b->largest);
+    status |= fwrite(&key_len, 2, 1, b->file) != 1 || fwrite(b->largest, key_len, 1, b->file) != 1 - (key_len == 0);
+    b->offset += 2 + key_len;
+
+    if (bloom_init(&bloom, b->num_records, lsm_bloom_fpr) != 0)
+    {
+        builder_free(b, 1);
+        return NULL;
+    }
+    for (i = 0; i < b->num_records; i++)
+    {
+        bloom_add(&bloom, b->hashes[i]);
+    }
+    footer.bloom_offset = b->offset;
+    footer.bloom_bits = bloom.num_bits;
+    footer.bloom_hashes = bloom.num_hashes;
+    footer.magic = LSM_MAGIC;
+    status |= fwrite(bloom.bits, (bloom.num_bits + 7) / 8, 1, b->file) != 1;
+    status |= fwrite(&footer, sizeof footer, 1, b->file) != 1;
+    bloom_free(&bloom);
+    status |= fflush(b->file) != 0 || fdatasync(fileno(b->file)) != 0;
+    if (status)
+    {
+        builder_free(b, 1);
+        return NULL;
+    }
+    builder_free(b, 0);
+    return sstable_open(t, b->number);
+}
+
+/**
+ * @brief Rewrite the manifest of a table.
+ *
+ * @param t the table, locked exclusively
+ * @return 0 on success, -1 on error
+ */
+static int write_manifest(struct lsm_table *t)
+{
+    char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32], tmp_path[MAX_PATH_LEN + MAX_TABLE_LEN + 32];
+    FILE *file = fopen(lsm_path(tmp_path, t, 0, "manifest_tmp"), "w");
+    int level, i, status = 0;
+
+    if (file == NULL)
+    {
+        return -1;
+    }
+    fprintf(file, "next %lu\nlog %lu\n", t->next_number, t->imm ? t->imm->log_number : t->mem->log_number);
+    for (level = 0; level < LSM_LEVELS; level++)
+    {
+        for (i = 0; i < t->num_files[level]; i++)
+        {
+            fprintf(file, "sst %d %lu\n", level, t->files[level][i]->number);
+        }
+    }
+    status |= fflush(file) != 0 || fdatasync(fileno(file)) != 0;
+    status |= fclose(file) != 0;
+    if (status || rename(tmp_path, lsm_path(path, t, 0, "manifest")) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Add an SSTable to a level: at the end of level 0, in key order
+ * in the others.
+ *
+ * @param t the table, locked exclusively
+ * @param level the level
+ * @param sst the SSTable
+ * @return 0 on success, -1 if out of memory
+ */
+static int level_add(struct lsm_table *t, int level, struct sstable *sst)
+{
+    struct sstable **grown;
+    int i;
+
+    if (t->num_files[level] == t->max_files[level])
+    {
+        grown = realloc(t->files[level], (t->max_files[level] * 2 + 8) * sizeof *grown);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        t->files[level] = grown;
+        t->max_files[level] = t->max_files[level] * 2 + 8;
+    }
+    i = t->num_files[level];
+    while (level > 0 && i > 0 && strcmp(t->files[level][i - 1]->smallest, sst->smallest) > 0)
+    {
+        t->files[level][i] = t->files[level][i - 1];
+        i--;
+    }
+    t->files[level][i] = sst;
+    t->num_files[level]++;
+    return 0;
+}
+
+/**
+ * @brief Take an SSTable out of a level.
+ *
+ * @param t the table, locked exclusively
+ * @param level the level
+ * @param sst the SSTable
+ * @return no return value
+ */
+static void level_remove(struct lsm_table *t, int level, struct sstable *sst)
+{
+    int i;
+
+    for (i = 0; i < t->num_files[level]; i++)
+    {
+        if (t->files[level][i] == sst)
+        {
+            memmove(&t->files[level][i], &t->files[level][i + 1], (t->num_files[level] - i - 1) * sizeof sst);
+            t->num_files[level]--;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Find the SSTable of a level past 0 whose range may hold a key.
+ *
+ * @param t the table, locked
+ * @param level the level
+ * @param key the key
+ * @return index of the first SSTable whose largest key is not less than the key
+ */
+static int level_find(const struct lsm_table *t, int level, const char *key)
+{
+    int low = 0, high = t->num_files[level], mid;
+
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (strcmp(t->files[level][mid]->largest, key) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Look a key up in every memtable and SSTable, newest first.
+ *
+ * @param t the table, locked
+ * @param key the key
+ * @param value where to copy the value
+ * @return 1 if the key is in the table, 0 if it is not
+ */
+static int table_find(struct lsm_table *t, const char *key, char value[MAX_VALUE_LEN])
+{
+    struct lsm_node *prev[LSM_SKIPLIST_HEIGHT], *node;
+    struct memtable *mems[2] = { t->mem, t->imm };
+    unsigned int hashes[2];
+    int i, level, deleted;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (mems[i] && (node = memtable_seek(mems[i], key, prev)) != NULL)
+        {
+            if (node->value)
+            {
+                strcpy(value, node->value);
+            }
+            return node->value != NULL;
+        }
+    }
+    bloom_hash(key, hashes);
+    for (i = t->num_files[0] - 1; i >= 0; i--)
+    {
+        if (sstable_get(t->files[0][i], key, hashes, value, &deleted) == 1)
+        {
+            return !deleted;
+        }
+    }
+    for (level = 1; level < LSM_LEVELS; level++)
+    {
+        i = level_find(t, level, key);
+        if (i < t->num_files[level] && sstable_get(t->files[level][i], key, hashes, value, &deleted) == 1)
+        {
+            return !deleted;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Ensure a source has len bytes buffered, moving to the next
+ * SSTable of its run at the end of one.
+ *
+ * @param s the source
+ * @param len bytes wanted
+ * @return 1 if they are there, 0 at the end of the SSTable
+ */
+static int source_fill(struct lsm_source *s, int len)
+{
+    struct sstable *sst = s->files[s->file];
+    ssize_t got;
+
+    if (s->buf_len - s->buf_pos >= len)
+    {
+        return 1;
+    }
+    memmove(s->buf, s->buf + s->buf_pos, s->buf_len - s->buf_pos);
+    s->buf_len -= s->buf_pos;
+    s->buf_pos = 0;
+    while (s->buf_len < len && s->offset < sst->data_len)
+    {
+        got = LSM_READ_BUFFER - s->buf_len;
+        if (got > sst->data_len - s->offset)
+        {
+            got = sst->data_len - s->offset;
+        }
+        got = pread(sst->fd, s->buf + s->buf_len, got, s->offset);
+        if (got <= 0)
+        {
+            return 0;
+        }
+        s->buf_len += got;
+        s->offset += got;
+    }
+    return s->buf_len >= len;
+}
+
+/**
+ * @brief Free the memtable records a source copied.
+ *
+ * @param s the source
+ * @return no return value
+ */
+static void source_free_pairs(struct lsm_source *s)
+{
+    int i;
+
+    for (i = 0; i < s->num_pairs; i++)
+    {
+        free(s->keys[i]);
+        free(s->values[i]);
+    }
+    s->num_pairs = 0;
+    s->pair = 0;
+}
+
+/**
+ * @brief Copy the next records of the memtable of a source.
+ *
+ * The table lock must be held.
+ *
+ * @param s the source
+ * @param from the key to start at
+ * @param after 1 to skip from itself
+ * @return 0 on success, -1 if out of memory
+ */
+static int source_copy_memtable(struct lsm_source *s, const char *from, int after)
+{
+    struct lsm_node *prev[LSM_SKIPLIST_HEIGHT], *node;
+
+    source_free_pairs(s);
+    node = memtable_seek(s->mem, from, prev);
+    node = (node && after) ? node->next[0] : prev[0]->next[0];
+    for (; node && s->num_pairs < LSM_MEMTABLE_CHUNK; node = node->next[0])
+    {
+        s->keys[s->num_pairs] = strdup(node->key);
+        s->values[s->num_pairs] = node->value ? strdup(node->value) : NULL;
+        if (s->keys[s->num_pairs] == NULL || (node->value && s->values[s->num_pairs] == NULL))
+        {
+            free(s->keys[s->num_pairs]);
+            free(s->values[s->num_pairs]);
+            s->more = 0;
+            return -1;
+        }
+        s->num_pairs++;
+    }
+    s->more = node != NULL;
+    return 0;
+}
+
+/**
+ * @brief Move a source to its next record.
+ *
+ * @param s the source
+ * @return no return value
+ */
+static void source_next(struct lsm_source *s)
+{
+    int used;
+
+    s->valid = 0;
+    if (s->mem)
+    {
+        if (s->pair == s->num_pairs && s->more)
+        {
+            // Copy the next records, after the last one read
+            pthread_rwlock_rdlock(s->lock);
+            source_copy_memtable(s, s->key, 1);
+            pthread_rwlock_unlock(s->lock);
+        }
+        if (s->pair < s->num_pairs)
+        {
+            strcpy(s->key, s->keys[s->pair]);
+            strcpy(s->value, s->values[s->pair] ? s->values[s->pair] : "");
+            s->deleted = s->values[s->pair] == NULL;
+            s->pair++;
+            s->valid = 1;
+        }
+        return;
+    }
+    while (s->file < s->num_files)
+    {
+        source_fill(s, LSM_RECORD_MAX);
+        used = decode_record(s->buf + s->buf_pos, s->buf_len - s->buf_pos, s->key, s->value, &s->deleted);
+        if (used > 0)
+        {
+            s->buf_pos += used;
+            s->valid = 1;
+            return;
+        }
+        // End of this SSTable, go on with the next of the run
+        s->file++;
+        s->offset = 0;
+        s->buf_pos = 0;
+        s->buf_len = 0;
+    }
+}
+
+/**
+ * @brief Point a source at a run of SSTables, from the first key not less than a key.
+ *
+ * @param s the source
+ * @param files the SSTables, in key order
+ * @param num_files number of SSTables
+ * @param from the key
+ * @return 0 on success, -1 if out of memory
+ */
+static int source_open_run(struct lsm_source *s, struct sstable **files, int num_files, const char *from)
+{
+    struct sstable *sst;
+    int i;
+
+    memset(s, 0, sizeof *s);
+    s->files = files;
+    s->num_files = num_files;
+    s->buf = malloc(LSM_READ_BUFFER);
+    if (s->buf == NULL)
+    {
+        return -1;
+    }
+    while (s->file < num_files && strcmp(s->files[s->file]->largest, from) < 0)
+    {
+        s->file++;
+    }
+    if (s->file < num_files && from[0] != '\0' && s->files[s->file]->num_index > 0)
+    {
+        // Start at the block of the last indexed key before from
+        sst = s->files[s->file];
+        for (i = 0; i + 1 < sst->num_index && strcmp(sst->index_keys[i + 1], from) <= 0; i++)
+        {
+        }
+        s->offset = sst->index_offsets[i];
+    }
+    do
+    {
+        source_next(s);
+    }
+    while (s->valid && strcmp(s->key, from) < 0);
+    return 0;
+}
+
+/**
+ * @brief Point a source at a memtable from a key on.
+ *
+ * The table lock must be held.
+ *
+ * @param s the source
+ * @param mem the memtable
+ * @param lock the lock of its table
+ * @param from the first key
+ * @return 0 on success, -1 if out of memory
+ */
+static int source_open_memtable(struct lsm_source *s, struct memtable *mem, pthread_rwlock_t *lock, const char *from)
+{
+    memset(s, 0, sizeof *s);
+    __atomic_add_fetch(&mem->refs, 1, __ATOMIC_ACQ_REL);
+    s->mem = mem;
+    s->lock = lock;
+    if (source_copy_memtable(s, from, 0) != 0)
+    {
+        return -1;
+    }
+    source_next(s);
+    return 0;
+}
+
+/**
+ * @brief Free what a source holds.
+ *
+ * @param s the source
+ * @return no return value
+ */
+static void source_free(struct lsm_source *s)
+{
+    source_free_pairs(s);
+    if (s->mem)
+    {
+        memtable_unref(s->mem);
+    }
+    free(s->buf);
+}
+
+/**
+ * @brief Make an iterator with no sources yet.
+ *
+ * @param num_sources most sources it will have
+ * @param num_refs most SSTables it will reference
+ * @return the iterator, NULL if out of memory
+ */
+static struct lsm_iterator *iterator_new(int num_sources, int num_refs)
+{
+    struct lsm_iterator *it = calloc(1, sizeof *it);
+
+    if (it == NULL)
+    {
+        return NULL;
+    }
+    it->sources = calloc(num_sources + 1, sizeof *it->sources);
+    it->refs = calloc(num_refs + 1, sizeof *it->refs);
+    if (it->sources == NULL || it->refs == NULL)
+    {
+        free(it->sources);
+        free(it->refs);
+        free(it);
+        return NULL;
+    }
+    return it;
+}
+
+/**
+ * @brief Add a reference to every SSTable of a run to an iterator.
+ *
+ * @param it the iterator
+ * @param files the SSTables
+ * @param num_files number of SSTables
+ * @return a copy of the run owned by the iterator, NULL if out of memory
+ */
+static struct sstable **iterator_ref(struct lsm_iterator *it, struct sstable **files, int num_files)
+{
+    struct sstable **run = malloc((num_files + 1) * sizeof *run);
+    int i;
+
+    if (run == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < num_files; i++)
+    {
+        __atomic_add_fetch(&files[i]->refs, 1, __ATOMIC_ACQ_REL);
+        it->refs[it->num_refs++] = files[i];
+        run[i] = files[i];
+    }
+    return run;
+}
+
+void lsm_iterator_close(struct lsm_iterator *it)
+{
+    int i;
+
+    if (it == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < it->num_sources; i++)
+    {
+        if (it->sources[i].files)
+        {
+            free(it->sources[i].files);
+        }
+        source_free(&it->sources[i]);
+    }
+    for (i = 0; i < it->num_refs; i++)
+    {
+        sstable_unref(it->refs[i]);
+    }
+    free(it->sources);
+    free(it->refs);
+    free(it);
+}
+
+/**
+ * @brief Read the next key of an iterator, deletes included.
+ *
+ * @param it the iterator
+ * @param key where to copy the key
+ * @param value where to copy the value
+ * @param deleted where to store 1 for a delete
+ * @return 1 if a record was read, 0 at the end
+ */
+static int iterator_next_any(struct lsm_iterator *it, char key[MAX_KEY_LEN], char value[MAX_VALUE_LEN], int *deleted)
+{
+    int i, newest = -1;
+
+    for (i = 0; i < it->num_sources; i++)
+    {
+        if (it->sources[i].valid && (newest == -1 || strcmp(it->sources[i].key, it->sources[newest].key) < 0))
+        {
+            newest = i;
+        }
+    }
+    if (newest == -1)
+    {
+        return 0;
+    }
+
+    // The first source with the smallest key is the newest; older
+    // versions of the key are skipped
+    strcpy(key, it->sources[newest].key);
+    strcpy(value, it->sources[newest].value);
+    *deleted = it->sources[newest].deleted;
+    for (i = newest; i < it->num_sources; i++)
+    {
+        if (it->sources[i].valid && !strcmp(it->sources[i].key, key))
+        {
+            source_next(&it->sources[i]);
+        }
+    }
+    return 1;
+}
+
+int lsm_iterator_next(struct lsm_iterator *it, char key[MAX_KEY_LEN], char value[MAX_VALUE_LEN])
+{
+    int deleted;
+
+    while (iterator_next_any(it, key, value, &deleted))
+    {
+        if (!deleted)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct lsm_iterator *lsm_iterator_open(int table, const char *from)
+{
+    struct lsm_table *t = &lsm_tables[table];
+    struct lsm_iterator *it;
+    struct sstable **run;
+    int i, level, num_refs = 0, status = 0;
+
+    pthread_rwlock_rdlock(&t->lock);
+    for (level = 0; level < LSM_LEVELS; level++)
+    {
+        num_refs += t->num_files[level];
+    }
+    it = iterator_new(2 + t->num_files[0] + LSM_LEVELS, num_refs);
+    if (it == NULL)
+    {
+        pthread_rwlock_unlock(&t->lock);
+        return NULL;
+    }
+    status |= source_open_memtable(&it->sources[it->num_sources++], t->mem, &t->lock, from);
+    if (t->imm)
+    {
+        status |= source_open_memtable(&it->sources[it->num_sources++], t->imm, &t->lock, from);
+    }
+    for (i = t->num_files[0] - 1; i >= 0; i--)
+    {
+        run = iterator_ref(it, &t->files[0][i], 1);
+        status |= run == NULL || source_open_run(&it->sources[it->num_sources++], run, 1, from);
+    }
+    for (level = 1; level < LSM_LEVELS; level++)
+    {
+        if (t->num_files[level] > 0)
+        {
+            run = iterator_ref(it, t->files[level], t->num_files[level]);
+            status |= run == NULL || source_open_run(&it->sources[it->num_sources++], run, t->num_files[level], from);
+        }
+    }
+    pthread_rwlock_unlock(&t->lock);
+    if (status)
+    {
+        lsm_iterator_close(it);
+        return NULL;
+    }
+    return it;
+}
+
+/**
+ * @brief Write the frozen memtable of a table out as a level 0 SSTable.
+ *
+ * @param t the table
+ * @return 1 if there was one, 0 if not, -1 if it could not be written
+ */
+static int flush_memtable(struct lsm_table *t)
+{
+    char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32];
+    struct sstable_builder b;
+    struct sstable *sst = NULL;
+    struct memtable *imm;
+    struct lsm_node *node;
+    unsigned long log, first_log, last_log;
+    int status;
+
+    pthread_rwlock_wrlock(&t->lock);
+    imm = t->imm;
+    status = imm ? builder_start(t, &b) : -1;
+    pthread_rwlock_unlock(&t->lock);
+    if (imm == NULL)
+    {
+        return 0;
+    }
+
+    // Nobody changes a frozen memtable, so it is read unlocked
+    for (node = imm->head.next[0]; node && status == 0; node = node->next[0])
+    {
+        status = builder_add(&b, node->key, node->value);
+    }
+    if (status == 0)
+    {
+        sst = builder_finish(t, &b);
+    }
+    else if (b.file)
+    {
+        builder_free(&b, 1);
+    }
+    if (sst == NULL)
+    {
+        // Try again on the next wake up
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&t->lock);
+    level_add(t, 0, sst);
+    first_log = imm->log_number;
+    last_log = t->mem->log_number;
+    __atomic_store_n(&t->imm, NULL, __ATOMIC_RELEASE);
+    write_manifest(t);
+    pthread_rwlock_unlock(&t->lock);
+
+    // Every log before the memtable's own is now in SSTables
+    for (log = first_log; log < last_log; log++)
+    {
+        unlink(lsm_path(path, t, log, "log"));
+    }
+    memtable_unref(imm);
+
+    pthread_mutex_lock(&t->room_lock);
+    pthread_cond_broadcast(&t->room);
+    pthread_mutex_unlock(&t->room_lock);
+    return 1;
+}
+
+/**
+ * @brief Bytes of the SSTables of a level.
+ *
+ * @param t the table, locked
+ * @param level the level
+ * @return the bytes
+ */
+static off_t level_bytes(const struct lsm_table *t, int level)
+{
+    off_t bytes = 0;
+    int i;
+
+    for (i = 0; i < t->num_files[level]; i++)
+    {
+        bytes += t->files[level][i]->file_bytes;
+    }
+    return bytes;
+}
+
+/**
+ * @brief Add an SSTable to a growing list.
+ *
+ * @param list the list
+ * @param num number of SSTables in it
+ * @param max room in it
+ * @param sst the SSTable
+ * @return 0 on success, -1 if out of memory
+ */
+static int list_add(struct sstable ***list, int *num, int *max, struct sstable *sst)
+{
+    struct sstable **grown;
+
+    if (*num == *max)
+    {
+        grown = realloc(*list, (*max * 2 + 8) * sizeof *grown);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        *list = grown;
+        *max = *max * 2 + 8;
+    }
+    (*list)[(*num)++] = sst;
+    return 0;
+}
+
+/**
+ * @brief Merge SSTables of one level into the next, if a level is too large.
+ *
+ * @param t the table
+ * @return 1 if a merge was done, 0 otherwise
+ */
+static int compact(struct lsm_table *t)
+{
+    struct sstable **inputs[2] = { NULL, NULL }, **outputs = NULL, **run, *sst;
+    int num_inputs[2] = { 0, 0 }, max_inputs[2] = { 0, 0 }, num_outputs = 0, max_outputs = 0;
+    char smallest[MAX_KEY_LEN], largest[MAX_KEY_LEN], key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    struct sstable_builder b;
+    struct lsm_iterator *it = NULL;
+    off_t limit = LSM_LEVEL1_BYTES;
+    int i, level = -1, next, drop_deletes, deleted, status = 0, building = 0;
+
+    // Level 0 by count of SSTables, the others by size
+    pthread_rwlock_rdlock(&t->lock);
+    if (t->num_files[0] >= LSM_L0_FILES)
+    {
+        level = 0;
+    }
+    for (i = 1; level == -1 && i < LSM_LEVELS - 1; i++, limit *= LSM_LEVEL_RATIO)
+    {
+        if (level_bytes(t, i) > limit)
+        {
+            level = i;
+        }
+    }
+    if (level == -1)
+    {
+        pthread_rwlock_unlock(&t->lock);
+        return 0;
+    }
+    next = level + 1;
+    if (level == 0)
+    {
+        for (i = 0; i < t->num_files[0]; i++)
+        {
+            status |= list_add(&inputs[0], &num_inputs[0], &max_inputs[0], t->files[0][i]);
+        }
+    }
+    else
+    {
+        // Take turns through the level
+        for (i = 0; i < t->num_files[level] && strcmp(t->files[level][i]->smallest, t->compact_pointer[level]) <= 0; i++)
+        {
+        }
+        status |= list_add(&inputs[0], &num_inputs[0], &max_inputs[0], t->files[level][i < t->num_files[level] ? i : 0]);
+    }
+    if (status)
+    {
+        pthread_rwlock_unlock(&t->lock);
+        free(inputs[0]);
+        return 0;
+    }
+    if (level > 0)
+    {
+        strcpy(t->compact_pointer[level], inputs[0][0]->smallest);
+    }
+    strcpy(smallest, inputs[0][0]->smallest);
+    strcpy(largest, inputs[0][0]->largest);
+    for (i = 1; i < num_inputs[0]; i++)
+    {
+        if (strcmp(inputs[0][i]->smallest, smallest) < 0)
+        {
+            strcpy(smallest, inputs[0][i]->smallest);
+        }
+        if (strcmp(inputs[0][i]->largest, largest) > 0)
+        {
+            strcpy(largest, inputs[0][i]->largest);
+        }
+    }
+    for (i = 0; i < t->num_files[next]; i++)
+    {
+        if (strcmp(t->files[next][i]->largest, smallest) >= 0 && strcmp(t->files[next][i]->smallest, largest) <= 0)
+        {
+            status |= list_add(&inputs[1], &num_inputs[1], &max_inputs[1], t->files[next][i]);
+        }
+    }
+
+    // A delete can go once nothing older than the merge may hold its key
+    drop_deletes = 1;
+    for (i = next + 1; i < LSM_LEVELS; i++)
+    {
+        drop_deletes &= t->num_files[i] == 0;
+    }
+
+    // Level 0 SSTables overlap, so each is its own source, newest first
+    it = status ? NULL : iterator_new(num_inputs[0] + 1, num_inputs[0] + num_inputs[1]);
+    for (i = num_inputs[0] - 1; it && i >= 0; i--)
+    {
+        run = iterator_ref(it, &inputs[0][i], 1);
+        status |= run == NULL || source_open_run(&it->sources[it->num_sources++], run, 1, "");
+    }
+    if (it && num_inputs[1] > 0)
+    {
+        run = iterator_ref(it, inputs[1], num_inputs[1]);
+        status |= run == NULL || source_open_run(&it->sources[it->num_sources++], run, num_inputs[1], "");
+    }
+    pthread_rwlock_unlock(&t->lock);
+    if (it == NULL)
+    {
+        status = -1;
+    }
+
+    while (status == 0 && iterator_next_any(it, key, value, &deleted))
+    {
+        if (deleted && drop_deletes)
+        {
+            continue;
+        }
+        if (!building)
+        {
+            pthread_rwlock_wrlock(&t->lock);
+            status = builder_start(t, &b);
+            pthread_rwlock_unlock(&t->lock);
+            building = status == 0;
+        }
+        if (status == 0)
+        {
+            status = builder_add(&b, key, deleted ? NULL : value);
+        }
+        if (status == 0 && b.offset >= LSM_FILE_BYTES)
+        {
+            building = 0;
+            sst = builder_finish(t, &b);
+            status = sst == NULL || list_add(&outputs, &num_outputs, &max_outputs, sst);
+        }
+    }
+    if (status == 0 && building)
+    {
+        sst = builder_finish(t, &b);
+        status = sst == NULL || list_add(&outputs, &num_outputs, &max_outputs, sst);
+    }
+    else if (building)
+    {
+        builder_free(&b, 1);
+    }
+    lsm_iterator_close(it);
+
+    if (status == 0)
+    {
+        pthread_rwlock_wrlock(&t->lock);
+        for (i = 0; i < num_inputs[0]; i++)
+        {
+            level_remove(t, level, inputs[0][i]);
+        }
+        for (i = 0; i < num_inputs[1]; i++)
+        {
+            level_remove(t, next, inputs[1][i]);
+        }
+        for (i = 0; i < num_outputs; i++)
+        {
+            level_add(t, next, outputs[i]);
+        }
+        write_manifest(t);
+        pthread_rwlock_unlock(&t->lock);
+
+        // Iterators still reading the inputs keep them until they are done
+        for (i = 0; i < num_inputs[0] + num_inputs[1]; i++)
+        {
+            sst = i < num_inputs[0] ? inputs[0][i] : inputs[1][i - num_inputs[0]];
+            sst->obsolete = 1;
+            sstable_unref(sst);
+        }
+    }
+    else
+    {
+        for (i = 0; i < num_outputs; i++)
+        {
+            outputs[i]->obsolete = 1;
+            sstable_unref(outputs[i]);
+        }
+    }
+    free(inputs[0]);
+    free(inputs[1]);
+    free(outputs);
+    return status == 0;
+}
+
+/**
+ * @brief Write out frozen memtables and merge SSTables whenever woken.
+ *
+ * @param arg unused
+ * @return never returns
+ */
+static void *background_thread(void *arg)
+{
+    struct lsm_table *t;
+    int i, done, status;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&work_lock);
+        while (!work_pending)
+        {
+            pthread_cond_wait(&work_ready, &work_lock);
+        }
+        work_pending = 0;
+        pthread_mutex_unlock(&work_lock);
+
+        // A flush and a merge of one table may run at once, never two of either
+        do
+        {
+            done = 0;
+            for (i = 0; i < MAX_TABLES; i++)
+            {
+                t = &lsm_tables[i];
+                if (!__atomic_load_n(&t->opened, __ATOMIC_ACQUIRE))
+                {
+                    continue;
+                }
+                if (!__atomic_exchange_n(&t->flushing, 1, __ATOMIC_ACQ_REL))
+                {
+                    status = flush_memtable(t);
+                    __atomic_store_n(&t->flushing, 0, __ATOMIC_RELEASE);
+                    if (status == -1)
+                    {
+                        // Tell waiting writers only now, so that the retry
+                        // they ask for finds flushing clear
+                        pthread_mutex_lock(&t->room_lock);
+                        t->flush_failures++;
+                        pthread_cond_broadcast(&t->room);
+                        pthread_mutex_unlock(&t->room_lock);
+                    }
+                    done |= status == 1;
+                }
+                if (!__atomic_exchange_n(&t->compacting, 1, __ATOMIC_ACQ_REL))
+                {
+                    done |= compact(t);
+                    __atomic_store_n(&t->compacting, 0, __ATOMIC_RELEASE);
+                }
+            }
+        }
+        while (done);
+    }
+    return arg;
+}
+
+int lsm_init(const char *directory, int sync_always, double bloom_fpr)
+{
+    pthread_t thread;
+    int i;
+
+    snprintf(lsm_directory, sizeof lsm_directory, "%s", directory);
+    lsm_sync_always = sync_always;
+    lsm_bloom_fpr = bloom_fpr;
+    for (i = 0; i < LSM_BACKGROUND_THREADS; i++)
+    {
+        if (pthread_create(&thread, NULL, background_thread, NULL) != 0)
+        {
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+/**
+ * @brief Replay a log into the memtable.
+ *
+ * A record cut short by a crash at the end of the log is dropped.
+ *
+ * @param t the table
+ * @param number number of the log
+ * @return no return value
+ */
+static void replay_log(struct lsm_table *t, unsigned long number)
+{
+    char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32], key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    char *buf;
+    int fd, used, deleted;
+    off_t len, pos = 0;
+
+    fd = open(lsm_path(path, t, number, "log"), O_RDONLY);
+    if (fd == -1)
+    {
+        return;
+    }
+    len = lseek(fd, 0, SEEK_END);
+    buf = malloc(len + 1);
+    if (buf && pread(fd, buf, len, 0) == len)
+    {
+        while ((used = decode_record(buf + pos, len - pos, key, value, &deleted)) > 0)
+        {
+            memtable_put(t->mem, key, deleted ? NULL : value);
+            pos += used;
+        }
+    }
+    free(buf);
+    close(fd);
+}
+
+int lsm_open(int table, const char *name)
+{
+    struct lsm_table *t = &lsm_tables[table];
+    char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32], line[64];
+    struct sstable *sst;
+    unsigned long number, first_log = 1;
+    int level;
+    FILE *manifest;
+
+    memset(t, 0, sizeof *t);
+    snprintf(t->name, sizeof t->name, "%s", name);
+    pthread_rwlock_init(&t->lock, NULL);
+    pthread_mutex_init(&t->room_lock, NULL);
+    pthread_cond_init(&t->room, NULL);
+    t->next_number = 1;
+
+    manifest = fopen(lsm_path(path, t, 0, "manifest"), "r");
+    while (manifest && fgets(line, sizeof line, manifest))
+    {
+        if (sscanf(line, "next %lu", &number) == 1)
+        {
+            t->next_number = number;
+        }
+        else if (sscanf(line, "log %lu", &number) == 1)
+        {
+            first_log = number;
+        }
+        else if (sscanf(line, "sst %d %lu", &level, &number) == 2 && level >= 0 && level < LSM_LEVELS)
+        {
+            sst = sstable_open(t, number);
+            if (sst == NULL || level_add(t, level, sst) != 0)
+            {
+                fclose(manifest);
+                return -1;
+            }
+        }
+    }
+    if (manifest)
+    {
+        fclose(manifest);
+    }
+
+    // Logs not yet in SSTables all go back into the memtable, which keeps
+    // them until it is written out
+    t->mem = memtable_new(first_log);
+    if (t->mem == NULL)
+    {
+        return -1;
+    }
+    for (number = first_log; number < t->next_number; number++)
+    {
+        replay_log(t, number);
+    }
+    number = t->next_number++;
+    t->log_fd = open(lsm_path(path, t, number, "log"), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (t->log_fd == -1 || write_manifest(t) != 0)
+    {
+        return -1;
+    }
+    // Tables are opened while the background thread runs
+    __atomic_store_n(&t->opened, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Freeze a full memtable and start a new one, with a new log.
+ *
+ * @param t the table, locked exclusively
+ * @return no return value
+ */
+static void maybe_freeze(struct lsm_table *t)
+{
+    char path[MAX_PATH_LEN + MAX_TABLE_LEN + 32];
+    struct memtable *mem;
+    int fd;
+
+    if (t->mem->bytes < LSM_MEMTABLE_BYTES || t->imm != NULL)
+    {
+        return;
+    }
+    fd = open(lsm_path(path, t, t->next_number, "log"), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    mem = fd == -1 ? NULL : memtable_new(t->next_number);
+    if (mem == NULL)
+    {
+        // Keep writing to this memtable and try again on the next write
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return;
+    }
+    t->next_number++;
+    close(t->log_fd);
+    t->log_fd = fd;
+    __atomic_store_n(&t->imm, t->mem, __ATOMIC_RELEASE);
+    t->mem = mem;
+    write_manifest(t);
+    wake_background();
+}
+
+/**
+ * @brief Log a write and apply it to the memtable.
+ *
+ * Writers wait while both memtables are full, and give up after
+ * LSM_FLUSH_RETRIES failed write outs of the frozen one.
+ *
+ * @param t the table
+ * @param key the key
+ * @param value the value, NULL for a delete
+ * @param must_exist 1 to do nothing, returning 1, if the key is not in the table
+ * @return 0 on success, 1 if must_exist and the key is not there, -1 on error
+ */
+static int table_write(struct lsm_table *t, const char *key, const char *value, int must_exist)
+{
+    char record[LSM_RECORD_MAX], old_value[MAX_VALUE_LEN];
+    unsigned long failures;
+    int len, status = 0, retries = 0;
+
+    for (;;)
+    {
+        pthread_rwlock_wrlock(&t->lock);
+        if (t->mem->bytes < LSM_MEMTABLE_BYTES || t->imm == NULL)
+        {
+            break;
+        }
+        pthread_rwlock_unlock(&t->lock);
+        if (retries == LSM_FLUSH_RETRIES)
+        {
+            return -1;
+        }
+
+        // Also retries a flush that failed
+        pthread_mutex_lock(&t->room_lock);
+        failures = t->flush_failures;
+        wake_background();
+        while (__atomic_load_n(&t->imm, __ATOMIC_ACQUIRE) != NULL && t->flush_failures == failures)
+        {
+            pthread_cond_wait(&t->room, &t->room_lock);
+        }
+        if (t->flush_failures != failures)
+        {
+            retries++;
+        }
+        pthread_mutex_unlock(&t->room_lock);
+    }
+    if (must_exist && !table_find(t, key, old_value))
+    {
+        status = 1;
+    }
+    else
+    {
+        len = encode_record(record, key, value);
+        if (write_all(t->log_fd, record, len) != 0 || (lsm_sync_always && fdatasync(t->log_fd) != 0) ||
+            memtable_put(t->mem, key, value) != 0)
+        {
+            status = -1;
+        }
+        maybe_freeze(t);
+    }
+    pthread_rwlock_unlock(&t->lock);
+    return status;
+}
+
+int lsm_get(int table, const char *key, char value[MAX_VALUE_LEN])
+{
+    struct lsm_table *t = &lsm_tables[table];
+    int found;
+
+    pthread_rwlock_rdlock(&t->lock);
+    found = table_find(t, key, value);
+    pthread_rwlock_unlock(&t->lock);
+    return found ? 0 : -1;
+}
+
+int lsm_set(int table, const char *key, const char *value)
+{
+    return table_write(&lsm_tables[table], key, value, 0);
+}
+
+int lsm_delete(int table, const char *key)
+{
+    return table_write(&lsm_tables[table], key, NULL, 1);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @brief This file declares the LSM tree storage engine, used for every
+ * table when storage_policy is lsm.
+ *
+ * Writes go to a log and a skiplist in memory, the memtable. A full
+ * memtable is frozen and written out by a background thread as an
+ * SSTable: an immutable file of records sorted by key, with a sparse
+ * index of every LSM_INDEX_INTERVAL-th key and a bloom filter, both kept
+ * in memory. New SSTables go to level 0; background threads merge them
+ * into level 1, and a level that grows past its size into the next,
+ * where SSTables never overlap. Which SSTables make up a table is kept in
+ * its manifest, rewritten on every change.
+ *
+ * A lookup checks the memtables, then level 0 newest first, then one
+ * SSTable per level; the bloom filters skip most SSTables without a read,
+ * and the sparse index narrows the rest to one block. A delete writes a
+ * marker that hides older versions until a merge into the last level
+ * drops both.
+ */
+
+#ifndef LSM_H
+#define LSM_H
+
+#include "utils.h"
+
+#define LSM_LEVELS 4	///< Levels of SSTables.
+#define LSM_MEMTABLE_BYTES (4 << 20)	///< Memtable size at which it is written out.
+#define LSM_L0_FILES 4	///< SSTables in level 0 that start a merge into level 1.
+#define LSM_LEVEL1_BYTES (16 << 20)	///< Size of level 1; every level after it is LSM_LEVEL_RATIO times larger.
+#define LSM_LEVEL_RATIO 10	///< Growth from one level to the next.
+#define LSM_FILE_BYTES (4 << 20)	///< Size at which a merge starts a new SSTable.
+#define LSM_INDEX_INTERVAL 16	///< Records between two keys of the sparse index.
+#define LSM_SKIPLIST_HEIGHT 16	///< Max height of a memtable node.
+#define LSM_BACKGROUND_THREADS 2	///< Threads writing out memtables and merging SSTables.
+#define LSM_FLUSH_RETRIES 3	///< Failed write outs of a full memtable before a writer gives up.
+
+struct lsm_iterator;
+
+/**
+ * @brief Start the background threads.
+ *
+ * Call it once, before any table is opened.
+ *
+ * @param directory Data directory, with a trailing '/'.
+ * @param sync_always 1 to sync the log after every write.
+ * @param bloom_fpr False positive rate of the bloom filters of new SSTables.
+ * @return Return 0 on success, -1 if the threads cannot be started.
+ */
+int lsm_init(const char *directory, int sync_always, double bloom_fpr);
+
+/**
+ * @brief Open a table, reading its SSTables and replaying its log.
+ *
+ * @param table Table index.
+ * @param name Table name.
+ * @return Return 0 on success, -1 if its files cannot be read or created.
+ */
+int lsm_open(int table, const char *name);
+
+/**
+ * @brief Read the value of a key.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param value Where to copy the value.
+ * @return Return 0 on success, -1 if the key is not in the table.
+ */
+int lsm_get(int table, const char *key, char value[MAX_VALUE_LEN]);
+
+/**
+ * @brief Insert or update a record.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param value The value.
+ * @return Return 0 on success, -1 if the write could not be logged or
+ * both memtables are full and cannot be written out.
+ */
+int lsm_set(int table, const char *key, const char *value);
+
+/**
+ * @brief Delete a record.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @return Return 0 on success, 1 if the key is not in the table, -1 if
+ * the delete could not be logged or both memtables are full and cannot
+ * be written out.
+ */
+int lsm_delete(int table, const char *key);
+
+/**
+ * @brief Start reading the records of a table in key order.
+ *
+ * The iterator sees the SSTables of the table as they were when it was
+ * opened; writes to the memtables made since may or may not be seen.
+ *
+ * @param table Table index.
+ * @param from First key to read, "" to start at the first key.
+ * @return Return the iterator, NULL if out of memory.
+ */
+struct lsm_iterator *lsm_iterator_open(int table, const char *from);
+
+/**
+ * @brief Read the next record of an iterator.
+ *
+ * @param it The iterator.
+ * @param key Where to copy the key.
+ * @param value Where to copy the value.
+ * @return Return 1 if a record was read, 0 at the end of the table.
+ */
+int lsm_iterator_next(struct lsm_iterator *it, char key[MAX_KEY_LEN], char value[MAX_VALUE_LEN]);
+
+/**
+ * @brief Free an iterator.
+ *
+ * @param it The iterator.
+ */
+void lsm_iterator_close(struct lsm_iterator *it);
+
+#endif
@@ -1,7 +1,10 @@
 %{
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "utils.h"
+#include "lockscheme.h"
+#include "disklog.h"
 
 int colnum=0;
 int m;
@@ -13,6 +16,17 @@ extern int passwordcount;
 extern int tablecount;
 extern int storagepolicycount;
 extern int datadirectorycount;
+extern int queryworkerscount;
+extern int parallelscanthresholdcount;
+extern int lockschemecount;
+extern int lockstripescount;
+extern int partitionworkerscount;
+extern int querycachebytescount;
+extern int fsyncpolicycount;
+extern int snapshotintervalcount;
+extern int bufferpoolbytescount;
+extern int bloomfprcount;
+extern int servewhileloadingcount;
 extern struct config_params paramslex;
 
 
@@ -43,8 +57,18 @@ int intVal;
 
 
 %token HOSTTOK PORTTOK USERNAMETOK PASSWORDTOK TABLETOK DASH END_OF_FILE
-%token STORAGEPOLICYTOK DATADIRECTORYTOK INMEMORYTOK ONDISKTOK CONCURRENCYTOK
-%token COMMA COLON NEWLINE INTTOK CHARTOK CBRACKET
+%token STORAGEPOLICYTOK DATADIRECTORYTOK INMEMORYTOK ONDISKTOK LSMTOK BTREETOK CONCURRENCYTOK
+%token COMMA COLON NEWLINE INTTOK FLOATTOK CHARTOK CBRACKET
+%token QUERYWORKERSTOK PARALLELSCANTHRESHOLDTOK
+%token LOCKSCHEMETOK LOCKSTRIPESTOK PERROWTOK PERSTRIPETOK PERTABLETOK
+%token PARTITIONWORKERSTOK
+%token QUERYCACHEBYTESTOK
+%token FSYNCPOLICYTOK ALWAYSTOK OSTOK
+%token SNAPSHOTINTERVALTOK
+%token BUFFERPOOLBYTESTOK
+%token BLOOMFPRTOK
+%token SERVEWHILELOADINGTOK
+%token <intVal> EVERYMSTOK
 %token <stringVal> STRING
 %token <intVal> INTEGERTOK
 %token <passwordVal> PASSWORD
@@ -73,11 +97,26 @@ paramslex.storage_policy=1;
 storagepolicycount=storagepolicycount+1;
 }
 |
+STORAGEPOLICYTOK LSMTOK {
+paramslex.storage_policy=STORAGE_POLICY_LSM;
+storagepolicycount=storagepolicycount+1;
+}
+|
+STORAGEPOLICYTOK BTREETOK {
+paramslex.storage_policy=STORAGE_POLICY_BTREE;
+storagepolicycount=storagepolicycount+1;
+}
+|
 DATADIRECTORYTOK DATA {
 strncpy(paramslex.data_directory, $2, sizeof paramslex.data_directory);
 datadirectorycount=datadirectorycount+1;
 }
 |
+DATADIRECTORYTOK PASSWORD {
+strncpy(paramslex.data_directory, $2, sizeof paramslex.data_directory);
+datadirectorycount=datadirectorycount+1;
+}
+|
 STORAGEPOLICYTOK INMEMORYTOK END_OF_FILE {
 paramslex.storage_policy=0; 
 storagepolicycount=storagepolicycount+1;
@@ -90,12 +129,30 @@ storagepolicycount=storagepolicycount+1;
 return;
 }
 |
+STORAGEPOLICYTOK LSMTOK END_OF_FILE {
+paramslex.storage_policy=STORAGE_POLICY_LSM;
+storagepolicycount=storagepolicycount+1;
+return;
+}
+|
+STORAGEPOLICYTOK BTREETOK END_OF_FILE {
+paramslex.storage_policy=STORAGE_POLICY_BTREE;
+storagepolicycount=storagepolicycount+1;
+return;
+}
+|
 DATADIRECTORYTOK DATA END_OF_FILE {
 strncpy(paramslex.data_directory, $2, sizeof paramslex.data_directory);
 datadirectorycount=datadirectorycount+1;
 return;
 }
 |
+DATADIRECTORYTOK PASSWORD END_OF_FILE {
+strncpy(paramslex.data_directory, $2, sizeof paramslex.data_directory);
+datadirectorycount=datadirectorycount+1;
+return;
+}
+|
 HOSTTOK STRING { 
 strncpy(paramslex.server_host, $2, sizeof paramslex.server_host);
 server_hostcount=server_hostcount+1; }
@@ -121,6 +178,173 @@ paramslex.concurrency = $2;
 return;
 }
 |
+QUERYWORKERSTOK INTEGERTOK {
+paramslex.query_workers = $2;
+queryworkerscount=queryworkerscount+1;
+}
+|
+QUERYWORKERSTOK INTEGERTOK END_OF_FILE {
+paramslex.query_workers = $2;
+queryworkerscount=queryworkerscount+1;
+return;
+}
+|
+PARALLELSCANTHRESHOLDTOK INTEGERTOK {
+paramslex.parallel_scan_threshold = $2;
+parallelscanthresholdcount=parallelscanthresholdcount+1;
+}
+|
+PARALLELSCANTHRESHOLDTOK INTEGERTOK END_OF_FILE {
+paramslex.parallel_scan_threshold = $2;
+parallelscanthresholdcount=parallelscanthresholdcount+1;
+return;
+}
+|
+LOCKSCHEMETOK PERROWTOK {
+paramslex.lock_scheme = LOCK_SCHEME_ROW;
+lockschemecount=lockschemecount+1;
+}
+|
+LOCKSCHEMETOK PERROWTOK END_OF_FILE {
+paramslex.lock_scheme = LOCK_SCHEME_ROW;
+lockschemecount=lockschemecount+1;
+return;
+}
+|
+LOCKSCHEMETOK PERSTRIPETOK {
+paramslex.lock_scheme = LOCK_SCHEME_STRIPED;
+lockschemecount=lockschemecount+1;
+}
+|
+LOCKSCHEMETOK PERSTRIPETOK END_OF_FILE {
+paramslex.lock_scheme = LOCK_SCHEME_STRIPED;
+lockschemecount=lockschemecount+1;
+return;
+}
+|
+LOCKSCHEMETOK PERTABLETOK {
+paramslex.lock_scheme = LOCK_SCHEME_TABLE;
+lockschemecount=lockschemecount+1;
+}
+|
+LOCKSCHEMETOK PERTABLETOK END_OF_FILE {
+paramslex.lock_scheme = LOCK_SCHEME_TABLE;
+lockschemecount=lockschemecount+1;
+return;
+}
+|
+LOCKSTRIPESTOK INTEGERTOK {
+paramslex.lock_stripes = $2;
+lockstripescount=lockstripescount+1;
+}
+|
+LOCKSTRIPESTOK INTEGERTOK END_OF_FILE {
+paramslex.lock_stripes = $2;
+lockstripescount=lockstripescount+1;
+return;
+}
+|
+PARTITIONWORKERSTOK INTEGERTOK {
+paramslex.partition_workers = $2;
+partitionworkerscount=partitionworkerscount+1;
+}
+|
+PARTITIONWORKERSTOK INTEGERTOK END_OF_FILE {
+paramslex.partition_workers = $2;
+partitionworkerscount=partitionworkerscount+1;
+return;
+}
+|
+QUERYCACHEBYTESTOK INTEGERTOK {
+paramslex.query_cache_bytes = $2;
+querycachebytescount=querycachebytescount+1;
+}
+|
+QUERYCACHEBYTESTOK INTEGERTOK END_OF_FILE {
+paramslex.query_cache_bytes = $2;
+querycachebytescount=querycachebytescount+1;
+return;
+}
+|
+FSYNCPOLICYTOK ALWAYSTOK {
+paramslex.fsync_policy = DISK_LOG_SYNC_ALWAYS;
+fsyncpolicycount=fsyncpolicycount+1;
+}
+|
+FSYNCPOLICYTOK ALWAYSTOK END_OF_FILE {
+paramslex.fsync_policy = DISK_LOG_SYNC_ALWAYS;
+fsyncpolicycount=fsyncpolicycount+1;
+return;
+}
+|
+FSYNCPOLICYTOK EVERYMSTOK {
+paramslex.fsync_policy = DISK_LOG_SYNC_PERIODIC;
+paramslex.fsync_interval_ms = $2;
+fsyncpolicycount=fsyncpolicycount+1;
+}
+|
+FSYNCPOLICYTOK EVERYMSTOK END_OF_FILE {
+paramslex.fsync_policy = DISK_LOG_SYNC_PERIODIC;
+paramslex.fsync_interval_ms = $2;
+fsyncpolicycount=fsyncpolicycount+1;
+return;
+}
+|
+FSYNCPOLICYTOK OSTOK {
+paramslex.fsync_policy = DISK_LOG_SYNC_OS;
+fsyncpolicycount=fsyncpolicycount+1;
+}
+|
+FSYNCPOLICYTOK OSTOK END_OF_FILE {
+paramslex.fsync_policy = DISK_LOG_SYNC_OS;
+fsyncpolicycount=fsyncpolicycount+1;
+return;
+}
+|
+SNAPSHOTINTERVALTOK INTEGERTOK {
+paramslex.snapshot_interval = $2;
+snapshotintervalcount=snapshotintervalcount+1;
+}
+|
+SNAPSHOTINTERVALTOK INTEGERTOK END_OF_FILE {
+paramslex.snapshot_interval = $2;
+snapshotintervalcount=snapshotintervalcount+1;
+return;
+}
+|
+BUFFERPOOLBYTESTOK INTEGERTOK {
+paramslex.buffer_pool_bytes = $2;
+bufferpoolbytescount=bufferpoolbytescount+1;
+}
+|
+BUFFERPOOLBYTESTOK INTEGERTOK END_OF_FILE {
+paramslex.buffer_pool_bytes = $2;
+bufferpoolbytescount=bufferpoolbytescount+1;
+return;
+}
+|
+BLOOMFPRTOK PASSWORD {
+paramslex.bloom_fpr = atof($2);
+bloomfprcount=bloomfprcount+1;
+}
+|
+BLOOMFPRTOK PASSWORD END_OF_FILE {
+paramslex.bloom_fpr = atof($2);
+bloomfprcount=bloomfprcount+1;
+return;
+}
+|
+SERVEWHILELOADINGTOK INTEGERTOK {
+paramslex.serve_while_loading = $2;
+servewhileloadingcount=servewhileloadingcount+1;
+}
+|
+SERVEWHILELOADINGTOK INTEGERTOK END_OF_FILE {
+paramslex.serve_while_loading = $2;
+servewhileloadingcount=servewhileloadingcount+1;
+return;
+}
+|
 PASSWORDTOK PASSWORD { 
 strncpy(paramslex.password, $2, sizeof paramslex.password); 
 passwordcount=passwordcount+1; }
@@ -227,6 +451,19 @@ while($1[m]!='\0'){
 }
  }
 |
+STRING COLON FLOATTOK { 
+strncpy(paramslex.mycolumns[tablecount][colnum], $1 , sizeof paramslex.mycolumns[tablecount][colnum]);
+sprintf (paramslex.column_types[tablecount][colnum], "float");
+colnum=colnum+1;
+m=0;
+while($1[m]!='\0'){
+ m=m+1;
+ if(m==20){
+  error_occurred=1;
+  }
+}
+ }
+|
 STRING COLON CHARTOK INTEGERTOK CBRACKET { 
 strncpy(paramslex.mycolumns[tablecount][colnum], $1 , sizeof paramslex.mycolumns[tablecount][colnum]);
 snprintf(paramslex.column_types[tablecount][colnum], sizeof paramslex.column_types[tablecount][colnum], "char[%d]\n",$4 );
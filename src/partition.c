@@ -0,0 +1,204 @@
+/**
+ * @file
+ * @brief This file implements the partitioned execution mode declared in
+ * partition.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "partition.h"
+
+/**
+ * @brief One connection's channels to the owners.
+ */
+struct partition_client {
+	/// Ring i carries this connection's calls to owner i.
+	struct partition_ring rings[MAX_PARTITION_OWNERS];
+
+	/// Posted by an owner when the connection's call has returned.
+	sem_t done;
+
+	/// Set while a connection holds this slot.
+	int in_use;
+};
+
+/**
+ * @brief An owner thread.
+ */
+struct partition_owner {
+	/// The thread itself.
+	pthread_t thread;
+
+	/// Index of the owner, which is also the ring it reads in each client.
+	int id;
+
+	/// Set by the owner before it blocks on wakeup.
+	int sleeping;
+
+	/// Posted by a producer that finds the owner asleep.
+	sem_t wakeup;
+} __attribute__((aligned(64)));
+
+static struct partition_owner owners[MAX_PARTITION_OWNERS];
+static int num_owners;
+
+/// Clients are never freed, so an owner may keep polling a slot that is being released.
+static struct partition_client clients[MAX_PARTITION_CLIENTS];
+
+/// One past the highest client slot ever used.
+static int num_client_slots;
+
+/**
+ * @brief Run every call waiting for an owner, once around all clients.
+ *
+ * @param owner the owner polling
+ * @return the number of calls run
+ */
+static int partition_poll(struct partition_owner *owner)
+{
+    struct partition_ring *ring;
+    struct partition_call *call;
+    int i, ran = 0, slots = __atomic_load_n(&num_client_slots, __ATOMIC_ACQUIRE);
+    unsigned int head;
+
+    for (i = 0; i < slots; i++)
+    {
+        ring = &clients[i].rings[owner->id];
+        head = ring->head;
+        while (head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+        {
+            call = ring->calls[head & (PARTITION_RING_SIZE - 1)];
+            __atomic_store_n(&ring->head, ++head, __ATOMIC_RELEASE);
+            call->fn(call->arg);
+            sem_post(&clients[i].done);
+            ran++;
+        }
+    }
+    return ran;
+}
+
+/**
+ * @brief Main loop of an owner: pin to a core, then serve calls forever.
+ *
+ * @param arg the owner's struct partition_owner
+ * @return never returns
+ */
+static void *partition_owner_main(void *arg)
+{
+    struct partition_owner *owner = arg;
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpus;
+
+    if (num_cores > 0)
+    {
+        CPU_ZERO(&cpus);
+        CPU_SET(owner->id % num_cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+    }
+
+    while (1)
+    {
+        if (partition_poll(owner) > 0)
+        {
+            continue;
+        }
+        // Announce the nap, then look once more so a call pushed in
+        // between is not left waiting for the next one
+        __atomic_store_n(&owner->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (partition_poll(owner) > 0)
+        {
+            __atomic_store_n(&owner->sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        sem_wait(&owner->wakeup);
+    }
+    return NULL;
+}
+
+int partition_init(int count)
+{
+    int i;
+
+    if (count > MAX_PARTITION_OWNERS)
+    {
+        count = MAX_PARTITION_OWNERS;
+    }
+    for (i = 0; i < MAX_PARTITION_CLIENTS; i++)
+    {
+        sem_init(&clients[i].done, 0, 0);
+    }
+    for (i = 0; i < count; i++)
+    {
+        owners[i].id = i;
+        owners[i].sleeping = 0;
+        sem_init(&owners[i].wakeup, 0, 0);
+        if (pthread_create(&owners[i].thread, NULL, partition_owner_main, &owners[i]) != 0)
+        {
+            return -1;
+        }
+        pthread_detach(owners[i].thread);
+        num_owners++;
+    }
+    return 0;
+}
+
+int partition_owner_of(int table)
+{
+    return table % num_owners;
+}
+
+struct partition_client *partition_client_open(void)
+{
+    int i, slots;
+
+    for (i = 0; i < MAX_PARTITION_CLIENTS; i++)
+    {
+        if (__atomic_exchange_n(&clients[i].in_use, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            // Let the owners start polling this slot
+            slots = __atomic_load_n(&num_client_slots, __ATOMIC_RELAXED);
+            while (slots <= i && !__atomic_compare_exchange_n(&num_client_slots, &slots, i + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            {
+            }
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+void partition_client_close(struct partition_client *client)
+{
+    __atomic_store_n(&client->in_use, 0, __ATOMIC_RELEASE);
+}
+
+void partition_call(struct partition_client *client, int table, void (*fn)(void *), void *arg)
+{
+    struct partition_owner *owner = &owners[partition_owner_of(table)];
+    struct partition_ring *ring = &client->rings[owner->id];
+    struct partition_call call;
+    unsigned int tail = ring->tail;
+
+    call.fn = fn;
+    call.arg = arg;
+
+    // A connection has one call in flight, so the ring never fills up
+    ring->calls[tail & (PARTITION_RING_SIZE - 1)] = &call;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&owner->sleeping, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&owner->sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+        sem_post(&owner->wakeup);
+    }
+
+    while (sem_wait(&client->done) != 0)
+    {
+        // interrupted by a signal
+    }
+}
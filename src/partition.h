@@ -0,0 +1,95 @@
+/**
+ * @file
+ * @brief This file declares the partitioned (shared-nothing) execution
+ * mode of the storage server.
+ *
+ * Every table is owned by exactly one owner thread, pinned to a core.
+ * Connection threads do not touch table data themselves; they hand each
+ * operation to the owner of its table through a single-producer,
+ * single-consumer ring and wait for it to complete. Since an owner is
+ * the only thread that ever runs operations on its tables, those
+ * operations need no locks.
+ */
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#define MAX_PARTITION_OWNERS 32	///< Max owner threads.
+#define MAX_PARTITION_CLIENTS 256	///< Max connections registered at once.
+#define PARTITION_RING_SIZE 4	///< Entries per ring, a power of two.
+
+/**
+ * @brief An operation handed to an owner.
+ */
+struct partition_call {
+	/// Function the owner runs.
+	void (*fn)(void *);
+
+	/// Argument passed to fn.
+	void *arg;
+};
+
+/**
+ * @brief A single-producer, single-consumer ring of calls.
+ *
+ * The producer only writes tail and the consumer only writes head, each
+ * on a cache line of its own.
+ */
+struct partition_ring {
+	/// Next entry the consumer reads.
+	unsigned int head __attribute__((aligned(64)));
+
+	/// Next entry the producer writes.
+	unsigned int tail __attribute__((aligned(64)));
+
+	/// The entries.
+	struct partition_call *calls[PARTITION_RING_SIZE];
+};
+
+/**
+ * @brief One connection's channels to the owners.
+ */
+struct partition_client;
+
+/**
+ * @brief Start the owner threads, pinning owner i to core i.
+ *
+ * @param num_owners Number of owners (capped at MAX_PARTITION_OWNERS).
+ * @return Return 0 on success, -1 otherwise.
+ */
+int partition_init(int num_owners);
+
+/**
+ * @brief Get the owner of a table.
+ *
+ * @param table Table index.
+ * @return The index of the owner thread.
+ */
+int partition_owner_of(int table);
+
+/**
+ * @brief Register the calling connection thread with the owners.
+ *
+ * @return The connection's channels, or NULL if MAX_PARTITION_CLIENTS
+ * connections are already registered.
+ */
+struct partition_client *partition_client_open(void);
+
+/**
+ * @brief Unregister a connection; it must have no call in progress.
+ *
+ * @param client Value returned by partition_client_open().
+ */
+void partition_client_close(struct partition_client *client);
+
+/**
+ * @brief Run fn(arg) on the owner of a table and wait for it to return.
+ *
+ * @param client The calling connection's channels.
+ * @param table Table the operation works on.
+ * @param fn Function to run.
+ * @param arg Argument passed to fn.
+ */
+void partition_call(struct partition_client *client, int table, void (*fn)(void *), void *arg);
+
+#endif
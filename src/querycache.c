@@ -0,0 +1,245 @@
+/**
+ * @file
+ * @brief This file implements the query result cache declared in
+ * querycache.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "querycache.h"
+#include "schema.h"
+
+/**
+ * @brief One cached query result, allocated in a single block together
+ * with its predicate string and keys.
+ */
+struct query_cache_entry {
+	/// Next entry in the same hash bucket.
+	struct query_cache_entry *hash_next;
+
+	/// Neighbours in the LRU list, most recently used first.
+	struct query_cache_entry *lru_prev;
+	struct query_cache_entry *lru_next;
+
+	/// Hash of the table and predicate.
+	unsigned int hash;
+
+	/// Table index.
+	int table;
+
+	/// Write version of the table the result belongs to.
+	unsigned long version;
+
+	/// Bytes charged against the budget.
+	size_t bytes;
+
+	/// Number of keys.
+	int num_keys;
+
+	/// Normalized predicate string.
+	char *predicate;
+
+	/// The matching keys, in slot order.
+	char (*keys)[MAX_KEY_LEN];
+};
+
+static struct query_cache_entry *buckets[QUERY_CACHE_BUCKETS];
+static struct query_cache_entry *lru_head;
+static struct query_cache_entry *lru_tail;
+static size_t cache_budget;
+static struct query_cache_stats cache_stats;
+
+/// Protects the buckets, the LRU list and the counters.
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Hash a table and predicate.
+ *
+ * @param table table index
+ * @param predicate normalized predicate string
+ * @return the hash
+ */
+static unsigned int query_cache_hash(int table, const char *predicate)
+{
+    return schema_hash(predicate) ^ ((unsigned int)table * 2654435761u);
+}
+
+/**
+ * @brief Unlink an entry from the LRU list.
+ *
+ * @param entry the entry
+ * @return no return value
+ */
+static void lru_unlink(struct query_cache_entry *entry)
+{
+    if (entry->lru_prev)
+    {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else
+    {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next)
+    {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else
+    {
+        lru_tail = entry->lru_prev;
+    }
+}
+
+/**
+ * @brief Put an entry at the front of the LRU list.
+ *
+ * @param entry the entry, not in the list
+ * @return no return value
+ */
+static void lru_push_front(struct query_cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head)
+    {
+        lru_head->lru_prev = entry;
+    }
+    lru_head = entry;
+    if (lru_tail == NULL)
+    {
+        lru_tail = entry;
+    }
+}
+
+/**
+ * @brief Unlink an entry from its bucket and the LRU list and free it.
+ *
+ * @param entry the entry
+ * @return no return value
+ */
+static void entry_remove(struct query_cache_entry *entry)
+{
+    struct query_cache_entry **link = &buckets[entry->hash & (QUERY_CACHE_BUCKETS - 1)];
+
+    while (*link != entry)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    lru_unlink(entry);
+    cache_stats.bytes -= entry->bytes;
+    cache_stats.entries--;
+    free(entry);
+}
+
+/**
+ * @brief Find the entry of a table and predicate.
+ *
+ * @param hash hash of table and predicate
+ * @param table table index
+ * @param predicate normalized predicate string
+ * @return the entry, or NULL if there is none
+ */
+static struct query_cache_entry *entry_find(unsigned int hash, int table, const char *predicate)
+{
+    struct query_cache_entry *entry = buckets[hash & (QUERY_CACHE_BUCKETS - 1)];
+
+    while (entry && (entry->hash != hash || entry->table != table || strcmp(entry->predicate, predicate)))
+    {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+void query_cache_init(size_t budget)
+{
+    cache_budget = budget;
+}
+
+int query_cache_enabled(void)
+{
+    return cache_budget > 0;
+}
+
+int query_cache_lookup(int table, const char *predicate, unsigned long version, char matched_keys[][MAX_KEY_LEN])
+{
+    unsigned int hash = query_cache_hash(table, predicate);
+    struct query_cache_entry *entry;
+    int num_keys = -1;
+
+    pthread_mutex_lock(&cache_lock);
+    entry = entry_find(hash, table, predicate);
+    if (entry && entry->version != version)
+    {
+        // The table has been written since, the result is stale
+        entry_remove(entry);
+        entry = NULL;
+    }
+    if (entry)
+    {
+        num_keys = entry->num_keys;
+        memcpy(matched_keys, entry->keys, (size_t)num_keys * MAX_KEY_LEN);
+        lru_unlink(entry);
+        lru_push_front(entry);
+        cache_stats.hits++;
+    }
+    else
+    {
+        cache_stats.misses++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return num_keys;
+}
+
+void query_cache_store(int table, const char *predicate, unsigned long version, char matched_keys[][MAX_KEY_LEN], int num_keys)
+{
+    unsigned int hash = query_cache_hash(table, predicate);
+    size_t predicate_len = strlen(predicate) + 1;
+    size_t bytes = sizeof(struct query_cache_entry) + predicate_len + (size_t)num_keys * MAX_KEY_LEN;
+    struct query_cache_entry *entry, *old;
+
+    if (bytes > cache_budget)
+    {
+        return;
+    }
+    entry = malloc(bytes);
+    if (entry == NULL)
+    {
+        return;
+    }
+    entry->hash = hash;
+    entry->table = table;
+    entry->version = version;
+    entry->bytes = bytes;
+    entry->num_keys = num_keys;
+    entry->keys = (char (*)[MAX_KEY_LEN])(entry + 1);
+    entry->predicate = (char *)(entry->keys + num_keys);
+    memcpy(entry->keys, matched_keys, (size_t)num_keys * MAX_KEY_LEN);
+    memcpy(entry->predicate, predicate, predicate_len);
+
+    pthread_mutex_lock(&cache_lock);
+    old = entry_find(hash, table, predicate);
+    if (old)
+    {
+        entry_remove(old);
+    }
+    while (cache_stats.bytes + bytes > cache_budget)
+    {
+        entry_remove(lru_tail);
+        cache_stats.evictions++;
+    }
+    entry->hash_next = buckets[hash & (QUERY_CACHE_BUCKETS - 1)];
+    buckets[hash & (QUERY_CACHE_BUCKETS - 1)] = entry;
+    lru_push_front(entry);
+    cache_stats.bytes += bytes;
+    cache_stats.entries++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void query_cache_get_stats(struct query_cache_stats *stats)
+{
+    pthread_mutex_lock(&cache_lock);
+    *stats = cache_stats;
+    pthread_mutex_unlock(&cache_lock);
+}
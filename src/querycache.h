@@ -0,0 +1,87 @@
+/**
+ * @file
+ * @brief This file declares the cache of QUERY results kept by the
+ * storage server.
+ *
+ * An entry maps a table and a normalized predicate string to the keys
+ * the query matched. Every entry remembers the write version its table
+ * had when the scan started; any SET, UPDATE or DELETE bumps the
+ * version, so a lookup never returns a result older than the table.
+ * Entries are evicted least recently used first once the cache holds
+ * more than its byte budget.
+ */
+
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <stddef.h>
+#include "utils.h"
+
+#define QUERY_CACHE_BUCKETS 1024	///< Hash buckets, a power of two.
+
+/**
+ * @brief Counters of the cache, for logging.
+ */
+struct query_cache_stats {
+	/// Lookups answered from the cache.
+	unsigned long hits;
+
+	/// Lookups that had to scan the table.
+	unsigned long misses;
+
+	/// Entries dropped to stay within the budget.
+	unsigned long evictions;
+
+	/// Bytes held by the entries.
+	size_t bytes;
+
+	/// Number of entries.
+	int entries;
+};
+
+/**
+ * @brief Set up the cache.
+ *
+ * @param budget Max bytes held by the entries; 0 disables the cache.
+ */
+void query_cache_init(size_t budget);
+
+/**
+ * @brief Check whether the cache is in use.
+ *
+ * @return Return 1 if query_cache_init() was given a budget, 0 otherwise.
+ */
+int query_cache_enabled(void);
+
+/**
+ * @brief Look up the result of a query.
+ *
+ * An entry stored under an older version of the table is dropped.
+ *
+ * @param table Table index.
+ * @param predicate Normalized predicate string.
+ * @param version Current write version of the table.
+ * @param matched_keys Where to copy the matching keys, in slot order.
+ * @return The number of matching keys, or -1 on a miss.
+ */
+int query_cache_lookup(int table, const char *predicate, unsigned long version, char matched_keys[][MAX_KEY_LEN]);
+
+/**
+ * @brief Remember the result of a query.
+ *
+ * @param table Table index.
+ * @param predicate Normalized predicate string.
+ * @param version Write version of the table read before the scan started.
+ * @param matched_keys The matching keys, in slot order.
+ * @param num_keys Number of matching keys.
+ */
+void query_cache_store(int table, const char *predicate, unsigned long version, char matched_keys[][MAX_KEY_LEN], int num_keys);
+
+/**
+ * @brief Read the counters of the cache.
+ *
+ * @param stats Where to copy the counters.
+ */
+void query_cache_get_stats(struct query_cache_stats *stats);
+
+#endif
@@ -0,0 +1,411 @@
+/**
+ * @file
+ * @brief This file implements the redo log and snapshots declared in
+ * redolog.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "redolog.h"
+#include "schema.h"
+
+#define REDO_LOG_LINE_LEN (MAX_TABLE_LEN + MAX_KEY_LEN + MAX_VALUE_LEN + 32)	///< Longest line of a log or snapshot.
+#define REDO_LOG_BATCH_LEN (64 * REDO_LOG_LINE_LEN)	///< Bytes of lines a batch holds.
+
+/// Data directory, with a trailing '/'.
+static char log_directory[MAX_PATH_LEN + 1];
+
+/// The current log, -1 until redo_log_open() is done.
+static int log_fd = -1;
+
+/// Number of the current log.
+static unsigned long log_number;
+
+/// Number of the first log the snapshot being taken does not cover.
+static unsigned long snapshot_number;
+
+/// 1 to sync the log after every change.
+static int log_sync_always;
+
+/// Guards log_fd, log_number and the batches.
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Signalled each time a batch has been written.
+static pthread_cond_t log_written = PTHREAD_COND_INITIALIZER;
+
+/// The batch being filled and the one being written.
+static char batch_lines[2][REDO_LOG_BATCH_LEN];
+static int batch_len[2];
+static int filling;
+
+/// Number of the batch being filled, and of the last one written.
+static unsigned long filling_id = 1;
+static unsigned long written_id;
+
+/// 1 while a writer is writing a batch.
+static int flushing;
+
+/// Batches failed_from to failed_to could not be written or synced,
+/// failed_from 0 if none has failed. Lines after a failed write or sync
+/// cannot be trusted to reach the file, so every batch after it fails
+/// too, failed_to staying ULONG_MAX, until a snapshot starts a new log.
+static unsigned long failed_from;
+static unsigned long failed_to;
+
+/**
+ * @brief Build the path of a file in the data directory.
+ *
+ * @param path where to write the path, MAX_PATH_LEN + 32 bytes
+ * @param name file name
+ * @param number log number, or 0 for a name without one
+ * @return path
+ */
+static char *log_path(char *path, const char *name, unsigned long number)
+{
+    if (number > 0)
+    {
+        snprintf(path, MAX_PATH_LEN + 32, "%s%s_%lu.txt", log_directory, name, number);
+    }
+    else
+    {
+        snprintf(path, MAX_PATH_LEN + 32, "%s%s.txt", log_directory, name);
+    }
+    return path;
+}
+
+/**
+ * @brief Restore one line of a log or snapshot.
+ *
+ * @param line the line, without its newline
+ * @param apply where to send the record
+ * @return no return value
+ */
+static void apply_line(char *line, redo_log_apply_fn apply)
+{
+    char *fields[5], *end;
+    unsigned long metadata = 0;
+    int i, num_fields, table;
+
+    // The value goes last, whatever it holds
+    num_fields = line[0] == 'S' ? 5 : 3;
+    fields[0] = line;
+    for (i = 1; i < num_fields; i++)
+    {
+        fields[i] = strchr(fields[i - 1], ';');
+        if (fields[i] == NULL)
+        {
+            return;
+        }
+        *fields[i]++ = '\0';
+    }
+    table = schema_find_table(schema_current(), fields[1]);
+    if (table == -1 || fields[2][0] == '\0' || strlen(fields[2]) >= MAX_KEY_LEN)
+    {
+        // A table since dropped from the config, or a damaged line
+        return;
+    }
+    if (!strcmp(fields[0], "S"))
+    {
+        metadata = strtoul(fields[3], &end, 10);
+        if (*end == '\0' && strlen(fields[4]) < MAX_VALUE_LEN)
+        {
+            apply(table, fields[2], metadata, fields[4]);
+        }
+    }
+    else if (!strcmp(fields[0], "D") && strchr(fields[2], ';') == NULL)
+    {
+        apply(table, fields[2], 0, NULL);
+    }
+}
+
+/**
+ * @brief Restore every line of a log or snapshot.
+ *
+ * A line cut short by a crash at the end of the file is ignored.
+ *
+ * @param file the file, after any header
+ * @param apply where to send the records
+ * @return no return value
+ */
+static void apply_file(FILE *file, redo_log_apply_fn apply)
+{
+    char line[REDO_LOG_LINE_LEN];
+    int len;
+
+    while (fgets(line, sizeof line, file))
+    {
+        len = strlen(line);
+        if (line[len - 1] != '\n')
+        {
+            break;
+        }
+        line[len - 1] = '\0';
+        apply_line(line, apply);
+    }
+}
+
+/**
+ * @brief Write the batch being filled to the current log, and wake every
+ * writer waiting on it.
+ *
+ * @return no return value; log_lock must be held, and is released while
+ * the batch is written
+ */
+static void write_batch(void)
+{
+    char *lines = batch_lines[filling];
+    int *len = &batch_len[filling];
+    unsigned long id = filling_id;
+    ssize_t written;
+    int fd = log_fd, done = 0, failed;
+
+    // Writers coming in now fill the other batch
+    filling ^= 1;
+    filling_id++;
+    flushing = 1;
+    failed = failed_from != 0 && failed_to == ULONG_MAX;
+    pthread_mutex_unlock(&log_lock);
+
+    while (!failed && done < *len)
+    {
+        written = write(fd, lines + done, *len - done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            failed = 1;
+        }
+        else
+        {
+            done += written;
+        }
+    }
+    if (!failed && log_sync_always && fdatasync(fd) != 0)
+    {
+        failed = 1;
+    }
+
+    pthread_mutex_lock(&log_lock);
+    if (failed && !(failed_from != 0 && failed_to == ULONG_MAX))
+    {
+        failed_from = id;
+        failed_to = ULONG_MAX;
+    }
+    *len = 0;
+    written_id = id;
+    flushing = 0;
+    pthread_cond_broadcast(&log_written);
+}
+
+/**
+ * @brief Wait until a batch is written, writing it if no one else is.
+ *
+ * @param id number of the batch
+ * @return no return value; log_lock must be held
+ */
+static void wait_written(unsigned long id)
+{
+    while (written_id < id)
+    {
+        if (flushing)
+        {
+            pthread_cond_wait(&log_written, &log_lock);
+        }
+        else
+        {
+            write_batch();
+        }
+    }
+}
+
+/**
+ * @brief Queue a line for the current log.
+ *
+ * Lines are written in the order they are queued.
+ *
+ * @param line the line, with its newline
+ * @param len length of the line
+ * @return the number of the batch holding the line, 0 if there is no log
+ */
+static unsigned long log_line(const char *line, int len)
+{
+    unsigned long id = 0;
+
+    pthread_mutex_lock(&log_lock);
+    // A full batch is written first, by this writer if no one else is
+    while (log_fd != -1 && batch_len[filling] + len > REDO_LOG_BATCH_LEN)
+    {
+        wait_written(filling_id);
+    }
+    if (log_fd != -1)
+    {
+        memcpy(batch_lines[filling] + batch_len[filling], line, len);
+        batch_len[filling] += len;
+        id = filling_id;
+    }
+    pthread_mutex_unlock(&log_lock);
+    return id;
+}
+
+int redo_log_open(const char *directory, int sync_always, redo_log_apply_fn apply)
+{
+    char path[MAX_PATH_LEN + 32];
+    unsigned long number = 1;
+    FILE *file;
+
+    snprintf(log_directory, sizeof log_directory, "%s", directory);
+    log_sync_always = sync_always;
+
+    // The snapshot names the first log written after it was started
+    file = fopen(log_path(path, "snapshot", 0), "r");
+    if (file)
+    {
+        if (fscanf(file, "redo %lu\n", &number) != 1 || number == 0)
+        {
+            number = 1;
+        }
+        apply_file(file, apply);
+        fclose(file);
+    }
+    while ((file = fopen(log_path(path, "redo", number), "r")) != NULL)
+    {
+        apply_file(file, apply);
+        fclose(file);
+        number++;
+    }
+
+    pthread_mutex_lock(&log_lock);
+    log_number = number;
+    log_fd = open(log_path(path, "redo", number), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    pthread_mutex_unlock(&log_lock);
+    return log_fd == -1 ? -1 : 0;
+}
+
+unsigned long redo_log_set(int table, const char *key, unsigned long metadata, const char *value)
+{
+    char line[REDO_LOG_LINE_LEN];
+    int len;
+
+    len = snprintf(line, sizeof line, "S;%s;%s;%lu;%s\n", schema_current()->tables[table].name, key, metadata, value);
+    return log_line(line, len);
+}
+
+unsigned long redo_log_delete(int table, const char *key)
+{
+    char line[REDO_LOG_LINE_LEN];
+    int len;
+
+    len = snprintf(line, sizeof line, "D;%s;%s\n", schema_current()->tables[table].name, key);
+    return log_line(line, len);
+}
+
+int redo_log_wait(unsigned long id)
+{
+    int status;
+
+    if (id == 0)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&log_lock);
+    wait_written(id);
+    status = (failed_from != 0 && id >= failed_from && id <= failed_to) ? -1 : 0;
+    pthread_mutex_unlock(&log_lock);
+    return status;
+}
+
+FILE *redo_log_snapshot_begin(void)
+{
+    char path[MAX_PATH_LEN + 32];
+    FILE *snapshot;
+    int fd, synced;
+
+    // Changes queued so far go to this log, and from here on to the next
+    // one, which the snapshot names
+    pthread_mutex_lock(&log_lock);
+    while (flushing || batch_len[filling] > 0)
+    {
+        if (flushing)
+        {
+            pthread_cond_wait(&log_written, &log_lock);
+        }
+        else
+        {
+            write_batch();
+        }
+    }
+    fd = open(log_path(path, "redo", log_number + 1), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1)
+    {
+        pthread_mutex_unlock(&log_lock);
+        return NULL;
+    }
+    synced = fdatasync(log_fd) == 0;
+    close(log_fd);
+    log_fd = fd;
+    snapshot_number = ++log_number;
+    if (failed_from != 0 && failed_to == ULONG_MAX)
+    {
+        // Batches from here on go to the new log
+        failed_to = filling_id - 1;
+    }
+    pthread_mutex_unlock(&log_lock);
+
+    if (!synced)
+    {
+        // The old log may be missing changes; the next snapshot, which
+        // copies them from the tables, is the one to replace it
+        return NULL;
+    }
+
+    snapshot = fopen(log_path(path, "snapshot_tmp", 0), "w");
+    if (snapshot)
+    {
+        fprintf(snapshot, "redo %lu\n", snapshot_number);
+    }
+    return snapshot;
+}
+
+void redo_log_snapshot_record(FILE *snapshot, int table, const char *key, unsigned long metadata, const char *value)
+{
+    fprintf(snapshot, "S;%s;%s;%lu;%s\n", schema_current()->tables[table].name, key, metadata, value);
+}
+
+int redo_log_snapshot_end(FILE *snapshot)
+{
+    char path[MAX_PATH_LEN + 32], tmp_path[MAX_PATH_LEN + 32];
+    unsigned long number;
+    int status = 0;
+
+    if (fflush(snapshot) != 0 || fdatasync(fileno(snapshot)) != 0)
+    {
+        status = -1;
+    }
+    if (fclose(snapshot) != 0 || status != 0)
+    {
+        unlink(log_path(tmp_path, "snapshot_tmp", 0));
+        return -1;
+    }
+    if (rename(log_path(tmp_path, "snapshot_tmp", 0), log_path(path, "snapshot", 0)) != 0)
+    {
+        return -1;
+    }
+
+    // Older logs are covered by the snapshot
+    for (number = snapshot_number - 1; number > 0; number--)
+    {
+        if (unlink(log_path(path, "redo", number)) != 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief This file declares the redo log and snapshots that let the
+ * in-memory tables survive a restart.
+ *
+ * Every change to a table is appended to the current redo log file,
+ * "redo_<n>.txt" in the data directory, as "S;table;key;metadata;value"
+ * for a SET and "D;table;key" for a DELETE. A snapshot switches writers
+ * to the next log file first, then copies every table into
+ * "snapshot.txt" while they keep running. The copy is fuzzy, but every
+ * change it may have missed is in the logs that follow the switch, and
+ * replaying a change that it did see is harmless. Once the snapshot is
+ * on disk the logs before the switch are removed, so recovery reads one
+ * snapshot and the changes made since it was started.
+ *
+ * Changes are queued in memory in the order they are logged. Writers
+ * arriving together are committed as one batch: the first of them to
+ * wait writes every queued line with a single write(), and, when syncing
+ * always, a single fdatasync(), then all of them are woken.
+ */
+
+#ifndef REDOLOG_H
+#define REDOLOG_H
+
+#include <stdio.h>
+#include "utils.h"
+
+/**
+ * @brief Called for every record restored, value NULL for a delete.
+ */
+typedef void (*redo_log_apply_fn)(int table, const char *key, unsigned long metadata, const char *value);
+
+/**
+ * @brief Restore the tables from the latest snapshot and the logs after
+ * it, then start a new log.
+ *
+ * Changes are not logged until this returns.
+ *
+ * @param directory Data directory, with a trailing '/'.
+ * @param sync_always 1 to sync the log after every change.
+ * @param apply Where to send the restored records.
+ * @return Return 0 on success, -1 if the new log cannot be created.
+ */
+int redo_log_open(const char *directory, int sync_always, redo_log_apply_fn apply);
+
+/**
+ * @brief Log a SET.
+ *
+ * The line is only queued; pass the number returned to redo_log_wait()
+ * before answering the client. The caller must hold the record's writer
+ * lock, so that changes to a record are logged in the order they were
+ * made, but need not hold it while waiting.
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @param metadata The record's new metadata.
+ * @param value The record's new value.
+ * @return Return the number of the batch holding the change, 0 if there is no log.
+ */
+unsigned long redo_log_set(int table, const char *key, unsigned long metadata, const char *value);
+
+/**
+ * @brief Log a DELETE.
+ *
+ * Works as redo_log_set().
+ *
+ * @param table Table index.
+ * @param key The key.
+ * @return Return the number of the batch holding the change, 0 if there is no log.
+ */
+unsigned long redo_log_delete(int table, const char *key);
+
+/**
+ * @brief Wait until a batch of changes is written (and synced, when
+ * syncing always).
+ *
+ * A batch fails if it cannot be written or synced, and so does every
+ * batch after it, until a snapshot starts a new log.
+ *
+ * @param id Number returned by redo_log_set() or redo_log_delete().
+ * @return Return 0 on success, -1 if the batch could not be written.
+ */
+int redo_log_wait(unsigned long id);
+
+/**
+ * @brief Start a snapshot, switching writers to a new log.
+ *
+ * @return Return the file to pass to redo_log_snapshot_record(), NULL on
+ * error, including when the log being left could not be synced.
+ */
+FILE *redo_log_snapshot_begin(void);
+
+/**
+ * @brief Add a record to a snapshot.
+ *
+ * @param snapshot File returned by redo_log_snapshot_begin().
+ * @param table Table index.
+ * @param key The key.
+ * @param metadata The record's metadata.
+ * @param value The record's value.
+ */
+void redo_log_snapshot_record(FILE *snapshot, int table, const char *key, unsigned long metadata, const char *value);
+
+/**
+ * @brief Finish a snapshot: sync it, put it in place of the last one and
+ * remove the logs it covers.
+ *
+ * @param snapshot File returned by redo_log_snapshot_begin().
+ * @return Return 0 on success, -1 if the snapshot could not be written;
+ * the last one and its logs are kept.
+ */
+int redo_log_snapshot_end(FILE *snapshot);
+
+#endif
@@ -0,0 +1,246 @@
+/**
+ * @file
+ * @brief This file implements the immutable schema snapshot declared in
+ * schema.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "schema.h"
+
+/**
+ * @brief The published snapshot; only ever accessed atomically.
+ */
+static struct schema *current_schema = NULL;
+
+unsigned int schema_hash(const char *name)
+{
+    unsigned int hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct schema *schema_build(const struct config_params *params)
+{
+    struct schema *schema = calloc(1, sizeof(struct schema));
+    struct schema_table *table;
+    struct schema_column *column;
+    int i, j, slot;
+
+    if (schema == NULL)
+    {
+        return NULL;
+    }
+
+    schema->num_tables = params->tablecount;
+    for (i = 0; i < params->tablecount; i++)
+    {
+        table = &schema->tables[i];
+        strncpy(table->name, params->mytables[i], MAX_TABLE_LEN - 1);
+        table->hash = schema_hash(table->name);
+        table->num_columns = params->numcolumnspertable[i];
+
+        for (j = 0; j < table->num_columns; j++)
+        {
+            column = &table->columns[j];
+            strncpy(column->name, params->mycolumns[i][j], MAX_COLNAME_LEN - 1);
+            column->hash = schema_hash(column->name);
+            column->name_len = strlen(column->name);
+            if (strstr(params->column_types[i][j], "float"))
+            {
+                column->type = COLUMN_TYPE_FLOAT;
+                column->size = 0;
+            }
+            else if (strstr(params->column_types[i][j], "int"))
+            {
+                column->type = COLUMN_TYPE_INT;
+                column->size = 0;
+            }
+            else
+            {
+                column->type = COLUMN_TYPE_CHAR;
+                if (sscanf(params->column_types[i][j], "char[%d]", &column->size) != 1)
+                {
+                    column->size = 0;
+                }
+            }
+        }
+
+        // Linear probing; the hash is never more than half full
+        slot = table->hash & (SCHEMA_HASH_SLOTS - 1);
+        while (schema->table_slots[slot] != 0)
+        {
+            slot = (slot + 1) & (SCHEMA_HASH_SLOTS - 1);
+        }
+        schema->table_slots[slot] = i + 1;
+    }
+    return schema;
+}
+
+void schema_install(struct schema *schema)
+{
+    __atomic_store_n(&current_schema, schema, __ATOMIC_RELEASE);
+}
+
+const struct schema *schema_current(void)
+{
+    return __atomic_load_n(&current_schema, __ATOMIC_ACQUIRE);
+}
+
+int schema_find_table(const struct schema *schema, const char *name)
+{
+    unsigned int hash = schema_hash(name);
+    int slot = hash & (SCHEMA_HASH_SLOTS - 1);
+    const struct schema_table *table;
+
+    while (schema->table_slots[slot] != 0)
+    {
+        table = &schema->tables[schema->table_slots[slot] - 1];
+        if (table->hash == hash && !strcmp(table->name, name))
+        {
+            return schema->table_slots[slot] - 1;
+        }
+        slot = (slot + 1) & (SCHEMA_HASH_SLOTS - 1);
+    }
+    return -1;
+}
+
+int schema_find_column(const struct schema_table *table, const char *name)
+{
+    unsigned int hash = schema_hash(name);
+    int i;
+
+    for (i = 0; i < table->num_columns; i++)
+    {
+        if (table->columns[i].hash == hash && !strcmp(table->columns[i].name, name))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int schema_parse_value(const struct schema_table *table, const char *value, struct schema_field fields[MAX_COLUMNS_PER_TABLE])
+{
+    const struct schema_column *column;
+    const char *p = value, *start, *end;
+    long long num;
+    int i, negative;
+
+    for (i = 0; i < table->num_columns; i++)
+    {
+        column = &table->columns[i];
+        if (i > 0)
+        {
+            if (*p != ',')
+            {
+                // Too few columns
+                return -1;
+            }
+            p++;
+        }
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+
+        // The name has to be this column's, followed by its value
+        if (strncmp(p, column->name, column->name_len) != 0)
+        {
+            return -1;
+        }
+        p += column->name_len;
+        if (*p != ',' && *p != '\0' && !isspace((unsigned char)*p))
+        {
+            return -1;
+        }
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        start = p;
+
+        if (column->type == COLUMN_TYPE_INT)
+        {
+            num = 0;
+            negative = (*p == '-');
+            if (*p == '-' || *p == '+')
+            {
+                p++;
+            }
+            if (!isdigit((unsigned char)*p))
+            {
+                return -1;
+            }
+            while (isdigit((unsigned char)*p))
+            {
+                num = num * 10 + (*p - '0');
+                if (num > (long long)INT_MAX + 1)
+                {
+                    return -1;
+                }
+                p++;
+            }
+            end = p;
+            while (isspace((unsigned char)*p))
+            {
+                p++;
+            }
+            if (*p != ',' && *p != '\0')
+            {
+                // Not an integer
+                return -1;
+            }
+            num = negative ? -num : num;
+            if (num > INT_MAX)
+            {
+                return -1;
+            }
+            fields[i].int_value = (int)num;
+            fields[i].float_value = 0;
+        }
+        else
+        {
+            while (*p != ',' && *p != '\0')
+            {
+                p++;
+            }
+            end = p;
+            while (end > start && isspace((unsigned char)end[-1]))
+            {
+                end--;
+            }
+            fields[i].int_value = 0;
+            fields[i].float_value = 0;
+            if (column->type == COLUMN_TYPE_FLOAT)
+            {
+                struct token number = { start, end - start };
+                if (token_to_double(number, &fields[i].float_value) == -1)
+                {
+                    // Not a number
+                    return -1;
+                }
+            }
+            else if (end - start > column->size)
+            {
+                return -1;
+            }
+        }
+        fields[i].value.start = start;
+        fields[i].value.len = end - start;
+    }
+
+    if (*p != '\0')
+    {
+        // Too many columns
+        return -1;
+    }
+    return 0;
+}
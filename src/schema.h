@@ -0,0 +1,156 @@
+/**
+ * @file
+ * @brief This file declares the immutable table schema that the storage
+ * server reads on its hot paths.
+ *
+ * The schema is built once from the config parameters and published
+ * through a single pointer. Readers never lock it; a schema change
+ * builds a new snapshot and swaps the pointer atomically.
+ */
+
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include "utils.h"
+#include "tokenizer.h"
+
+#define COLUMN_TYPE_INT 0	///< Column declared as int.
+#define COLUMN_TYPE_CHAR 1	///< Column declared as char[SIZE].
+#define COLUMN_TYPE_FLOAT 2	///< Column declared as float, stored as a double.
+
+#define SCHEMA_HASH_SLOTS 256	///< Slots in the table name hash, a power of two > 2 * MAX_TABLES.
+
+/**
+ * @brief One column of a table.
+ */
+struct schema_column {
+	/// Column name.
+	char name[MAX_COLNAME_LEN];
+
+	/// Hash of the column name.
+	unsigned int hash;
+
+	/// Length of the column name.
+	int name_len;
+
+	/// One of the COLUMN_TYPE_* constants.
+	int type;
+
+	/// SIZE of a char[SIZE] column, 0 for other types.
+	int size;
+};
+
+/**
+ * @brief One table and its columns, in declaration order.
+ */
+struct schema_table {
+	/// Table name.
+	char name[MAX_TABLE_LEN];
+
+	/// Hash of the table name.
+	unsigned int hash;
+
+	/// Number of columns in the table.
+	int num_columns;
+
+	/// The columns of the table.
+	struct schema_column columns[MAX_COLUMNS_PER_TABLE];
+};
+
+/**
+ * @brief One column of a record value, as found by schema_parse_value().
+ */
+struct schema_field {
+	/// The column's value, a view into the record value.
+	struct token value;
+
+	/// The value as an integer, for int columns.
+	int int_value;
+
+	/// The value as a number, for float columns.
+	double float_value;
+};
+
+/**
+ * @brief A complete, read-only snapshot of every table.
+ */
+struct schema {
+	/// Number of tables.
+	int num_tables;
+
+	/// Tables, indexed the same way as the server's tables array.
+	struct schema_table tables[MAX_TABLES];
+
+	/// Open addressed hash of table names, holding table index + 1 (0 is empty).
+	int table_slots[SCHEMA_HASH_SLOTS];
+};
+
+/**
+ * @brief Hash a table or column name.
+ *
+ * @param name The name to hash.
+ * @return The 32 bit FNV-1a hash of name.
+ */
+unsigned int schema_hash(const char *name);
+
+/**
+ * @brief Build a schema snapshot from the loaded config parameters.
+ *
+ * @param params The config parameters returned by read_config().
+ * @return A newly allocated schema, or NULL if out of memory.
+ */
+struct schema *schema_build(const struct config_params *params);
+
+/**
+ * @brief Publish a schema snapshot to all threads.
+ *
+ * The snapshot being replaced is not freed, since other threads may
+ * still be reading it. Schema changes are rare, so this costs little.
+ *
+ * @param schema The snapshot to publish; it must not be modified afterwards.
+ */
+void schema_install(struct schema *schema);
+
+/**
+ * @brief Get the snapshot currently in use.
+ *
+ * @return The current schema, or NULL before the first schema_install().
+ */
+const struct schema *schema_current(void);
+
+/**
+ * @brief Look up a table by name.
+ *
+ * @param schema The snapshot to search.
+ * @param name The table name.
+ * @return The table index, or -1 if there is no such table.
+ */
+int schema_find_table(const struct schema *schema, const char *name);
+
+/**
+ * @brief Look up a column of a table by name.
+ *
+ * @param table The table to search.
+ * @param name The column name.
+ * @return The column index, or -1 if there is no such column.
+ */
+int schema_find_column(const struct schema_table *table, const char *name);
+
+/**
+ * @brief Check a record value against a table and split it into fields.
+ *
+ * The value must list every column of the table, in declaration order,
+ * as "name value" pairs separated by commas. Int values are a decimal
+ * integer with an optional sign; float values a decimal number, in
+ * fixed or exponent notation; char[SIZE] values are the rest of the
+ * column, trimmed, and at most SIZE characters long. The value is walked
+ * once, checking and converting each column as it goes.
+ *
+ * @param table The table the value is for.
+ * @param value The record value.
+ * @param fields Where to store the columns of the value.
+ * @return Return 0 if the value matches the table, -1 otherwise.
+ */
+int schema_parse_value(const struct schema_table *table, const char *value, struct schema_field fields[MAX_COLUMNS_PER_TABLE]);
+
+#endif
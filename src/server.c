@@ -17,6 +17,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 #include <signal.h>
 #include "utils.h"
@@ -27,128 +28,344 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#include <sched.h>
+#include "threadpool.h"
+#include "schema.h"
+#include "lockscheme.h"
+#include "partition.h"
+#include "tokenizer.h"
+#include "querycache.h"
+#include "keyindex.h"
+#include "disklog.h"
+#include "redolog.h"
+#include "lsm.h"
+#include "btree.h"
+#include "bufferpool.h"
 
 #define MAX_LISTENQUEUELEN 20   ///< The maximum number of queued connections.
+#define SCAN_MORSEL_SIZE 64     ///< Rows handed to a scan thread at a time.
+#define AGGREGATE_BUCKETS 2048  ///< Hash buckets for the groups of an aggregate, a power of two.
+#define AGGREGATE_NUMBER_LEN 24 ///< Longest result of an aggregate, "%.17g" of a negative double.
+#define MAX_CMD_FIELDS 6        ///< Fields of the longest command (SELECT;table;predicates;columns;limit;cursor).
+#define LOAD_BATCH_RECORDS 256  ///< Records of a LOAD stored together.
+#define LOAD_BUFFER_SIZE (64 * 1024) ///< Bytes of a LOAD read from the socket at a time.
+#define RECORD_READ_SPINS 100  ///< Times a reader spins on a record being written before yielding the CPU.
 
 // Global Variables
 FILE *fserverOut;
-struct server_record tables [MAX_TABLES][MAX_RECORDS_PER_TABLE];
+struct server_record tables [MAX_TABLES][MAX_RECORDS_PER_TABLE] __attribute__((aligned(64)));
+struct server_value values [MAX_TABLES][MAX_RECORDS_PER_TABLE];
 int first_empty[MAX_TABLES];
+int next_slot[MAX_TABLES];
+unsigned char slot_published[MAX_TABLES][MAX_RECORDS_PER_TABLE];
+pthread_rwlock_t table_shape_lock[MAX_TABLES];
+unsigned long table_version[MAX_TABLES];
 struct config_params params;
+struct threadpool scan_pool;
+
+/// 1 once the files of a table are open; until then commands on it get ERR_TABLE_LOADING.
+/// -1 if they could not be opened; commands on it then get ERR_UNKNOWN.
+int table_ready[MAX_TABLES];
+
+/// The connection thread's channels to the table owners in partitioned mode, NULL otherwise.
+__thread struct partition_client *connection_partition;
+
+/*
+ * Rows [0, first_empty) of a table are visible to readers. SETs append
+ * without locking each other out: an appender claims next_slot with a
+ * compare-and-swap, fills the slot, raises its slot_published flag and
+ * then moves first_empty over every published slot it finds, finishing
+ * the job for appenders that completed out of order. Appends and updates
+ * hold table_shape_lock shared; DELETE, which shifts rows, holds it
+ * exclusively.
+ */
 
 /**
- * @brief Check if key exists in the server
+ * @brief Check whether every table is only ever touched by its owner thread
  *
- * @param key_to_search key to search for in server
- * @param first_empty index of the first empty spot in keys & values
- * @param table_num the table to search the key for
- * @return returns index of record with matching key if it exists, false(-1) if it doesn't
+ * In partitioned mode writers never meet each other, so they skip the record
+ * and table locks; the sequence counters are still bumped.
+ *
+ * @return returns true(1) in partitioned mode, false(0) otherwise
  */
-int key_exist(char key_to_search_for[MAX_KEY_LEN], int first_empty, int table_num)
+static inline int owners_only(void)
 {
-    int i = 0;
-    for (i = 0; i < first_empty; i++)
+    return params.partition_workers > 0;
+}
+
+/**
+ * @brief Get the number of rows readers may scan in a table
+ *
+ * @param table_num index of the table
+ * @return returns the number of published rows
+ */
+static inline int table_rows(int table_num)
+{
+    return __atomic_load_n(&first_empty[table_num], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Bump the write version of a table once a write is visible
+ *
+ * Cached query results are only used while the version they were
+ * computed under is current.
+ *
+ * @param table_num index of the table
+ * @return no return value
+ */
+static inline void table_written(int table_num)
+{
+    __atomic_add_fetch(&table_version[table_num], 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Claim the next free slot of a table for an append
+ *
+ * @param table_num index of the table
+ * @return returns the claimed slot, -1 if the table is full
+ */
+static int reserve_slot(int table_num)
+{
+    int slot = __atomic_load_n(&next_slot[table_num], __ATOMIC_RELAXED);
+    do
     {
-        pthread_mutex_lock(&tables[table_num][i].lock);
-        if (!strcmp(key_to_search_for, tables[table_num][i].key))
+        if (slot >= MAX_RECORDS_PER_TABLE)
         {
-            pthread_mutex_unlock(&tables[table_num][i].lock);
-            return i;
+            return -1;
         }
-        pthread_mutex_unlock(&tables[table_num][i].lock);
     }
-    return -1;
+    while (!__atomic_compare_exchange_n(&next_slot[table_num], &slot, slot + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return slot;
 }
 
 /**
- * @brief Get the name of the column based on name given to search for
+ * @brief Make a filled slot visible, along with any ready slots after it
  *
- * @param column_name column name to find the type for
- * @param num_columns number of columns for the table
- * @param table_num index of the table parsing
- * @param mycolumns names of the columns
- * @param column_types types of the columns
- * @return return string of type of the column
+ * @param table_num index of the table
+ * @param slot slot returned by reserve_slot() and now fully written
+ * @return no return value
  */
-char *get_column_type(char column_name[MAX_COLNAME_LEN], int num_columns, int table_num, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10])
+static void publish_slot(int table_num, int slot)
 {
-    int i;
-    for (i = 0; i < num_columns; i ++)
+    int rows;
+
+    // Sequentially consistent so that of two appenders finishing neighbouring
+    // slots at once, at least one sees the other's flag and advances past it
+    __atomic_store_n(&slot_published[table_num][slot], 1, __ATOMIC_SEQ_CST);
+    rows = __atomic_load_n(&first_empty[table_num], __ATOMIC_SEQ_CST);
+    while (rows < MAX_RECORDS_PER_TABLE && __atomic_load_n(&slot_published[table_num][rows], __ATOMIC_SEQ_CST))
     {
-        pthread_mutex_lock(&params.lock);
-        if (!strcmp(mycolumns[table_num][i], column_name))
+        // On failure rows is reloaded with the count another appender set
+        if (__atomic_compare_exchange_n(&first_empty[table_num], &rows, rows + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
         {
-            if (strstr(column_types[table_num][i], "int"))
-            {
-                pthread_mutex_unlock(&params.lock);
-                return "int";
-            }
-            else
-            {
-                pthread_mutex_unlock(&params.lock);
-                return "string";
-            }
+            rows++;
         }
-        pthread_mutex_unlock(&params.lock);
     }
 }
 
 /**
- * @brief Get the column name from a query predicate
+ * @brief Start changing a record: take its writer lock and make its sequence odd
  *
- * @param pred predicate to get the column out of
- * @param ret string to return the column name too
+ * @param table_num index of the table holding the record
+ * @param index slot of the record about to be modified
  * @return no return value
  */
-void split_query_get_column(char pred[MAX_VALUE_LEN], char ret[MAX_VALUE_LEN])
+static inline void record_write_begin(int table_num, int index)
 {
-    char strtoktemp[MAX_VALUE_LEN];
-    strcpy(strtoktemp, pred);
-    if (strstr(pred, ">"))
+    struct server_record *record = &tables[table_num][index];
+    if (!owners_only())
     {
-        get_param(strtoktemp, ret, 0, ">\0");
+        lock_record(table_num, index);
     }
-    else if (strstr(pred, "<"))
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Finish changing a record: make its sequence even again and unlock it
+ *
+ * @param table_num index of the table holding the record
+ * @param index slot of the record that was modified
+ * @return no return value
+ */
+static inline void record_write_end(int table_num, int index)
+{
+    struct server_record *record = &tables[table_num][index];
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELEASE);
+    if (!owners_only())
     {
-        get_param(strtoktemp, ret, 0, "<\0");
+        unlock_record(table_num, index);
     }
-    else if (strstr(pred, "="))
+}
+
+/**
+ * @brief Start an optimistic read of a record, waiting out any write in progress
+ *
+ * @param record record about to be read
+ * @return the sequence number to hand to record_read_retry()
+ */
+static inline unsigned int record_read_begin(struct server_record *record)
+{
+    unsigned int seq, spins = 0;
+    while ((seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE)) & 1)
     {
-        get_param(strtoktemp, ret, 0, "=\0");
+        // a writer is in the middle of an update; if it takes long, it
+        // may be waiting for this CPU
+        if (++spins < RECORD_READ_SPINS)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        else
+        {
+            sched_yield();
+        }
     }
-    else
+    return seq;
+}
+
+/**
+ * @brief Check whether a record changed while it was being read
+ *
+ * @param record record that was read
+ * @param seq value returned by record_read_begin()
+ * @return returns true(1) if the copy may be torn and must be read again
+ */
+static inline int record_read_retry(struct server_record *record, unsigned int seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&record->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * @brief Copy the key of a record without taking its lock
+ *
+ * @param record record to read
+ * @param key buffer of MAX_KEY_LEN bytes to copy the key into
+ * @return no return value
+ */
+void record_read_key(struct server_record *record, char key[MAX_KEY_LEN])
+{
+    unsigned int seq;
+    do
     {
-        strcpy(ret, "");
+        seq = record_read_begin(record);
+        memcpy(key, record->key, MAX_KEY_LEN);
     }
+    while (record_read_retry(record, seq));
+    key[MAX_KEY_LEN - 1] = '\0';
 }
 
 /**
- * @brief Get the comparison value from a query predicate
+ * @brief Copy the value and metadata of a record without taking its lock
  *
- * @param pred predicate to get the value out of
- * @param ret string to return the column name too
+ * @param table_num index of the table holding the record
+ * @param index slot of the record to read
+ * @param value buffer of MAX_VALUE_LEN bytes to copy the value into
+ * @param metadata where to store the metadata, may be NULL
  * @return no return value
  */
-void split_query_get_value(char pred[MAX_VALUE_LEN], char ret[MAX_VALUE_LEN])
+void record_read_value(int table_num, int index, char value[MAX_VALUE_LEN], unsigned long *metadata)
 {
-    char strtoktemp[MAX_VALUE_LEN];
-    strcpy(strtoktemp, pred);
-    if (strstr(pred, ">"))
+    struct server_record *record = &tables[table_num][index];
+    unsigned int seq;
+    unsigned long meta;
+    do
     {
-        get_param(strtoktemp, ret, 1, ">\0");
+        seq = record_read_begin(record);
+        memcpy(value, values[table_num][index].value, MAX_VALUE_LEN);
+        meta = record->metadata;
     }
-    else if (strstr(pred, "<"))
+    while (record_read_retry(record, seq));
+    value[MAX_VALUE_LEN - 1] = '\0';
+    if (metadata)
     {
-        get_param(strtoktemp, ret, 1, "<\0");
+        *metadata = meta;
     }
-    else if (strstr(pred, "="))
+}
+
+/**
+ * @brief A record copied out of a table by a SELECT
+ */
+struct query_row {
+    /// Key of the record
+    char key[MAX_KEY_LEN];
+
+    /// Value of the record, or of its selected columns
+    char value[MAX_VALUE_LEN];
+
+    /// Metadata of the record
+    unsigned long metadata;
+};
+
+/**
+ * @brief Copy the key, value and metadata of a record in one read
+ *
+ * @param table_num index of the table holding the record
+ * @param index slot of the record to read
+ * @param row where to copy the record
+ * @return no return value
+ */
+void record_read_row(int table_num, int index, struct query_row *row)
+{
+    struct server_record *record = &tables[table_num][index];
+    unsigned int seq;
+    do
     {
-        get_param(strtoktemp, ret, 1, "=\0");
+        seq = record_read_begin(record);
+        memcpy(row->key, record->key, MAX_KEY_LEN);
+        memcpy(row->value, values[table_num][index].value, MAX_VALUE_LEN);
+        row->metadata = record->metadata;
     }
-    else
+    while (record_read_retry(record, seq));
+    row->key[MAX_KEY_LEN - 1] = '\0';
+    row->value[MAX_VALUE_LEN - 1] = '\0';
+}
+
+/**
+ * @brief Read the stored int and float columns of a record
+ *
+ * @param table_num index of the table
+ * @param index index of the record
+ * @param ints where to copy the int columns
+ * @param floats where to copy the float columns
+ * @return no return value
+ */
+void record_read_numbers(int table_num, int index, int ints[MAX_COLUMNS_PER_TABLE], double floats[MAX_COLUMNS_PER_TABLE])
+{
+    struct server_record *record = &tables[table_num][index];
+    unsigned int seq;
+    do
+    {
+        seq = record_read_begin(record);
+        memcpy(ints, values[table_num][index].ints, sizeof values[table_num][index].ints);
+        memcpy(floats, values[table_num][index].floats, sizeof values[table_num][index].floats);
+    }
+    while (record_read_retry(record, seq));
+}
+
+/**
+ * @brief Check if key exists in the server
+ *
+ * @param key_to_search key to search for in server
+ * @param first_empty index of the first empty spot in keys & values
+ * @param table_num the table to search the key for
+ * @return returns index of record with matching key if it exists, false(-1) if it doesn't
+ */
+int key_exist(char key_to_search_for[MAX_KEY_LEN], int first_empty, int table_num)
+{
+    int i = 0;
+    char key[MAX_KEY_LEN];
+    for (i = 0; i < first_empty; i++)
     {
-        strcpy(ret, "");
+        record_read_key(&tables[table_num][i], key);
+        if (!strcmp(key_to_search_for, key))
+        {
+            return i;
+        }
     }
+    return -1;
 }
 
 /**
@@ -209,405 +426,263 @@ char *trim(char *str)
  */
 int has_table(char table_name[MAX_TABLE_LEN])
 {
-    int i;
-    pthread_mutex_lock(&params.lock);
-    for (i = 0; i < params.tablecount; i++)
-    {
-        if (!strcmp(table_name, params.mytables[i]))
-        {
-            pthread_mutex_unlock(&params.lock);
-            return i;
-        }
-    }
-    pthread_mutex_unlock(&params.lock);
-    return -1;
+    return schema_find_table(schema_current(), table_name);
 }
 
 /**
  * @brief Check if table exists in the server
  *
  * @param col_to_search column name to search for
- * @param mycolumns names of all the columns of all the tables
- * @param num_columns number of columns for the table
  * @param table_num index of the table that is being parsed
  * @return returns column index if it exists, -1 if it doesn't
  */
-int has_column(char col_to_search[MAX_COLNAME_LEN], char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], int num_columns, int table_num)
+int has_column(char col_to_search[MAX_COLNAME_LEN], int table_num)
 {
-    int i;
-    for (i = 0; i < num_columns; i++ )
-    {
-        pthread_mutex_lock(&params.lock);
-        if (!strcmp(col_to_search, mycolumns[table_num][i]))
-        {
-            pthread_mutex_unlock(&params.lock);
-            return i;
-        }
-        pthread_mutex_unlock(&params.lock);
-    }
-    return -1;
+    return schema_find_column(&schema_current()->tables[table_num], col_to_search);
 }
 
 /**
- * @brief Check if the column types match the values given
- *
- * @param val_to_set value to parse
- * @param num_columns number of columns for the table
- * @param table_num index of the table parsing
- * @param column_types types of the columns
- * @return returns true(1) if all column types match, false(0) if it doesn't
+ * @brief A query predicate, checked once when the query arrives
  */
-int check_column_types(char val_to_set[MAX_VALUE_LEN], int num_columns, int table_num, char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10])
-{
-    int i, j, len_str, str_modifier;
-    char val[MAX_VALUE_LEN], strtoktemp[MAX_VALUE_LEN], temp[MAX_VALUE_LEN];
-
-    for (i = 0; i < num_columns; i++)
-    {
-
-        strcpy(strtoktemp, val_to_set);
-        get_param(strtoktemp, val, i, ",\0");
-
-        strcpy(strtoktemp, val);
-        get_param(strtoktemp, val, 1, " \0");
-
-        len_str = strlen(val);
-
-        if (val[0] == '-' || val[0] == '+')
-            len_str--;
+struct predicate {
+    /// Index of the column in the table
+    int column;
 
-        pthread_mutex_lock(&params.lock);
-        if (strstr(column_types[table_num][i], "int"))
-        {
-            pthread_mutex_unlock(&params.lock);
-            strcpy(temp, val);
-
-            str_modifier = 0;
-
-            for (j = 0; temp[j] != NULL; j++)
-            {
-                if (temp[j] != '0')
-                {
-                    break;
-                }
-                str_modifier++;
-            }
+    /// Type of the column (COLUMN_TYPE_*)
+    int type;
 
-            if (len_str != j)
-            {
-                // val is not just all zeroes
-                // remove the number of leading zeroes from len_str
-                len_str = len_str - str_modifier;
+    /// Comparison operator: '>', '<' or '='
+    char op;
 
-            }
+    /// Value compared against, a view into the command
+    struct token value;
 
-            if (atoi(val) == 0 || len_str != (floor(log10(abs(atoi(val)))) + 1))
-            {
-                // val is an integer but has alpha characters in it
-                if ((strcmp(val, "0")))
-                {
-                    return -1;
-                }
+    /// The value as an integer, for int columns
+    int int_value;
 
-            }
-        }
-        else
-        {
-            pthread_mutex_unlock(&params.lock);
-            // column is of type string
-            char temp[MAX_VALUE_LEN];
-            // Get the max size of the records in the string column
-            int start_recording = 0;
-            int index = 0, j;
-            pthread_mutex_lock(&params.lock);
-            for (j = 0; column_types[table_num][i][j] != '\0'; j++ )
-            {
-                if (column_types[table_num][i][j] == '[')
-                {
-                    start_recording = 1;
-                }
-                else if (column_types[table_num][i][j] == ']')
-                {
-                    start_recording = 0;
-                }
-                else if (start_recording)
-                {
-                    temp[index] = column_types[table_num][i][j];
-                    index++;
-                }
-            }
-            pthread_mutex_unlock(&params.lock);
-            temp[index] = '\0';
-            int col_size = atoi(temp);
-            if (col_size < len_str)
-            {
-                return -1;
-            }
-        }
-    }
-    return 1;
-}
+    /// The value as a number, for float columns
+    double float_value;
+};
 
 /**
- * @brief Check if the value has the correct matching column names
+ * @brief Checks if the value passes all parsing
  *
  * @param val_to_set value to parse
- * @param num_columns number of columns for the table
- * @param table_num index of the table parsing
- * @param mycolumns names of the columns
- * @return returns true(1) if all column names match, false(-1) if it doesn't
+ * @param table_num table index for the parsing
+ * @param fields where to store the columns of the value
+ * @return returns true(1) if matches all parsing, false(-1) if it doesn't
  */
-int check_mycolumns(char val_to_set[MAX_VALUE_LEN], int num_columns, int table_num, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN])
+int parse_value(char val_to_set[MAX_VALUE_LEN], int table_num, struct schema_field fields[MAX_COLUMNS_PER_TABLE])
 {
-    int i;
-    char val[MAX_VALUE_LEN], val_temp[MAX_VALUE_LEN], strtoktemp[MAX_VALUE_LEN];
-
-    for (i = 0; i < num_columns; i++)
+    if (schema_parse_value(&schema_current()->tables[table_num], val_to_set, fields) == -1)
     {
-        strcpy(strtoktemp, val_to_set);
-        get_param(strtoktemp, val_temp, i, ",\0");
-
-        strcpy(strtoktemp, val_temp);
-        get_param(strtoktemp, val, 0, " \0");
-
-        pthread_mutex_lock(&params.lock);
-        if (strcmp(val, mycolumns[table_num][i]))
-        {
-            pthread_mutex_unlock(&params.lock);
-            return -1;
-        }
-        pthread_mutex_unlock(&params.lock);
+        return -1;
     }
     return 1;
 }
 
 /**
- * @brief Check if the value has the correct number of columns
+ * @brief Split a predicate into its column, operator and value and check them
  *
- * @param val_to_set value to parse
- * @param num_columns number of columns for the table
- * @return returns true(1) if right number of columns, false(-1) if it doesn't
+ * The operator is the first of '>', '<' or '=' in the predicate. Int and
+ * float columns take any of them and a number, string columns only '='.
+ *
+ * @param pred predicate to parse
+ * @param table_num index of the table parsing
+ * @param compiled where to store the parsed predicate
+ * @return returns true(1) if the predicate is valid, false(-1) if it isn't
  */
-int num_col_val(char val_to_set[MAX_VALUE_LEN], int num_columns)
+int compile_predicate(struct token pred, int table_num, struct predicate *compiled)
 {
-    int i;
-    char val[MAX_VALUE_LEN], old_val[MAX_VALUE_LEN], strtoktemp[MAX_VALUE_LEN];
-    strcpy(old_val, "");
+    const struct schema_table *table = &schema_current()->tables[table_num];
+    char column_name[MAX_COLNAME_LEN];
+    struct token column;
+    int i = 0;
 
-    for (i = 0; i < num_columns; i++)
+    while (i < pred.len && pred.start[i] != '>' && pred.start[i] != '<' && pred.start[i] != '=')
     {
-        strcpy(strtoktemp, val_to_set);
-        get_param(strtoktemp, val, i, ",\0");
-        if (!strcmp(val, old_val))
-        {
-            //too few columns in val_to_set
-            return -1;
-        }
-        strcpy(old_val, val);
+        i++;
     }
-    strcpy(strtoktemp, val_to_set);
-    get_param(strtoktemp, val, i, ",\0");
-
-    if (!strcmp(val, old_val))
+    if (i == pred.len)
     {
-        // correct number of columns in val_to_set
-        return 1;
+        // No operator
+        return -1;
     }
-    // too many columns in val_to_set
-    return -1;
-}
-
-/**
- * @brief Checks if the value passes all parsing
- *
- * @param val_to_set value to parse
- * @param table_num table index for the parsing
- * @return returns true(1) if matches all parsing, false(-1) if it doesn't
- */
-int parse_value(char val_to_set[MAX_VALUE_LEN], int table_num)
-{
-    if (num_col_val(val_to_set, params.numcolumnspertable[table_num]) == -1)
+    column.start = pred.start;
+    column.len = i;
+    compiled->op = pred.start[i];
+    compiled->value.start = pred.start + i + 1;
+    compiled->value.len = pred.len - i - 1;
+    compiled->value = token_trim(compiled->value);
+
+    if (token_copy(token_trim(column), column_name, MAX_COLNAME_LEN) == -1)
     {
         return -1;
     }
-    else if (check_mycolumns(val_to_set, params.numcolumnspertable[table_num], table_num, params.mycolumns) == -1 )
+    compiled->column = has_column(column_name, table_num);
+    if (compiled->column == -1)
     {
+        //column name doesn't exist
         return -1;
     }
-    else if (check_column_types(val_to_set, params.numcolumnspertable[table_num], table_num, params.column_types) == -1)
+    compiled->type = table->columns[compiled->column].type;
+
+    if (compiled->type == COLUMN_TYPE_INT)
+    {
+        // check that the comparing value is a int
+        return token_to_int(compiled->value, &compiled->int_value) == -1 ? -1 : 1;
+    }
+    if (compiled->type == COLUMN_TYPE_FLOAT)
     {
+        // converted once here, never while scanning
+        return token_to_double(compiled->value, &compiled->float_value) == -1 ? -1 : 1;
+    }
+    if (compiled->op != '=')
+    {
+        // Uses an illegal operator
         return -1;
     }
     return 1;
 }
 
 /**
- * @brief Check if all the predicates in the string are formatted correctly
+ * @brief Umbrella function for all predicate parsing
+ *
+ * An empty predicate string matches every record.
  *
  * @param predicates predicates to parse
- * @param num_columns number of columns for the table
  * @param table_num index of the table parsing
- * @param mycolumns names of the columns
- * @param column_types types of the columns
- * @param num_pred number of predicates to parse
- * @return returns true(1) if parses correctly, false(-1) if it doesn't
+ * @param compiled where to store the parsed predicates, which point into predicates
+ * @return returns the number of predicates if they parse, false(-1) if they don't
  */
-int check_predicates(char predicates[MAX_VALUE_LEN], int num_columns, int table_num, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10], int num_pred)
+int parse_predicates(struct token predicates, int table_num, struct predicate compiled[MAX_COLUMNS_PER_TABLE])
 {
-    int i, len_str;
-    char strtoktemp[MAX_VALUE_LEN], pred[MAX_VALUE_LEN], old_pred[MAX_VALUE_LEN], operator[MAX_VALUE_LEN], comparator[MAX_VALUE_LEN], column_name[MAX_COLNAME_LEN], temp[MAX_COLNAME_LEN];
-    strcpy(old_pred, "");
-    for (i = 0; i < num_pred; i++)
-    {
-        strcpy(strtoktemp, predicates);
-        get_param(strtoktemp, pred, i, ",\0");
+    int num_columns = schema_current()->tables[table_num].num_columns;
+    struct token preds[MAX_COLUMNS_PER_TABLE];
+    int column_has_pred[MAX_COLUMNS_PER_TABLE];
+    int i, num_pred;
 
-        split_query_get_column(pred, column_name);
-        strcpy(column_name, trim(column_name));
-        strcpy(temp, get_column_type(column_name, num_columns, table_num, mycolumns, column_types));
+    if (token_trim(predicates).len == 0)
+    {
+        return 0;
+    }
+    // A column can only be used once, so there are at most num_columns predicates
+    num_pred = token_split(predicates, ',', preds, num_columns);
+    if (num_pred == -1)
+    {
+        return -1;
+    }
 
-        if (!strcmp(temp, "int"))
+    // Use array to keep track of which columns have a predicate assigned already
+    for (i = 0; i < num_columns; i++)
+    {
+        column_has_pred[i] = 0;
+    }
+    for (i = 0; i < num_pred; i++)
+    {
+        if (compile_predicate(preds[i], table_num, &compiled[i]) == -1)
         {
-            if (!(strstr(pred, "=") || strstr(pred, ">") || strstr(pred, "<")))
-            {
-                // Uses an illegal operator
-                return -1;
-            }
-            // check that the comparing value is a int
-            split_query_get_value(pred, comparator);
-            strcpy(comparator, trim(comparator));
-            len_str = strlen(comparator);
-            if (comparator[0] == '-' || comparator[0] == '+')
-                len_str--;
-
-            if (atoi(comparator) == 0 || len_str != (floor(log10(abs(atoi(comparator)))) + 1))
-            {
-                if (atoi(comparator) >= 0 && len_str != (floor(log10(abs(atoi(comparator)))) + 2))
-                {
-                    if (strcmp(comparator, "0"))
-                        return -1;
-                }
-            }
+            return -1;
         }
-        else
+        if (column_has_pred[compiled[i].column] == 1)
         {
-            if (!strstr(pred, "="))
-            {
-                // Uses an illegal operator
-                return -1;
-            }
+            // column name has already been used
+            return -1;
         }
-        strcpy(old_pred, pred);
+        column_has_pred[compiled[i].column] = 1;
     }
-    return 1;
+    return num_pred;
 }
 
 /**
- * @brief Check if the predicate has the correct matching column names
+ * @brief Parse the column list of a SELECT
  *
- * @param pred_to_set predicate to parse
- * @param num_columns number of columns for the table
+ * An empty list, or "*", selects the whole value.
+ *
+ * @param columns comma separated column names
  * @param table_num index of the table parsing
- * @param mycolumns names of the columns
- * @return returns true(1) if all column names match, false(-1) if it doesn't
+ * @param selected where to store the indexes of the columns, in the order asked for
+ * @return returns the number of columns (0 for the whole value), false(-1) if they don't parse
  */
-int check_mycolumns_pred(char pred_to_set[MAX_VALUE_LEN], int num_columns, int table_num, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], int num_pred)
+int parse_columns(struct token columns, int table_num, int selected[MAX_COLUMNS_PER_TABLE])
 {
-    int i, col_index;
-    char pred[MAX_VALUE_LEN], pred_temp[MAX_VALUE_LEN], strtoktemp[MAX_VALUE_LEN];
-    int column_has_pred[num_columns];
+    int num_columns = schema_current()->tables[table_num].num_columns;
+    struct token names[MAX_COLUMNS_PER_TABLE];
+    char column_name[MAX_COLNAME_LEN];
+    int i, j, num_selected;
 
-    // Use array to keep track of which columns have a predicate assigned already
-    for (i = 0; i < num_columns; i++)
+    columns = token_trim(columns);
+    if (columns.len == 0 || token_equals(columns, "*"))
     {
-        column_has_pred[i] = 0;
+        return 0;
     }
-
-    for (i = 0; i < num_pred; i++)
+    num_selected = token_split(columns, ',', names, num_columns);
+    if (num_selected == -1)
     {
-        strcpy(strtoktemp, pred_to_set);
-        get_param(strtoktemp, pred_temp, i, ",\0");
-
-        split_query_get_column(pred_temp, pred);
-        strcpy(pred, trim(pred));
-
-        col_index = has_column(pred, mycolumns, num_columns, table_num);
-
-        if (col_index == -1)
+        return -1;
+    }
+    for (i = 0; i < num_selected; i++)
+    {
+        if (token_copy(token_trim(names[i]), column_name, MAX_COLNAME_LEN) == -1)
         {
-            //column name doesn't exist
             return -1;
         }
-        if (column_has_pred[col_index] == 1)
+        selected[i] = has_column(column_name, table_num);
+        if (selected[i] == -1)
         {
-            // column name has already been used
             return -1;
         }
-        column_has_pred[col_index] = 1;
+        for (j = 0; j < i; j++)
+        {
+            if (selected[j] == selected[i])
+            {
+                // column name has already been used
+                return -1;
+            }
+        }
     }
-    return 1;
+    return num_selected;
 }
 
 /**
- * @brief Check if the predicate string has the correct number of predicates
+ * @brief Write parsed predicates in a canonical form
  *
- * @param predicates predicates to parse
- * @param num_columns number of columns for the table
- * @return returns number of predicates if right number of predicates, false(-1) if there are too many
+ * Predicates that select the same records the same way give the same
+ * string, whatever their order, spacing or leading zeroes.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param normalized where to write the canonical form
+ * @return no return value
  */
-int num_of_predicates(char predicates[MAX_VALUE_LEN], int num_columns)
+void normalize_predicates(const struct predicate *predicates, int num_pred, char normalized[MAX_CMD_LEN])
 {
-    int i;
-    char pred[MAX_VALUE_LEN], old_pred[MAX_VALUE_LEN], strtoktemp[MAX_VALUE_LEN];
-    strcpy(old_pred, "");
+    int column, i, len = 0;
 
-    for (i = 0; i < num_columns; i++)
+    normalized[0] = '\0';
+    // Each column has at most one predicate, so column order is canonical
+    for (column = 0; column < MAX_COLUMNS_PER_TABLE; column++)
     {
-        strcpy(strtoktemp, predicates);
-        get_param(strtoktemp, pred, i, ",\0");
-
-        if (!strcmp(pred, old_pred))
+        for (i = 0; i < num_pred; i++)
         {
-            // num of predicates is less than num_columns
-            return i;
+            if (predicates[i].column != column)
+            {
+                continue;
+            }
+            if (predicates[i].type == COLUMN_TYPE_INT)
+            {
+                len += snprintf(normalized + len, MAX_CMD_LEN - len, "%d%c%d,", column, predicates[i].op, predicates[i].int_value);
+            }
+            else if (predicates[i].type == COLUMN_TYPE_FLOAT)
+            {
+                len += snprintf(normalized + len, MAX_CMD_LEN - len, "%d%c%.17g,", column, predicates[i].op, predicates[i].float_value);
+            }
+            else
+            {
+                len += snprintf(normalized + len, MAX_CMD_LEN - len, "%d=%.*s,", column, predicates[i].value.len, predicates[i].value.start);
+            }
         }
-        strcpy(old_pred, pred);
     }
-    strcpy(strtoktemp, predicates);
-    get_param(strtoktemp, pred, i, ",\0");
-    if (!strcmp(pred, old_pred))
-    {
-        // num of predicates is equal to num_columns
-        return num_columns;
-    }
-    // too many columns in val_to_set
-    return -1;
-}
-
-/**
- * @brief Umbrella function for all predicate parsing
- *
- * @param predicates predicates to parse
- * @param table_num index of the table parsing
- * @param params config parameters from config file
- * @return returns true(1) if matches all parsing, false(0) if it doesn't
- */
-int parse_predicates(char predicates[MAX_VALUE_LEN], int table_num)
-{
-    int i = num_of_predicates(predicates, params.numcolumnspertable[table_num]);
-    if (i == -1)
-    {
-        return -1;
-    }
-    if (check_mycolumns_pred(predicates, params.numcolumnspertable[table_num], table_num, params.mycolumns, i) == -1 )
-    {
-        return -1;
-    }
-    if (check_predicates(predicates, params.numcolumnspertable[table_num], table_num, params.mycolumns, params.column_types, i) == -1 )
-    {
-        return -1;
-    }
-    return i;
 }
 
 /**
@@ -621,9 +696,11 @@ int parse_predicates(char predicates[MAX_VALUE_LEN], int table_num)
  */
 void get_command(char key_to_get[MAX_KEY_LEN], char value_to_get[MAX_VALUE_LEN], int first_empty, int table_num)
 {
-    int index = 0, start = 0, i;
-    char val_to_ret[MAX_VALUE_LEN], strtoktemp[MAX_CMD_LEN];
-    strcpy(val_to_ret, "");
+    int index = 0;
+    char strtoktemp[MAX_CMD_LEN], key[MAX_KEY_LEN];
+    unsigned long metadata;
+    struct server_record *record;
+    unsigned int seq;
 
     if (first_empty == 0)
     {
@@ -632,232 +709,111 @@ void get_command(char key_to_get[MAX_KEY_LEN], char value_to_get[MAX_VALUE_LEN],
     }
     while (index < first_empty)
     {
-        pthread_mutex_lock(&tables[table_num][index].lock);
-        if (!strcmp(tables[table_num][index].key, key_to_get))
+        record_read_key(&tables[table_num][index], key);
+        if (!strcmp(key, key_to_get))
         {
-            pthread_mutex_unlock(&tables[table_num][index].lock);
             break;
         }
-        pthread_mutex_unlock(&tables[table_num][index].lock);
         index++;
     }
-    pthread_mutex_lock(&tables[table_num][index].lock);
-    if (index == first_empty && strcmp(tables[table_num][index].key, key_to_get))
+    if (index == first_empty)
     {
-        pthread_mutex_unlock(&tables[table_num][index].lock);
         strcpy(value_to_get, "ERR_KEY_NOT_FOUND");
         return;
     }
-    strcpy(value_to_get, tables[table_num][index].value);
-    strcat(value_to_get, ";");
-    snprintf(strtoktemp, MAX_CMD_LEN, "%d", tables[table_num][index].metadata);
-    strcat(value_to_get, strtoktemp);
-    pthread_mutex_unlock(&tables[table_num][index].lock);
-}
-
-void get_command_perm(char key_to_get[MAX_KEY_LEN], FILE *fileLoadData, char value_to_get[MAX_VALUE_LEN])
-{
-    char loadLine[MAX_VALUE_LEN];
-    char loadLineTemp1[MAX_VALUE_LEN];
-    char loadlineTemp2[MAX_VALUE_LEN];
-    char *pch = NULL;
-
-    bool stopLoad;
-    bool firstPass;
-    bool found;
-    size_t lengthString;
-
-    firstPass = true;
-    stopLoad = false;
-    found = false;
-
-    strcpy(loadLine, "");
-    strcpy(loadLineTemp1, "");
-    strcpy(loadlineTemp2, "");
-    strcpy(value_to_get, "");
-
-    if (fileLoadData)
-        do
-        {
-            strcpy (loadLineTemp1, loadLine);
-            fgets(loadLine, MAX_VALUE_LEN, fileLoadData);
-
-            lengthString = strlen(loadLine) - 1;
-            if (loadLine[lengthString] == '\n')
-                loadLine[lengthString] = '\0';
-            strcpy (loadlineTemp2, loadLine);
-            pch = strtok (loadlineTemp2, ":");
-
-            if ( (firstPass == false) && (strcmp(loadLineTemp1, loadLine) == 0) )
-                stopLoad = true;
-            else
-            {
-                if (strcmp(loadlineTemp2, key_to_get) == 0)
-                {
-                    found = true;
-                    pch = strtok (NULL, ":");
-                    strcpy(value_to_get, pch);
-                }
-            }
 
-            if (firstPass == true)
-                firstPass = false;
-
-        }
-        while (stopLoad == false);
+    // The row may be rewritten or shifted by a delete between the key match
+    // and the copy, so check the key again in the same read section
+    record = &tables[table_num][index];
+    do
+    {
+        seq = record_read_begin(record);
+        memcpy(key, record->key, MAX_KEY_LEN);
+        memcpy(value_to_get, values[table_num][index].value, MAX_VALUE_LEN);
+        metadata = record->metadata;
+    }
+    while (record_read_retry(record, seq));
+    key[MAX_KEY_LEN - 1] = '\0';
+    value_to_get[MAX_VALUE_LEN - 1] = '\0';
 
-    if (found == false)
+    if (strcmp(key, key_to_get))
+    {
         strcpy(value_to_get, "ERR_KEY_NOT_FOUND");
-
+        return;
+    }
+    strcat(value_to_get, ";");
+    snprintf(strtoktemp, MAX_CMD_LEN, "%lu", metadata);
+    strcat(value_to_get, strtoktemp);
 }
 
-void get_command_specific_perm(int lineNumber, FILE *fileLoadData, char value_to_get[MAX_VALUE_LEN])
+/**
+ * @brief Store the int columns of a value next to it
+ *
+ * The caller must be the record's writer.
+ *
+ * @param table_num index of the table parsing
+ * @param index index of the record
+ * @param fields the columns of the value, from parse_value()
+ * @return no return value
+ */
+void store_fields(int table_num, int index, const struct schema_field fields[MAX_COLUMNS_PER_TABLE])
 {
+    int i, num_columns = schema_current()->tables[table_num].num_columns;
 
-    char loadLine[MAX_VALUE_LEN];
-    char loadLineTemp1[MAX_VALUE_LEN];
-    char loadlineTemp2[MAX_VALUE_LEN];
-    char *pch2 = NULL;
-    int i;
-
-    bool stopLoad;
-    bool firstPass;
-    bool found;
-    size_t lengthString;
-
-    firstPass = true;
-    stopLoad = false;
-    found = false;
-
-    strcpy(loadLine, "");
-    strcpy(loadLineTemp1, "");
-    strcpy(loadlineTemp2, "");
-    strcpy(value_to_get, "");
-
-    for (i = 0; i <= lineNumber; i++)
+    for (i = 0; i < num_columns; i++)
     {
-        strcpy (loadLineTemp1, loadLine);
-        fgets(loadLine, MAX_VALUE_LEN, fileLoadData);
-
-        lengthString = strlen(loadLine) - 1;
-        if (loadLine[lengthString] == '\n')
-            loadLine[lengthString] = '\0';
-
-        strcpy (loadlineTemp2, loadLine);
-        if ( (firstPass == false) && (strcmp(loadLineTemp1, loadLine) == 0) )
-            stopLoad = true;
-        else
-        {
-            found = true;
-            get_param(loadlineTemp2, value_to_get, 1, ":\0");
-        }
-        if (firstPass == true)
-            firstPass = false;
-
+        values[table_num][index].ints[i] = fields[i].int_value;
+        values[table_num][index].floats[i] = fields[i].float_value;
     }
-
-    if (stopLoad == true)
-        strcpy(value_to_get, "STOP_LOADING");
-
 }
 
 /**
- * @brief Set the item using key_to_set and value_to_set
+ * @brief Append a new item using key_to_set and value_to_set
+ *
+ * The caller must hold table_shape_lock for the table (shared) and have
+ * added key_to_set to the key index, so no other SET appends it too.
  *
  * @param key_to_set key to set
  * @param value_to_set value to set
- * @param first_empty index of the first empty spot in keys & values
+ * @param fields the columns of value_to_set, from parse_value()
  * @param table_num index of the table parsing
+ * @param logged where to store the redo log number of the change for redo_log_wait(), left alone if it was not logged
  * @return returns success string if it works (ERR_UNKNOWN if table already at max)
  */
-char *set_command(char key_to_set[MAX_KEY_LEN], char value_to_set[MAX_VALUE_LEN],  int first_empty, int table_num)
+char *set_command(char key_to_set[MAX_KEY_LEN], char value_to_set[MAX_VALUE_LEN], const struct schema_field fields[MAX_COLUMNS_PER_TABLE], int table_num, unsigned long *logged)
 {
-    if (first_empty > MAX_RECORDS_PER_TABLE)
+    int slot = reserve_slot(table_num);
+    if (slot == -1)
     {
+        key_index_remove(table_num, key_to_set);
         return "ERR_UNKNOWN";
     }
-    pthread_mutex_lock(&tables[table_num][first_empty].lock);
-    strcpy(tables[table_num][first_empty].key, key_to_set);
-    strcpy(tables[table_num][first_empty].value, value_to_set);
-    tables[table_num][first_empty].metadata = (unsigned long)time(NULL);
-    pthread_mutex_unlock(&tables[table_num][first_empty].lock);
-    return "SUCCESS";
-}
-
-char *set_command_perm(char key_to_set[MAX_KEY_LEN], char value_to_set[MAX_VALUE_LEN], FILE *fileLoadData, FILE *fileWriteData)
-{
-    // Set, Update, Delete Functionality
-
-    char loadLine[MAX_VALUE_LEN];
-    char loadLineTemp1[MAX_VALUE_LEN];
-    char loadLineTemp2[MAX_VALUE_LEN];
-    char *pch = NULL;
-
-    bool stopLoad;
-    bool firstPass;
-    bool found;
-    bool insert;
-    bool deletef;
-
-    size_t lengthString;
-
-    strcpy(loadLine, "");
-    strcpy(loadLineTemp1, "");
-    strcpy(loadLineTemp2, "");
-
-    firstPass = true;
-    stopLoad = false;
-    insert = true;
-    deletef = false;
-
-    if (fileLoadData != NULL)
+    record_write_begin(table_num, slot);
+    strcpy(tables[table_num][slot].key, key_to_set);
+    strcpy(values[table_num][slot].value, value_to_set);
+    store_fields(table_num, slot, fields);
+    tables[table_num][slot].metadata = (unsigned long)time(NULL);
+    record_write_end(table_num, slot);
+    if (params.snapshot_interval > 0)
     {
-        do
+        // Nobody can find the record before it is published, and once it
+        // is, an update must not be logged ahead of it
+        if (!owners_only())
         {
-            strcpy (loadLineTemp1, loadLine);
-            fgets(loadLine, 100, fileLoadData);
-
-            lengthString = strlen(loadLine) - 1;
-            if (loadLine[lengthString] == '\n')
-                loadLine[lengthString] = '\0';
-            strcpy (loadLineTemp2, loadLine);
-            pch = strtok (loadLineTemp2, ":");
-
-            if ( (firstPass == false) && (strcmp(loadLineTemp1, loadLine) == 0) )
-                stopLoad = true;
-            else
-            {
-                if (strcmp(loadLineTemp2, key_to_set) == 0)
-                {
-                    insert = false;
-                    if (deletef == false)
-                    {
-                        fprintf(fileWriteData, "%s:", key_to_set);
-                        fprintf(fileWriteData, "%s", value_to_set);
-                        fprintf(fileWriteData, "\n");
-                    }
-                }
-                else
-                {
-                    if (strcmp(loadLine, "") != 0)
-                        fprintf(fileWriteData, "%s\n", loadLine);
-                }
-            }
-
-            if (firstPass == true)
-                firstPass = false;
-
+            lock_record(table_num, slot);
+        }
+        publish_slot(table_num, slot);
+        *logged = redo_log_set(table_num, key_to_set, tables[table_num][slot].metadata, value_to_set);
+        if (!owners_only())
+        {
+            unlock_record(table_num, slot);
         }
-        while (stopLoad == false);
-
     }
-
-    if (insert == true)
+    else
     {
-        fprintf(fileWriteData, "%s:", key_to_set);
-        fprintf(fileWriteData, "%s", value_to_set);
-        fprintf(fileWriteData, "\n");
+        publish_slot(table_num, slot);
     }
+    table_written(table_num);
     return "SUCCESS";
 }
 
@@ -866,22 +822,34 @@ char *set_command_perm(char key_to_set[MAX_KEY_LEN], char value_to_set[MAX_VALUE
  *
  * @param key_to_update key to set
  * @param value_to_update value to set
+ * @param fields the columns of value_to_update, from parse_value()
  * @param record_loc index of the record to update
  * @param table_num index of the table parsing
  * @param meta_data_recieved meta data recieved from client
- * @return returns success string if it works (always successful, due to key_exist() check)
+ * @param logged where to store the redo log number of the change for redo_log_wait(), left alone if it was not logged
+ * @return returns success string if it works (ERR_TRANSACTION_ABORT on a metadata mismatch)
  */
-char *update_command(char key_to_update[MAX_KEY_LEN], char value_to_update[MAX_VALUE_LEN], int record_loc, int table_num, unsigned long int meta_data_recieved)
+char *update_command(char key_to_update[MAX_KEY_LEN], char value_to_update[MAX_VALUE_LEN], const struct schema_field fields[MAX_COLUMNS_PER_TABLE], int record_loc, int table_num, unsigned long int meta_data_recieved, unsigned long *logged)
 {
-    pthread_mutex_lock(&tables[table_num][record_loc].lock);
+    if (!owners_only())
+    {
+        lock_record(table_num, record_loc);
+    }
     if ((tables[table_num][record_loc].metadata != meta_data_recieved) && (meta_data_recieved != 0))
     {
-        pthread_mutex_unlock(&tables[table_num][record_loc].lock);
+        if (!owners_only())
+        {
+            unlock_record(table_num, record_loc);
+        }
         strcpy(value_to_update, "ERR_TRANSACTION_ABORT");
         return "ERR_TRANSACTION_ABORT";
     }
+    // Already holding the writer lock, so only the sequence has to move
+    __atomic_store_n(&tables[table_num][record_loc].seq, tables[table_num][record_loc].seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
     strcpy(tables[table_num][record_loc].key, key_to_update);
-    strcpy(tables[table_num][record_loc].value, value_to_update);
+    strcpy(values[table_num][record_loc].value, value_to_update);
+    store_fields(table_num, record_loc, fields);
     unsigned long new_meta = (unsigned long)time(NULL);
     if (tables[table_num][record_loc].metadata >= new_meta)
     {
@@ -891,615 +859,2797 @@ char *update_command(char key_to_update[MAX_KEY_LEN], char value_to_update[MAX_V
     {
         tables[table_num][record_loc].metadata = new_meta;
     }
-    pthread_mutex_unlock(&tables[table_num][record_loc].lock);
+    if (params.snapshot_interval > 0)
+    {
+        *logged = redo_log_set(table_num, key_to_update, tables[table_num][record_loc].metadata, value_to_update);
+    }
+    record_write_end(table_num, record_loc);
+    table_written(table_num);
     return "SUCCESS";
 }
 
 /**
- * @brief Get the index of the column based on the column name given
+ * @brief Update the item with key_to_set if it exists, append it otherwise
  *
- * @param column_name column name to find the type for
- * @param mycolumns names of the columns
+ * @param key_to_set key to set
+ * @param value_to_set value to set
+ * @param meta_data_recieved meta data recieved from client
  * @param table_num index of the table parsing
- * @return return the index of the column name given
+ * @param logged where to store the redo log number of the change for redo_log_wait(), left alone if it was not logged
+ * @return returns the reply for the client (ERR_INVALID_PARAM if the value does not match the table)
  */
-int get_column_index(char column_name[MAX_COLNAME_LEN], char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], int table_num)
+char *set_in_memory(char key_to_set[MAX_KEY_LEN], char value_to_set[MAX_VALUE_LEN], unsigned long meta_data_recieved, int table_num, unsigned long *logged)
 {
-    int i;
-    for (i = 0; i < MAX_COLUMNS_PER_TABLE; i++)
+    struct schema_field fields[MAX_COLUMNS_PER_TABLE];
+    char *reply;
+    int has_key;
+
+    if (!owners_only())
+    {
+        pthread_rwlock_rdlock(&table_shape_lock[table_num]);
+    }
+    has_key = key_exist(key_to_set, table_rows(table_num), table_num);
+    while (has_key == -1 && !key_index_insert(table_num, key_to_set))
+    {
+        // Another SET is appending the same key; once its record is
+        // published this one updates it instead
+        sched_yield();
+        has_key = key_exist(key_to_set, table_rows(table_num), table_num);
+    }
+    if (has_key != -1)
+    {
+        // Key exists, do an update
+        trim(value_to_set);
+    }
+    if (parse_value(value_to_set, table_num, fields) != 1)
     {
-        if (!strcmp(column_name, mycolumns[table_num][i]))
+        // value string does not match the setup of the table
+        reply = "ERR_INVALID_PARAM";
+        if (has_key == -1)
         {
-            return i;
+            key_index_remove(table_num, key_to_set);
         }
     }
+    else if (has_key != -1)
+    {
+        reply = update_command(key_to_set, value_to_set, fields, has_key, table_num, meta_data_recieved, logged);
+    }
+    else
+    {
+        reply = set_command(key_to_set, value_to_set, fields, table_num, logged);
+    }
+    if (!owners_only())
+    {
+        pthread_rwlock_unlock(&table_shape_lock[table_num]);
+    }
+    return reply;
 }
 
 /**
- * @brief Check if the value in the row index and column index passes the predicate
+ * @brief Check an int column against an int predicate
  *
- * @param predicate predicate to test for true or false
- * @param table_num index of the table parsing
- * @param column_index index of the column to check the predicate for
- * @param row_index index of the row to check the predicate for
- * @param column_types types of the columns
- * @return returns true(1) if the predicate is true, false(0) if it doesn't
+ * @param pred the predicate
+ * @param val_in_table the column's value
+ * @return returns true(1) if the predicate is true, false(0) if it isn't
  */
-int predicate_true(char predicate[MAX_VALUE_LEN],  int table_num, int column_index, int row_index, char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10])
+static inline int predicate_int_true(const struct predicate *pred, int val_in_table)
 {
-    char strtoktemp[MAX_VALUE_LEN], operator[MAX_VALUE_LEN], val_to_measure[MAX_VALUE_LEN], col_str[MAX_VALUE_LEN], table_val[MAX_VALUE_LEN];
-    int int_to_measure, val_in_table;
-
-    if (strstr(column_types[table_num][column_index], "int"))
+    if (pred->op == '>')
     {
-        // column is of type int
-        split_query_get_value(predicate, val_to_measure);
-
-        int_to_measure = atoi(val_to_measure);
-
-        pthread_mutex_lock(&tables[table_num][row_index].lock);
-        strcpy(strtoktemp, tables[table_num][row_index].value);
-        pthread_mutex_unlock(&tables[table_num][row_index].lock);
-        get_param(strtoktemp, col_str, column_index, ",\0");
-
-        strcpy(strtoktemp, col_str);
-        get_param(strtoktemp, table_val, 1, " \0");
-
-        val_in_table = atoi(table_val);
-
-        if (strstr(predicate, ">"))
-        {
-            if (val_in_table > int_to_measure)
-            {
-                return 1;
-            }
-            return -1;
-        }
-        else if (strstr(predicate, "<"))
-        {
-            if (val_in_table < int_to_measure)
-            {
-                return 1;
-            }
-            return -1;
-        }
-        else if (strstr(predicate, "="))
-        {
-            if (val_in_table == int_to_measure)
-            {
-                return 1;
-            }
-            return -1;
-        }
+        return val_in_table > pred->int_value;
     }
-    else
+    if (pred->op == '<')
     {
-        // column is of type int, only operator is '='
-        split_query_get_value(predicate, val_to_measure);
-
-        pthread_mutex_lock(&tables[table_num][row_index].lock);
-        strcpy(strtoktemp, tables[table_num][row_index].value);
-        pthread_mutex_unlock(&tables[table_num][row_index].lock);
-
-        get_param(strtoktemp, col_str, column_index, ",\0");
-        strcpy(strtoktemp, col_str);
-        get_param(strtoktemp, table_val, 1, " \0");
-
-        if (!strcmp(val_to_measure, table_val))
-        {
-            // String equals the predicate value
-            return 1;
-        }
-        // String does not equal the predicate value
-        return -1;
+        return val_in_table < pred->int_value;
     }
+    return val_in_table == pred->int_value;
 }
 
-int predicate_true_perm(char predicate[MAX_VALUE_LEN], char lineFromFile [MAX_VALUE_LEN], int table_num, int column_index, int row_index, char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10])
+/**
+ * @brief Check a float column against a float predicate
+ *
+ * @param pred the predicate
+ * @param val_in_table the column's value
+ * @return returns true(1) if the predicate is true, false(0) if it isn't
+ */
+static inline int predicate_float_true(const struct predicate *pred, double val_in_table)
 {
-    char strtoktemp[MAX_VALUE_LEN], operator[MAX_VALUE_LEN], val_to_measure[MAX_VALUE_LEN];
-    int int_to_measure, val_in_table, i;
-    char *pch;
-
-    if (strstr(column_types[table_num][column_index], "int"))
+    if (pred->op == '>')
+    {
+        return val_in_table > pred->float_value;
+    }
+    if (pred->op == '<')
     {
-        // column is of type int
-        split_query_get_value(predicate, val_to_measure);
+        return val_in_table < pred->float_value;
+    }
+    return val_in_table == pred->float_value;
+}
 
-        int_to_measure = atoi(val_to_measure);
+/**
+ * @brief Check if a record value passes the predicates
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param value the record value, split into its columns once
+ * @return returns true(1) if all predicates are true, false(-1) if one isn't
+ */
+int predicates_match(const struct predicate *predicates, int num_pred, struct token value)
+{
+    struct token columns[MAX_COLUMNS_PER_TABLE], name, val;
+    int i, num_columns, val_in_table;
+    double float_in_table;
 
-        strcpy(strtoktemp, lineFromFile);
-        pch = strtok (strtoktemp, ":");
+    if (num_pred == 0)
+    {
+        return 1;
+    }
+    num_columns = token_split(value, ',', columns, MAX_COLUMNS_PER_TABLE);
 
-        for (i = column_index; i > 0; i--)
+    for (i = 0; i < num_pred; i++)
+    {
+        if (predicates[i].column >= num_columns)
         {
-            pch = strtok (NULL, ",");
+            return -1;
         }
+        token_name_value(token_trim(columns[predicates[i].column]), &name, &val);
 
-        strcpy(strtoktemp, pch);
-        pch = strtok (strtoktemp, " ");
-        pch = strtok (NULL, " ");
-
-        val_in_table = atoi(pch);
-
-
-        if (strstr(predicate, ">"))
+        if (predicates[i].type == COLUMN_TYPE_INT)
         {
-            if (val_in_table > int_to_measure)
+            if (token_to_int(val, &val_in_table) == -1 || !predicate_int_true(&predicates[i], val_in_table))
             {
-                return 1;
+                return -1;
             }
-            return -1;
         }
-        else if (operator[0] == '<')
+        else if (predicates[i].type == COLUMN_TYPE_FLOAT)
         {
-            if (val_in_table < int_to_measure)
+            if (token_to_double(val, &float_in_table) == -1 || !predicate_float_true(&predicates[i], float_in_table))
             {
-                return 1;
+                return -1;
             }
-            return -1;
         }
-        else if (operator[0] == '=')
+        else if (!token_same(val, predicates[i].value))
         {
-            if (val_in_table == int_to_measure)
-            {
-                return 1;
-            }
+            // only operator on strings is '='
             return -1;
         }
     }
-    else
-    {
-        // column is of type int, only operator is '='
-
-        strcpy(strtoktemp, predicate);
-        get_param(strtoktemp, val_to_measure, column_index, " \0");
-
-        strcpy(strtoktemp, lineFromFile);
-
-        get_param(strtoktemp, lineFromFile, 0, ":");
-
-        if (!strcmp(val_to_measure, lineFromFile))
-        {
-            // String equals the predicate value
-            return 1;
-        }
-        // String does not equal the predicate value
-        return -1;
-    }
+    return 1;
 }
 
-
 /**
- * @brief Check if the value in the row index and column index passes the predicates
+ * @brief Check if the record in the row index passes the predicates
+ *
+ * Predicates on int and float columns only are checked against the
+ * numbers stored with the record, without reading its value.
  *
- * @param predicates predicates to check if true or false
- * @param numcolumns number of columns in the table
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
  * @param table_num index of the table parsing
- * @param mycolumns names of the columns
- * @param column_types types of the columns
  * @param row_index index of the row to check the predicate for
- * @return returns true(1) if the predicate is true, false(0) if it doesn't
+ * @return returns true(1) if the predicate is true, false(-1) if it doesn't
  */
-int predicates_true(char predicates[MAX_VALUE_LEN],  int num_columns, int table_num, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10], int row_index)
+int predicates_true(const struct predicate *predicates, int num_pred, int table_num, int row_index)
 {
-    char strtoktemp[MAX_VALUE_LEN], pred[MAX_VALUE_LEN], old_pred[MAX_VALUE_LEN], column_name[MAX_COLNAME_LEN];
-    int index = 0, col_index;
+    char value[MAX_VALUE_LEN];
+    int ints[MAX_COLUMNS_PER_TABLE];
+    double floats[MAX_COLUMNS_PER_TABLE];
+    struct token tok;
+    int i, only_numbers = 1;
 
-    strcpy(old_pred, "");
-    strcpy(strtoktemp, predicates);
-    get_param(strtoktemp, pred, index, ",\0");
-
-    while (strcmp(pred, old_pred) != 0)
+    if (num_pred == 0)
     {
-        split_query_get_column(pred, column_name);
-        strcpy(column_name, trim(column_name));
-
-        col_index = get_column_index(column_name, mycolumns, table_num);
-        if (predicate_true(pred, table_num, col_index, row_index, column_types) == -1)
+        return 1;
+    }
+    for (i = 0; i < num_pred; i++)
+    {
+        if (predicates[i].type == COLUMN_TYPE_CHAR)
         {
-            return -1;
+            only_numbers = 0;
         }
-        index++;
-        strcpy(old_pred, pred);
-
-        strcpy(strtoktemp, predicates);
-        get_param(strtoktemp, pred, index, ",\0");
     }
-    return 1;
-}
-
-int predicates_true_perm(char predicates[MAX_VALUE_LEN], char lineFromFile [MAX_VALUE_LEN], int num_columns, int table_num, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10], int row_index)
-{
-    char strtoktemp[MAX_VALUE_LEN], pred[MAX_VALUE_LEN], old_pred[MAX_VALUE_LEN], column_name[MAX_COLNAME_LEN];
-    int index = 0, col_index;
-
-    strcpy(old_pred, "");
-    strcpy(strtoktemp, predicates);
-    get_param(strtoktemp, pred, index, ",\0");
-
-    while (strcmp(pred, old_pred) != 0)
+    if (only_numbers)
     {
-        strcpy(strtoktemp, pred);
-        get_param(strtoktemp, column_name, 0, " \0");
-
-        col_index = get_column_index(column_name, mycolumns, table_num);
-
-        if (predicate_true_perm(pred, lineFromFile, table_num, col_index, row_index, column_types) == -1)
+        record_read_numbers(table_num, row_index, ints, floats);
+        for (i = 0; i < num_pred; i++)
         {
-            return -1;
+            if (predicates[i].type == COLUMN_TYPE_INT ? !predicate_int_true(&predicates[i], ints[predicates[i].column])
+                                                      : !predicate_float_true(&predicates[i], floats[predicates[i].column]))
+            {
+                return -1;
+            }
         }
-        index++;
-        strcpy(old_pred, pred);
-
-        strcpy(strtoktemp, predicates);
-        get_param(strtoktemp, pred, index, ",\0");
+        return 1;
     }
-    return 1;
+    record_read_value(table_num, row_index, value, NULL);
+    tok.start = value;
+    tok.len = strlen(value);
+    return predicates_match(predicates, num_pred, tok);
 }
 
-
 /**
- * @brief Query the table for matching values
+ * @brief Check if a value read from a table file passes the predicates
  *
- * @param sock The socket connected to the client.
- * @param predicates predicates to check if true or false
- * @param first_empty index of the first empty spot in keys & values
- * @param table_num index of the table parsing
- * @param numcolumns number of columns in the table
- * @param mycolumns names of the columns
- * @param column_types types of the columns
- * @return returns the status for the server
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param lineFromFile the value of the record
+ * @return returns true(1) if the predicate is true, false(-1) if it doesn't
  */
-int query_command(int sock, char predicates[MAX_VALUE_LEN],  int first_empty, int table_num, int num_columns, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10])
+int predicates_true_perm(const struct predicate *predicates, int num_pred, char lineFromFile [MAX_VALUE_LEN])
 {
-    int matched_lines[MAX_RECORDS_PER_TABLE];
-    char comm_string[MAX_CMD_LEN];
-    int i, index = 0;
-    strcpy(comm_string, "");
+    struct token tok;
 
-    for (i = 0; i < first_empty; i++ )
-    {
-        if (predicates_true(predicates, num_columns, table_num, mycolumns, column_types, i) == 1)
-        {
-            matched_lines[index] = i;
-            index++;
-        }
-    }
+    tok.start = lineFromFile;
+    tok.len = strlen(lineFromFile);
+    return predicates_match(predicates, num_pred, tok);
+}
 
-    if (index == 0)
-    {
-        // There are no records in the table that match the predicates
-        strcpy(comm_string, "-1;0");
-        sendall(sock, comm_string, strlen(comm_string));
-        sendall(sock, "\n", 1);
-        return 0;
-    }
 
-    for (i = 0; i < index; i++)
+/**
+ * @brief Find a column of a record value
+ *
+ * @param value the record value
+ * @param column index of the column
+ * @param column_value where to store the value of the column
+ * @return returns true(1) if the value has the column, false(-1) if it doesn't
+ */
+int column_token(struct token value, int column, struct token *column_value)
+{
+    struct token columns[MAX_COLUMNS_PER_TABLE], name;
+
+    if (token_split(value, ',', columns, MAX_COLUMNS_PER_TABLE) <= column)
     {
-        sprintf(comm_string, "%d", index - 1 - i);
-        strcat(comm_string, ";");
-        strcat(comm_string, tables[table_num][matched_lines[i]].key);
-        strcat(comm_string, "\n\0");
-        if (sendall(sock, comm_string, strlen(comm_string)) == 0 && recvline(sock, comm_string, MAX_CMD_LEN) == 0)
-        {
-            // Everything little thing is gonna be all right
-        }
+        return -1;
     }
-    return 0;
+    token_name_value(token_trim(columns[column]), &name, column_value);
+    return 1;
 }
 
-int query_command_perm(int sock, char predicates[MAX_VALUE_LEN], int table_num, int num_columns, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10], FILE *fileToLoad)
+/**
+ * @brief The aggregates of one group of an AGGREGATE
+ */
+struct aggregate_group {
+    /// Value of the GROUP BY column, "" without one
+    char name[MAX_STRTYPE_SIZE + 1];
+
+    /// Number of records in the group
+    long long count;
+
+    /// Sum, minimum and maximum of the aggregated column; doubles hold
+    /// every int sum of a table exactly
+    double sum;
+    double min;
+    double max;
+};
+
+/**
+ * @brief An AGGREGATE query and its results
+ */
+struct aggregate {
+    /// One of "COUNT", "SUM", "MIN", "MAX" or "AVG"
+    char function[6];
+
+    /// Index of the int or float column aggregated, -1 for COUNT
+    int column;
+
+    /// Type of the column aggregated (COLUMN_TYPE_*)
+    int column_type;
+
+    /// Index of the char column grouped on, -1 without GROUP BY
+    int group_column;
+
+    /// Groups, in the order their first record was found
+    struct aggregate_group groups[MAX_RECORDS_PER_TABLE];
+    int num_groups;
+
+    /// Index + 1 of the group hashed to each bucket, 0 if empty
+    int buckets[AGGREGATE_BUCKETS];
+
+    /// Aggregated column and group of each matching row, filled by the
+    /// scan threads
+    double row_values[MAX_RECORDS_PER_TABLE];
+    char row_groups[MAX_RECORDS_PER_TABLE][MAX_STRTYPE_SIZE + 1];
+};
+
+/**
+ * @brief Check the function, column and GROUP BY column of an AGGREGATE
+ *
+ * COUNT takes any column, or none; the others take an int or float column. The
+ * GROUP BY column, if any, has to be a char column.
+ *
+ * @param function aggregate function
+ * @param column column to aggregate
+ * @param group_by column to group on, empty for none
+ * @param table_num index of the table parsing
+ * @param agg the aggregate to set up
+ * @return returns true(1) if the aggregate is valid, false(-1) if it isn't
+ */
+int parse_aggregate(struct token function, struct token column, struct token group_by, int table_num, struct aggregate *agg)
 {
-    int matched_lines[MAX_RECORDS_PER_TABLE];
-    char comm_string[MAX_CMD_LEN], lineFromFile [MAX_VALUE_LEN];
-    char *pch = NULL;
-    int i, index = 0;
-    bool stopLoop = false;
-    strcpy(comm_string, "");
-    i = 0;
+    const struct schema_table *table = &schema_current()->tables[table_num];
+    char column_name[MAX_COLNAME_LEN];
+
+    function = token_trim(function);
+    column = token_trim(column);
+    group_by = token_trim(group_by);
+    if (!token_equals(function, "COUNT") && !token_equals(function, "SUM") && !token_equals(function, "MIN") &&
+        !token_equals(function, "MAX") && !token_equals(function, "AVG"))
+    {
+        return -1;
+    }
+    token_copy(function, agg->function, sizeof agg->function);
 
-    while (!stopLoop)
+    agg->column = -1;
+    agg->column_type = COLUMN_TYPE_INT;
+    if (!token_equals(function, "COUNT"))
     {
-        get_command_specific_perm(i, fileToLoad, lineFromFile);
-        if (strcmp(lineFromFile, "STOP_LOADING") != 0)
+        if (token_copy(column, column_name, MAX_COLNAME_LEN) == -1)
         {
-            if (predicates_true_perm(predicates, lineFromFile, num_columns, table_num, mycolumns, column_types, i) == 1)
-            {
-                matched_lines[index] = i;
-                index++;
-            }
+            return -1;
         }
-        else
+        agg->column = has_column(column_name, table_num);
+        if (agg->column == -1 || table->columns[agg->column].type == COLUMN_TYPE_CHAR)
         {
-            stopLoop = true;
+            return -1;
         }
-        i++;
-    }
-    if (index == 0)
-    {
-        // There are no records in the table that match the predicates
-        strcpy(comm_string, "-1;0");
-        sendall(sock, comm_string, strlen(comm_string));
-        sendall(sock, "\n", 1);
-        return 0;
+        agg->column_type = table->columns[agg->column].type;
     }
 
-    for (i = 0; i < index; i++)
+    agg->group_column = -1;
+    if (group_by.len > 0)
     {
-        sprintf(comm_string, "%d", index - 1 - i);
-        strcat(comm_string, ";");
-        get_command_specific_perm(matched_lines[index], fileToLoad, lineFromFile);
-        strcat(comm_string, lineFromFile); // get'ed line
-        sendall(sock, comm_string, strlen(comm_string));
-        sendall(sock, "\n", 1);
-
-        int wait_for_commands = 1;
-        char cmd[MAX_CMD_LEN];
-        int status = recvline(sock, cmd, MAX_CMD_LEN);
-        if (status != 0)
+        if (token_copy(group_by, column_name, MAX_COLNAME_LEN) == -1)
         {
-            // Either an error occurred or the client closed the connection.
-            wait_for_commands = 0;
+            return -1;
         }
-        else
+        agg->group_column = has_column(column_name, table_num);
+        if (agg->group_column == -1 || table->columns[agg->group_column].type != COLUMN_TYPE_CHAR)
         {
-            // Handle the command from the client.
-            if (strstr(cmd, "SUCCESS"))
-                wait_for_commands = 0; // Got the message, don't need to wait anymore
+            return -1;
         }
     }
-    return 0;
+    agg->num_groups = 0;
+    memset(agg->buckets, 0, sizeof agg->buckets);
+    return 1;
+}
+
+/**
+ * @brief Find the group of a GROUP BY value, adding it if it is new
+ *
+ * @param agg the aggregate
+ * @param name value of the GROUP BY column
+ * @return returns the group
+ */
+struct aggregate_group *aggregate_group_find(struct aggregate *agg, const char *name)
+{
+    unsigned int bucket = schema_hash(name) & (AGGREGATE_BUCKETS - 1);
+    struct aggregate_group *group;
 
+    // There are fewer groups than buckets, so an empty bucket is always found
+    while (agg->buckets[bucket])
+    {
+        group = &agg->groups[agg->buckets[bucket] - 1];
+        if (!strcmp(group->name, name))
+        {
+            return group;
+        }
+        bucket = (bucket + 1) & (AGGREGATE_BUCKETS - 1);
+    }
+    group = &agg->groups[agg->num_groups++];
+    agg->buckets[bucket] = agg->num_groups;
+    snprintf(group->name, sizeof group->name, "%s", name);
+    group->count = 0;
+    group->sum = 0;
+    return group;
 }
 
 /**
- * @brief Delete the item in the server based on key_to_delete
+ * @brief Add a matching record to its group
  *
- * @param key_to_delete key to set
- * @param first_empty index of the first empty spot in keys & values
- * @param table_num index of the table parsing
- * @param num_columns number of columns in the table
- * @param mycolumns names of the columns
- * @return returns success string if it works (ERR_KEY_NOT_FOUND if key_to_delete DNE in keys)
+ * @param agg the aggregate
+ * @param name value of the GROUP BY column, "" without one
+ * @param value value of the aggregated column
+ * @return no return value
  */
-char *delete_command(char key_to_delete[MAX_KEY_LEN],  int first_empty, int table_num, int num_columns, char mycolumns[MAX_TABLES][MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN] )
+void aggregate_add(struct aggregate *agg, const char *name, double value)
 {
-    char row[MAX_VALUE_LEN];
-    int index = 0, i;
-    if (first_empty == 0)
+    struct aggregate_group *group = aggregate_group_find(agg, name);
+
+    if (group->count == 0 || value < group->min)
     {
-        return "ERR_KEY_NOT_FOUND";
+        group->min = value;
     }
-    while (index < first_empty)
+    if (group->count == 0 || value > group->max)
+    {
+        group->max = value;
+    }
+    group->count++;
+    group->sum += value;
+}
+
+/**
+ * @brief Copy the aggregated column and group of a matching row into the aggregate
+ *
+ * Int and float columns are read from the numbers stored with the record,
+ * the value is only read for the GROUP BY column. Both come from the same
+ * version of the record.
+ *
+ * @param agg the aggregate
+ * @param table_num index of the table parsing
+ * @param row_index index of the row
+ * @return no return value
+ */
+void aggregate_read_row(struct aggregate *agg, int table_num, int row_index)
+{
+    struct server_record *record = &tables[table_num][row_index];
+    char value[MAX_VALUE_LEN];
+    int ints[MAX_COLUMNS_PER_TABLE];
+    double floats[MAX_COLUMNS_PER_TABLE];
+    struct token tok, group;
+    unsigned int seq;
+
+    do
     {
-        pthread_mutex_lock(&tables[table_num][index].lock);
-        if (!strcmp(tables[table_num][index].key, key_to_delete))
+        seq = record_read_begin(record);
+        memcpy(ints, values[table_num][row_index].ints, sizeof ints);
+        memcpy(floats, values[table_num][row_index].floats, sizeof floats);
+        if (agg->group_column != -1)
         {
-            pthread_mutex_unlock(&tables[table_num][index].lock);
-            break;
+            memcpy(value, values[table_num][row_index].value, MAX_VALUE_LEN);
         }
-        pthread_mutex_unlock(&tables[table_num][index].lock);
-        index++;
     }
-    if (index == first_empty)
+    while (record_read_retry(record, seq));
+
+    agg->row_values[row_index] = 0;
+    if (agg->column != -1)
     {
-        return "ERR_KEY_NOT_FOUND";
+        agg->row_values[row_index] = agg->column_type == COLUMN_TYPE_INT ? ints[agg->column] : floats[agg->column];
     }
-    for (; index < first_empty - 1; index++)
+    agg->row_groups[row_index][0] = '\0';
+    if (agg->group_column != -1)
     {
-        pthread_mutex_lock(&tables[table_num][index].lock);
-        strcpy(tables[table_num][index].key, tables[table_num][index + 1].key);
-        strcpy(tables[table_num][index].value, tables[table_num][index + 1].value);
-        tables[table_num][index].metadata = tables[table_num][index].metadata;
-        pthread_mutex_unlock(&tables[table_num][index].lock);
+        value[MAX_VALUE_LEN - 1] = '\0';
+        tok.start = value;
+        tok.len = strlen(value);
+        if (column_token(tok, agg->group_column, &group) == -1 ||
+            token_copy(group, agg->row_groups[row_index], MAX_STRTYPE_SIZE + 1) == -1)
+        {
+            agg->row_groups[row_index][0] = '\0';
+        }
     }
-    return "SUCCESS";
 }
 
-char *delete_command_perm(char key_to_set[MAX_KEY_LEN], FILE *fileLoadData, FILE *fileWriteData)
-{
+/**
+ * @brief Shared state of one table scan, split into morsels between threads
+ */
+struct scan_job {
+    /// Predicates every matching row has to pass
+    const struct predicate *predicates;
+    int num_pred;
 
-    // Set, Update, Delete Functionality
+    /// Table being scanned
+    int table_num;
 
-    char loadLine[MAX_VALUE_LEN];
-    char loadLineTemp1[MAX_VALUE_LEN];
-    char loadLineTemp2[MAX_VALUE_LEN];
-    char *pch = NULL;
+    /// Rows [0, first_empty) are scanned
+    int first_empty;
 
-    bool stopLoad;
-    bool firstPass;
-    bool found;
-    bool insert;
-    bool deletef;
+    /// First row of the next unclaimed morsel, advanced atomically
+    int next_row;
 
-    size_t lengthString;
+    /// matched[i] is set to 1 if row i passes the predicates
+    char matched[MAX_RECORDS_PER_TABLE];
 
-    strcpy(loadLine, "");
-    strcpy(loadLineTemp1, "");
-    strcpy(loadLineTemp2, "");
+    /// Aggregate the matching rows are read into, NULL for a plain query
+    struct aggregate *aggregate;
+};
 
-    firstPass = true;
-    stopLoad = false;
-    insert = true;
-    deletef = true;
+/**
+ * @brief Claim morsels of a scan job until the table is exhausted
+ *
+ * Run by the querying thread and by scan_pool workers at the same time.
+ * Each thread only writes the matched flags of the rows it claimed.
+ *
+ * @param arg the struct scan_job to work on
+ * @return no return value
+ */
+void scan_morsels(void *arg)
+{
+    struct scan_job *job = arg;
+    int start, end, i;
 
-    do
+    while ((start = __sync_fetch_and_add(&job->next_row, SCAN_MORSEL_SIZE)) < job->first_empty)
     {
-        strcpy (loadLineTemp1, loadLine);
-        fgets(loadLine, 100, fileLoadData);
-
-        lengthString = strlen(loadLine) - 1;
-        if (loadLine[lengthString] == '\n')
-            loadLine[lengthString] = '\0';
-        strcpy (loadLineTemp2, loadLine);
-        pch = strtok (loadLineTemp2, ":");
-
-        if ( (firstPass == false) && (strcmp(loadLineTemp1, loadLine) == 0) )
-            stopLoad = true;
-        else
+        end = start + SCAN_MORSEL_SIZE;
+        if (end > job->first_empty)
+        {
+            end = job->first_empty;
+        }
+        for (i = start; i < end; i++)
         {
-            if (strcmp(loadLineTemp2, key_to_set) == 0)
+            job->matched[i] = (predicates_true(job->predicates, job->num_pred, job->table_num, i) == 1);
+            if (job->matched[i] && job->aggregate)
             {
-                insert = false;
+                aggregate_read_row(job->aggregate, job->table_num, i);
             }
         }
+    }
+}
+
+/**
+ * @brief Flag the rows of a table that match a query
+ *
+ * Tables with at least params.parallel_scan_threshold rows are split
+ * into morsels that are scanned by params.query_workers threads; smaller
+ * tables are scanned on the calling thread. The caller holds the table
+ * scan lock.
+ *
+ * @param job the scan, with predicates, num_pred and table_num set
+ * @return no return value
+ */
+void scan_table(struct scan_job *job)
+{
+    int num_tasks = 1;
 
-        if (firstPass == true)
-            firstPass = false;
+    job->first_empty = table_rows(job->table_num);
+    job->next_row = 0;
 
+    if (params.query_workers > 1 && job->first_empty >= params.parallel_scan_threshold)
+    {
+        // Never start more threads than there are morsels to hand out
+        num_tasks = (job->first_empty + SCAN_MORSEL_SIZE - 1) / SCAN_MORSEL_SIZE;
+        if (num_tasks > params.query_workers)
+        {
+            num_tasks = params.query_workers;
+        }
     }
-    while (stopLoad == false);
+    threadpool_run(&scan_pool, scan_morsels, job, num_tasks);
+}
 
-    if (insert == true)
-        return "ERR_KEY_NOT_FOUND";
+/**
+ * @brief Collect the keys of the records matching a query
+ *
+ * Matching keys are returned in slot order.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @param matched_keys where to copy the keys of the matching records
+ * @return returns the number of matching records
+ */
+int query_collect(const struct predicate *predicates, int num_pred, int table_num, char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN])
+{
+    struct scan_job job;
+    int i, index = 0;
 
-    return "SUCCESS";
+    job.predicates = predicates;
+    job.num_pred = num_pred;
+    job.table_num = table_num;
+    job.aggregate = NULL;
+
+    lock_table_scan(table_num);
+    scan_table(&job);
+
+    // Merge the per-row results in slot order, copying the keys before
+    // writers are let back in
+    for (i = 0; i < job.first_empty; i++ )
+    {
+        if (job.matched[i])
+        {
+            record_read_key(&tables[table_num][i], matched_keys[index]);
+            index++;
+        }
+    }
+    unlock_table_scan(table_num);
+    return index;
 }
 
 /**
- * @brief Process a command from the client.
+ * @brief Count the records matching a query without collecting their keys
  *
- * @param sock The socket connected to the client.
- * @param cmd The command received from the client.
- * @param *auth_var variable that keeps track if client is authorized or not
- * @return Returns 0 on success, -1 otherwise.
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @return returns the number of matching records
  */
-int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
+int query_count(const struct predicate *predicates, int num_pred, int table_num)
 {
-    char key_temp[MAX_KEY_LEN];
-    char value_temp[MAX_VALUE_LEN];
-    char strtok_temp[MAX_CMD_LEN];
-    char username_temp[MAX_USERNAME_LEN];
-    char passwd_temp[MAX_ENC_PASSWORD_LEN];
-    char update_value_temp[MAX_VALUE_LEN];
-    char table_temp[MAX_TABLE_LEN];
-    char pred_temp[MAX_VALUE_LEN];
-    char meta_temp[MAX_CMD_LEN];
+    struct scan_job job;
+    int i, count = 0;
 
-    char *is_auth = strstr(cmd, "AUTH");
-    char *is_get = strstr(cmd, "GET");
-    char *is_set = strstr(cmd, "SET");
-    char *is_delete = strstr(cmd, "DELETE");
-    char *is_query = strstr(cmd, "QUERY");
+    job.predicates = predicates;
+    job.num_pred = num_pred;
+    job.table_num = table_num;
+    job.aggregate = NULL;
 
-    int table_index, return_val_query_perm, has_key;
-    unsigned long int meta_temp_int;
+    lock_table_scan(table_num);
+    scan_table(&job);
+    unlock_table_scan(table_num);
 
-    // AUTH comand called
-    if (is_auth)
+    for (i = 0; i < job.first_empty; i++)
     {
-        // Get the username and password from the communication string
-        strcpy(strtok_temp, cmd);
-        get_param(strtok_temp, username_temp, 1, ";\0");
-        strcpy(strtok_temp, cmd);
-        get_param(strtok_temp, passwd_temp, 2, ";\0");
+        count += job.matched[i];
+    }
+    return count;
+}
 
-        pthread_mutex_lock(&params.lock);
-        if (!strcmp(params.username, username_temp) && !strcmp(params.password, passwd_temp))
+/**
+ * @brief Aggregate the records matching a query
+ *
+ * The scan threads read the aggregated and GROUP BY columns of the rows
+ * they match; the rows are then added to their groups in slot order.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @param agg the aggregate, set up by parse_aggregate()
+ * @return no return value
+ */
+void query_aggregate(const struct predicate *predicates, int num_pred, int table_num, struct aggregate *agg)
+{
+    struct scan_job job;
+    int i;
+
+    job.predicates = predicates;
+    job.num_pred = num_pred;
+    job.table_num = table_num;
+    job.aggregate = agg;
+
+    lock_table_scan(table_num);
+    scan_table(&job);
+    unlock_table_scan(table_num);
+
+    for (i = 0; i < job.first_empty; i++)
+    {
+        if (job.matched[i])
         {
-            pthread_mutex_unlock(&params.lock);
-            // Username and password from client cmd are the same as in the config file
-            *auth_var = 1;
-            strcpy(value_temp, "SUCCESS");
-            sendall(sock, value_temp, strlen(value_temp));
+            aggregate_add(agg, agg->row_groups[i], agg->row_values[i]);
+        }
+    }
+}
+
+/**
+ * @brief Find the slot a paged query resumes from
+ *
+ * A cursor is "<slot>.<key>": the slot after the last record returned
+ * and that record's key. If rows were deleted since, the key is looked
+ * up again; if it was deleted itself, the scan resumes one slot earlier,
+ * so a row may be sent twice but none is skipped for that delete.
+ *
+ * @param cursor cursor sent by the client, "" for the first page
+ * @param table_num index of the table parsing
+ * @return returns the slot to resume from, -1 if the cursor is malformed
+ */
+int query_cursor_slot(const char *cursor, int table_num)
+{
+    char key[MAX_KEY_LEN];
+    const char *dot;
+    int slot = 0, rows = table_rows(table_num), index;
+
+    if (cursor[0] == '\0')
+    {
+        return 0;
+    }
+    dot = strchr(cursor, '.');
+    if (dot == NULL || dot == cursor || dot - cursor > 9 || strlen(dot + 1) >= MAX_KEY_LEN)
+    {
+        return -1;
+    }
+    for (; cursor < dot; cursor++)
+    {
+        if (!isdigit((unsigned char)*cursor))
+        {
+            return -1;
+        }
+        slot = slot * 10 + (*cursor - '0');
+    }
+    if (slot < 1)
+    {
+        return -1;
+    }
+    if (slot <= rows)
+    {
+        record_read_key(&tables[table_num][slot - 1], key);
+        if (!strcmp(key, dot + 1))
+        {
+            return slot;
+        }
+    }
+    index = key_exist((char *)(dot + 1), rows, table_num);
+    if (index != -1)
+    {
+        return index + 1;
+    }
+    return slot - 1 < rows ? slot - 1 : rows;
+}
+
+/**
+ * @brief Collect one page of the keys of the records matching a query
+ *
+ * Rows are scanned in slot order from the cursor on the calling thread,
+ * stopping as soon as limit keys have been found.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @param cursor where to resume, "" for the first page
+ * @param limit max keys to collect, at least 1
+ * @param matched_keys where to copy the keys of the matching records
+ * @param next_cursor where to write the cursor of the next page ("" if this is the last page)
+ * @return returns the number of keys collected, -1 if the cursor is malformed
+ */
+int query_collect_page(const struct predicate *predicates, int num_pred, int table_num, const char *cursor, int limit,
+                       char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN], char next_cursor[MAX_CURSOR_LEN])
+{
+    int i, rows, index = 0;
+
+    next_cursor[0] = '\0';
+    lock_table_scan(table_num);
+    i = query_cursor_slot(cursor, table_num);
+    if (i == -1)
+    {
+        unlock_table_scan(table_num);
+        return -1;
+    }
+    rows = table_rows(table_num);
+    for (; i < rows && index < limit; i++)
+    {
+        if (predicates_true(predicates, num_pred, table_num, i) == 1)
+        {
+            record_read_key(&tables[table_num][i], matched_keys[index]);
+            index++;
+        }
+    }
+    if (index == limit && i < rows)
+    {
+        snprintf(next_cursor, MAX_CURSOR_LEN, "%d.%s", i, matched_keys[index - 1]);
+    }
+    unlock_table_scan(table_num);
+    return index;
+}
+
+/**
+ * @brief Cut a record value down to its selected columns
+ *
+ * @param value the record value, replaced by the selected columns
+ * @param columns indexes of the selected columns
+ * @param num_columns number of selected columns, 0 to keep the whole value
+ * @return no return value
+ */
+void project_value(char value[MAX_VALUE_LEN], const int *columns, int num_columns)
+{
+    char projected[MAX_VALUE_LEN];
+    struct token whole, split[MAX_COLUMNS_PER_TABLE], column;
+    int i, num_split, len = 0;
+
+    if (num_columns == 0)
+    {
+        return;
+    }
+    whole.start = value;
+    whole.len = strlen(value);
+    num_split = token_split(whole, ',', split, MAX_COLUMNS_PER_TABLE);
+    for (i = 0; i < num_columns; i++)
+    {
+        if (columns[i] >= num_split)
+        {
+            continue;
+        }
+        column = token_trim(split[columns[i]]);
+        len += snprintf(projected + len, MAX_VALUE_LEN - len, "%s%.*s", len ? "," : "", column.len, column.start);
+    }
+    projected[len] = '\0';
+    strcpy(value, projected);
+}
+
+/**
+ * @brief Collect one page of the records matching a SELECT
+ *
+ * Like query_collect_page(), but each row is read once, key, value and
+ * metadata together, and the predicates are checked against that copy.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @param columns indexes of the selected columns
+ * @param num_columns number of selected columns, 0 for the whole value
+ * @param cursor where to resume, "" for the first page
+ * @param limit max records to collect, at least 1
+ * @param rows where to copy the matching records
+ * @param next_cursor where to write the cursor of the next page ("" if this is the last page)
+ * @return returns the number of records collected, -1 if the cursor is malformed
+ */
+int query_select_page(const struct predicate *predicates, int num_pred, int table_num, const int *columns, int num_columns,
+                      const char *cursor, int limit, struct query_row *rows, char next_cursor[MAX_CURSOR_LEN])
+{
+    struct token tok;
+    int i, num_rows, index = 0;
+
+    next_cursor[0] = '\0';
+    lock_table_scan(table_num);
+    i = query_cursor_slot(cursor, table_num);
+    if (i == -1)
+    {
+        unlock_table_scan(table_num);
+        return -1;
+    }
+    num_rows = table_rows(table_num);
+    for (; i < num_rows && index < limit; i++)
+    {
+        record_read_row(table_num, i, &rows[index]);
+        tok.start = rows[index].value;
+        tok.len = strlen(rows[index].value);
+        if (predicates_match(predicates, num_pred, tok) == 1)
+        {
+            project_value(rows[index].value, columns, num_columns);
+            index++;
+        }
+    }
+    if (index == limit && i < num_rows)
+    {
+        snprintf(next_cursor, MAX_CURSOR_LEN, "%d.%s", i, rows[index - 1].key);
+    }
+    unlock_table_scan(table_num);
+    return index;
+}
+
+/**
+ * @brief Send the keys of the records matching a query to the client
+ *
+ * @param sock The socket connected to the client.
+ * @param matched_keys keys of the matching records, in slot order
+ * @param index number of matching records
+ * @return returns the status for the server
+ */
+int query_reply(int sock, char matched_keys[][MAX_KEY_LEN], int index)
+{
+    char comm_string[MAX_CMD_LEN];
+    int i;
+
+    if (index == 0)
+    {
+        // There are no records in the table that match the predicates
+        strcpy(comm_string, "-1;0");
+        sendall(sock, comm_string, strlen(comm_string));
+        sendall(sock, "\n", 1);
+        return 0;
+    }
+
+    for (i = 0; i < index; i++)
+    {
+        sprintf(comm_string, "%d", index - 1 - i);
+        strcat(comm_string, ";");
+        strcat(comm_string, matched_keys[i]);
+        strcat(comm_string, "\n\0");
+        if (sendall(sock, comm_string, strlen(comm_string)) == 0 && recvline(sock, comm_string, MAX_CMD_LEN) == 0)
+        {
+            // Everything little thing is gonna be all right
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Build the path of the data directory, with a trailing '/', creating it if needed
+ *
+ * @param datadirectory where to write the path
+ * @return returns datadirectory
+ */
+char *data_directory_path(char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8])
+{
+    // The first name in the configured path, past any leading "./"
+    const char *name = params.data_directory + strspn(params.data_directory, "./");
+    struct stat st = {0};
+
+    snprintf(datadirectory, MAX_PATH_LEN + 1, "%.*s/", (int)strcspn(name, "./"), name);
+    if (stat(datadirectory, &st) == -1)
+    {
+        mkdir(datadirectory, 0700);
+    }
+    return datadirectory;
+}
+
+/**
+ * @brief Build the path of a table's file, creating the data directory if needed
+ *
+ * @param table_name name of the table
+ * @param datadirectory where to write the path
+ * @return returns datadirectory
+ */
+char *table_file_path(const char table_name[MAX_TABLE_LEN], char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8])
+{
+    data_directory_path(datadirectory);
+    strcat(datadirectory, table_name);
+    strcat(datadirectory, "_tbl.txt");
+    return datadirectory;
+}
+
+/**
+ * @brief Send one page of a paged query, or the count of a count-only query
+ *
+ * The reply is a header "SUCCESS;<n>;<cursor>" followed by n lines of
+ * keys. Count-only queries send no keys.
+ *
+ * @param sock The socket connected to the client.
+ * @param matched_keys keys of the page, in slot order (NULL for a count)
+ * @param index number of keys in the page, or the count
+ * @param next_cursor cursor of the next page, "" if there is none
+ * @return returns the status for the server
+ */
+int query_page_reply(int sock, char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN], int index, const char *next_cursor)
+{
+    char comm_string[MAX_CMD_LEN];
+    int i, len;
+
+    len = snprintf(comm_string, MAX_CMD_LEN, "SUCCESS;%d;%s\n", index, next_cursor);
+    for (i = 0; matched_keys && i < index; i++)
+    {
+        if (len + MAX_KEY_LEN + 1 > MAX_CMD_LEN)
+        {
+            // Flush whole buffers rather than one line at a time
+            if (sendall(sock, comm_string, len) != 0)
+            {
+                return -1;
+            }
+            len = 0;
+        }
+        len += sprintf(comm_string + len, "%s\n", matched_keys[i]);
+    }
+    return sendall(sock, comm_string, len) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Send one page of a SELECT
+ *
+ * The reply is a header "SUCCESS;<n>;<cursor>" followed by n lines of
+ * "key;metadata;value".
+ *
+ * @param sock The socket connected to the client.
+ * @param rows records of the page, in slot order
+ * @param index number of records in the page
+ * @param next_cursor cursor of the next page, "" if there is none
+ * @return returns the status for the server
+ */
+int query_select_reply(int sock, const struct query_row *rows, int index, const char *next_cursor)
+{
+    char comm_string[MAX_CMD_LEN];
+    int i, len;
+
+    len = snprintf(comm_string, MAX_CMD_LEN, "SUCCESS;%d;%s\n", index, next_cursor);
+    for (i = 0; i < index; i++)
+    {
+        if (len + MAX_KEY_LEN + MAX_VALUE_LEN + 24 > MAX_CMD_LEN)
+        {
+            if (sendall(sock, comm_string, len) != 0)
+            {
+                return -1;
+            }
+            len = 0;
+        }
+        len += sprintf(comm_string + len, "%s;%lu;%s\n", rows[i].key, rows[i].metadata, rows[i].value);
+    }
+    return sendall(sock, comm_string, len) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Send the results of an AGGREGATE
+ *
+ * The reply is a header "SUCCESS;<n>" followed by n lines of
+ * "group;value", the group being empty without GROUP BY. Without GROUP
+ * BY, COUNT and SUM always have a result; MIN, MAX and AVG have none if
+ * no record matched.
+ *
+ * @param sock The socket connected to the client.
+ * @param agg the aggregate
+ * @return returns the status for the server
+ */
+int aggregate_reply(int sock, struct aggregate *agg)
+{
+    char comm_string[MAX_CMD_LEN];
+    struct aggregate_group *group;
+    const char *format = agg->column_type == COLUMN_TYPE_INT ? "%s;%.0f\n" : "%s;%.17g\n";
+    int i, len;
+
+    if (agg->num_groups == 0 && agg->group_column == -1 &&
+        (!strcmp(agg->function, "COUNT") || !strcmp(agg->function, "SUM")))
+    {
+        aggregate_group_find(agg, "");
+    }
+    len = snprintf(comm_string, MAX_CMD_LEN, "SUCCESS;%d\n", agg->num_groups);
+    for (i = 0; i < agg->num_groups; i++)
+    {
+        // A line is the group, ';', the result, '\n' and the terminator.
+        if (len + MAX_STRTYPE_SIZE + AGGREGATE_NUMBER_LEN + 3 > MAX_CMD_LEN)
+        {
+            if (sendall(sock, comm_string, len) != 0)
+            {
+                return -1;
+            }
+            len = 0;
+        }
+        group = &agg->groups[i];
+        if (!strcmp(agg->function, "COUNT"))
+        {
+            len += snprintf(comm_string + len, sizeof comm_string - len, "%s;%lld\n", group->name, group->count);
+        }
+        else if (!strcmp(agg->function, "SUM"))
+        {
+            len += snprintf(comm_string + len, sizeof comm_string - len, format, group->name, group->sum);
+        }
+        else if (!strcmp(agg->function, "MIN"))
+        {
+            len += snprintf(comm_string + len, sizeof comm_string - len, format, group->name, group->min);
+        }
+        else if (!strcmp(agg->function, "MAX"))
+        {
+            len += snprintf(comm_string + len, sizeof comm_string - len, format, group->name, group->max);
+        }
+        else
+        {
+            len += snprintf(comm_string + len, sizeof comm_string - len, "%s;%.17g\n", group->name, group->sum / group->count);
+        }
+    }
+    return sendall(sock, comm_string, len) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Read the value of a key of a table on disk
+ *
+ * @param table_num index of the table
+ * @param key the key
+ * @param value where to copy the value
+ * @return returns 0 on success, -1 if the key is not in the table
+ */
+int get_perm(int table_num, const char *key, char value[MAX_VALUE_LEN])
+{
+    if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        return lsm_get(table_num, key, value);
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        return btree_get(table_num, key, value);
+    }
+    return disk_log_get(table_num, key, value);
+}
+
+/**
+ * @brief Insert or update a record of a table on disk
+ *
+ * @param table_num index of the table
+ * @param key the key
+ * @param value the value
+ * @return returns 0 on success, -1 if the write failed
+ */
+int set_perm(int table_num, const char *key, const char *value)
+{
+    if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        return lsm_set(table_num, key, value);
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        return btree_set(table_num, key, value);
+    }
+    return disk_log_set(table_num, key, value);
+}
+
+/**
+ * @brief Delete a record of a table on disk
+ *
+ * @param table_num index of the table
+ * @param key the key
+ * @return returns 0 on success, 1 if the key is not in the table, -1 if the write failed
+ */
+int delete_perm(int table_num, const char *key)
+{
+    if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        return lsm_delete(table_num, key);
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        return btree_delete(table_num, key);
+    }
+    return disk_log_delete(table_num, key);
+}
+
+/**
+ * @brief Records of a table on disk, read in one pass
+ *
+ * On-disk tables are read from their file, LSM tables from an iterator
+ * and btree tables from a cursor.
+ */
+struct perm_reader {
+    /// Index of the table.
+    int table_num;
+
+    /// The table file when storage_policy is on-disk, may be NULL.
+    FILE *file;
+
+    /// The iterator when storage_policy is lsm, may be NULL.
+    struct lsm_iterator *lsm;
+
+    /// The cursor when storage_policy is btree, may be NULL.
+    struct btree_cursor *btree;
+};
+
+/**
+ * @brief Start reading the records of a table on disk
+ *
+ * @param reader the reader
+ * @param table_num index of the table
+ * @param table_name name of the table
+ * @param from first key to read; table files are not sorted and start at their first line
+ * @return no return value
+ */
+void open_reader_perm(struct perm_reader *reader, int table_num, char table_name[MAX_TABLE_LEN], const char *from)
+{
+    char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
+
+    reader->table_num = table_num;
+    reader->file = NULL;
+    reader->lsm = NULL;
+    reader->btree = NULL;
+    if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        reader->lsm = lsm_iterator_open(table_num, from);
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        reader->btree = btree_cursor_open(table_num, from);
+    }
+    else
+    {
+        reader->file = fopen(table_file_path(table_name, datadirectory), "rt");
+    }
+}
+
+/**
+ * @brief Stop reading the records of a table on disk
+ *
+ * @param reader the reader
+ * @return no return value
+ */
+void close_reader_perm(struct perm_reader *reader)
+{
+    if (reader->file)
+    {
+        fclose(reader->file);
+    }
+    lsm_iterator_close(reader->lsm);
+    btree_cursor_close(reader->btree);
+}
+
+/**
+ * @brief Read the next record line of a table on disk
+ *
+ * Delete lines are skipped. The line is split at its colon, and checked
+ * against the table's log, as only the latest line of a live key holds a
+ * record. LSM and btree tables return each live record once, in key order.
+ *
+ * @param reader the reader
+ * @param lineFromFile where to read the line; the key is left in it
+ * @param value where to point at the value
+ * @return returns true(1) if the line holds a record, false(0) if it is dead, -1 at the end of the table
+ */
+int next_line_perm(struct perm_reader *reader, char lineFromFile[MAX_KEY_LEN + MAX_VALUE_LEN + 2], char **value)
+{
+    char *colon;
+    long offset;
+
+    if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        *value = lineFromFile + MAX_KEY_LEN + 1;
+        return (reader->lsm && lsm_iterator_next(reader->lsm, lineFromFile, *value)) ? 1 : -1;
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        *value = lineFromFile + MAX_KEY_LEN + 1;
+        return (reader->btree && btree_cursor_next(reader->btree, lineFromFile, *value)) ? 1 : -1;
+    }
+    do
+    {
+        offset = reader->file ? ftell(reader->file) : -1;
+        if (offset == -1 || fgets(lineFromFile, MAX_KEY_LEN + MAX_VALUE_LEN + 2, reader->file) == NULL)
+        {
+            return -1;
+        }
+        lineFromFile[strcspn(lineFromFile, "\n")] = '\0';
+        colon = strchr(lineFromFile, ':');
+    }
+    while (colon == NULL);
+    *colon = '\0';
+    *value = colon + 1;
+    return disk_log_is_current(reader->table_num, lineFromFile, offset);
+}
+
+/**
+ * @brief Collect one page of a query on a table file, or count its matches
+ *
+ * The file is read once, line by line. On disk the cursor's slot is the
+ * line to resume from; for an LSM or btree table it counts records in key order.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param reader the records of the table
+ * @param cursor where to resume, "" for the first page
+ * @param limit max keys to collect, 0 to only count the matches
+ * @param matched_keys where to copy the keys of the matching records
+ * @param next_cursor where to write the cursor of the next page ("" if this is the last page)
+ * @return returns the number of keys collected (or matches counted), -1 if the cursor is malformed
+ */
+int query_page_perm(const struct predicate *predicates, int num_pred, struct perm_reader *reader, const char *cursor,
+                    int limit, char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN], char next_cursor[MAX_CURSOR_LEN])
+{
+    char lineFromFile[MAX_KEY_LEN + MAX_VALUE_LEN + 2];
+    char *value;
+    int live, line = 0, start = 0, index = 0;
+
+    next_cursor[0] = '\0';
+    if (cursor[0] != '\0' && (sscanf(cursor, "%d.", &start) != 1 || start < 1))
+    {
+        return -1;
+    }
+    while ((live = next_line_perm(reader, lineFromFile, &value)) != -1)
+    {
+        // Dead lines are counted too, so a cursor's line stays put
+        if (line++ < start || !live)
+        {
+            continue;
+        }
+        if (limit > 0 && index == limit)
+        {
+            // There is at least one more line to look at
+            snprintf(next_cursor, MAX_CURSOR_LEN, "%d.%s", line - 1, matched_keys[index - 1]);
+            break;
+        }
+        if (predicates_true_perm(predicates, num_pred, value) == 1)
+        {
+            if (limit > 0)
+            {
+                snprintf(matched_keys[index], MAX_KEY_LEN, "%.*s", MAX_KEY_LEN - 1, lineFromFile);
+            }
+            index++;
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief Collect the keys of every record matching a query on a table file
+ *
+ * The file is read once, from start to end, as a table on disk has no
+ * size limit; the keys go in an array grown as they come.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table
+ * @param table_name name of the table
+ * @param matched_keys where to point at the keys; the caller frees them
+ * @return returns the number of keys collected, -1 if memory ran out
+ */
+int query_all_perm(const struct predicate *predicates, int num_pred, int table_num, char table_name[MAX_TABLE_LEN],
+                   char (**matched_keys)[MAX_KEY_LEN])
+{
+    char lineFromFile[MAX_KEY_LEN + MAX_VALUE_LEN + 2];
+    char (*keys)[MAX_KEY_LEN] = NULL, (*grown)[MAX_KEY_LEN];
+    struct perm_reader reader;
+    char *value;
+    int live, num_keys = 0, max_keys = 0;
+
+    open_reader_perm(&reader, table_num, table_name, "");
+    while ((live = next_line_perm(&reader, lineFromFile, &value)) != -1)
+    {
+        if (!live || predicates_true_perm(predicates, num_pred, value) != 1)
+        {
+            continue;
+        }
+        if (num_keys == max_keys)
+        {
+            max_keys = max_keys ? max_keys * 2 : MAX_RECORDS_PER_TABLE;
+            grown = realloc(keys, (size_t)max_keys * sizeof *keys);
+            if (grown == NULL)
+            {
+                close_reader_perm(&reader);
+                free(keys);
+                return -1;
+            }
+            keys = grown;
+        }
+        snprintf(keys[num_keys++], MAX_KEY_LEN, "%.*s", MAX_KEY_LEN - 1, lineFromFile);
+    }
+    close_reader_perm(&reader);
+    *matched_keys = keys;
+    return num_keys;
+}
+
+/**
+ * @brief Collect one page of a SELECT on a table file
+ *
+ * Works as query_page_perm(). Records on disk carry no metadata, so it
+ * is always 0.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param reader the records of the table
+ * @param columns indexes of the selected columns
+ * @param num_columns number of selected columns, 0 for the whole value
+ * @param cursor where to resume, "" for the first page
+ * @param limit max records to collect, at least 1
+ * @param rows where to copy the matching records
+ * @param next_cursor where to write the cursor of the next page ("" if this is the last page)
+ * @return returns the number of records collected, -1 if the cursor is malformed
+ */
+int query_select_perm(const struct predicate *predicates, int num_pred, struct perm_reader *reader, const int *columns,
+                      int num_columns, const char *cursor, int limit, struct query_row *rows, char next_cursor[MAX_CURSOR_LEN])
+{
+    char lineFromFile[MAX_KEY_LEN + MAX_VALUE_LEN + 2];
+    char *value;
+    int live, line = 0, start = 0, index = 0;
+
+    next_cursor[0] = '\0';
+    if (cursor[0] != '\0' && (sscanf(cursor, "%d.", &start) != 1 || start < 1))
+    {
+        return -1;
+    }
+    while ((live = next_line_perm(reader, lineFromFile, &value)) != -1)
+    {
+        // Dead lines are counted too, so a cursor's line stays put
+        if (line++ < start || !live)
+        {
+            continue;
+        }
+        if (index == limit)
+        {
+            // There is at least one more line to look at
+            snprintf(next_cursor, MAX_CURSOR_LEN, "%d.%s", line - 1, rows[index - 1].key);
+            break;
+        }
+        if (predicates_true_perm(predicates, num_pred, value) == 1)
+        {
+            snprintf(rows[index].key, MAX_KEY_LEN, "%.*s", MAX_KEY_LEN - 1, lineFromFile);
+            snprintf(rows[index].value, MAX_VALUE_LEN, "%s", value);
+            rows[index].metadata = 0;
+            project_value(rows[index].value, columns, num_columns);
+            index++;
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief Aggregate the records of a table file matching a query
+ *
+ * The file is read once, line by line.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param reader the records of the table
+ * @param agg the aggregate, set up by parse_aggregate()
+ * @return no return value
+ */
+void aggregate_perm(const struct predicate *predicates, int num_pred, struct perm_reader *reader, struct aggregate *agg)
+{
+    char lineFromFile[MAX_KEY_LEN + MAX_VALUE_LEN + 2];
+    char name[MAX_STRTYPE_SIZE + 1];
+    struct token tok, column;
+    char *record;
+    double value;
+    int live, int_value;
+
+    while ((live = next_line_perm(reader, lineFromFile, &record)) != -1)
+    {
+        if (!live || predicates_true_perm(predicates, num_pred, record) != 1)
+        {
+            continue;
+        }
+        tok.start = record;
+        tok.len = strlen(record);
+        value = 0;
+        if (agg->column != -1)
+        {
+            if (column_token(tok, agg->column, &column) == -1)
+            {
+                continue;
+            }
+            if (agg->column_type == COLUMN_TYPE_FLOAT)
+            {
+                if (token_to_double(column, &value) == -1)
+                {
+                    continue;
+                }
+            }
+            else if (token_to_int(column, &int_value) == -1)
+            {
+                continue;
+            }
+            else
+            {
+                value = int_value;
+            }
+        }
+        name[0] = '\0';
+        if (agg->group_column != -1 && column_token(tok, agg->group_column, &column) == 1 &&
+            token_copy(column, name, sizeof name) == -1)
+        {
+            name[0] = '\0';
+        }
+        aggregate_add(agg, name, value);
+    }
+}
+
+/**
+ * @brief Collect the keys of a table file in a range, in order
+ *
+ * Table files are not kept in key order, so the whole file is read once,
+ * keeping the max_keys + 1 smallest keys in the range sorted. LSM and
+ * btree tables are read from the first key of the range and stop once the
+ * keys are found.
+ *
+ * @param reader the records of the table
+ * @param from first key of the range, "" to start at the first key
+ * @param to key the range stops before, "" to run to the last key
+ * @param keys where to copy the keys, room for max_keys + 1
+ * @param max_keys max keys to return
+ * @param next where to copy the first key in the range that was not returned, "" if all were
+ * @return returns the number of keys collected
+ */
+int scan_perm(struct perm_reader *reader, const char *from, const char *to, char keys[][MAX_KEY_LEN], int max_keys,
+              char next[MAX_KEY_LEN])
+{
+    char lineFromFile[MAX_KEY_LEN + MAX_VALUE_LEN + 2];
+    char *value;
+    int i, live, num_keys = 0;
+
+    next[0] = '\0';
+    while ((live = next_line_perm(reader, lineFromFile, &value)) != -1)
+    {
+        if (!live)
+        {
+            continue;
+        }
+        if (strcmp(lineFromFile, from) < 0 || (to[0] != '\0' && strcmp(lineFromFile, to) >= 0))
+        {
+            continue;
+        }
+        if (num_keys == max_keys + 1 && strcmp(lineFromFile, keys[max_keys]) >= 0)
+        {
+            if (reader->lsm || reader->btree)
+            {
+                // These tables are read in key order, so no later key fits
+                break;
+            }
+            continue;
+        }
+        if (num_keys < max_keys + 1)
+        {
+            num_keys++;
+        }
+        // Insertion into the sorted keys, dropping the largest when full
+        for (i = num_keys - 1; i > 0 && strcmp(keys[i - 1], lineFromFile) > 0; i--)
+        {
+            strcpy(keys[i], keys[i - 1]);
+        }
+        strcpy(keys[i], lineFromFile);
+    }
+    if (num_keys > max_keys)
+    {
+        strcpy(next, keys[max_keys]);
+        num_keys = max_keys;
+    }
+    return num_keys;
+}
+
+/**
+ * @brief Delete the item in the server based on key_to_delete
+ *
+ * @param key_to_delete key to set
+ * @param table_num index of the table parsing
+ * @param logged where to store the redo log number of the change for redo_log_wait(), left alone if it was not logged
+ * @return returns success string if it works (ERR_KEY_NOT_FOUND if key_to_delete DNE in keys)
+ */
+char *delete_command(char key_to_delete[MAX_KEY_LEN], int table_num, unsigned long *logged)
+{
+    char key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    unsigned long metadata;
+    int index = 0, rows;
+
+    // Rows are about to move, so wait out every append and update in the table
+    if (!owners_only())
+    {
+        pthread_rwlock_wrlock(&table_shape_lock[table_num]);
+    }
+    rows = first_empty[table_num];
+    while (index < rows)
+    {
+        record_read_key(&tables[table_num][index], key);
+        if (!strcmp(key, key_to_delete))
+        {
+            break;
+        }
+        index++;
+    }
+    if (index == rows)
+    {
+        if (!owners_only())
+        {
+            pthread_rwlock_unlock(&table_shape_lock[table_num]);
+        }
+        return "ERR_KEY_NOT_FOUND";
+    }
+    for (; index < rows - 1; index++)
+    {
+        record_read_key(&tables[table_num][index + 1], key);
+        record_read_value(table_num, index + 1, value, &metadata);
+        record_write_begin(table_num, index);
+        strcpy(tables[table_num][index].key, key);
+        strcpy(values[table_num][index].value, value);
+        memcpy(values[table_num][index].ints, values[table_num][index + 1].ints, sizeof values[table_num][index].ints);
+        memcpy(values[table_num][index].floats, values[table_num][index + 1].floats, sizeof values[table_num][index].floats);
+        tables[table_num][index].metadata = metadata;
+        record_write_end(table_num, index);
+    }
+    slot_published[table_num][rows - 1] = 0;
+    next_slot[table_num] = rows - 1;
+    __atomic_store_n(&first_empty[table_num], rows - 1, __ATOMIC_RELEASE);
+    key_index_remove(table_num, key_to_delete);
+    if (params.snapshot_interval > 0)
+    {
+        *logged = redo_log_delete(table_num, key_to_delete);
+    }
+    table_written(table_num);
+    if (!owners_only())
+    {
+        pthread_rwlock_unlock(&table_shape_lock[table_num]);
+    }
+    return "SUCCESS";
+}
+
+/**
+ * @brief An in-memory operation, run by the owner of its table in partitioned mode.
+ */
+struct table_op {
+    /// Table the operation works on
+    int table_num;
+
+    /// Key and value of GET, SET and DELETE
+    char *key;
+    char *value;
+    unsigned long metadata;
+
+    /// Predicates and results of QUERY
+    const struct predicate *predicates;
+    int num_pred;
+
+    /// Page of a paged QUERY: where it resumes, how many keys it may
+    /// return (0 to only count) and where the next page starts
+    const char *cursor;
+    int limit;
+    char *next_cursor;
+    char (*matched_keys)[MAX_KEY_LEN];
+    int num_matched;
+
+    /// Columns and records of a SELECT
+    const int *columns;
+    int num_columns;
+    struct query_row *rows;
+
+    /// Records of a LOAD
+    char (*load_keys)[MAX_KEY_LEN];
+    char (*load_values)[MAX_VALUE_LEN];
+    int num_records;
+
+    /// Function, columns and results of an AGGREGATE
+    struct aggregate *aggregate;
+
+    /// Snapshot being taken
+    FILE *snapshot;
+
+    /// Redo log number of the last change made, 0 if none was logged
+    unsigned long logged;
+
+    /// Reply for the client
+    char *reply;
+};
+
+/**
+ * @brief GET run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_get(void *arg)
+{
+    struct table_op *op = arg;
+    get_command(op->key, op->value, table_rows(op->table_num), op->table_num);
+}
+
+/**
+ * @brief SET run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_set(void *arg)
+{
+    struct table_op *op = arg;
+    op->reply = set_in_memory(op->key, op->value, op->metadata, op->table_num, &op->logged);
+}
+
+/**
+ * @brief DELETE run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_delete(void *arg)
+{
+    struct table_op *op = arg;
+    op->reply = delete_command(op->key, op->table_num, &op->logged);
+}
+
+/**
+ * @brief Batch of a LOAD run by run_table_op()
+ *
+ * The whole batch is handed to the table's owner at once. It stops at
+ * the first record that cannot be stored.
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_load(void *arg)
+{
+    struct table_op *op = arg;
+    int i;
+
+    op->reply = "SUCCESS";
+    for (i = 0; i < op->num_records && !strcmp(op->reply, "SUCCESS"); i++)
+    {
+        op->reply = set_in_memory(op->load_keys[i], op->load_values[i], 0, op->table_num, &op->logged);
+    }
+}
+
+/**
+ * @brief Copy a table into a snapshot, run by run_table_op()
+ *
+ * Rows only move on a DELETE, so DELETEs wait for the copy; SETs and
+ * updates go on, and the redo log covers what the copy misses of them.
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_snapshot(void *arg)
+{
+    struct table_op *op = arg;
+    struct query_row row;
+    int i, rows;
+
+    if (!owners_only())
+    {
+        pthread_rwlock_rdlock(&table_shape_lock[op->table_num]);
+    }
+    rows = table_rows(op->table_num);
+    for (i = 0; i < rows; i++)
+    {
+        record_read_row(op->table_num, i, &row);
+        redo_log_snapshot_record(op->snapshot, op->table_num, row.key, row.metadata, row.value);
+    }
+    if (!owners_only())
+    {
+        pthread_rwlock_unlock(&table_shape_lock[op->table_num]);
+    }
+}
+
+/**
+ * @brief QUERY scan run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_query(void *arg)
+{
+    struct table_op *op = arg;
+    op->num_matched = query_collect(op->predicates, op->num_pred, op->table_num, op->matched_keys);
+}
+
+/**
+ * @brief Paged or count-only QUERY scan run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_query_page(void *arg)
+{
+    struct table_op *op = arg;
+
+    if (op->limit == 0)
+    {
+        op->next_cursor[0] = '\0';
+        op->num_matched = query_count(op->predicates, op->num_pred, op->table_num);
+        return;
+    }
+    op->num_matched = query_collect_page(op->predicates, op->num_pred, op->table_num, op->cursor, op->limit,
+                                         op->matched_keys, op->next_cursor);
+}
+
+/**
+ * @brief SELECT scan run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_select(void *arg)
+{
+    struct table_op *op = arg;
+    op->num_matched = query_select_page(op->predicates, op->num_pred, op->table_num, op->columns, op->num_columns,
+                                        op->cursor, op->limit, op->rows, op->next_cursor);
+}
+
+/**
+ * @brief AGGREGATE scan run by run_table_op()
+ *
+ * @param arg the struct table_op
+ * @return no return value
+ */
+void table_op_aggregate(void *arg)
+{
+    struct table_op *op = arg;
+    query_aggregate(op->predicates, op->num_pred, op->table_num, op->aggregate);
+}
+
+/**
+ * @brief Run an in-memory operation on the thread allowed to touch its table
+ *
+ * In partitioned mode the operation is handed to the table's owner and the
+ * call waits for it; otherwise it runs on the calling connection thread.
+ * Waiting for the redo log to write a change is left to the calling
+ * thread, so an owner goes on to its next operation meanwhile.
+ *
+ * @param fn one of the table_op_* functions
+ * @param op the operation, op->table_num set
+ * @return no return value
+ */
+void run_table_op(void (*fn)(void *), struct table_op *op)
+{
+    op->logged = 0;
+    if (connection_partition)
+    {
+        partition_call(connection_partition, op->table_num, fn, op);
+    }
+    else
+    {
+        fn(op);
+    }
+    if (redo_log_wait(op->logged) != 0)
+    {
+        op->reply = "ERR_UNKNOWN";
+    }
+}
+
+/**
+ * @brief Snapshot every in-memory table
+ *
+ * @return returns 0 on success, -1 if the snapshot could not be written
+ */
+int take_snapshot(void)
+{
+    struct table_op op;
+    int i;
+
+    op.snapshot = redo_log_snapshot_begin();
+    if (op.snapshot == NULL)
+    {
+        return -1;
+    }
+    for (i = 0; i < schema_current()->num_tables; i++)
+    {
+        op.table_num = i;
+        run_table_op(table_op_snapshot, &op);
+    }
+    return redo_log_snapshot_end(op.snapshot);
+}
+
+/**
+ * @brief Snapshot the tables every snapshot_interval seconds
+ *
+ * @param arg unused
+ * @return never returns
+ */
+void *snapshot_thread(void *arg)
+{
+    if (params.partition_workers > 0)
+    {
+        // The owners copy their own tables
+        connection_partition = partition_client_open();
+        if (connection_partition == NULL)
+        {
+            logger(fserverOut, "Error opening a channel to the owner threads, no snapshots will be taken.\n", LOGGING_SERVER);
+            return arg;
+        }
+    }
+    for (;;)
+    {
+        sleep(params.snapshot_interval);
+        if (take_snapshot() != 0)
+        {
+            logger(fserverOut, "Error writing a snapshot of the tables.\n", LOGGING_SERVER);
+        }
+    }
+    return arg;
+}
+
+/**
+ * @brief Store a batch of records of a LOAD
+ *
+ * @param table_num index of the table
+ * @param keys the keys
+ * @param values the values
+ * @param num_records number of records
+ * @return returns the reply for the client (SUCCESS if every record was stored)
+ */
+char *load_batch(int table_num, char keys[][MAX_KEY_LEN], char values[][MAX_VALUE_LEN], int num_records)
+{
+    int i;
+
+    if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+    {
+        struct table_op op;
+        op.table_num = table_num;
+        op.load_keys = keys;
+        op.load_values = values;
+        op.num_records = num_records;
+        run_table_op(table_op_load, &op);
+        return op.reply;
+    }
+    else if (params.storage_policy == STORAGE_POLICY_ON_DISK)
+    {
+        // One append to the table file for the whole batch
+        return disk_log_set_batch(table_num, keys, values, num_records) == 0 ? "SUCCESS" : "ERR_UNKNOWN";
+    }
+    for (i = 0; i < num_records; i++)
+    {
+        if (set_perm(table_num, keys[i], values[i]) == -1)
+        {
+            return "ERR_UNKNOWN";
+        }
+    }
+    return "SUCCESS";
+}
+
+/**
+ * @brief Read the records of a LOAD from the client and store them
+ *
+ * The records are "key;value" lines, body_len bytes in all. They are read
+ * in large chunks, never past the end of the body, and stored
+ * LOAD_BATCH_RECORDS at a time. Batches stored before a bad record stay
+ * stored.
+ *
+ * @param sock the socket connected to the client
+ * @param table_num index of the table
+ * @param body_len bytes of records following the command
+ * @return returns the reply for the client, NULL if the connection was lost
+ */
+char *load_records(int sock, int table_num, int body_len)
+{
+    char (*keys)[MAX_KEY_LEN] = malloc(LOAD_BATCH_RECORDS * sizeof *keys);
+    char (*vals)[MAX_VALUE_LEN] = malloc(LOAD_BATCH_RECORDS * sizeof *vals);
+    char *buf = malloc(LOAD_BUFFER_SIZE), *line, *end, *sep;
+    struct schema_field fields[MAX_COLUMNS_PER_TABLE];
+    int len = 0, num_records = 0, want;
+    ssize_t got;
+    char *reply = "SUCCESS";
+
+    if (keys == NULL || vals == NULL || buf == NULL)
+    {
+        reply = "ERR_UNKNOWN";
+    }
+    while (!strcmp(reply, "SUCCESS") && (body_len > 0 || len > 0))
+    {
+        want = LOAD_BUFFER_SIZE - len < body_len ? LOAD_BUFFER_SIZE - len : body_len;
+        if (want == 0)
+        {
+            // Bytes left over with no newline, or a line longer than the buffer
+            reply = "ERR_INVALID_PARAM";
+            break;
+        }
+        got = recv(sock, buf + len, want, 0);
+        if (got <= 0)
+        {
+            reply = NULL;
+            break;
+        }
+        body_len -= got;
+        len += got;
+
+        // Take every complete line out of the buffer
+        line = buf;
+        while (!strcmp(reply, "SUCCESS") && (end = memchr(line, '\n', buf + len - line)) != NULL)
+        {
+            sep = memchr(line, ';', end - line);
+            if (sep == NULL || sep == line || sep - line >= MAX_KEY_LEN || end - sep - 1 >= MAX_VALUE_LEN)
+            {
+                reply = "ERR_INVALID_PARAM";
+                break;
+            }
+            memcpy(keys[num_records], line, sep - line);
+            keys[num_records][sep - line] = '\0';
+            memcpy(vals[num_records], sep + 1, end - sep - 1);
+            vals[num_records][end - sep - 1] = '\0';
+            line = end + 1;
+
+            // set_in_memory() checks the values of in-memory tables itself
+            if (params.storage_policy != STORAGE_POLICY_IN_MEMORY &&
+                parse_value(trim(vals[num_records]), table_num, fields) != 1)
+            {
+                reply = "ERR_INVALID_PARAM";
+                break;
+            }
+            if (++num_records == LOAD_BATCH_RECORDS)
+            {
+                reply = load_batch(table_num, keys, vals, num_records);
+                num_records = 0;
+            }
+        }
+        len -= line - buf;
+        memmove(buf, line, len);
+    }
+    if (reply && !strcmp(reply, "SUCCESS") && num_records > 0)
+    {
+        reply = load_batch(table_num, keys, vals, num_records);
+    }
+    free(keys);
+    free(vals);
+    free(buf);
+    return reply;
+}
+
+/**
+ * @brief Put back a record read from a snapshot or the redo log at startup
+ *
+ * @param table_num index of the table
+ * @param key the key
+ * @param metadata the record's metadata
+ * @param value the record's value, NULL to delete it
+ * @return no return value
+ */
+void restore_record(int table_num, const char *key, unsigned long metadata, const char *value)
+{
+    struct schema_field fields[MAX_COLUMNS_PER_TABLE];
+    char key_copy[MAX_KEY_LEN], value_copy[MAX_VALUE_LEN];
+    unsigned long logged = 0;
+    int index;
+
+    strcpy(key_copy, key);
+    if (value == NULL)
+    {
+        // Nothing is logged until the redo log is open
+        delete_command(key_copy, table_num, &logged);
+        return;
+    }
+    strcpy(value_copy, value);
+    if (parse_value(value_copy, table_num, fields) != 1)
+    {
+        return;
+    }
+    index = key_exist(key_copy, table_rows(table_num), table_num);
+    if (index == -1)
+    {
+        index = reserve_slot(table_num);
+        if (index == -1)
+        {
+            return;
+        }
+    }
+    record_write_begin(table_num, index);
+    strcpy(tables[table_num][index].key, key_copy);
+    strcpy(values[table_num][index].value, value_copy);
+    store_fields(table_num, index, fields);
+    tables[table_num][index].metadata = metadata;
+    record_write_end(table_num, index);
+    if (index >= table_rows(table_num))
+    {
+        publish_slot(table_num, index);
+        key_index_insert(table_num, key_copy);
+    }
+    table_written(table_num);
+}
+
+/**
+ * @brief Run an in-memory QUERY, answering it from the query cache when it can
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @param matched_keys where to copy the keys of the matching records
+ * @return returns the number of matching records
+ */
+int query_in_memory(const struct predicate *predicates, int num_pred, int table_num, char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN])
+{
+    char normalized[MAX_CMD_LEN];
+    unsigned long version = 0;
+    struct table_op op;
+    int num_matched;
+
+    if (query_cache_enabled())
+    {
+        // Read the version before scanning, so a write racing the scan
+        // leaves the stored result already stale
+        normalize_predicates(predicates, num_pred, normalized);
+        version = __atomic_load_n(&table_version[table_num], __ATOMIC_ACQUIRE);
+        num_matched = query_cache_lookup(table_num, normalized, version, matched_keys);
+        if (num_matched != -1)
+        {
+            return num_matched;
+        }
+    }
+
+    op.table_num = table_num;
+    op.predicates = predicates;
+    op.num_pred = num_pred;
+    op.matched_keys = matched_keys;
+    run_table_op(table_op_query, &op);
+
+    if (query_cache_enabled())
+    {
+        query_cache_store(table_num, normalized, version, matched_keys, op.num_matched);
+    }
+    return op.num_matched;
+}
+
+/**
+ * @brief Run one page of an in-memory QUERY, answering it from the query cache when it can
+ *
+ * Only a first page that asks for every match, or for the count alone,
+ * is answered from the cache; a first page that holds every match is
+ * stored in it.
+ *
+ * @param predicates parsed predicates
+ * @param num_pred number of predicates
+ * @param table_num index of the table parsing
+ * @param cursor where to resume, "" for the first page
+ * @param limit max keys to collect, 0 to only count
+ * @param matched_keys where to copy the keys of the matching records
+ * @param next_cursor where to write the cursor of the next page ("" if this is the last page)
+ * @return returns the number of keys collected (the number of matches if limit is 0), -1 if the cursor is malformed
+ */
+int query_page_in_memory(const struct predicate *predicates, int num_pred, int table_num, const char *cursor, int limit,
+                         char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN], char next_cursor[MAX_CURSOR_LEN])
+{
+    char normalized[MAX_CMD_LEN];
+    unsigned long version = 0;
+    struct table_op op;
+    int num_matched, first_page = query_cache_enabled() && cursor[0] == '\0';
+
+    if (first_page)
+    {
+        normalize_predicates(predicates, num_pred, normalized);
+        version = __atomic_load_n(&table_version[table_num], __ATOMIC_ACQUIRE);
+        if (limit == 0 || limit == MAX_RECORDS_PER_TABLE)
+        {
+            num_matched = query_cache_lookup(table_num, normalized, version, matched_keys);
+            if (num_matched != -1)
+            {
+                next_cursor[0] = '\0';
+                return num_matched;
+            }
+        }
+    }
+
+    op.table_num = table_num;
+    op.predicates = predicates;
+    op.num_pred = num_pred;
+    op.cursor = cursor;
+    op.limit = limit;
+    op.next_cursor = next_cursor;
+    op.matched_keys = matched_keys;
+    run_table_op(table_op_query_page, &op);
+
+    if (first_page && limit > 0 && op.num_matched != -1 && next_cursor[0] == '\0')
+    {
+        query_cache_store(table_num, normalized, version, matched_keys, op.num_matched);
+    }
+    return op.num_matched;
+}
+
+/**
+ * @brief Copy one field of a command into a buffer
+ *
+ * @param fields the fields of the command
+ * @param num_fields number of fields
+ * @param index index of the field to copy
+ * @param buf where to copy the field
+ * @param size size of buf
+ * @return returns 0 on success, -1 if the field is missing or too long
+ */
+int command_field(const struct token *fields, int num_fields, int index, char *buf, int size)
+{
+    if (index >= num_fields)
+    {
+        return -1;
+    }
+    return token_copy(fields[index], buf, size);
+}
+
+/**
+ * @brief Copy the key field of a command into a buffer
+ *
+ * @param fields the fields of the command
+ * @param num_fields number of fields
+ * @param index index of the key field
+ * @param key where to copy the key
+ * @return returns 0 on success, -1 if the key is missing, empty or too long
+ */
+int command_key(const struct token *fields, int num_fields, int index, char key[MAX_KEY_LEN])
+{
+    if (index >= num_fields || fields[index].len == 0)
+    {
+        return -1;
+    }
+    return token_copy(fields[index], key, MAX_KEY_LEN);
+}
+
+/**
+ * @brief Refuse a command on a table whose files are still being opened, or failed to open
+ *
+ * @param sock the socket connected to the client
+ * @param table_num index of the table
+ * @return returns true(1) if the table is not ready and the client was told so, false(0) otherwise
+ */
+int table_loading(int sock, int table_num)
+{
+    int ready = __atomic_load_n(&table_ready[table_num], __ATOMIC_ACQUIRE);
+
+    if (ready == 1)
+    {
+        return 0;
+    }
+    else if (ready == -1)
+    {
+        sendall(sock, "ERR_UNKNOWN\n", 12);
+    }
+    else
+    {
+        sendall(sock, "ERR_TABLE_LOADING\n", 18);
+    }
+    return 1;
+}
+
+/**
+ * @brief Open the files of a table and build its in-memory index
+ *
+ * @param table_num index of the table
+ * @return returns 0 on success, -1 if the files cannot be opened
+ */
+int open_table(int table_num)
+{
+    char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 16];
+    char log_message[MAX_PATH_LEN + MAX_TABLE_LEN + 128];
+    const char *name = schema_current()->tables[table_num].name;
+    int status = 0;
+
+    if (params.storage_policy == STORAGE_POLICY_ON_DISK)
+    {
+        if (disk_log_open(table_num, table_file_path(name, datadirectory)) != 0)
+        {
+            snprintf(log_message, sizeof log_message, "Error opening table file %s: %s.\n", datadirectory, strerror(errno));
+            status = -1;
+        }
+    }
+    else if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        if (lsm_open(table_num, name) != 0)
+        {
+            snprintf(log_message, sizeof log_message, "Error opening the LSM files of table %s: %s.\n", name, strerror(errno));
+            status = -1;
+        }
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        data_directory_path(datadirectory);
+        strcat(datadirectory, name);
+        strcat(datadirectory, "_btree.dat");
+        if (btree_open(table_num, datadirectory, params.fsync_policy == DISK_LOG_SYNC_ALWAYS, params.bloom_fpr) != 0)
+        {
+            snprintf(log_message, sizeof log_message, "Error opening table file %s: %s.\n", datadirectory, strerror(errno));
+            status = -1;
+        }
+    }
+    if (status != 0)
+    {
+        logger(fserverOut, log_message, LOGGING_SERVER);
+    }
+    return status;
+}
+
+/**
+ * @brief Claim tables and open them until none are left
+ *
+ * Run by the loading thread and by scan_pool workers at the same time. A
+ * table that fails to open is marked failed rather than stopping the server.
+ *
+ * @param arg counter of the next table to open
+ * @return no return value
+ */
+void open_tables(void *arg)
+{
+    int *next_table = arg;
+    char log_message[MAX_TABLE_LEN + 64];
+    int table_num;
+
+    while ((table_num = __sync_fetch_and_add(next_table, 1)) < schema_current()->num_tables)
+    {
+        if (open_table(table_num) != 0)
+        {
+            // A table that cannot be read cannot be served; the others still can
+            snprintf(log_message, sizeof log_message, "Table %s could not be opened.\n",
+                     schema_current()->tables[table_num].name);
+            logger(fserverOut, log_message, LOGGING_SERVER);
+            __atomic_store_n(&table_ready[table_num], -1, __ATOMIC_RELEASE);
+            continue;
+        }
+        __atomic_store_n(&table_ready[table_num], 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief Open the files of every table, several tables at a time
+ *
+ * @param arg unused
+ * @return no return value
+ */
+void *load_tables(void *arg)
+{
+    struct timespec start, end;
+    char log_message[100];
+    int next_table = 0, num_tasks = schema_current()->num_tables;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (num_tasks > scan_pool.num_threads + 1)
+    {
+        num_tasks = scan_pool.num_threads + 1;
+    }
+    threadpool_run(&scan_pool, open_tables, &next_table, num_tasks);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    snprintf(log_message, sizeof log_message, "Opened %d tables in %.3f s.\n", schema_current()->num_tables,
+             (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    logger(fserverOut, log_message, LOGGING_SERVER);
+    return arg;
+}
+
+/**
+ * @brief Process a command from the client.
+ *
+ * @param sock The socket connected to the client.
+ * @param cmd The command received from the client.
+ * @param *auth_var variable that keeps track if client is authorized or not
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
+{
+    char key_temp[MAX_KEY_LEN];
+    char value_temp[MAX_VALUE_LEN];
+    char username_temp[MAX_USERNAME_LEN];
+    char passwd_temp[MAX_ENC_PASSWORD_LEN];
+    char update_value_temp[MAX_VALUE_LEN];
+    char table_temp[MAX_TABLE_LEN];
+    char pred_temp[MAX_VALUE_LEN];
+    char meta_temp[MAX_KEY_LEN];
+
+    // Split the command once; the fields are views into cmd
+    struct token fields[MAX_CMD_FIELDS];
+    int num_fields = tokenize(cmd, ';', fields, MAX_CMD_FIELDS);
+
+    int table_index, return_val_query_perm;
+
+    if (num_fields == -1)
+    {
+        strcpy(value_temp, "ERR_INVALID_PARAM");
+        sendall(sock, value_temp, strlen(value_temp));
+        sendall(sock, "\n", 1);
+        return -1;
+    }
+
+    // AUTH comand called
+    if (token_equals(fields[0], "AUTH"))
+    {
+        // Get the username and password from the communication string
+        if (command_field(fields, num_fields, 1, username_temp, MAX_USERNAME_LEN) == -1 ||
+            command_field(fields, num_fields, 2, passwd_temp, MAX_ENC_PASSWORD_LEN) == -1)
+        {
+            strcpy(value_temp, "ERR_AUTHENTICATION_FAILED");
+            sendall(sock, value_temp, strlen(value_temp));
+            sendall(sock, "\n", 1);
+            return -1;
+        }
+
+        if (!strcmp(params.username, username_temp) && !strcmp(params.password, passwd_temp))
+        {
+            // Username and password from client cmd are the same as in the config file
+            *auth_var = 1;
+            strcpy(value_temp, "SUCCESS");
+            sendall(sock, value_temp, strlen(value_temp));
+            sendall(sock, "\n", 1);
+        }
+        else
+        {
+            // Username and password from client cmd are not the same as in the config file
+            strcpy(value_temp, "ERR_AUTHENTICATION_FAILED");
+            sendall(sock, value_temp, strlen(value_temp));
+            sendall(sock, "\n", 1);
+            return -1;
+        }
+    }
+    else if (token_equals(fields[0], "GET"))
+    {
+        if (*auth_var)
+        {
+            // Get table and key names from cmd
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 ||
+                command_key(fields, num_fields, 2, key_temp) == -1)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+            table_index = has_table(table_temp);
+            if (table_index == -1)
+            {
+                // table name doesn't exist in the config file / server
+                strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+            if (table_loading(sock, table_index))
+            {
+                return 0;
+            }
+            // table exists in config file, continue
+            if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+            {
+                // Use memory for server storage
+                struct table_op op;
+                op.table_num = table_index;
+                op.key = key_temp;
+                op.value = value_temp;
+                run_table_op(table_op_get, &op);
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+            }
+            else
+            {
+                if (get_perm(table_index, key_temp, value_temp) == -1)
+                {
+                    strcpy(value_temp, "ERR_KEY_NOT_FOUND");
+                }
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+            }
+        }
+        else
+        {
+            // Client is not authenticated to the server yet
+            strcpy(value_temp, "ERR_NOT_AUTHENTICATED");
+            sendall(sock, value_temp, strlen(value_temp));
+            sendall(sock, "\n", 1);
+            return -1;
+        }
+    }
+    else if (token_equals(fields[0], "SET"))
+    {
+        if (*auth_var)
+        {
+            // Client is authenticated
+
+            // Get the table name, key and value to store from cmd
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 ||
+                command_key(fields, num_fields, 2, key_temp) == -1 ||
+                command_field(fields, num_fields, 3, value_temp, MAX_VALUE_LEN) == -1)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+
+            table_index = has_table(table_temp);
+            if (table_index == -1)
+            {
+                // table name DNE in the config params
+                strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+            if (table_loading(sock, table_index))
+            {
+                return 0;
+            }
+            // table does exist in config params
+
+            if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+            {
+                // Use memory for storing the server
+                struct table_op op;
+                if (command_field(fields, num_fields, 4, meta_temp, MAX_KEY_LEN) == -1)
+                {
+                    // No metadata sent
+                    strcpy(meta_temp, "0");
+                }
+                op.table_num = table_index;
+                op.key = key_temp;
+                op.value = value_temp;
+                op.metadata = atoi(meta_temp);
+                run_table_op(table_op_set, &op);
+                sendall(sock, op.reply, strlen(op.reply));
+                sendall(sock, "\n", 1);
+                if (!strcmp(op.reply, "ERR_INVALID_PARAM"))
+                {
+                    return -1;
+                }
+            }
+            else
+            {
+
+                trim(value_temp);
+                struct schema_field fields[MAX_COLUMNS_PER_TABLE];
+                if (parse_value(value_temp, table_index, fields) == 1)
+                {
+
+                    if (set_perm(table_index, key_temp, value_temp) == -1)
+                    {
+                        strcpy(update_value_temp, "ERR_UNKNOWN");
+                    }
+                    else
+                    {
+                        strcpy(update_value_temp, "SUCCESS");
+                    }
+                    sendall(sock, update_value_temp, strlen(update_value_temp));
+                    sendall(sock, "\n", 1);
+                }
+                else
+                {
+                    // value string does not match the setup of the table
+                    strcpy(update_value_temp, "ERR_INVALID_PARAM");
+                    sendall(sock, update_value_temp, strlen(update_value_temp));
+                    sendall(sock, "\n", 1);
+                    return -1;
+                }
+
+            }
+        }
+        else
+        {
+            strcpy(value_temp, "ERR_NOT_AUTHENTICATED");
+            sendall(sock, value_temp, strlen(value_temp));
+            sendall(sock, "\n", 1);
+            return -1;
+        }
+    }
+    else if (token_equals(fields[0], "QUERY"))
+    {
+        if (*auth_var)
+        {
+            // Client is authorized to access server
+
+            // Get the table name from the command
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 || num_fields < 3)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+
+            table_index = has_table(table_temp);
+            if (table_index == -1)
+            {
+                // table name DNE in the config params
+                strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+            if (table_loading(sock, table_index))
+            {
+                return 0;
+            }
+            // Table does exist in the config_params
+            struct predicate predicates[MAX_COLUMNS_PER_TABLE];
+            int num_pred = parse_predicates(fields[2], table_index, predicates);
+
+            // A limit, and the cursor of a previous page, ask for one page
+            // of keys; a limit of 0 only counts the matches
+            char cursor[MAX_CURSOR_LEN], next_cursor[MAX_CURSOR_LEN];
+            char matched_keys[MAX_RECORDS_PER_TABLE][MAX_KEY_LEN];
+            int paged = (num_fields >= 4), limit = 0, num_matched;
+            cursor[0] = '\0';
+            if (paged && (token_to_int(token_trim(fields[3]), &limit) == -1 || limit < 0 ||
+                          (num_fields >= 5 && command_field(fields, num_fields, 4, cursor, MAX_CURSOR_LEN) == -1)))
+            {
+                num_pred = -1;
+            }
+            if (limit > MAX_RECORDS_PER_TABLE)
+            {
+                limit = MAX_RECORDS_PER_TABLE;
+            }
+
+            if (num_pred != -1 && paged)
+            {
+                if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+                {
+                    num_matched = query_page_in_memory(predicates, num_pred, table_index, cursor, limit, matched_keys,
+                                                       next_cursor);
+                }
+                else
+                {
+                    struct perm_reader reader;
+                    open_reader_perm(&reader, table_index, table_temp, "");
+                    num_matched = query_page_perm(predicates, num_pred, &reader, cursor, limit, matched_keys, next_cursor);
+                    close_reader_perm(&reader);
+                }
+                if (num_matched != -1)
+                {
+                    return query_page_reply(sock, limit > 0 ? matched_keys : NULL, num_matched, next_cursor);
+                }
+                num_pred = -1;
+            }
+            if (num_pred != -1)
+            {
+                if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+                {
+                    num_matched = query_in_memory(predicates, num_pred, table_index, matched_keys);
+                    return query_reply(sock, matched_keys, num_matched);
+                }
+                else
+                {
+                    char (*all_keys)[MAX_KEY_LEN];
+                    num_matched = query_all_perm(predicates, num_pred, table_index, table_temp, &all_keys);
+                    if (num_matched == -1)
+                    {
+                        strcpy(pred_temp, "ERR_UNKNOWN");
+                        sendall(sock, pred_temp, strlen(pred_temp));
+                        sendall(sock, "\n", 1);
+                        return -1;
+                    }
+                    query_reply(sock, all_keys, num_matched);
+                    free(all_keys);
+                    return 0;
+                }
+            }
+            else
+            {
+                strcpy(pred_temp, "ERR_INVALID_PARAM");
+                sendall(sock, pred_temp, strlen(pred_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+        }
+        else
+        {
+            strcpy(value_temp, "ERR_NOT_AUTHENTICATED");
+            sendall(sock, value_temp, strlen(value_temp));
+            sendall(sock, "\n", 1);
+            return -1;
+        }
+    }
+    else if (token_equals(fields[0], "SELECT"))
+    {
+        if (*auth_var)
+        {
+            // Client is authorized to access server
+
+            // SELECT;table;predicates;columns;limit[;cursor]
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 || num_fields < 5)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+
+            table_index = has_table(table_temp);
+            if (table_index == -1)
+            {
+                // table name DNE in the config params
+                strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+            if (table_loading(sock, table_index))
+            {
+                return 0;
+            }
+
+            struct predicate predicates[MAX_COLUMNS_PER_TABLE];
+            int columns[MAX_COLUMNS_PER_TABLE];
+            char cursor[MAX_CURSOR_LEN], next_cursor[MAX_CURSOR_LEN];
+            struct query_row *rows = NULL;
+            int num_pred = parse_predicates(fields[2], table_index, predicates);
+            int num_columns = parse_columns(fields[3], table_index, columns);
+            int limit = 0, num_matched = -1;
+
+            cursor[0] = '\0';
+            if (token_to_int(token_trim(fields[4]), &limit) == -1 || limit < 1 ||
+                (num_fields >= 6 && command_field(fields, num_fields, 5, cursor, MAX_CURSOR_LEN) == -1))
+            {
+                num_pred = -1;
+            }
+            if (limit > MAX_RECORDS_PER_TABLE)
+            {
+                limit = MAX_RECORDS_PER_TABLE;
+            }
+            if (num_pred != -1 && num_columns != -1)
+            {
+                rows = malloc((size_t)limit * sizeof *rows);
+            }
+
+            if (rows)
+            {
+                if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+                {
+                    struct table_op op;
+                    op.table_num = table_index;
+                    op.predicates = predicates;
+                    op.num_pred = num_pred;
+                    op.columns = columns;
+                    op.num_columns = num_columns;
+                    op.cursor = cursor;
+                    op.limit = limit;
+                    op.next_cursor = next_cursor;
+                    op.rows = rows;
+                    run_table_op(table_op_select, &op);
+                    num_matched = op.num_matched;
+                }
+                else
+                {
+                    struct perm_reader reader;
+                    open_reader_perm(&reader, table_index, table_temp, "");
+                    num_matched = query_select_perm(predicates, num_pred, &reader, columns, num_columns,
+                                                    cursor, limit, rows, next_cursor);
+                    close_reader_perm(&reader);
+                }
+            }
+            if (num_matched != -1)
+            {
+                return_val_query_perm = query_select_reply(sock, rows, num_matched, next_cursor);
+                free(rows);
+                return return_val_query_perm;
+            }
+            free(rows);
+            strcpy(pred_temp, "ERR_INVALID_PARAM");
+            sendall(sock, pred_temp, strlen(pred_temp));
             sendall(sock, "\n", 1);
+            return -1;
         }
         else
         {
-            pthread_mutex_unlock(&params.lock);
-            // Username and password from client cmd are not the same as in the config file
-            strcpy(value_temp, "ERR_AUTHENTICATION_FAILED");
+            strcpy(value_temp, "ERR_NOT_AUTHENTICATED");
             sendall(sock, value_temp, strlen(value_temp));
             sendall(sock, "\n", 1);
             return -1;
         }
     }
-    else if (is_get)
+    else if (token_equals(fields[0], "AGGREGATE"))
     {
         if (*auth_var)
         {
-            // Get table name from cmd
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, table_temp, 1, ";\0");
-            table_index = has_table(table_temp);
-            if (table_index == -1)
+            // Client is authorized to access server
+
+            // AGGREGATE;table;function;column;predicates[;group_by]
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 || num_fields < 5)
             {
-                // table name doesn't exist in the config file / server
-                strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
+                strcpy(value_temp, "ERR_INVALID_PARAM");
                 sendall(sock, value_temp, strlen(value_temp));
                 sendall(sock, "\n", 1);
                 return -1;
             }
-            // table exists in config file, continue
 
-            // Get key name from cmd
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, key_temp, 2, ";\0");
-            pthread_mutex_lock(&params.lock);
-            if (params.storage_policy == 0)
+            table_index = has_table(table_temp);
+            if (table_index == -1)
             {
-                pthread_mutex_unlock(&params.lock);
-                // Use memory for server storage
-                get_command(key_temp, value_temp, first_empty[table_index], table_index);
+                // table name DNE in the config params
+                strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
                 sendall(sock, value_temp, strlen(value_temp));
                 sendall(sock, "\n", 1);
+                return -1;
             }
-            else
+            if (table_loading(sock, table_index))
             {
-                pthread_mutex_unlock(&params.lock);
-                FILE *fileLoadData;
-                char tablenamestring[MAX_TABLE_LEN + 8];
-                char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-
-                char datadirectoryTEMP2[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-                strcpy(datadirectoryTEMP2, params.data_directory);
-
-
-                get_param(datadirectoryTEMP2, datadirectory, 0, ".\0");
-
-                strcpy(datadirectoryTEMP2, datadirectory);
-                strcpy(datadirectory, "");
-                get_param(datadirectoryTEMP2, datadirectory, 0, "/\0");
-
-                strcat(datadirectory, "/");
-                struct stat st = {0};
+                return 0;
+            }
 
-                if (stat(datadirectory, &st) == -1)
-                {
-                    mkdir(datadirectory, 0700);
-                }
+            struct predicate predicates[MAX_COLUMNS_PER_TABLE];
+            struct token group_by = { "", 0 };
+            struct aggregate *agg = malloc(sizeof *agg);
+            int num_pred = parse_predicates(fields[4], table_index, predicates);
 
-                strcpy(tablenamestring, table_temp);
-                strcat(tablenamestring, "_tbl.txt");
-                strcat(datadirectory, tablenamestring);
-                fileLoadData = fopen (datadirectory, "rt");
-                get_command_perm(key_temp, fileLoadData, value_temp);
-                if (fileLoadData)
-                    fclose(fileLoadData);
-                sendall(sock, value_temp, strlen(value_temp));
+            if (num_fields >= 6)
+            {
+                group_by = fields[5];
+            }
+            if (agg == NULL || num_pred == -1 || parse_aggregate(fields[2], fields[3], group_by, table_index, agg) == -1)
+            {
+                free(agg);
+                strcpy(pred_temp, "ERR_INVALID_PARAM");
+                sendall(sock, pred_temp, strlen(pred_temp));
                 sendall(sock, "\n", 1);
+                return -1;
+            }
+
+            if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+            {
+                struct table_op op;
+                op.table_num = table_index;
+                op.predicates = predicates;
+                op.num_pred = num_pred;
+                op.aggregate = agg;
+                run_table_op(table_op_aggregate, &op);
             }
+            else
+            {
+                struct perm_reader reader;
+                open_reader_perm(&reader, table_index, table_temp, "");
+                aggregate_perm(predicates, num_pred, &reader, agg);
+                close_reader_perm(&reader);
+            }
+            return_val_query_perm = aggregate_reply(sock, agg);
+            free(agg);
+            return return_val_query_perm;
         }
         else
         {
-            // Client is not authenticated to the server yet
             strcpy(value_temp, "ERR_NOT_AUTHENTICATED");
             sendall(sock, value_temp, strlen(value_temp));
             sendall(sock, "\n", 1);
             return -1;
         }
     }
-    else if (is_set)
+    else if (token_equals(fields[0], "SCAN") || token_equals(fields[0], "PREFIX"))
     {
         if (*auth_var)
         {
-            // Client is authenticated
+            // Client is authorized to access server
 
-            // Get the table name from cmd
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, table_temp, 1, ";\0");
+            // SCAN;table;from;to;limit or PREFIX;table;prefix;limit[;from]
+            char from[MAX_KEY_LEN], to[MAX_KEY_LEN], next[MAX_KEY_LEN];
+            char keys[MAX_RECORDS_PER_TABLE + 1][MAX_KEY_LEN];
+            int prefix = token_equals(fields[0], "PREFIX"), limit, num_keys, valid;
+
+            valid = command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) != -1 &&
+                    command_field(fields, num_fields, 2, from, MAX_KEY_LEN) != -1;
+            if (valid && prefix)
+            {
+                key_index_prefix_end(from, to);
+                valid = num_fields >= 4 && token_to_int(token_trim(fields[3]), &limit) != -1;
+                if (valid && num_fields >= 5)
+                {
+                    // Resume a prefix scan from a later key
+                    valid = command_field(fields, num_fields, 4, key_temp, MAX_KEY_LEN) != -1;
+                    if (valid && strcmp(key_temp, from) > 0)
+                    {
+                        strcpy(from, key_temp);
+                    }
+                }
+            }
+            else if (valid)
+            {
+                valid = command_field(fields, num_fields, 3, to, MAX_KEY_LEN) != -1 && num_fields >= 5 &&
+                        token_to_int(token_trim(fields[4]), &limit) != -1;
+            }
+            if (!valid || limit < 1)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
+            if (limit > MAX_RECORDS_PER_TABLE)
+            {
+                limit = MAX_RECORDS_PER_TABLE;
+            }
 
             table_index = has_table(table_temp);
             if (table_index == -1)
@@ -1510,130 +3660,24 @@ int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
                 sendall(sock, "\n", 1);
                 return -1;
             }
-            // table does exist in config params
-
-            // Get the key and value to store from cmd
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, key_temp, 2, ";\0");
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, value_temp, 3, ";\0");
+            if (table_loading(sock, table_index))
+            {
+                return 0;
+            }
 
-            pthread_mutex_lock(&params.lock);
-            if (params.storage_policy == 0)
+            if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
             {
-                pthread_mutex_unlock(&params.lock);
-                // Use memory for storing the server
-                has_key = key_exist(key_temp, first_empty[table_index], table_index);
-                if (has_key != -1)
-                {
-                    // Key exists, do an update
-                    trim(value_temp);
-                    if (parse_value(value_temp, table_index) == 1)
-                    {
-                        strcpy(strtok_temp, cmd);
-                        get_param(strtok_temp, meta_temp, 4, ";\0");
-                        meta_temp_int = atoi(meta_temp);
-                        // value string matches the setup of the table
-                        strcpy(update_value_temp, update_command(key_temp, value_temp, has_key, table_index, meta_temp_int));
-                        sendall(sock, update_value_temp, strlen(value_temp));
-                        sendall(sock, "\n", 1);
-                    }
-                    else
-                    {
-                        // value string does not match the setup of the table
-                        strcpy(update_value_temp, "ERR_INVALID_PARAM");
-                        sendall(sock, update_value_temp, strlen(update_value_temp));
-                        sendall(sock, "\n", 1);
-                        return -1;
-                    }
-                }
-                else
-                {
-                    if (parse_value(value_temp, table_index) == 1)
-                    {
-                        // value string matches the setup of the table
-                        strcpy(value_temp, set_command(key_temp, value_temp, first_empty[table_index], table_index));
-                        sendall(sock, value_temp, strlen(value_temp));
-                        sendall(sock, "\n", 1);
-                        first_empty[table_index] = first_empty[table_index] + 1;
-                    }
-                    else
-                    {
-                        // value string does not match the setup of the table
-                        strcpy(update_value_temp, "ERR_INVALID_PARAM");
-                        sendall(sock, update_value_temp, strlen(update_value_temp));
-                        sendall(sock, "\n", 1);
-                        return -1;
-                    }
-                }
+                // The index has its own lock, so it is read from this thread in every mode
+                num_keys = key_index_range(table_index, from, to, keys, limit, next);
             }
             else
             {
-                pthread_mutex_unlock(&params.lock);
-
-                trim(value_temp);
-                if (parse_value(value_temp, table_index) == 1)
-                {
-
-                    // check if matches set up
-                    FILE *fileLoadData;
-                    FILE *fileWriteData;
-
-                    char tablenamestring[MAX_TABLE_LEN + 8];
-                    char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-
-                    char tablenamestringTEMP[MAX_TABLE_LEN + 13];
-                    char datadirectoryTEMP[MAX_PATH_LEN + MAX_TABLE_LEN + 13];
-
-                    char datadirectoryTEMP2[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-                    strcpy(datadirectoryTEMP2, params.data_directory);
-
-
-                    get_param(datadirectoryTEMP2, datadirectory, 0, ".\0");
-
-                    strcpy(datadirectoryTEMP2, datadirectory);
-                    strcpy(datadirectory, "");
-                    get_param(datadirectoryTEMP2, datadirectory, 0, "/\0");
-
-                    strcat(datadirectory, "/");
-                    struct stat st = {0};
-
-                    if (stat(datadirectory, &st) == -1)
-                    {
-                        mkdir(datadirectory, 0700);
-                    }
-
-                    strcpy(tablenamestring, table_temp);
-                    strcpy (tablenamestringTEMP, tablenamestring);
-                    strcat(tablenamestring, "_tbl.txt");
-                    strcat(tablenamestringTEMP, "_tbl_TEMP.txt");
-                    strcpy(datadirectoryTEMP, datadirectory);
-                    strcat(datadirectory, tablenamestring);
-                    strcat(datadirectoryTEMP, tablenamestringTEMP);
-                    fileLoadData = fopen (datadirectory, "rt");
-                    fileWriteData = fopen (datadirectoryTEMP, "w");
-                    strcpy(update_value_temp, set_command_perm(key_temp, value_temp, fileLoadData, fileWriteData));
-                    if (fileLoadData != NULL)
-                        fclose(fileLoadData);
-                    if (fileWriteData != NULL)
-                        fclose(fileWriteData);
-
-                    remove (datadirectory);
-                    rename (datadirectoryTEMP, datadirectory);
-
-                    sendall(sock, value_temp, strlen(value_temp));
-                    sendall(sock, "\n", 1);
-                }
-                else
-                {
-                    // value string does not match the setup of the table
-                    strcpy(update_value_temp, "ERR_INVALID_PARAM");
-                    sendall(sock, update_value_temp, strlen(update_value_temp));
-                    sendall(sock, "\n", 1);
-                    return -1;
-                }
-
+                struct perm_reader reader;
+                open_reader_perm(&reader, table_index, table_temp, from);
+                num_keys = scan_perm(&reader, from, to, keys, limit, next);
+                close_reader_perm(&reader);
             }
+            return query_page_reply(sock, keys, num_keys, next);
         }
         else
         {
@@ -1643,78 +3687,65 @@ int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
             return -1;
         }
     }
-    else if (is_query)
+    else if (token_equals(fields[0], "DELETE"))
     {
         if (*auth_var)
         {
             // Client is authorized to access server
 
-            // Get the table name from the command
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, table_temp, 1, ";\0");
+            // Get the table name and the key of the value to delete from the command
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 ||
+                command_key(fields, num_fields, 2, key_temp) == -1)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
 
             table_index = has_table(table_temp);
             if (table_index == -1)
             {
-                // table name DNE in the config params
+                // Table does not exist in the config_params
                 strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
                 sendall(sock, value_temp, strlen(value_temp));
                 sendall(sock, "\n", 1);
                 return -1;
             }
+            if (table_loading(sock, table_index))
+            {
+                return 0;
+            }
             // Table does exist in the config_params
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, pred_temp, 2, ";\0");
-            int num_pred = parse_predicates(pred_temp, table_index);
-            if (num_pred != -1)
+
+            if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+            {
+                // Use memory for storing the server
+                struct table_op op;
+                op.table_num = table_index;
+                op.key = key_temp;
+                run_table_op(table_op_delete, &op);
+                strcpy(value_temp, op.reply);
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+            }
+            else
             {
-                pthread_mutex_lock(&params.lock);
-                if (params.storage_policy == 0)
+                int deleted = delete_perm(table_index, key_temp);
+                if (deleted == 0)
                 {
-                    pthread_mutex_unlock(&params.lock);
-                    return query_command(sock, pred_temp, first_empty[table_index], table_index, params.numcolumnspertable[table_index], params.mycolumns, params.column_types);
+                    strcpy(value_temp, "SUCCESS");
+                }
+                else if (deleted == 1)
+                {
+                    strcpy(value_temp, "ERR_KEY_NOT_FOUND");
                 }
                 else
                 {
-                    pthread_mutex_unlock(&params.lock);
-                    FILE *fileLoadData;
-                    char tablenamestring[MAX_TABLE_LEN + 8];
-                    char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-                    char datadirectoryTEMP2[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-                    strcpy(datadirectoryTEMP2, params.data_directory);
-
-
-                    get_param(datadirectoryTEMP2, datadirectory, 0, ".\0");
-
-                    strcpy(datadirectoryTEMP2, datadirectory);
-                    strcpy(datadirectory, "");
-                    get_param(datadirectoryTEMP2, datadirectory, 0, "/\0");
-
-                    strcat(datadirectory, "/");
-                    struct stat st = {0};
-
-                    if (stat(datadirectory, &st) == -1)
-                    {
-                        mkdir(datadirectory, 0700);
-                    }
-                    strcpy(tablenamestring, table_temp);
-                    strcat(tablenamestring, "_tbl.txt");
-                    strcat(datadirectory, tablenamestring);
-                    fileLoadData = fopen (datadirectory, "rt");
-                    return_val_query_perm = query_command_perm(sock, pred_temp, table_index, params.numcolumnspertable[table_index], params.mycolumns, params.column_types, fileLoadData);
-
-                    if (fileLoadData)
-                        fclose(fileLoadData);
-
-                    return return_val_query_perm;
+                    strcpy(value_temp, "ERR_UNKNOWN");
                 }
-            }
-            else
-            {
-                strcpy(pred_temp, "ERR_INVALID_PARAM");
-                sendall(sock, pred_temp, strlen(pred_temp));
+                sendall(sock, value_temp, strlen(value_temp));
                 sendall(sock, "\n", 1);
-                return -1;
             }
         }
         else
@@ -1725,89 +3756,49 @@ int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
             return -1;
         }
     }
-    else if (is_delete)
+    else if (token_equals(fields[0], "LOAD"))
     {
         if (*auth_var)
         {
-            // Client is authorized to access server
+            // LOAD;table;bytes, then bytes of "key;value" lines
+            int body_len;
+            char *reply;
 
-            // Get the table name from the command
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, table_temp, 1, ";\0");
+            if (command_field(fields, num_fields, 1, table_temp, MAX_TABLE_LEN) == -1 || num_fields < 3 ||
+                token_to_int(token_trim(fields[2]), &body_len) == -1 || body_len < 0)
+            {
+                strcpy(value_temp, "ERR_INVALID_PARAM");
+                sendall(sock, value_temp, strlen(value_temp));
+                sendall(sock, "\n", 1);
+                return -1;
+            }
 
             table_index = has_table(table_temp);
             if (table_index == -1)
             {
-                // Table does not exist in the config_params
+                // The records were not read, so the connection cannot go on
                 strcpy(value_temp, "ERR_TABLE_NOT_FOUND");
                 sendall(sock, value_temp, strlen(value_temp));
                 sendall(sock, "\n", 1);
                 return -1;
             }
-            // Table does exist in the config_params
-
-            // Get the key of the value to delete
-            strcpy(strtok_temp, cmd);
-            get_param(strtok_temp, key_temp, 2, ";\0");
+            if (table_loading(sock, table_index))
+            {
+                // The records were not read either
+                return -1;
+            }
 
-            pthread_mutex_lock(&params.lock);
-            if (params.storage_policy == 0)
+            reply = load_records(sock, table_index, body_len);
+            if (reply == NULL)
             {
-                pthread_mutex_unlock(&params.lock);
-                // Use memory for storing the server
-                strcpy(value_temp, delete_command(key_temp, first_empty[table_index], table_index, params.numcolumnspertable[table_index], params.mycolumns));
-                first_empty[table_index] = first_empty[table_index] - 1;
-                sendall(sock, value_temp, strlen(value_temp));
-                sendall(sock, "\n", 1);
+                return -1;
             }
-            else
+            sendall(sock, reply, strlen(reply));
+            sendall(sock, "\n", 1);
+            if (strcmp(reply, "SUCCESS"))
             {
-                pthread_mutex_unlock(&params.lock);
-                FILE *fileLoadData;
-                FILE *fileWriteData;
-
-                char tablenamestring[MAX_TABLE_LEN + 8];
-                char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-
-                char tablenamestringTEMP[MAX_TABLE_LEN + 13];
-                char datadirectoryTEMP[MAX_PATH_LEN + MAX_TABLE_LEN + 13];
-
-                char datadirectoryTEMP2[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
-                strcpy(datadirectoryTEMP2, params.data_directory);
-
-
-                get_param(datadirectoryTEMP2, datadirectory, 0, ".\0");
-
-                strcpy(datadirectoryTEMP2, datadirectory);
-                strcpy(datadirectory, "");
-                get_param(datadirectoryTEMP2, datadirectory, 0, "/\0");
-
-                strcat(datadirectory, "/");
-                struct stat st = {0};
-
-                if (stat(datadirectory, &st) == -1)
-                {
-                    mkdir(datadirectory, 0700);
-                }
-
-                strcpy(tablenamestring, table_temp);
-                strcpy (tablenamestringTEMP, tablenamestring);
-                strcat(tablenamestring, "_tbl.txt");
-                strcat(tablenamestringTEMP, "_tbl_TEMP.txt");
-                strcpy(datadirectoryTEMP, datadirectory);
-                strcat(datadirectory, tablenamestring);
-                strcat(datadirectoryTEMP, tablenamestringTEMP);
-                fileLoadData = fopen (datadirectory, "rt");
-                fileWriteData = fopen (datadirectoryTEMP, "w");
-                strcpy(value_temp, delete_command_perm(key_temp, fileLoadData, fileWriteData));
-                fclose(fileLoadData);
-                fclose(fileWriteData);
-
-                remove (datadirectory);
-                rename (datadirectoryTEMP, datadirectory);
-
-                sendall(sock, value_temp, strlen(value_temp));
-                sendall(sock, "\n", 1);
+                // The rest of the records were not read
+                return -1;
             }
         }
         else
@@ -1822,6 +3813,7 @@ int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
     {
         strcpy(value_temp, "ERR_UNKNOWN");
         sendall(sock, value_temp, strlen(value_temp));
+        sendall(sock, "\n", 1);
         return -1;
     }
     return 0;
@@ -1830,12 +3822,23 @@ int handle_command(int sock, char cmd[MAX_CMD_LEN], int *auth_var)
 void *handle_client(void *arg)
 {
     int is_auth = 0;
-    pthread_t pth;
 
-    struct arguements *args = arg;;
+    struct arguements *args = arg;
     int clientsock = args->sock_;
     struct sockaddr_in clientaddr = args->clientaddr_;
-    socklen_t clientaddrlen = args->clientaddrlen_;
+    free(args);
+
+    if (params.partition_workers > 0)
+    {
+        connection_partition = partition_client_open();
+        if (connection_partition == NULL)
+        {
+            // Every channel to the owners is taken
+            sendall(clientsock, "ERR_UNKNOWN\n", 12);
+            close(clientsock);
+            return NULL;
+        }
+    }
 
 
     // Get commands from client.edit
@@ -1863,10 +3866,33 @@ void *handle_client(void *arg)
     // Close the connection with the client.
     close(clientsock);
     is_auth = 0;
+    if (connection_partition)
+    {
+        partition_client_close(connection_partition);
+        connection_partition = NULL;
+    }
 
     char log_message_closeconnection[150];
     sprintf(log_message_closeconnection, "Closed connection from %s:%d.\n", inet_ntoa(clientaddr.sin_addr), clientaddr.sin_port);
     logger(fserverOut, log_message_closeconnection, LOGGING_SERVER);
+
+    if (query_cache_enabled())
+    {
+        struct query_cache_stats stats;
+        query_cache_get_stats(&stats);
+        snprintf(log_message_closeconnection, sizeof log_message_closeconnection, "Query cache: %lu hits, %lu misses, %lu evictions, %d entries in %lu bytes.\n",
+                stats.hits, stats.misses, stats.evictions, stats.entries, (unsigned long)stats.bytes);
+        logger(fserverOut, log_message_closeconnection, LOGGING_SERVER);
+    }
+    if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        struct buffer_pool_stats stats;
+        buffer_pool_get_stats(&stats);
+        snprintf(log_message_closeconnection, sizeof log_message_closeconnection, "Buffer pool: %lu hits, %lu misses, %lu evictions in %d frames.\n",
+                stats.hits, stats.misses, stats.evictions, stats.frames);
+        logger(fserverOut, log_message_closeconnection, LOGGING_SERVER);
+    }
+    return NULL;
 }
 
 /**
@@ -1885,8 +3911,7 @@ int main(int argc, char *argv[])
     {
         for (j = 0; j < MAX_RECORDS_PER_TABLE; j++)
         {
-            pthread_mutex_init(&tables[i][j].lock, NULL);
-            pthread_mutex_unlock(&tables[i][j].lock);
+            tables[i][j].seq = 0;
         }
     }
 
@@ -1894,6 +3919,8 @@ int main(int argc, char *argv[])
     for (i = 0; i < MAX_TABLES; i++)
     {
         first_empty[i] = 0;
+        next_slot[i] = 0;
+        pthread_rwlock_init(&table_shape_lock[i], NULL);
     }
 
     time_t rawtime;
@@ -1908,6 +3935,10 @@ int main(int argc, char *argv[])
     {
         fserverOut = fopen (timeStamp, "w+");
     }
+    // Log lines reach a redirected output as they are written, even if
+    // the server is killed later
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
     // Process command line arguments.
     // This program expects exactly one argument: the config file name.
     assert(argc > 0);
@@ -1927,6 +3958,123 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    struct schema *schema = schema_build(&params);
+    if (schema == NULL)
+    {
+        printf("Error building table schema.\n");
+        exit(EXIT_FAILURE);
+    }
+    schema_install(schema);
+
+    if (lock_scheme_init(params.lock_scheme, MAX_TABLES, MAX_RECORDS_PER_TABLE, params.lock_stripes) != 0)
+    {
+        printf("Error setting up record locks.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (params.partition_workers > 0)
+    {
+        // Owners scan their own tables; no other thread may touch them
+        params.query_workers = 1;
+        if (partition_init(params.partition_workers) != 0)
+        {
+            printf("Error starting partition owner threads.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (params.storage_policy == STORAGE_POLICY_ON_DISK)
+    {
+        if (disk_log_init(params.fsync_policy, params.fsync_interval_ms) != 0)
+        {
+            printf("Error starting the table file sync thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (params.storage_policy == STORAGE_POLICY_LSM)
+    {
+        char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
+        if (lsm_init(data_directory_path(datadirectory), params.fsync_policy == DISK_LOG_SYNC_ALWAYS,
+                     params.bloom_fpr) != 0)
+        {
+            printf("Error starting the LSM background threads.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (params.storage_policy == STORAGE_POLICY_BTREE)
+    {
+        if (buffer_pool_init(params.buffer_pool_bytes) != 0)
+        {
+            printf("Error allocating the buffer pool.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The querying thread scans too, so the pool needs one thread fewer.
+    // Startup opens the tables on the pool as well, so it gets a thread
+    // per core even if queries use fewer.
+    int pool_threads = params.query_workers;
+    if (params.storage_policy != STORAGE_POLICY_IN_MEMORY && pool_threads < (int)sysconf(_SC_NPROCESSORS_ONLN))
+    {
+        pool_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (pool_threads > 1 && threadpool_init(&scan_pool, pool_threads - 1) != 0)
+    {
+        printf("Error starting query worker threads.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (params.storage_policy == STORAGE_POLICY_IN_MEMORY)
+    {
+        for (i = 0; i < schema->num_tables; i++)
+        {
+            table_ready[i] = 1;
+        }
+    }
+    else if (params.serve_while_loading)
+    {
+        pthread_t load_pth;
+        if (pthread_create(&load_pth, NULL, load_tables, NULL) != 0)
+        {
+            printf("Error starting the table loading thread.\n");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(load_pth);
+    }
+    else
+    {
+        load_tables(NULL);
+        for (i = 0; i < schema->num_tables; i++)
+        {
+            if (table_ready[i] != 1)
+            {
+                // Nobody is being served yet, so refuse to start
+                char log_message[MAX_TABLE_LEN + 64];
+                snprintf(log_message, sizeof log_message, "Not starting: table %s could not be opened.\n", schema->tables[i].name);
+                logger(fserverOut, log_message, LOGGING_SERVER);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    key_index_init();
+    query_cache_init(params.query_cache_bytes > 0 ? (size_t)params.query_cache_bytes : 0);
+
+    if (params.storage_policy == STORAGE_POLICY_IN_MEMORY && params.snapshot_interval > 0)
+    {
+        char datadirectory[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
+        pthread_t snapshot_pth;
+
+        // Start from a fresh snapshot, so the logs just read are not read again
+        if (redo_log_open(data_directory_path(datadirectory), params.fsync_policy == DISK_LOG_SYNC_ALWAYS, restore_record) != 0 ||
+            take_snapshot() != 0 || pthread_create(&snapshot_pth, NULL, snapshot_thread, NULL) != 0)
+        {
+            printf("Error restoring the tables from %s.\n", datadirectory);
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(snapshot_pth);
+    }
+
     char log_message_serveron[150];
     sprintf(log_message_serveron, "Server on %s:%d\n", params.server_host, params.server_port);
     logger(fserverOut, log_message_serveron, LOGGING_SERVER);
@@ -1991,12 +4139,14 @@ int main(int argc, char *argv[])
             sprintf(log_message_getconnection, "Got a connection from %s:%d.\n", inet_ntoa(clientaddr.sin_addr), clientaddr.sin_port);
             logger(fserverOut, log_message_getconnection, LOGGING_SERVER);
 
-            struct arguements args;
-            args.clientaddr_ = clientaddr;
-            args.sock_ = clientsock;
-            args.clientaddrlen_ = clientaddrlen;
+            // Each thread gets its own copy, the next accept() must not overwrite it
+            struct arguements *args = malloc(sizeof(struct arguements));
+            args->clientaddr_ = clientaddr;
+            args->sock_ = clientsock;
+            args->clientaddrlen_ = clientaddrlen;
 
-            pthread_create(&pth, NULL, handle_client, (void *)&args);
+            pthread_create(&pth, NULL, handle_client, (void *)args);
+            pthread_detach(pth);
         }
 
         // Stop listening for connections.
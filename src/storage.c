@@ -217,6 +217,16 @@ int storage_get(const char *table, const char *key, struct storage_record *recor
             errno = ERR_TABLE_NOT_FOUND;
             return -1;
         }
+        else if (strstr(buf, "ERR_TABLE_LOADING"))
+        {
+            errno = ERR_TABLE_LOADING;
+            return -1;
+        }
+        else if (strstr(buf, "ERR_UNKNOWN"))
+        {
+            errno = ERR_UNKNOWN;
+            return -1;
+        }
         else
         {
             strcpy(strtoktemp, buf);
@@ -335,6 +345,16 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
                 errno = ERR_TABLE_NOT_FOUND;
                 return -1;
             }
+            else if (strstr(buf, "ERR_TABLE_LOADING"))
+            {
+                errno = ERR_TABLE_LOADING;
+                return -1;
+            }
+            else if (strstr(buf, "ERR_UNKNOWN"))
+            {
+                errno = ERR_UNKNOWN;
+                return -1;
+            }
             else if (if_authfail)
             {
                 errno = ERR_NOT_AUTHENTICATED;
@@ -357,7 +377,7 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 
     else
     {
-        snprintf(buf, sizeof buf, "SET;%s;%s;%s;%d\n", table, key, record->value, record->metadata[0]);
+        snprintf(buf, sizeof buf, "SET;%s;%s;%s;%lu\n", table, key, record->value, (unsigned long)record->metadata[0]);
         if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0)
         {
             char *if_setfail = strstr(buf, "ERR_TABLE_NOT_FOUND");
@@ -370,6 +390,16 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
                 errno = ERR_TABLE_NOT_FOUND;
                 return -1;
             }
+            else if (strstr(buf, "ERR_TABLE_LOADING"))
+            {
+                errno = ERR_TABLE_LOADING;
+                return -1;
+            }
+            else if (strstr(buf, "ERR_UNKNOWN"))
+            {
+                errno = ERR_UNKNOWN;
+                return -1;
+            }
             else if (if_authfail)
             {
                 errno = ERR_NOT_AUTHENTICATED;
@@ -395,10 +425,145 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
     return -1;
 }
 
-int storage_query(const char *table, const char *predicates, char *keys[MAX_RECORDS_PER_TABLE], const int max_keys, void *conn)
+/**
+ * @brief Check that a table name or key only has letters and digits.
+ *
+ * @param str The string.
+ * @param size The size of the buffer it has to fit in.
+ * @return Return 1 if it does, and 0 otherwise.
+ */
+static int is_alnum_name(const char *str, int size)
+{
+    int x = 0;
+    while (str[x] != '\0')
+    {
+        if (!((str[x] >= 'a') && (str[x] <= 'z')) && !((str[x] >= '0') && (str[x] <= '9')) &&
+            !((str[x] >= 'A') && (str[x] <= 'Z')))
+        {
+            return 0;
+        }
+        x = x + 1;
+    }
+    return x < size;
+}
+
+int storage_bulk_load(const char *table, char **keys, struct storage_record *records, const int num_records, void *conn)
 {
+    if ((table == NULL) || (keys == NULL) || (records == NULL) || (num_records < 0) || (conn == NULL))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+
+    if (!strcmp(table, "") || !is_alnum_name(table, MAX_TABLE_LEN))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
 
-    if ((table == NULL) || (predicates == NULL) || (keys == NULL))
+    // Connection is really just a socket file descriptor.
+    int sock = (int)conn;
+
+    int recordnumber, len = 0;
+    char buf[MAX_CMD_LEN];
+    char *body = malloc((size_t)num_records * (MAX_KEY_LEN + MAX_VALUE_LEN + 2) + 1);
+
+    if (body == NULL)
+    {
+        errno = ERR_UNKNOWN;
+        return -1;
+    }
+
+    // One "key;value" line per record
+    for (recordnumber = 0; recordnumber < num_records; recordnumber++)
+    {
+        const char *key = keys[recordnumber];
+        const char *value = records[recordnumber].value;
+
+        if (key[0] == '\0' || !is_alnum_name(key, MAX_KEY_LEN) || strchr(value, '\n') ||
+            strnlen(value, MAX_VALUE_LEN) >= MAX_VALUE_LEN)
+        {
+            free(body);
+            errno = ERR_INVALID_PARAM;
+            return -1;
+        }
+        len += sprintf(body + len, "%s;%s\n", key, value);
+    }
+
+    // The header gives the length of the records so the server reads no further
+    snprintf(buf, sizeof buf, "LOAD;%s;%d\n", table, len);
+    if (sendall(sock, buf, strlen(buf)) != 0 || sendall(sock, body, len) != 0 ||
+        recvline(sock, buf, sizeof buf) != 0)
+    {
+        free(body);
+        errno = ERR_CONNECTION_FAIL;
+        return -1;
+    }
+    free(body);
+
+    if (strstr(buf, "ERR_NOT_AUTHENTICATED"))
+    {
+        errno = ERR_NOT_AUTHENTICATED;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_NOT_FOUND"))
+    {
+        errno = ERR_TABLE_NOT_FOUND;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_LOADING"))
+    {
+        errno = ERR_TABLE_LOADING;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_INVALID_PARAM"))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    else if (strcmp(buf, "SUCCESS"))
+    {
+        errno = ERR_UNKNOWN;
+        return -1;
+    }
+    return 0;
+}
+
+int storage_query(const char *table, const char *predicates, char **keys, const int max_keys, void *conn)
+{
+    if (keys == NULL)
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    // The server stops scanning once it has max_keys matches, but never
+    // sends more than MAX_RECORDS_PER_TABLE keys a page, so follow the
+    // cursor until the keys array is full; only then is a second request
+    // needed to count the rest
+    char cursor[MAX_CURSOR_LEN] = "";
+    int found = 0, count;
+
+    do
+    {
+        count = storage_query_page(table, predicates, keys + found, max_keys - found, cursor, conn);
+        if (count == -1)
+        {
+            return -1;
+        }
+        found += count;
+    } while (count > 0 && found < max_keys && strcmp(cursor, ""));
+
+    if (!strcmp(cursor, ""))
+    {
+        return found;
+    }
+    return storage_query_page(table, predicates, NULL, 0, NULL, conn);
+}
+
+int storage_query_page(const char *table, const char *predicates, char **keys, const int max_keys, char *cursor, void *conn)
+{
+
+    if ((table == NULL) || (predicates == NULL))
     {
         errno = ERR_INVALID_PARAM;
         return -1;
@@ -430,96 +595,367 @@ int storage_query(const char *table, const char *predicates, char *keys[MAX_RECO
     // Connection is really just a socket file descriptor.
     int sock = (int)conn;
 
-    // Send some data.
-    char buf[MAX_CMD_LEN], strtoktemp[MAX_CMD_LEN], temp[MAX_CMD_LEN], key[MAX_CMD_LEN];
-    memset(buf, 0, sizeof buf);
+    // A limit of 0 asks the server for the count only
+    int limit = ((keys == NULL) || (max_keys <= 0)) ? 0 : max_keys;
+    int count, keynumber;
+    char buf[MAX_CMD_LEN];
+    char *next_cursor;
 
-    snprintf(buf, sizeof buf, "QUERY;%s;%s\n", table, predicates);
-    if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0)
+    snprintf(buf, sizeof buf, "QUERY;%s;%s;%d;%s\n", table, predicates, limit, cursor ? cursor : "");
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
     {
+        errno = ERR_CONNECTION_FAIL;
+        return -1;
+    }
 
-        char *if_authfail = strstr(buf, "ERR_NOT_AUTHENTICATED");
-        char *if_getfail1 = strstr(buf, "ERR_KEY_NOT_FOUND");
-        char *if_getfail2 = strstr(buf, "ERR_TABLE_NOT_FOUND");
-        char *if_getfail3 = strstr(buf, "ERR_INVALID_PARAM");
-        if (if_authfail)
+    if (strstr(buf, "ERR_NOT_AUTHENTICATED"))
+    {
+        errno = ERR_NOT_AUTHENTICATED;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_KEY_NOT_FOUND"))
+    {
+        errno = ERR_KEY_NOT_FOUND;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_NOT_FOUND"))
+    {
+        errno = ERR_TABLE_NOT_FOUND;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_LOADING"))
+    {
+        errno = ERR_TABLE_LOADING;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_INVALID_PARAM"))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    else if (sscanf(buf, "SUCCESS;%d;", &count) != 1)
+    {
+        errno = ERR_UNKNOWN;
+        return -1;
+    }
+
+    // Header is "SUCCESS;<count>;<cursor>"
+    next_cursor = strchr(strchr(buf, ';') + 1, ';');
+    if (cursor)
+    {
+        snprintf(cursor, MAX_CURSOR_LEN, "%s", next_cursor ? next_cursor + 1 : "");
+    }
+    if (limit == 0)
+    {
+        return count;
+    }
+
+    for (keynumber = 0; keynumber < count; keynumber++)
+    {
+        if (recvline(sock, buf, sizeof buf) != 0)
         {
-            errno = ERR_NOT_AUTHENTICATED;
+            errno = ERR_CONNECTION_FAIL;
             return -1;
         }
-        else if (if_getfail1)
+        snprintf(keys[keynumber], MAX_KEY_LEN, "%.*s", MAX_KEY_LEN - 1, buf);
+    }
+    return count;
+}
+
+/**
+ * @brief Query the table for one page of matching records, values included.
+ */
+int storage_query_records(const char *table, const char *predicates, const char *columns, char **keys,
+                          struct storage_record *records, const int max_records, char *cursor, void *conn)
+{
+
+    if ((table == NULL) || (predicates == NULL) || (records == NULL) || (max_records <= 0))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+
+    if (!strcmp(table, "") || !is_alnum_name(table, MAX_TABLE_LEN))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+
+    // Connection is really just a socket file descriptor.
+    int sock = (int)conn;
+
+    int count, recordnumber;
+    char buf[MAX_CMD_LEN];
+    char *next_cursor, *metadata, *value;
+
+    snprintf(buf, sizeof buf, "SELECT;%s;%s;%s;%d;%s\n", table, predicates, columns ? columns : "", max_records,
+             cursor ? cursor : "");
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+        errno = ERR_CONNECTION_FAIL;
+        return -1;
+    }
+
+    if (strstr(buf, "ERR_NOT_AUTHENTICATED"))
+    {
+        errno = ERR_NOT_AUTHENTICATED;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_NOT_FOUND"))
+    {
+        errno = ERR_TABLE_NOT_FOUND;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_LOADING"))
+    {
+        errno = ERR_TABLE_LOADING;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_INVALID_PARAM"))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    else if (sscanf(buf, "SUCCESS;%d;", &count) != 1 || count > max_records)
+    {
+        errno = ERR_UNKNOWN;
+        return -1;
+    }
+
+    // Header is "SUCCESS;<count>;<cursor>"
+    next_cursor = strchr(strchr(buf, ';') + 1, ';');
+    if (cursor)
+    {
+        snprintf(cursor, MAX_CURSOR_LEN, "%s", next_cursor ? next_cursor + 1 : "");
+    }
+
+    // Then one "key;metadata;value" line per record
+    for (recordnumber = 0; recordnumber < count; recordnumber++)
+    {
+        if (recvline(sock, buf, sizeof buf) != 0)
         {
-            errno = ERR_KEY_NOT_FOUND;
+            errno = ERR_CONNECTION_FAIL;
             return -1;
         }
-        else if (if_getfail2)
+        metadata = strchr(buf, ';');
+        value = metadata ? strchr(metadata + 1, ';') : NULL;
+        if (value == NULL)
         {
-            errno = ERR_TABLE_NOT_FOUND;
+            errno = ERR_UNKNOWN;
             return -1;
         }
-        else if (if_getfail3)
+        *metadata++ = '\0';
+        *value++ = '\0';
+        if (keys)
         {
-            errno = ERR_INVALID_PARAM;
-            return -1;
+            snprintf(keys[recordnumber], MAX_KEY_LEN, "%.*s", MAX_KEY_LEN - 1, buf);
         }
-        int returncount;
+        snprintf(records[recordnumber].value, sizeof records[recordnumber].value, "%s", value);
+        records[recordnumber].metadata[0] = strtoul(metadata, NULL, 10);
+    }
+    return count;
+}
+
+/**
+ * @brief Aggregate the records of a table matching some predicates.
+ */
+int storage_aggregate(const char *table, const char *function, const char *column, const char *predicates,
+                      const char *group_by, struct storage_aggregate *results, const int max_results, void *conn)
+{
+
+    if ((table == NULL) || (function == NULL) || (predicates == NULL) || (results == NULL) || (max_results < 0))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
 
-        strcpy(strtoktemp, buf);
-        get_param(strtoktemp, temp, 0, ";\0");
-        strcpy(strtoktemp, buf);
-        get_param(strtoktemp, key, 1, ";\0");
+    if (!strcmp(table, "") || !is_alnum_name(table, MAX_TABLE_LEN))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
 
-        int count = atoi(temp);
+    // Connection is really just a socket file descriptor.
+    int sock = (int)conn;
 
-        if (count == -1)
+    int count, resultnumber;
+    char buf[MAX_CMD_LEN];
+    char *value;
+
+    snprintf(buf, sizeof buf, "AGGREGATE;%s;%s;%s;%s;%s\n", table, function, column ? column : "", predicates,
+             group_by ? group_by : "");
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+        errno = ERR_CONNECTION_FAIL;
+        return -1;
+    }
+
+    if (strstr(buf, "ERR_NOT_AUTHENTICATED"))
+    {
+        errno = ERR_NOT_AUTHENTICATED;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_NOT_FOUND"))
+    {
+        errno = ERR_TABLE_NOT_FOUND;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_LOADING"))
+    {
+        errno = ERR_TABLE_LOADING;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_INVALID_PARAM"))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    else if (sscanf(buf, "SUCCESS;%d", &count) != 1)
+    {
+        errno = ERR_UNKNOWN;
+        return -1;
+    }
+
+    // One "group;value" line per result; all are read off the connection
+    for (resultnumber = 0; resultnumber < count; resultnumber++)
+    {
+        if (recvline(sock, buf, sizeof buf) != 0)
         {
-            return 0;
+            errno = ERR_CONNECTION_FAIL;
+            return -1;
         }
-
-        if ((count + 1) > max_keys)
+        value = strrchr(buf, ';');
+        if (value == NULL)
         {
-            returncount = max_keys;
+            errno = ERR_UNKNOWN;
+            return -1;
         }
-        else
+        *value++ = '\0';
+        if (resultnumber < max_results)
         {
-            returncount = count + 1;
+            snprintf(results[resultnumber].group, sizeof results[resultnumber].group, "%.*s", MAX_STRTYPE_SIZE, buf);
+            results[resultnumber].value = strtod(value, NULL);
         }
+    }
+    return count;
+}
 
-        int keynumber = 0;
-        sscanf(key, "%s\n", keys[keynumber]);
-        keynumber = keynumber + 1;
+/**
+ * @brief Start an ordered walk over the keys of a table in a range.
+ */
+int storage_scan_begin(struct storage_iterator *it, const char *table, const char *from, const char *to, void *conn)
+{
+    if ((it == NULL) || (table == NULL) || (from == NULL) || (to == NULL) || !strcmp(table, "") ||
+        !is_alnum_name(table, MAX_TABLE_LEN) || !is_alnum_name(from, MAX_KEY_LEN) || !is_alnum_name(to, MAX_KEY_LEN))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    strcpy(it->table, table);
+    strcpy(it->from, from);
+    strcpy(it->to, to);
+    it->next[0] = '\0';
+    it->prefix = 0;
+    it->done = 0;
+    it->conn = conn;
+    return 0;
+}
 
+/**
+ * @brief Start an ordered walk over the keys of a table starting with a prefix.
+ */
+int storage_prefix_begin(struct storage_iterator *it, const char *table, const char *prefix, void *conn)
+{
+    if (storage_scan_begin(it, table, prefix == NULL ? "" : prefix, "", conn) == -1 || prefix == NULL)
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    it->prefix = 1;
+    return 0;
+}
 
-        while (keynumber < (count + 1))
-        {
-            sprintf (buf, "SUCCESS\n");
-            if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0)
-            {
-                strcpy(strtoktemp, buf);
-                get_param(strtoktemp, key, 0, ";\0");
-                strcpy(strtoktemp, buf);
-                get_param(strtoktemp, key, 1, ";\0");
-                if (keynumber < returncount)
-                {
-                    sscanf(key, "%s\n", keys[keynumber]);
-                }
-            }
-            else
-            {
-                errno = ERR_CONNECTION_FAIL;
-                return -1;
-            }
-            keynumber = keynumber + 1;
-        }
+/**
+ * @brief Get the next keys of an ordered walk.
+ */
+int storage_iterator_next(struct storage_iterator *it, char **keys, const int max_keys)
+{
+    if ((it == NULL) || (keys == NULL) || (max_keys <= 0))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    if (it->done)
+    {
+        return 0;
+    }
 
-        sprintf (buf, "SUCCESS\n");
-        if (sendall(sock, buf, strlen(buf)) == 0)
+    // Connection is really just a socket file descriptor.
+    int sock = (int)it->conn;
+
+    int count, keynumber;
+    char buf[MAX_CMD_LEN];
+    char *next;
+
+    if (it->prefix)
+    {
+        snprintf(buf, sizeof buf, "PREFIX;%s;%s;%d;%s\n", it->table, it->from, max_keys, it->next);
+    }
+    else
+    {
+        snprintf(buf, sizeof buf, "SCAN;%s;%s;%s;%d\n", it->table, it->next[0] ? it->next : it->from, it->to,
+                 max_keys);
+    }
+    if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0)
+    {
+        errno = ERR_CONNECTION_FAIL;
+        return -1;
+    }
+
+    if (strstr(buf, "ERR_NOT_AUTHENTICATED"))
+    {
+        errno = ERR_NOT_AUTHENTICATED;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_NOT_FOUND"))
+    {
+        errno = ERR_TABLE_NOT_FOUND;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_TABLE_LOADING"))
+    {
+        errno = ERR_TABLE_LOADING;
+        return -1;
+    }
+    else if (strstr(buf, "ERR_INVALID_PARAM"))
+    {
+        errno = ERR_INVALID_PARAM;
+        return -1;
+    }
+    else if (sscanf(buf, "SUCCESS;%d;", &count) != 1 || count > max_keys)
+    {
+        errno = ERR_UNKNOWN;
+        return -1;
+    }
+
+    // Header is "SUCCESS;<count>;<next key>", no next key once the walk is over
+    next = strchr(strchr(buf, ';') + 1, ';');
+    snprintf(it->next, sizeof it->next, "%s", next ? next + 1 : "");
+    if (it->next[0] == '\0')
+    {
+        it->done = 1;
+    }
+
+    for (keynumber = 0; keynumber < count; keynumber++)
+    {
+        if (recvline(sock, buf, sizeof buf) != 0)
         {
-            return returncount;
+            errno = ERR_CONNECTION_FAIL;
+            return -1;
         }
+        snprintf(keys[keynumber], MAX_KEY_LEN, "%.*s", MAX_KEY_LEN - 1, buf);
     }
-    errno = ERR_CONNECTION_FAIL;
-    return -1;
+    return count;
 }
 
 /**
@@ -34,6 +34,7 @@
 #define MAX_COLNAME_LEN 20	///< Max characters of a column name.
 #define MAX_STRTYPE_SIZE 40	///< Max SIZE of string types.
 #define MAX_VALUE_LEN 800	///< Max characters of a value.
+#define MAX_CURSOR_LEN 32	///< Max characters of a query page cursor.
 
 // Error codes.
 #define ERR_INVALID_PARAM 1		///< A parameter is not valid.
@@ -44,6 +45,7 @@
 #define ERR_KEY_NOT_FOUND 6		///< The key does not exist.
 #define ERR_UNKNOWN 7			///< Any other error.
 #define ERR_TRANSACTION_ABORT 8		///< Transaction abort error.
+#define ERR_TABLE_LOADING 9		///< The table is still being opened by the server; retry later.
 
 
 /**
@@ -59,6 +61,46 @@ struct storage_record {
 	uintptr_t metadata[8];
 };
 
+/**
+ * @brief One result of storage_aggregate().
+ */
+struct storage_aggregate {
+	/// Value of the GROUP BY column, "" without GROUP BY.
+	char group[MAX_STRTYPE_SIZE + 1];
+
+	/// The aggregate over the group.
+	double value;
+};
+
+/**
+ * @brief Position of an ordered walk over the keys of a table.
+ *
+ * Set up by storage_scan_begin() or storage_prefix_begin(), then passed
+ * to storage_iterator_next() until it returns 0.
+ */
+struct storage_iterator {
+	/// Table walked.
+	char table[MAX_TABLE_LEN];
+
+	/// 1 for a PREFIX walk, 0 for a SCAN.
+	int prefix;
+
+	/// Prefix of a PREFIX walk, or first key of a SCAN.
+	char from[MAX_KEY_LEN];
+
+	/// Key a SCAN stops before, "" to run to the last key.
+	char to[MAX_KEY_LEN];
+
+	/// Key the next batch starts from, "" before the first batch.
+	char next[MAX_KEY_LEN];
+
+	/// 1 once every key has been returned.
+	int done;
+
+	/// Connection to the server.
+	void *conn;
+};
+
 /**
  * @brief Establish a connection to the server.
  *
@@ -127,6 +169,29 @@ int storage_get(const char *table, const char *key, struct storage_record
 int storage_set(const char *table, const char *key, struct storage_record 
 		*record, void *conn);
 
+/**
+ * @brief Store many key/value pairs in a table with one request.
+ *
+ * @param table A table in the database.
+ * @param keys An array of num_records keys.
+ * @param records An array of num_records records holding the values.
+ * @param num_records The number of records to store.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ *
+ * Each record is stored as storage_set() would store it, except that the
+ * metadata is ignored and records are never deleted. The records are sent
+ * back to back and answered once, instead of one round trip each. If an
+ * error is returned, some of the records may have been stored, and the
+ * connection is closed by the server.
+ */
+int storage_bulk_load(const char *table, char **keys, struct storage_record *records,
+		const int num_records, void *conn);
+
 /**
  * @brief Query the table for records, and retrieve the matching keys.
  *
@@ -152,6 +217,133 @@ int storage_set(const char *table, const char *key, struct storage_record
 int storage_query(const char *table, const char *predicates, char **keys, 
 		const int max_keys, void *conn);
 
+/**
+ * @brief Query the table for one page of records matching some predicates.
+ *
+ * The server stops scanning as soon as it has max_keys matches, and
+ * returns a cursor for the rest. Pass the cursor back unchanged to get
+ * the next page.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as for storage_query().
+ * @param keys An array of at least max_keys strings where the matching
+ * keys will be copied, or NULL to only count the matching records.
+ * @param max_keys The size of the keys array (0 to only count).
+ * @param cursor A buffer of MAX_CURSOR_LEN characters holding "" for the
+ * first page, or the cursor returned with the previous page. On return it
+ * holds the cursor of the next page, or "" if there are no more pages.
+ * May be NULL to only get the first page.
+ * @param conn A connection to the server.
+ * @return Return the number of keys copied, or when counting the number
+ * of matching records, if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_KEY_NOT_FOUND, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ *
+ * A cursor is only an approximate position: records deleted between two
+ * pages may cause a record to be returned twice.
+ */
+int storage_query_page(const char *table, const char *predicates, char **keys,
+		const int max_keys, char *cursor, void *conn);
+
+/**
+ * @brief Query the table for one page of matching records, values included.
+ *
+ * Saves a storage_get() per key: the values come back in the same
+ * response as the keys.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as for storage_query().
+ * @param columns A comma separated list of the columns to return, in that
+ * order, or "" (or NULL) for the whole value.
+ * @param keys An array of at least max_records strings where the keys of
+ * the matching records will be copied, or NULL.
+ * @param records An array of at least max_records records where the
+ * values and metadata will be copied.
+ * @param max_records The size of the records array.
+ * @param cursor As for storage_query_page().
+ * @param conn A connection to the server.
+ * @return Return the number of records copied if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_query_records(const char *table, const char *predicates, const char *columns, char **keys,
+		struct storage_record *records, const int max_records, char *cursor, void *conn);
+
+/**
+ * @brief Aggregate the records of a table matching some predicates.
+ *
+ * The aggregate is computed by the server; only the results are sent back.
+ *
+ * @param table A table in the database.
+ * @param function One of "COUNT", "SUM", "MIN", "MAX" or "AVG".
+ * @param column The int column to aggregate. Ignored by COUNT.
+ * @param predicates A comma separated list of predicates, as for storage_query().
+ * @param group_by A char column to group the records on, or "" (or NULL)
+ * for a single result over all matching records.
+ * @param results An array of at least max_results results.
+ * @param max_results The size of the results array.
+ * @param conn A connection to the server.
+ * @return Return the number of results (groups) if successful, and -1
+ * otherwise. Only the first max_results are copied.
+ *
+ * Without GROUP BY, COUNT and SUM always return one result, while MIN,
+ * MAX and AVG return none if no record matches.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_aggregate(const char *table, const char *function, const char *column, const char *predicates,
+		const char *group_by, struct storage_aggregate *results, const int max_results, void *conn);
+
+/**
+ * @brief Start an ordered walk over the keys of a table in a range.
+ *
+ * @param it The iterator to set up.
+ * @param table A table in the database.
+ * @param from The first key of the range, or "" to start at the first key.
+ * @param to The key the range stops before, or "" to run to the last key.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to ERR_INVALID_PARAM.
+ */
+int storage_scan_begin(struct storage_iterator *it, const char *table, const char *from, const char *to,
+		void *conn);
+
+/**
+ * @brief Start an ordered walk over the keys of a table starting with a prefix.
+ *
+ * @param it The iterator to set up.
+ * @param table A table in the database.
+ * @param prefix The prefix, "" for every key.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to ERR_INVALID_PARAM.
+ */
+int storage_prefix_begin(struct storage_iterator *it, const char *table, const char *prefix, void *conn);
+
+/**
+ * @brief Get the next keys of an ordered walk.
+ *
+ * @param it An iterator set up by storage_scan_begin() or storage_prefix_begin().
+ * @param keys An array of at least max_keys strings where the next keys
+ * will be copied, in order.
+ * @param max_keys The size of the keys array.
+ * @return Return the number of keys copied, 0 once the walk is over, and
+ * -1 on error.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_iterator_next(struct storage_iterator *it, char **keys, const int max_keys);
+
 /**
  * @brief Close the connection to the server.
  *
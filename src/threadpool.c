@@ -0,0 +1,126 @@
+/**
+ * @file
+ * @brief This file implements the worker thread pool declared in
+ * threadpool.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "threadpool.h"
+
+/**
+ * @brief Main loop of a pool worker: pop a task, run it, mark it done.
+ *
+ * @param arg the pool the worker belongs to
+ * @return never returns
+ */
+static void *threadpool_worker(void *arg)
+{
+    struct threadpool *pool = arg;
+    struct threadpool_task *task;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->head == NULL)
+        {
+            pthread_cond_wait(&pool->task_ready, &pool->lock);
+        }
+        task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL)
+        {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        task->fn(task->arg);
+
+        pthread_mutex_lock(&pool->lock);
+        task->done = 1;
+        pthread_cond_broadcast(&pool->task_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+int threadpool_init(struct threadpool *pool, int num_threads)
+{
+    int i;
+
+    if (num_threads > MAX_POOL_THREADS)
+    {
+        num_threads = MAX_POOL_THREADS;
+    }
+
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->num_threads = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_ready, NULL);
+    pthread_cond_init(&pool->task_done, NULL);
+
+    for (i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, threadpool_worker, pool) != 0)
+        {
+            return -1;
+        }
+        pthread_detach(pool->threads[i]);
+        pool->num_threads++;
+    }
+    return 0;
+}
+
+void threadpool_run(struct threadpool *pool, void (*fn)(void *), void *arg, int num_tasks)
+{
+    struct threadpool_task tasks[MAX_POOL_THREADS];
+    int i, queued;
+
+    if (pool == NULL || pool->num_threads == 0 || num_tasks <= 1)
+    {
+        fn(arg);
+        return;
+    }
+
+    // One copy runs on the calling thread, the rest go to the workers.
+    queued = num_tasks - 1;
+    if (queued > pool->num_threads)
+    {
+        queued = pool->num_threads;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < queued; i++)
+    {
+        tasks[i].fn = fn;
+        tasks[i].arg = arg;
+        tasks[i].done = 0;
+        tasks[i].next = NULL;
+        if (pool->tail)
+        {
+            pool->tail->next = &tasks[i];
+        }
+        else
+        {
+            pool->head = &tasks[i];
+        }
+        pool->tail = &tasks[i];
+    }
+    pthread_cond_broadcast(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    fn(arg);
+
+    // The tasks live on this stack frame, so wait until every one is done.
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < queued; i++)
+    {
+        while (!tasks[i].done)
+        {
+            pthread_cond_wait(&pool->task_done, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief This file declares a small pool of worker threads that the
+ * storage server uses to split work (such as table scans) across cores.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+
+#define MAX_POOL_THREADS 32	///< Max worker threads in a pool.
+
+/**
+ * @brief A unit of work handed to the pool.
+ */
+struct threadpool_task {
+	/// Function the worker runs.
+	void (*fn)(void *);
+
+	/// Argument passed to fn.
+	void *arg;
+
+	/// Set once fn has returned.
+	int done;
+
+	/// Next task in the pool queue.
+	struct threadpool_task *next;
+};
+
+/**
+ * @brief A fixed set of worker threads fed from one queue.
+ */
+struct threadpool {
+	/// The worker threads.
+	pthread_t threads[MAX_POOL_THREADS];
+
+	/// Number of threads actually started.
+	int num_threads;
+
+	/// Queue of pending tasks.
+	struct threadpool_task *head;
+	struct threadpool_task *tail;
+
+	/// Protects the queue and the done flags of queued tasks.
+	pthread_mutex_t lock;
+
+	/// Signalled when a task is queued.
+	pthread_cond_t task_ready;
+
+	/// Signalled when a task finishes.
+	pthread_cond_t task_done;
+};
+
+/**
+ * @brief Start the worker threads of a pool.
+ *
+ * @param pool The pool to initialize.
+ * @param num_threads Number of workers to start (capped at MAX_POOL_THREADS).
+ * @return Return 0 on success, -1 otherwise.
+ */
+int threadpool_init(struct threadpool *pool, int num_threads);
+
+/**
+ * @brief Run fn(arg) on up to num_tasks threads and wait for all of them.
+ *
+ * The calling thread runs one copy itself, so the call makes progress
+ * even when every worker is busy. fn is expected to pull its share of
+ * the work from arg (for example with an atomic counter), so it does not
+ * matter how many copies actually end up running concurrently.
+ *
+ * @param pool The pool to run on, or NULL to run fn once inline.
+ * @param fn Function to run.
+ * @param arg Argument shared by all copies of fn.
+ * @param num_tasks Number of copies of fn to run.
+ */
+void threadpool_run(struct threadpool *pool, void (*fn)(void *), void *arg, int num_tasks);
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * @file
+ * @brief This file implements the tokenizer declared in tokenizer.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include "tokenizer.h"
+
+int tokenize(const char *str, char delim, struct token *tokens, int max_tokens)
+{
+    struct token whole;
+    whole.start = str;
+    whole.len = strlen(str);
+    return token_split(whole, delim, tokens, max_tokens);
+}
+
+int token_split(struct token tok, char delim, struct token *tokens, int max_tokens)
+{
+    const char *p = tok.start, *end = tok.start + tok.len;
+    const char *field = p;
+    int count = 0;
+
+    for (;; p++)
+    {
+        if (p == end || *p == delim)
+        {
+            if (count == max_tokens)
+            {
+                return -1;
+            }
+            tokens[count].start = field;
+            tokens[count].len = p - field;
+            count++;
+            if (p == end)
+            {
+                return count;
+            }
+            field = p + 1;
+        }
+    }
+}
+
+struct token token_trim(struct token tok)
+{
+    while (tok.len > 0 && isspace((unsigned char)tok.start[0]))
+    {
+        tok.start++;
+        tok.len--;
+    }
+    while (tok.len > 0 && isspace((unsigned char)tok.start[tok.len - 1]))
+    {
+        tok.len--;
+    }
+    return tok;
+}
+
+void token_name_value(struct token tok, struct token *name, struct token *value)
+{
+    int i = 0;
+
+    while (i < tok.len && !isspace((unsigned char)tok.start[i]))
+    {
+        i++;
+    }
+    name->start = tok.start;
+    name->len = i;
+    value->start = tok.start + i;
+    value->len = tok.len - i;
+    *value = token_trim(*value);
+}
+
+int token_equals(struct token tok, const char *str)
+{
+    return strncmp(tok.start, str, tok.len) == 0 && str[tok.len] == '\0';
+}
+
+int token_same(struct token a, struct token b)
+{
+    return a.len == b.len && memcmp(a.start, b.start, a.len) == 0;
+}
+
+int token_copy(struct token tok, char *buf, int size)
+{
+    if (tok.len >= size)
+    {
+        return -1;
+    }
+    memcpy(buf, tok.start, tok.len);
+    buf[tok.len] = '\0';
+    return 0;
+}
+
+int token_to_int(struct token tok, int *value)
+{
+    long long result = 0;
+    int i = 0, negative = 0;
+
+    if (tok.len > 0 && (tok.start[0] == '-' || tok.start[0] == '+'))
+    {
+        negative = (tok.start[0] == '-');
+        i++;
+    }
+    if (i == tok.len)
+    {
+        return -1;
+    }
+    for (; i < tok.len; i++)
+    {
+        if (!isdigit((unsigned char)tok.start[i]))
+        {
+            return -1;
+        }
+        result = result * 10 + (tok.start[i] - '0');
+        if (result > (long long)INT_MAX + 1)
+        {
+            return -1;
+        }
+    }
+    if (negative)
+    {
+        result = -result;
+    }
+    if (result > INT_MAX || result < INT_MIN)
+    {
+        return -1;
+    }
+    *value = (int)result;
+    return 0;
+}
+
+int token_to_double(struct token tok, double *value)
+{
+    char buf[64];
+    char *end;
+    int i = 0, digits = 0;
+
+    // Check the form first, so strtod() never sees hex, inf or nan
+    if (tok.len == 0 || tok.len >= (int)sizeof buf)
+    {
+        return -1;
+    }
+    if (tok.start[i] == '-' || tok.start[i] == '+')
+    {
+        i++;
+    }
+    for (; i < tok.len && isdigit((unsigned char)tok.start[i]); i++)
+    {
+        digits++;
+    }
+    if (i < tok.len && tok.start[i] == '.')
+    {
+        for (i++; i < tok.len && isdigit((unsigned char)tok.start[i]); i++)
+        {
+            digits++;
+        }
+    }
+    if (digits == 0)
+    {
+        return -1;
+    }
+    if (i < tok.len && (tok.start[i] == 'e' || tok.start[i] == 'E'))
+    {
+        i++;
+        if (i < tok.len && (tok.start[i] == '-' || tok.start[i] == '+'))
+        {
+            i++;
+        }
+        if (i == tok.len)
+        {
+            return -1;
+        }
+        for (; i < tok.len && isdigit((unsigned char)tok.start[i]); i++)
+        {
+        }
+    }
+    if (i != tok.len)
+    {
+        return -1;
+    }
+
+    memcpy(buf, tok.start, tok.len);
+    buf[tok.len] = '\0';
+    errno = 0;
+    *value = strtod(buf, &end);
+    if (errno == ERANGE && (*value > 1.0 || *value < -1.0))
+    {
+        // Overflow; underflow to a tiny number or zero is fine
+        return -1;
+    }
+    return 0;
+}
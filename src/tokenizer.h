@@ -0,0 +1,116 @@
+/**
+ * @file
+ * @brief This file declares the tokenizer the storage server uses to
+ * pick apart commands, values and predicates.
+ *
+ * Tokens are views into the string being parsed: nothing is copied and
+ * the string is never modified, so a command can be split once where it
+ * was received and its fields handed around by value.
+ */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+/**
+ * @brief A piece of a string. It is not NUL terminated.
+ */
+struct token {
+	/// First character of the token.
+	const char *start;
+
+	/// Number of characters in the token.
+	int len;
+};
+
+/**
+ * @brief Split a string at every delim in one pass.
+ *
+ * Empty fields are kept, so "a;;b" gives three tokens.
+ *
+ * @param str The string to split, up to its NUL terminator.
+ * @param delim The delimiting character.
+ * @param tokens Where to store the fields.
+ * @param max_tokens Size of tokens.
+ * @return The number of fields, or -1 if there are more than max_tokens.
+ */
+int tokenize(const char *str, char delim, struct token *tokens, int max_tokens);
+
+/**
+ * @brief Split a token at every delim in one pass, like tokenize().
+ *
+ * @param tok The token to split.
+ * @param delim The delimiting character.
+ * @param tokens Where to store the fields.
+ * @param max_tokens Size of tokens.
+ * @return The number of fields, or -1 if there are more than max_tokens.
+ */
+int token_split(struct token tok, char delim, struct token *tokens, int max_tokens);
+
+/**
+ * @brief Drop leading and trailing whitespace.
+ *
+ * @param tok The token to trim.
+ * @return The trimmed token.
+ */
+struct token token_trim(struct token tok);
+
+/**
+ * @brief Split a "name value" column into its name and its value.
+ *
+ * The name ends at the first whitespace; the value is the rest, trimmed.
+ *
+ * @param tok A trimmed column.
+ * @param name Where to store the name.
+ * @param value Where to store the value (empty if there is none).
+ */
+void token_name_value(struct token tok, struct token *name, struct token *value);
+
+/**
+ * @brief Compare a token with a NUL terminated string.
+ *
+ * @param tok The token.
+ * @param str The string.
+ * @return Return 1 if they hold the same characters, 0 otherwise.
+ */
+int token_equals(struct token tok, const char *str);
+
+/**
+ * @brief Compare two tokens.
+ *
+ * @param a The first token.
+ * @param b The second token.
+ * @return Return 1 if they hold the same characters, 0 otherwise.
+ */
+int token_same(struct token a, struct token b);
+
+/**
+ * @brief Copy a token into a NUL terminated buffer.
+ *
+ * @param tok The token.
+ * @param buf The buffer.
+ * @param size Size of buf, including the terminator.
+ * @return Return 0 on success, -1 if the token does not fit.
+ */
+int token_copy(struct token tok, char *buf, int size);
+
+/**
+ * @brief Parse a token holding a decimal integer with an optional sign.
+ *
+ * @param tok The token, without surrounding whitespace.
+ * @param value Where to store the integer.
+ * @return Return 0 on success, -1 if the token is not an integer that fits in an int.
+ */
+int token_to_int(struct token tok, int *value);
+
+/**
+ * @brief Parse a token holding a decimal number, as in "-12.5" or "3e8".
+ *
+ * Hex, "inf" and "nan" are not accepted.
+ *
+ * @param tok The token, without surrounding whitespace.
+ * @param value Where to store the number.
+ * @return Return 0 on success, -1 if the token is not a finite decimal number.
+ */
+int token_to_double(struct token tok, double *value);
+
+#endif
@@ -13,6 +13,8 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include "utils.h"
+#include "lockscheme.h"
+#include "disklog.h"
 #include "parser.tab.h"
 
 extern int yyparse();
@@ -26,6 +28,17 @@ int passwordcount=0;
 int tablecount=0;
 int storagepolicycount=0;
 int datadirectorycount=0;
+int queryworkerscount=0;
+int parallelscanthresholdcount=0;
+int lockschemecount=0;
+int lockstripescount=0;
+int partitionworkerscount=0;
+int querycachebytescount=0;
+int fsyncpolicycount=0;
+int snapshotintervalcount=0;
+int bufferpoolbytescount=0;
+int bloomfprcount=0;
+int servewhileloadingcount=0;
 struct config_params paramslex;
 
 
@@ -124,6 +137,115 @@ int read_config(const char *config_file, struct config_params *params)
     	params->storage_policy=0;
     }
 
+    params->query_workers=paramslex.query_workers;
+    params->parallel_scan_threshold=paramslex.parallel_scan_threshold;
+
+    if((queryworkerscount>1)||(parallelscanthresholdcount>1)) {
+    	error_occurred = 1;
+    }
+
+    if(queryworkerscount==0){
+    	// Default to one scan thread per online core.
+    	params->query_workers=(int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(params->query_workers<1){
+    	params->query_workers=1;
+    }
+
+    if(parallelscanthresholdcount==0){
+    	params->parallel_scan_threshold=DEFAULT_PARALLEL_SCAN_THRESHOLD;
+    }
+
+    params->lock_scheme=paramslex.lock_scheme;
+    params->lock_stripes=paramslex.lock_stripes;
+
+    if((lockschemecount>1)||(lockstripescount>1)) {
+    	error_occurred = 1;
+    }
+
+    if(lockschemecount==0){
+    	params->lock_scheme=LOCK_SCHEME_ROW;
+    }
+    if(lockstripescount==0){
+    	params->lock_stripes=DEFAULT_LOCK_STRIPES;
+    }
+    if(params->lock_stripes<1){
+    	error_occurred = 1;
+    }
+
+    params->partition_workers=paramslex.partition_workers;
+    if(partitionworkerscount>1) {
+    	error_occurred = 1;
+    }
+    if(partitionworkerscount==0){
+    	params->partition_workers=0;
+    }
+
+    params->query_cache_bytes=paramslex.query_cache_bytes;
+    if(querycachebytescount>1) {
+    	error_occurred = 1;
+    }
+    if(querycachebytescount==0){
+    	params->query_cache_bytes=0;
+    }
+
+    params->fsync_policy=paramslex.fsync_policy;
+    params->fsync_interval_ms=paramslex.fsync_interval_ms;
+    if(fsyncpolicycount>1) {
+    	error_occurred = 1;
+    }
+    if(fsyncpolicycount==0){
+    	params->fsync_policy=DISK_LOG_SYNC_OS;
+    }
+    if(params->fsync_policy==DISK_LOG_SYNC_PERIODIC&&params->fsync_interval_ms<1){
+    	error_occurred = 1;
+    }
+
+    params->snapshot_interval=paramslex.snapshot_interval;
+    if(snapshotintervalcount>1) {
+    	error_occurred = 1;
+    }
+    if(snapshotintervalcount==0){
+    	params->snapshot_interval=0;
+    }
+    if(params->snapshot_interval>0&&datadirectorycount==0){
+    	// Snapshots and the redo log live in the data directory
+    	error_occurred = 1;
+    }
+
+    params->buffer_pool_bytes=paramslex.buffer_pool_bytes;
+    if(bufferpoolbytescount>1) {
+    	error_occurred = 1;
+    }
+    if(bufferpoolbytescount==0){
+    	params->buffer_pool_bytes=DEFAULT_BUFFER_POOL_BYTES;
+    }
+    if(params->buffer_pool_bytes<1){
+    	error_occurred = 1;
+    }
+
+    params->bloom_fpr=paramslex.bloom_fpr;
+    if(bloomfprcount>1) {
+    	error_occurred = 1;
+    }
+    if(bloomfprcount==0){
+    	params->bloom_fpr=DEFAULT_BLOOM_FPR;
+    }
+    if(!(params->bloom_fpr>0&&params->bloom_fpr<1)){
+    	error_occurred = 1;
+    }
+
+    params->serve_while_loading=paramslex.serve_while_loading;
+    if(servewhileloadingcount>1) {
+    	error_occurred = 1;
+    }
+    if(servewhileloadingcount==0){
+    	params->serve_while_loading=0;
+    }
+    if(params->serve_while_loading!=0&&params->serve_while_loading!=1){
+    	error_occurred = 1;
+    }
+
 
     return error_occurred ? -1 : 0;
 }
@@ -169,14 +291,15 @@ void get_param(char str[MAX_VALUE_LEN], char to_return[MAX_VALUE_LEN], int param
 {
 
     int i = 0;
-    char *pch;
-    pch = strtok (str, delims);
+    char *pch, *saveptr;
+    // strtok_r so that concurrent connection and scan threads don't share state
+    pch = strtok_r (str, delims, &saveptr);
 
     while (pch != NULL)
     {
         if (param_num - i > 0)
         {
-            pch = strtok (NULL, delims);
+            pch = strtok_r (NULL, delims, &saveptr);
             i++;
         }
         else
@@ -27,6 +27,21 @@ static const char CONFIG_COMMENT_CHAR = '#';
  */
 #define MAX_CMD_LEN (1024 * 8)
 
+/**
+ * @brief Default for parallel_scan_threshold when the config file omits it.
+ */
+#define DEFAULT_PARALLEL_SCAN_THRESHOLD 256
+
+/**
+ * @brief Default for buffer_pool_bytes when the config file omits it.
+ */
+#define DEFAULT_BUFFER_POOL_BYTES (8 << 20)
+
+/**
+ * @brief Default for bloom_fpr when the config file omits it.
+ */
+#define DEFAULT_BLOOM_FPR 0.01
+
 /**
  * @brief A macro to log some information.
  *
@@ -47,6 +62,14 @@ static const char CONFIG_COMMENT_CHAR = '#';
 #define DBG(x)  {printf x; fflush(stdout);}
 #endif
 
+/**
+ * @brief Values of storage_policy.
+ */
+#define STORAGE_POLICY_IN_MEMORY 0
+#define STORAGE_POLICY_ON_DISK 1
+#define STORAGE_POLICY_LSM 2
+#define STORAGE_POLICY_BTREE 3
+
 /**
  * @brief A struct to store config parameters.
  */
@@ -74,6 +97,7 @@ struct config_params {
 
 	char column_types[MAX_TABLES][MAX_COLUMNS_PER_TABLE][10];
 
+	/// Where tables are kept, one of the STORAGE_POLICY_* constants.
 	int storage_policy;
 
 	// The directory where tables are stored.
@@ -81,28 +105,83 @@ struct config_params {
 
   int concurrency;
 
+  /// Threads used to scan one table during a QUERY (1 disables parallel scans).
+  int query_workers;
+
+  /// Tables with fewer rows than this are always scanned by a single thread.
+  int parallel_scan_threshold;
+
+  /// How writers lock records, one of the LOCK_SCHEME_* constants.
+  int lock_scheme;
+
+  /// Number of locks in the pool when lock_scheme is per-stripe.
+  int lock_stripes;
+
+  /// Core-pinned owner threads in partitioned mode, 0 when every connection
+  /// thread works on the tables directly.
+  int partition_workers;
+
+  /// Bytes of QUERY results the server may cache, 0 to disable the cache.
+  int query_cache_bytes;
+
+  /// When on-disk writes reach the disk, one of the DISK_LOG_SYNC_* constants.
+  int fsync_policy;
+
+  /// Milliseconds between syncs when fsync_policy is every-N-ms.
+  int fsync_interval_ms;
+
+  /// Seconds between snapshots of the in-memory tables, 0 to keep no
+  /// snapshots or redo log.
+  int snapshot_interval;
+
+  /// Bytes of table file pages cached when storage_policy is btree.
+  int buffer_pool_bytes;
+
+  /// False positive rate of the bloom filters of the LSM and btree
+  /// tables, between 0 and 1.
+  double bloom_fpr;
+
+  /// 1 to accept connections while the table files are being opened at
+  /// startup, answering commands on tables not yet open with
+  /// ERR_TABLE_LOADING. In-memory tables are always restored first.
+  int serve_while_loading;
+
   pthread_mutex_t lock;
 };
 
 /**
  * @brief Encapsulate the value associated with a key in a table.
  *
- * The metadata will be used later.
+ * Only the fields read on every lookup live here, two records to a cache
+ * line; the value itself is kept apart in a struct server_value at the
+ * same table and slot. The metadata will be used later.
  */
 struct server_record {
-	/// This is where the actual value is stored.
-	char value[MAX_VALUE_LEN];
-
 	/// This is where the key is stored.
 	char key[MAX_KEY_LEN];
 
+	/// Bumped by writers before and after every change to the record or its value;
+	/// odd while a write is in progress. Writers serialize through the locks in lockscheme.h.
+	unsigned int seq;
+
 	/// A place to put any extra data.
 	unsigned long metadata;
-
-	/// mutex variable for locking
-	pthread_mutex_t lock;
 };
 
+/**
+ * @brief The value of a record, on cache lines of its own.
+ */
+struct server_value {
+	/// This is where the actual value is stored.
+	char value[MAX_VALUE_LEN];
+
+	/// The int columns of the value, parsed when it was stored (0 for other columns).
+	int ints[MAX_COLUMNS_PER_TABLE];
+
+	/// The float columns of the value, parsed when it was stored (0 for other columns).
+	double floats[MAX_COLUMNS_PER_TABLE];
+} __attribute__((aligned(64)));
+
 
 /**
  * @brief Encapsulate the value associated with a key in a table.
@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 10      // How long to wait for each test to run.
+#define SIMPLETABLES_CONF       "conf-simpletables.conf"    // Server configuration file with an in-memory table.
+#define DISKTABLES_CONF         "conf-disktables.conf"      // Server configuration file with an on-disk table.
+#define NUMKEYS     10          // Number of records the fixtures store.
+#define MAXRESULTS  10          // Size of the results array.
+#define TOLERANCE   0.0001      // How much an aggregate can be off by.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "sales"     // The table to use.
+#define MISSINGTABLE    "missingtable"  // A non-existing table.
+
+// Results array used by test fixture.
+struct storage_aggregate test_results[MAXRESULTS];
+
+/**
+ * @brief Store NUMKEYS records s0 .. s9, with amount 1 .. 10 split over
+ * the regions east (odd amounts) and west (even amounts).
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "s%d", i);
+        snprintf(record.value, sizeof record.value, "region %s,amount %d", i % 2 ? "west" : "east", i + 1);
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an empty in-memory table.
+ */
+void test_setup_memory()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "memoryempty.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an in-memory table and populate it.
+ */
+void test_setup_memory_populate()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "memorydata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an on-disk table and populate it.
+ */
+void test_setup_disk_populate()
+{
+    test_conn = init_start_connect(DISKTABLES_CONF, "diskdata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    populate();
+}
+
+/**
+ * @brief Run an aggregate without GROUP BY and check its single result.
+ */
+void check_single(const char *function, const char *predicates, double expected)
+{
+    int n = storage_aggregate(TABLE, function, "amount", predicates, "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 1, "%s returned %d results instead of 1.", function, n);
+    fail_unless(strcmp(test_results[0].group, "") == 0, "%s without GROUP BY returned a group.", function);
+    fail_unless(fabs(test_results[0].value - expected) < TOLERANCE, "%s returned %f instead of %f.",
+                function, test_results[0].value, expected);
+}
+
+/**
+ * @brief Find the result of a group.
+ * @return The index of the group in test_results, or -1 if it wasn't returned.
+ */
+int find_group(const char *group, int n)
+{
+    int i;
+    for (i = 0; i < n && i < MAXRESULTS; i++)
+    {
+        if (strcmp(test_results[i].group, group) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Aggregate tests without GROUP BY:
+ *  each function over every record
+ *  each function over the records matching a predicate
+ *  empty matches
+ */
+
+START_TEST (test_aggregate_all)
+{
+    check_single("COUNT", "", 10);
+    check_single("SUM", "", 55);
+    check_single("MIN", "", 1);
+    check_single("MAX", "", 10);
+    check_single("AVG", "", 5.5);
+}
+END_TEST
+
+START_TEST (test_aggregate_predicate)
+{
+    check_single("COUNT", "amount > 6", 4);
+    check_single("SUM", "amount > 6", 34);
+    check_single("MIN", "region = west", 2);
+    check_single("MAX", "region = east", 9);
+    check_single("AVG", "region = east, amount > 4", 7);
+}
+END_TEST
+
+START_TEST (test_aggregate_no_match)
+{
+    check_single("COUNT", "amount > 100", 0);
+    check_single("SUM", "amount > 100", 0);
+
+    int n = storage_aggregate(TABLE, "MIN", "amount", "amount > 100", "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 0, "MIN of no records returned %d results.", n);
+    n = storage_aggregate(TABLE, "AVG", "amount", "amount > 100", "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 0, "AVG of no records returned %d results.", n);
+}
+END_TEST
+
+START_TEST (test_aggregate_empty_table)
+{
+    check_single("COUNT", "", 0);
+
+    int n = storage_aggregate(TABLE, "MAX", "amount", "", "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 0, "MAX of an empty table returned %d results.", n);
+}
+END_TEST
+
+/*
+ * Aggregate tests with GROUP BY:
+ *  one result per group
+ *  groups with no matching record are left out
+ *  only max_results results are copied
+ */
+
+START_TEST (test_aggregate_group)
+{
+    int n = storage_aggregate(TABLE, "SUM", "amount", "", "region", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 2, "SUM by region returned %d groups instead of 2.", n);
+
+    int i = find_group("east", n);
+    fail_unless(i >= 0 && fabs(test_results[i].value - 25) < TOLERANCE, "SUM of east is wrong.");
+    i = find_group("west", n);
+    fail_unless(i >= 0 && fabs(test_results[i].value - 30) < TOLERANCE, "SUM of west is wrong.");
+
+    n = storage_aggregate(TABLE, "COUNT", "", "amount > 8", "region", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 2, "COUNT by region returned %d groups instead of 2.", n);
+    i = find_group("east", n);
+    fail_unless(i >= 0 && fabs(test_results[i].value - 1) < TOLERANCE, "COUNT of east is wrong.");
+    i = find_group("west", n);
+    fail_unless(i >= 0 && fabs(test_results[i].value - 1) < TOLERANCE, "COUNT of west is wrong.");
+}
+END_TEST
+
+START_TEST (test_aggregate_group_filtered)
+{
+    int n = storage_aggregate(TABLE, "AVG", "amount", "region = west", "region", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == 1, "AVG of west by region returned %d groups instead of 1.", n);
+    fail_unless(strcmp(test_results[0].group, "west") == 0, "AVG returned the wrong group.");
+    fail_unless(fabs(test_results[0].value - 6) < TOLERANCE, "AVG of west is wrong.");
+}
+END_TEST
+
+START_TEST (test_aggregate_group_max_results)
+{
+    strncpy(test_results[1].group, "untouched", sizeof test_results[1].group);
+    int n = storage_aggregate(TABLE, "MAX", "amount", "", "region", test_results, 1, test_conn);
+    fail_unless(n == 2, "MAX by region didn't return the number of groups.");
+    fail_unless(strcmp(test_results[1].group, "untouched") == 0, "No results past max_results should be modified.");
+}
+END_TEST
+
+/*
+ * Invalid aggregate tests:
+ *  unknown function
+ *  aggregate of a char column
+ *  missing table
+ */
+
+START_TEST (test_aggregate_bad_function)
+{
+    int n = storage_aggregate(TABLE, "MEDIAN", "amount", "", "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == -1, "Unknown aggregate didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Aggregate didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_aggregate_char_column)
+{
+    int n = storage_aggregate(TABLE, "SUM", "region", "", "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == -1, "SUM of a char column didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Aggregate didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_aggregate_missing_table)
+{
+    int n = storage_aggregate(MISSINGTABLE, "COUNT", "", "", "", test_results, MAXRESULTS, test_conn);
+    fail_unless(n == -1, "Aggregate on a missing table didn't fail.");
+    fail_unless(errno == ERR_TABLE_NOT_FOUND, "Aggregate didn't set the errno properly.");
+}
+END_TEST
+
+/**
+ * @brief This runs the aggregate tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("aggregate");
+    TCase *tc;
+
+    // Aggregate tests on an empty table
+    tc = tcase_create("aggregate empty");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory, test_teardown);
+    tcase_add_test(tc, test_aggregate_empty_table);
+    suite_add_tcase(s, tc);
+
+    // Aggregate tests on an in-memory table
+    tc = tcase_create("aggregate memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory_populate, test_teardown);
+    tcase_add_test(tc, test_aggregate_all);
+    tcase_add_test(tc, test_aggregate_predicate);
+    tcase_add_test(tc, test_aggregate_no_match);
+    tcase_add_test(tc, test_aggregate_group);
+    tcase_add_test(tc, test_aggregate_group_filtered);
+    tcase_add_test(tc, test_aggregate_group_max_results);
+    tcase_add_test(tc, test_aggregate_bad_function);
+    tcase_add_test(tc, test_aggregate_char_column);
+    tcase_add_test(tc, test_aggregate_missing_table);
+    suite_add_tcase(s, tc);
+
+    // Aggregate tests on an on-disk table
+    tc = tcase_create("aggregate disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk_populate, test_teardown);
+    tcase_add_test(tc, test_aggregate_all);
+    tcase_add_test(tc, test_aggregate_predicate);
+    tcase_add_test(tc, test_aggregate_group);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define BTREE_CONF      "conf-btree.conf"           // Server configuration file with a btree table.
+#define BTREELOOSE_CONF "conf-btree-loose.conf"     // Server configuration file with a btree table and a loose bloom filter.
+#define LSMLOOSE_CONF   "conf-lsm-loose.conf"       // Server configuration file with an LSM table and a loose bloom filter.
+#define BADFPR_CONF     "conf-badfpr.conf"          // Server configuration file with a rate above 1.
+#define ZEROFPR_CONF    "conf-zerofpr.conf"         // Server configuration file with a rate of 0.
+#define DUPLICATEFPR_CONF   "conf-duplicatefpr.conf"    // Server configuration file with two rates.
+#define NUMKEYS     50          // Number of records the fixtures store.
+#define NUMMISSING  150         // Number of missing keys looked up.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "inttbl"    // The table to use.
+
+/**
+ * @brief Store NUMKEYS records even0 .. even98, on even numbers only.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "even%d", 2 * i);
+        snprintf(record.value, sizeof record.value, "col %d", 2 * i);
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+}
+
+/**
+ * @brief Check that every stored key is found and no missing key is.
+ *
+ * @param deleted Every deleted-th key was deleted, or 0 if none were.
+ */
+void check_lookups(int deleted)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "even%d", 2 * i);
+        if (deleted && i % deleted == 0)
+        {
+            fail_unless(storage_get(TABLE, key, &record, test_conn) == -1, "Deleted %s was found.", key);
+            fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+            continue;
+        }
+        fail_unless(storage_get(TABLE, key, &record, test_conn) == 0, "Stored %s wasn't found.", key);
+    }
+
+    // Keys next to stored ones, and keys far from them.
+    for (i = 0; i < NUMMISSING; i++)
+    {
+        if (i < NUMKEYS)
+            snprintf(key, sizeof key, "even%d", 2 * i + 1);
+        else
+            snprintf(key, sizeof key, "odd%d", i);
+        fail_unless(storage_get(TABLE, key, &record, test_conn) == -1, "Missing %s was found.", key);
+        fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+    }
+}
+
+/**
+ * @brief Start the server with a configuration file and populate it.
+ */
+void setup_populate(char *config_file, char *serverout_file)
+{
+    test_conf = config_file;
+    test_conn = init_start_connect(test_conf, serverout_file, &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with a btree table and populate it.
+ */
+void test_setup_btree_populate()
+{
+    setup_populate(BTREE_CONF, "btree.serverout");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with a loose btree bloom filter and populate it.
+ */
+void test_setup_btree_loose_populate()
+{
+    setup_populate(BTREELOOSE_CONF, "btreeloose.serverout");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with a loose LSM bloom filter and populate it.
+ */
+void test_setup_lsm_loose_populate()
+{
+    setup_populate(LSMLOOSE_CONF, "lsmloose.serverout");
+}
+
+/*
+ * Bloom filter tests:
+ *  no stored key is filtered out, and no missing key is found,
+ *  however many false positives the filter lets through
+ *  after deletes, and after the filters are rebuilt on restart
+ */
+
+START_TEST (test_bloom_lookup)
+{
+    check_lookups(0);
+}
+END_TEST
+
+START_TEST (test_bloom_delete)
+{
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i += 3)
+    {
+        snprintf(key, sizeof key, "even%d", 2 * i);
+        fail_unless(storage_set(TABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+    check_lookups(3);
+}
+END_TEST
+
+START_TEST (test_bloom_restart)
+{
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i += 3)
+    {
+        snprintf(key, sizeof key, "even%d", 2 * i);
+        fail_unless(storage_set(TABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+    restart();
+    check_lookups(3);
+}
+END_TEST
+
+/*
+ * Bloom filter configuration tests:
+ *  the rate must be above 0 and below 1
+ *  the rate may only be given once
+ */
+
+START_TEST (test_config_badfpr)
+{
+    int serverpid = start_server(BADFPR_CONF, NULL, "test_config_badfpr.serverout");
+    fail_unless(serverpid < 0, "Server should not run with a false positive rate above 1.");
+}
+END_TEST
+
+START_TEST (test_config_zerofpr)
+{
+    int serverpid = start_server(ZEROFPR_CONF, NULL, "test_config_zerofpr.serverout");
+    fail_unless(serverpid < 0, "Server should not run with a false positive rate of 0.");
+}
+END_TEST
+
+START_TEST (test_config_duplicatefpr)
+{
+    int serverpid = start_server(DUPLICATEFPR_CONF, NULL, "test_config_duplicatefpr.serverout");
+    fail_unless(serverpid < 0, "Server should not run with two false positive rates in the config file.");
+}
+END_TEST
+
+/**
+ * @brief This runs the bloom filter tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("bloom");
+    TCase *tc;
+
+    // Bloom filter tests on a btree table
+    tc = tcase_create("bloom btree");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_btree_populate, test_teardown);
+    tcase_add_test(tc, test_bloom_lookup);
+    tcase_add_test(tc, test_bloom_restart);
+    suite_add_tcase(s, tc);
+
+    // Bloom filter tests on a btree table with many false positives
+    tc = tcase_create("bloom btree loose");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_btree_loose_populate, test_teardown);
+    tcase_add_test(tc, test_bloom_lookup);
+    tcase_add_test(tc, test_bloom_delete);
+    tcase_add_test(tc, test_bloom_restart);
+    suite_add_tcase(s, tc);
+
+    // Bloom filter tests on an LSM table with many false positives
+    tc = tcase_create("bloom lsm loose");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_lsm_loose_populate, test_teardown);
+    tcase_add_test(tc, test_bloom_lookup);
+    tcase_add_test(tc, test_bloom_delete);
+    tcase_add_test(tc, test_bloom_restart);
+    suite_add_tcase(s, tc);
+
+    // Bloom filter configuration tests
+    tc = tcase_create("bloom config");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_config_badfpr);
+    tcase_add_test(tc, test_config_zerofpr);
+    tcase_add_test(tc, test_config_duplicatefpr);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
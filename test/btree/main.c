@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define BTREE_CONF      "conf-btree.conf"           // Server configuration file with a btree table.
+#define SMALLPOOL_CONF  "conf-btree-smallpool.conf" // Server configuration file with a btree table and a small buffer pool.
+#define NAMES_CONF      "conf-btree-names.conf"     // Server configuration file with a table and a column named btree.
+#define NUMKEYS     120         // Number of records the fixtures store, enough to split pages.
+#define PAGESIZE    25          // Number of keys asked for per call.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "words"     // The table to use.
+
+/**
+ * @brief Build the value of record i, padded so that few fit in a page.
+ */
+void make_value(char *value, int i, const char *tag)
+{
+    snprintf(value, MAX_VALUE_LEN, "num %d,word %s%03d-%.30s", i, tag, i, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+}
+
+/**
+ * @brief Store NUMKEYS records k000 .. k119, out of key order.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i, j;
+
+    memset(&record, 0, sizeof record);
+    for (j = 0; j < NUMKEYS; j++)
+    {
+        // 37 and NUMKEYS share no factor, so every key is stored once.
+        i = (j * 37) % NUMKEYS;
+        snprintf(key, sizeof key, "k%03d", i);
+        make_value(record.value, i, "w");
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+}
+
+/**
+ * @brief Check every record can be read and walked in order.
+ *
+ * @param tag The tag of the values stored.
+ * @param deleted Delete every deleted-th key, or 0 if none are deleted.
+ */
+void check_tree(const char *tag, int deleted)
+{
+    struct storage_record record;
+    struct storage_iterator it;
+    char key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    int i, n, next = 0, found = 0;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "k%03d", i);
+        if (deleted && i % deleted == 0)
+        {
+            fail_unless(storage_get(TABLE, key, &record, test_conn) == -1, "Deleted %s came back.", key);
+            continue;
+        }
+        fail_unless(storage_get(TABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+        make_value(value, i, tag);
+        fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+        found++;
+    }
+
+    fail_unless(storage_scan_begin(&it, TABLE, "", "", test_conn) == 0, "Couldn't start the scan.");
+    while ((n = storage_iterator_next(&it, test_keys, PAGESIZE)) > 0)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (deleted && next % deleted == 0)
+                next++;
+            snprintf(key, sizeof key, "k%03d", next);
+            fail_unless(strcmp(test_keys[i], key) == 0, "Scan returned %s instead of %s.", test_keys[i], key);
+            next++;
+        }
+    }
+    fail_unless(n == 0, "Scan failed.");
+    fail_unless(next >= NUMKEYS - 1, "Scan stopped before k%03d.", next);
+
+    n = storage_query(TABLE, "num > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == found, "Query found %d records instead of %d.", n, found);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with a btree table and populate it.
+ */
+void test_setup_btree_populate()
+{
+    test_conf = BTREE_CONF;
+    test_conn = init_start_connect(test_conf, "btree.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with a small buffer pool and populate it.
+ */
+void test_setup_smallpool_populate()
+{
+    test_conf = SMALLPOOL_CONF;
+    test_conn = init_start_connect(test_conf, "smallpool.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/*
+ * Btree tests:
+ *  records inserted out of order split pages and are read back in order
+ *  updates and deletes
+ *  the tree survives the server being killed
+ */
+
+START_TEST (test_btree_insert)
+{
+    check_tree("w", 0);
+}
+END_TEST
+
+START_TEST (test_btree_update)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i += 3)
+    {
+        snprintf(key, sizeof key, "k%03d", i);
+        make_value(record.value, i, "u");
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't update %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 3)
+    {
+        snprintf(key, sizeof key, "k%03d", i);
+        make_value(record.value, i, "w");
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't update %s back.", key);
+    }
+    check_tree("w", 0);
+}
+END_TEST
+
+START_TEST (test_btree_delete)
+{
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i += 4)
+    {
+        snprintf(key, sizeof key, "k%03d", i);
+        fail_unless(storage_set(TABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+    check_tree("w", 4);
+}
+END_TEST
+
+START_TEST (test_btree_restart)
+{
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i += 4)
+    {
+        snprintf(key, sizeof key, "k%03d", i);
+        fail_unless(storage_set(TABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+    restart();
+    check_tree("w", 4);
+}
+END_TEST
+
+START_TEST (test_btree_range)
+{
+    struct storage_iterator it;
+
+    fail_unless(storage_scan_begin(&it, TABLE, "k050", "k075", test_conn) == 0, "Couldn't start the scan.");
+    int n = storage_iterator_next(&it, test_keys, MAX_RECORDS_PER_TABLE);
+    fail_unless(n == 25, "Scan returned %d keys instead of 25.", n);
+    fail_unless(strcmp(test_keys[0], "k050") == 0 && strcmp(test_keys[24], "k074") == 0, "Scan returned the wrong range.");
+
+    fail_unless(storage_prefix_begin(&it, TABLE, "k11", test_conn) == 0, "Couldn't start the prefix walk.");
+    n = storage_iterator_next(&it, test_keys, MAX_RECORDS_PER_TABLE);
+    fail_unless(n == 10, "Prefix walk returned %d keys instead of 10.", n);
+}
+END_TEST
+
+/*
+ * Config tests:
+ *  btree is a keyword only as the value of storage_policy
+ */
+
+START_TEST (test_btree_names)
+{
+    struct storage_record record;
+
+    test_conn = init_start_connect(NAMES_CONF, "test_btree_names.serverout", &test_pid);
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "btree 5,lsm 6", sizeof record.value);
+    fail_unless(storage_set("btree", "key", &record, test_conn) == 0, "Couldn't set in the table named btree.");
+    fail_unless(storage_get("btree", "key", &record, test_conn) == 0, "Couldn't get from the table named btree.");
+    fail_unless(strcmp(record.value, "btree 5,lsm 6") == 0, "Get returned %s instead of btree 5,lsm 6.", record.value);
+
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+END_TEST
+
+/**
+ * @brief This runs the btree tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("btree");
+    TCase *tc;
+
+    // Btree tests
+    tc = tcase_create("btree");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_btree_populate, test_teardown);
+    tcase_add_test(tc, test_btree_insert);
+    tcase_add_test(tc, test_btree_update);
+    tcase_add_test(tc, test_btree_delete);
+    tcase_add_test(tc, test_btree_restart);
+    tcase_add_test(tc, test_btree_range);
+    suite_add_tcase(s, tc);
+
+    // Btree tests with a buffer pool smaller than the tree
+    tc = tcase_create("btree small pool");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_smallpool_populate, test_teardown);
+    tcase_add_test(tc, test_btree_insert);
+    tcase_add_test(tc, test_btree_restart);
+    suite_add_tcase(s, tc);
+
+    // Config tests
+    tc = tcase_create("btree config");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_btree_names);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
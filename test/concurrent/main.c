@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define MEMORY_CONF     "conf-memory.conf"  // Server configuration file with an in-memory table.
+#define NUMWRITERS  8           // Number of clients setting keys at once.
+#define NUMKEYS     40          // Number of keys every client sets.
+#define NUMFILLER   900         // Number of records loaded first, so looking for a key takes a while.
+#define NUMPAIRS    4           // Number of records the seqlock tests keep rewriting.
+#define NUMROUNDS   25          // Number of times each of those is rewritten by a writer.
+#define NUMREADERS  4           // Number of clients reading them meanwhile.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "inttbl"    // The table to use.
+#define PAIRTABLE   "pairtbl"   // A table with columns a and b, kept equal by every writer.
+
+/// Keys and records loaded before the clients start.
+char *filler_keys[NUMFILLER];
+struct storage_record filler_records[NUMFILLER];
+
+/**
+ * @brief Text fixture setup.  Start the server with an in-memory table and
+ * load NUMFILLER records into it.
+ */
+void test_setup_memory_filled()
+{
+    int i;
+
+    test_conn = init_start_connect(MEMORY_CONF, "memory.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    memset(filler_records, 0, sizeof filler_records);
+    for (i = 0; i < NUMFILLER; i++)
+    {
+        if (filler_keys[i] == NULL)
+            filler_keys[i] = (char *)malloc(MAX_KEY_LEN);
+        snprintf(filler_keys[i], MAX_KEY_LEN, "filler%d", i);
+        snprintf(filler_records[i].value, sizeof filler_records[i].value, "col -1");
+    }
+    fail_unless(storage_bulk_load(TABLE, filler_keys, filler_records, NUMFILLER, test_conn) == 0, "Load failed.");
+}
+
+/**
+ * @brief Set the keys "key0" to "key<NUMKEYS - 1>" over a connection of its own.
+ *
+ * @param writer Number of the client, stored in col.
+ * @param start Read end of a pipe that reaches end of file when all clients may start.
+ * @return The number of sets that failed, -1 if the client couldn't connect.
+ */
+int set_keys(int writer, int start)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    char c;
+    int i, failed = 0;
+
+    void *conn = storage_connect(SERVERHOST, server_port);
+    if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+        return -1;
+    read(start, &c, 1);
+    memset(&record, 0, sizeof record);
+    snprintf(record.value, sizeof record.value, "col %d", writer);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%d", i);
+        if (storage_set(TABLE, key, &record, conn) != 0)
+            failed++;
+    }
+    storage_disconnect(conn);
+    return failed;
+}
+
+/**
+ * @brief Rewrite the records "pair0" to "pair<NUMPAIRS - 1>" over a
+ * connection of its own, always with a equal to b.
+ *
+ * Even writers write short numbers and odd ones long numbers, so a
+ * reader that mixes two writes sees a differ from b.
+ *
+ * @param writer Number of the client.
+ * @param start Read end of a pipe that reaches end of file when all clients may start.
+ * @return The number of sets that failed, -1 if the client couldn't connect.
+ */
+int set_pairs(int writer, int start)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    char c;
+    int i, j, n, failed = 0;
+
+    void *conn = storage_connect(SERVERHOST, server_port);
+    if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+        return -1;
+    read(start, &c, 1);
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMROUNDS; i++)
+    {
+        for (j = 0; j < NUMPAIRS; j++)
+        {
+            n = writer % 2 ? 1000000000 + i * NUMWRITERS + writer : i;
+            snprintf(key, sizeof key, "pair%d", j);
+            snprintf(record.value, sizeof record.value, "a %d,b %d", n, n);
+            if (storage_set(PAIRTABLE, key, &record, conn) != 0)
+                failed++;
+        }
+    }
+    storage_disconnect(conn);
+    return failed;
+}
+
+/**
+ * @brief Read the records set_pairs() writes over a connection of its own
+ * and check that a always equals b.
+ *
+ * @param reader Number of the client.
+ * @param start Read end of a pipe that reaches end of file when all clients may start.
+ * @return The number of reads that failed or saw a differ from b, -1 if
+ * the client couldn't connect.
+ */
+int get_pairs(int reader, int start)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    char *keys[MAX_RECORDS_PER_TABLE];
+    char c;
+    int i, j, a, b, n, failed = 0;
+
+    void *conn = storage_connect(SERVERHOST, server_port);
+    if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+        return -1;
+    for (i = 0; i < MAX_RECORDS_PER_TABLE; i++)
+        keys[i] = (char *)malloc(MAX_KEY_LEN);
+    read(start, &c, 1);
+    for (i = 0; i < NUMROUNDS; i++)
+    {
+        for (j = 0; j < NUMPAIRS; j++)
+        {
+            snprintf(key, sizeof key, "pair%d", (j + reader) % NUMPAIRS);
+            if (storage_get(PAIRTABLE, key, &record, conn) != 0 ||
+                sscanf(record.value, "a %d,b %d", &a, &b) != 2 || a != b)
+                failed++;
+        }
+
+        // Every record is there, and none has a short a with a long b or
+        // the other way round
+        n = storage_query(PAIRTABLE, "a > -1", keys, MAX_RECORDS_PER_TABLE, conn);
+        if (n != NUMPAIRS)
+            failed++;
+        n = storage_query(PAIRTABLE, "a > 999999999, b < 1000000000", keys, MAX_RECORDS_PER_TABLE, conn);
+        if (n != 0)
+            failed++;
+        n = storage_query(PAIRTABLE, "a < 1000000000, b > 999999999", keys, MAX_RECORDS_PER_TABLE, conn);
+        if (n != 0)
+            failed++;
+    }
+    storage_disconnect(conn);
+    return failed;
+}
+
+/**
+ * @brief Run clients at once and wait for them.
+ *
+ * @param client What each client runs with its number, returning 0 if all went well.
+ * @param num_clients Number of clients.
+ * @param pids Where to store the process ids of the clients, to pass to wait_clients().
+ * @param start Pipe that reaches end of file when all clients may start.
+ */
+void run_clients(int (*client)(int, int), int num_clients, pid_t pids[], int start[2])
+{
+    int i;
+
+    for (i = 0; i < num_clients; i++)
+    {
+        pids[i] = fork();
+        fail_unless(pids[i] != -1, "Couldn't fork a client.");
+        if (pids[i] == 0)
+        {
+            close(start[1]);
+            _exit(client(i, start[0]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * @brief Wait for clients started by run_clients() and check they all went well.
+ *
+ * @param what What the clients do, for the failure message.
+ * @param num_clients Number of clients.
+ * @param pids Process ids of the clients.
+ */
+void wait_clients(const char *what, int num_clients, pid_t pids[])
+{
+    int i, status;
+
+    for (i = 0; i < num_clients; i++)
+    {
+        fail_unless(waitpid(pids[i], &status, 0) == pids[i], "Couldn't wait for client %d (%s).", i, what);
+        fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "Client %d (%s) failed.", i, what);
+    }
+}
+
+/**
+ * @brief Run NUMWRITERS clients of set_keys() at once and wait for them.
+ */
+void run_writers()
+{
+    pid_t pids[NUMWRITERS];
+    int start[2];
+
+    fail_unless(pipe(start) == 0, "Couldn't create a pipe.");
+    run_clients(set_keys, NUMWRITERS, pids, start);
+
+    // Let the clients connect, then start them together
+    sleep(1);
+    close(start[0]);
+    close(start[1]);
+    wait_clients("writer", NUMWRITERS, pids);
+}
+
+/*
+ * Concurrent set tests:
+ *  clients setting the same new keys at once store each key once
+ *  and a single delete removes it
+ */
+
+START_TEST (test_concurrent_set)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i, n;
+
+    run_writers();
+    n = storage_query(TABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS, "Query found %d records instead of %d.", n, NUMKEYS);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%d", i);
+        fail_unless(storage_get(TABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+    }
+}
+END_TEST
+
+START_TEST (test_concurrent_set_delete)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i, n;
+
+    run_writers();
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%d", i);
+        fail_unless(storage_set(TABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+        fail_unless(storage_get(TABLE, key, &record, test_conn) == -1 && errno == ERR_KEY_NOT_FOUND,
+                    "%s is still there after a delete.", key);
+    }
+    n = storage_query(TABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == 0, "Query found %d records after deleting them all.", n);
+}
+END_TEST
+
+/*
+ * Seqlock tests:
+ *  readers never see half of one write and half of another
+ */
+
+START_TEST (test_concurrent_get_set)
+{
+    pid_t writers[NUMWRITERS], readers[NUMREADERS];
+    int start[2];
+
+    // A start pipe of -1 lets the client go at once
+    fail_unless(set_pairs(0, -1) == 0, "Couldn't set the first pairs.");
+    fail_unless(pipe(start) == 0, "Couldn't create a pipe.");
+    run_clients(set_pairs, NUMWRITERS, writers, start);
+    run_clients(get_pairs, NUMREADERS, readers, start);
+
+    // Let the clients connect, then start them together
+    sleep(1);
+    close(start[0]);
+    close(start[1]);
+    wait_clients("reader", NUMREADERS, readers);
+    wait_clients("writer", NUMWRITERS, writers);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("concurrent");
+    TCase *tc;
+
+    // Concurrent set tests on in-memory tables
+    tc = tcase_create("concurrent memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory_filled, test_teardown);
+    tcase_add_test(tc, test_concurrent_set);
+    tcase_add_test(tc, test_concurrent_set_delete);
+    tcase_add_test(tc, test_concurrent_get_set);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define ALWAYS_CONF     "conf-always.conf"      // Server configuration file syncing every write.
+#define OS_CONF         "conf-os.conf"          // Server configuration file leaving syncs to the OS.
+#define EVERY10MS_CONF  "conf-every10ms.conf"   // Server configuration file syncing every 10 ms.
+#define NUMKEYS     20          // Number of records the fixtures store.
+#define NUMWRITERS  4           // Number of concurrent writers.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table.
+#define INTTABLEFILE DATADIR "/" INTTABLE "_tbl.txt"  // The file of the int table.
+
+/**
+ * @brief Store NUMKEYS records key00 .. key19, then update the even ones
+ * and delete every fifth one.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 2)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", 1000 + i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't update %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 5)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        fail_unless(storage_set(INTTABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+}
+
+/**
+ * @brief Check the records populate() leaves behind.
+ */
+void check_populated()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        if (i % 5 == 0)
+        {
+            fail_unless(storage_get(INTTABLE, key, &record, test_conn) == -1, "Deleted %s came back.", key);
+            fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+            continue;
+        }
+        fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+        snprintf(value, sizeof value, "col %d", i % 2 ? i : 1000 + i);
+        fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+    }
+
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS - NUMKEYS / 5, "Query found %d records instead of %d.", n, NUMKEYS - NUMKEYS / 5);
+    n = storage_query(INTTABLE, "col > 999", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS / 2 - NUMKEYS / 10, "Query found %d updated records.", n);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server syncing every write.
+ */
+void test_setup_always()
+{
+    test_conf = ALWAYS_CONF;
+    test_conn = init_start_connect(test_conf, "always.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server leaving syncs to the OS.
+ */
+void test_setup_os()
+{
+    test_conf = OS_CONF;
+    test_conn = init_start_connect(test_conf, "os.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server syncing every 10 ms.
+ */
+void test_setup_every10ms()
+{
+    test_conf = EVERY10MS_CONF;
+    test_conn = init_start_connect(test_conf, "every10ms.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/*
+ * Disk log tests:
+ *  sets, updates and deletes are read back
+ *  and survive the server being killed
+ */
+
+START_TEST (test_log_read)
+{
+    populate();
+    check_populated();
+}
+END_TEST
+
+START_TEST (test_log_restart)
+{
+    populate();
+    restart();
+    check_populated();
+
+    // The log keeps working after a restart.
+    struct storage_record record;
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 7", sizeof record.value);
+    fail_unless(storage_set(STRTABLE, "after", &record, test_conn) == 0, "Couldn't set after a restart.");
+    restart();
+    fail_unless(storage_get(STRTABLE, "after", &record, test_conn) == 0, "Couldn't get after a restart.");
+    fail_unless(strcmp(record.value, "col 7") == 0, "Get after a restart returned %s.", record.value);
+    check_populated();
+}
+END_TEST
+
+/*
+ * Group commit tests:
+ *  concurrent writers on their own connections all get their writes in
+ */
+
+START_TEST (test_log_concurrent)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int w, i, status;
+    pid_t pids[NUMWRITERS];
+
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        pids[w] = fork();
+        fail_unless(pids[w] >= 0, "Couldn't fork a writer.");
+        if (pids[w] == 0)
+        {
+            // The writer.
+            void *conn = storage_connect(SERVERHOST, server_port);
+            if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+                exit(EXIT_FAILURE);
+            memset(&record, 0, sizeof record);
+            for (i = 0; i < NUMKEYS; i++)
+            {
+                snprintf(key, sizeof key, "w%dk%02d", w, i);
+                snprintf(record.value, sizeof record.value, "col %d", w * 100 + i);
+                if (storage_set(INTTABLE, key, &record, conn) != 0)
+                    exit(EXIT_FAILURE);
+            }
+            storage_disconnect(conn);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        fail_unless(waitpid(pids[w], &status, 0) == pids[w], "Couldn't wait for a writer.");
+        fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "Writer %d failed.", w);
+    }
+
+    restart();
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        for (i = 0; i < NUMKEYS; i += 7)
+        {
+            char value[MAX_VALUE_LEN];
+            snprintf(key, sizeof key, "w%dk%02d", w, i);
+            snprintf(value, sizeof value, "col %d", w * 100 + i);
+            fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+            fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+        }
+    }
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMWRITERS * NUMKEYS, "Query found %d records instead of %d.", n, NUMWRITERS * NUMKEYS);
+}
+END_TEST
+
+/*
+ * Unterminated file tests:
+ *  a last record without its newline is kept, and one cut short is dropped
+ */
+
+/**
+ * @brief Write a table file of the int table before the server starts.
+ *
+ * @param contents The contents of the file.
+ */
+void write_table_file(const char *contents)
+{
+    system("rm -rf " DATADIR);
+    mkdir(DATADIR, 0777);
+    FILE *file = fopen(INTTABLEFILE, "w");
+    fail_unless(file != NULL, "Couldn't create the table file.");
+    fputs(contents, file);
+    fclose(file);
+}
+
+/**
+ * @brief Read back the table file of the int table.
+ *
+ * @param contents Where to store the contents of the file.
+ * @param size Size of contents.
+ */
+void read_table_file(char *contents, int size)
+{
+    FILE *file = fopen(INTTABLEFILE, "r");
+    fail_unless(file != NULL, "Couldn't open the table file.");
+    contents[fread(contents, 1, size - 1, file)] = '\0';
+    fclose(file);
+}
+
+START_TEST (test_log_unterminated)
+{
+    struct storage_record record;
+    char contents[MAX_VALUE_LEN];
+
+    write_table_file("key01:col 1\nkey02:col 2");
+    test_conf = ALWAYS_CONF;
+    test_conn = start_connect(test_conf, "test_log_unterminated.serverout", &test_pid);
+
+    fail_unless(storage_get(INTTABLE, "key01", &record, test_conn) == 0, "Couldn't get key01.");
+    fail_unless(strcmp(record.value, "col 1") == 0, "key01 is %s instead of col 1.", record.value);
+    fail_unless(storage_get(INTTABLE, "key02", &record, test_conn) == 0, "The last record was dropped.");
+    fail_unless(strcmp(record.value, "col 2") == 0, "key02 is %s instead of col 2.", record.value);
+    read_table_file(contents, sizeof contents);
+    fail_unless(strcmp(contents, "key01:col 1\nkey02:col 2\n") == 0, "The last record wasn't given its newline.");
+
+    // A record written after it is a line of its own.
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 3", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "key03", &record, test_conn) == 0, "Couldn't set key03.");
+    restart();
+    fail_unless(storage_get(INTTABLE, "key02", &record, test_conn) == 0, "Couldn't get key02 after a restart.");
+    fail_unless(strcmp(record.value, "col 2") == 0, "key02 is %s instead of col 2.", record.value);
+    fail_unless(storage_get(INTTABLE, "key03", &record, test_conn) == 0, "Couldn't get key03 after a restart.");
+    fail_unless(strcmp(record.value, "col 3") == 0, "key03 is %s instead of col 3.", record.value);
+
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+END_TEST
+
+START_TEST (test_log_cut_short)
+{
+    struct storage_record record;
+    char contents[MAX_VALUE_LEN];
+
+    // A set line cut before its colon.
+    write_table_file("key01:col 1\nkey0");
+    test_conf = ALWAYS_CONF;
+    test_conn = start_connect(test_conf, "test_log_cut_short.serverout", &test_pid);
+    fail_unless(storage_get(INTTABLE, "key01", &record, test_conn) == 0, "Couldn't get key01.");
+    fail_unless(storage_get(INTTABLE, "key0", &record, test_conn) == -1, "A cut line was taken for a record.");
+    read_table_file(contents, sizeof contents);
+    fail_unless(strcmp(contents, "key01:col 1\n") == 0, "The cut line wasn't dropped.");
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+END_TEST
+
+/**
+ * @brief This runs the disk log tests under each fsync policy.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("disklog");
+    TCase *tc;
+
+    // Disk log tests syncing every write
+    tc = tcase_create("disklog always");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_always, test_teardown);
+    tcase_add_test(tc, test_log_read);
+    tcase_add_test(tc, test_log_restart);
+    tcase_add_test(tc, test_log_concurrent);
+    suite_add_tcase(s, tc);
+
+    // Disk log tests leaving syncs to the OS
+    tc = tcase_create("disklog os");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_os, test_teardown);
+    tcase_add_test(tc, test_log_read);
+    tcase_add_test(tc, test_log_restart);
+    tcase_add_test(tc, test_log_concurrent);
+    suite_add_tcase(s, tc);
+
+    // Disk log tests syncing every 10 ms
+    tc = tcase_create("disklog every-10-ms");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_every10ms, test_teardown);
+    tcase_add_test(tc, test_log_read);
+    tcase_add_test(tc, test_log_restart);
+    tcase_add_test(tc, test_log_concurrent);
+    suite_add_tcase(s, tc);
+
+    // Table files whose last line has no newline
+    tc = tcase_create("disklog unterminated");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_log_unterminated);
+    tcase_add_test(tc, test_log_cut_short);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @brief This file implements the server fixture declared in fixture.h.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "fixture.h"
+
+int server_port;
+
+void *test_conn = NULL;
+
+int test_pid = -1;
+
+char *test_keys[MAX_RECORDS_PER_TABLE];
+
+char *test_conf = NULL;
+
+int start_server(char *config_file, int *status, const char *serverout_file)
+{
+    sleep(1);       // Give the OS enough time to kill previous process
+
+    pid_t childpid = fork();
+    if (childpid < 0)
+    {
+        // Failed to create child.
+        return -1;
+    }
+    else if (childpid == 0)
+    {
+        // The child.
+
+        // Redirect stdout and stderr to a file.
+        const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+        int outfd = open(outfile, O_CREAT | O_WRONLY | O_TRUNC, SERVEROUT_MODE);
+        close(STDOUT_FILENO);
+        close(STDERR_FILENO);
+        if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0)
+        {
+            perror("dup2 error");
+            return -1;
+        }
+
+        // Start the server
+        execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+        // Should never get here.
+        perror("Couldn't start server");
+        exit(EXIT_FAILURE);
+    }
+    else
+    {
+        // The parent.
+
+        // If the child terminates quickly, then there was probably a
+        // problem running the server (e.g., config file not found).
+        sleep(1);
+        int pid = waitpid(childpid, status, WNOHANG);
+        if (pid == childpid)
+            return -1; // Probably a problem starting the server.
+        else
+            return childpid; // Probably ok.
+    }
+}
+
+void *start_connect(char *config_file, char *serverout_file, int *serverpid)
+{
+    // Start the server.
+    int pid = start_server(config_file, NULL, serverout_file);
+    fail_unless(pid > 0, "Server didn't run properly.");
+    if (serverpid != NULL)
+        *serverpid = pid;
+
+    // Connect to the server.
+    void *conn = storage_connect(SERVERHOST, server_port);
+    fail_unless(conn != NULL, "Couldn't connect to server.");
+
+    // Authenticate with the server.
+    int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+    fail_unless(status == 0, "Authentication failed.");
+
+    return conn;
+}
+
+void *init_start_connect(char *config_file, char *serverout_file, int *serverpid)
+{
+    // Delete the data directory.
+    system("rm -rf " DATADIR);
+
+    return start_connect(config_file, serverout_file, serverpid);
+}
+
+int kill_server(int pid)
+{
+    int status = kill(pid, SIGKILL);
+    fail_unless(status == 0, "Couldn't kill server.");
+    waitpid(pid, NULL, 0);
+    return status;
+}
+
+void clear_keys()
+{
+    int i;
+    for (i = 0; i < MAX_RECORDS_PER_TABLE; i++)
+    {
+        if (test_keys[i] == NULL)
+            test_keys[i] = (char *)malloc(MAX_KEY_LEN);
+        strncpy(test_keys[i], "", MAX_KEY_LEN);
+    }
+}
+
+void restart()
+{
+    kill_server(test_pid);
+    test_conn = start_connect(test_conf, "restart.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't restart or connect to server.");
+}
+
+void test_teardown()
+{
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+
+void init_server_port(int argc, char *argv[])
+{
+    if (argc == 2)
+        server_port = atoi(argv[1]);
+    else
+        server_port = SERVERPORT;
+    printf("Using server port: %d.\n", server_port);
+}
+
+void run_suite(Suite *s)
+{
+    SRunner *sr = srunner_create(s);
+    srunner_set_log(sr, "results.log");
+    srunner_run_all(sr, CK_ENV);
+    srunner_ntests_failed(sr);
+    srunner_free(sr);
+}
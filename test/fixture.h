@@ -0,0 +1,96 @@
+/**
+ * @file
+ * @brief This file declares the server fixture shared by the test suites.
+ *
+ * A suite starts the storage server from its own directory, with one of
+ * its config files, connects to it and kills it after each test. Each
+ * suite keeps only its own config files, records and test cases.
+ */
+
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <check.h>
+#include "storage.h"
+
+#define SERVEREXEC  "./server"  // Server executable file.
+#define SERVEROUT   "default.serverout" // File where the server's output is stored.
+#define SERVEROUT_MODE  0666        // Permissions of the server ouptut file.
+
+// These settings should correspond to what's in the config files.
+#define SERVERHOST  "localhost" // The hostname where the server is running.
+#define SERVERPORT  4848        // The port where the server is running.
+#define SERVERUSERNAME  "admin"     // The server username
+#define SERVERPASSWORD  "dog4sale"  // The server password
+#define DATADIR     "./mydata"  // The data directory.
+
+/* Server port used by test */
+extern int server_port;
+
+/// Connection used by test fixture.
+extern void *test_conn;
+
+/// Server process id used by test fixture.
+extern int test_pid;
+
+/// Keys array used by test fixture.
+extern char *test_keys[MAX_RECORDS_PER_TABLE];
+
+/// Configuration file used by test fixture.
+extern char *test_conf;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param status Status info about the server (from waitpid).
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, int *status, const char *serverout_file);
+
+/**
+ * @brief Start the server, and connect to it.
+ * @return A connection to the server if successful.
+ */
+void *start_connect(char *config_file, char *serverout_file, int *serverpid);
+
+/**
+ * @brief Create an empty data directory, start the server, and connect to it.
+ * @return A connection to the server if successful.
+ */
+void *init_start_connect(char *config_file, char *serverout_file, int *serverpid);
+
+/**
+ * @brief Kill the server with given pid.
+ * @return 0 on success, -1 on error.
+ */
+int kill_server(int pid);
+
+/**
+ * @brief Allocate the keys array and set every key to "".
+ */
+void clear_keys();
+
+/**
+ * @brief Kill the server without warning, start it again with test_conf
+ * and reconnect.
+ */
+void restart();
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the server and kill it.
+ */
+void test_teardown();
+
+/**
+ * @brief Read the server port from the command line, SERVERPORT if it is not given.
+ */
+void init_server_port(int argc, char *argv[]);
+
+/**
+ * @brief Run every test of a suite, logging to results.log.
+ */
+void run_suite(Suite *s);
+
+#endif
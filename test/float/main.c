@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 10      // How long to wait for each test to run.
+#define SIMPLETABLES_CONF       "conf-simpletables.conf"    // Server configuration file with an in-memory table.
+#define DISKTABLES_CONF         "conf-disktables.conf"      // Server configuration file with an on-disk table.
+#define MAXRESULTS  10          // Size of the results array.
+#define FLOATTOLERANCE  0.0001      // How much a float value can be off by (due to type conversions).
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "items"     // The table to use.
+
+/**
+ * @brief Store a few records with float prices.
+ */
+void populate()
+{
+    struct storage_record record;
+
+    strncpy(record.value, "name tea,price 1.50,qty 3", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k1", &record, test_conn) == 0, "Couldn't set k1.");
+    strncpy(record.value, "name milk,price -2.25,qty 1", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k2", &record, test_conn) == 0, "Couldn't set k2.");
+    strncpy(record.value, "name bread,price 3,qty 2", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k3", &record, test_conn) == 0, "Couldn't set k3.");
+    strncpy(record.value, "name jam,price 0.001,qty 5", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k4", &record, test_conn) == 0, "Couldn't set k4.");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an in-memory table and populate it.
+ */
+void test_setup_memory_populate()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "memorydata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an on-disk table and populate it.
+ */
+void test_setup_disk_populate()
+{
+    test_conn = init_start_connect(DISKTABLES_CONF, "diskdata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Run a query and check the matching keys.
+ *
+ * @param predicates The predicates to query with.
+ * @param expected The keys expected, in any order, separated by spaces.
+ */
+void check_query(const char *predicates, const char *expected)
+{
+    char found[MAX_VALUE_LEN] = "";
+    char *key;
+    int i, n;
+
+    clear_keys();
+    n = storage_query(TABLE, predicates, test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n >= 0, "Query \"%s\" failed.", predicates);
+    for (i = 0; i < n; i++)
+    {
+        // Surround each key with spaces so a key can't match part of another.
+        strcat(found, " ");
+        strcat(found, test_keys[i]);
+        strcat(found, " ");
+    }
+
+    char copy[MAX_VALUE_LEN];
+    strncpy(copy, expected, sizeof copy);
+    i = 0;
+    for (key = strtok(copy, " "); key != NULL; key = strtok(NULL, " "))
+    {
+        char padded[MAX_KEY_LEN + 2];
+        snprintf(padded, sizeof padded, " %s ", key);
+        fail_unless(strstr(found, padded) != NULL, "Query \"%s\" didn't return %s.", predicates, key);
+        i++;
+    }
+    fail_unless(n == i, "Query \"%s\" returned %d keys instead of %d.", predicates, n, i);
+}
+
+/*
+ * Float value tests:
+ *  values are stored as given
+ *  ints are valid floats
+ *  malformed floats are rejected
+ */
+
+START_TEST (test_float_get)
+{
+    struct storage_record record;
+
+    fail_unless(storage_get(TABLE, "k1", &record, test_conn) == 0, "Couldn't get k1.");
+    fail_unless(strcmp(record.value, "name tea,price 1.50,qty 3") == 0, "Get returned %s.", record.value);
+    fail_unless(storage_get(TABLE, "k2", &record, test_conn) == 0, "Couldn't get k2.");
+    fail_unless(strcmp(record.value, "name milk,price -2.25,qty 1") == 0, "Get returned %s.", record.value);
+}
+END_TEST
+
+START_TEST (test_float_update)
+{
+    struct storage_record record;
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "name tea,price 1.75,qty 3", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k1", &record, test_conn) == 0, "Couldn't update k1.");
+    check_query("price > 1.6", "k1 k3");
+    check_query("price = 1.75", "k1");
+}
+END_TEST
+
+START_TEST (test_float_invalid)
+{
+    struct storage_record record;
+
+    strncpy(record.value, "name tea,price 1.2.3,qty 3", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k5", &record, test_conn) == -1, "Set of a malformed float didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Set didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_float_invalid_text)
+{
+    struct storage_record record;
+
+    strncpy(record.value, "name tea,price abc,qty 3", sizeof record.value);
+    fail_unless(storage_set(TABLE, "k5", &record, test_conn) == -1, "Set of a non-numeric float didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Set didn't set the errno properly.");
+}
+END_TEST
+
+/*
+ * Float predicate tests:
+ *  comparisons against fractional and negative values
+ *  float and int predicates together
+ *  malformed comparison values
+ */
+
+START_TEST (test_float_query)
+{
+    check_query("price > 1.4", "k1 k3");
+    check_query("price < 0", "k2");
+    check_query("price < 0.01", "k2 k4");
+    check_query("price = -2.25", "k2");
+    check_query("price = 3", "k3");
+    check_query("price > 100", "");
+}
+END_TEST
+
+START_TEST (test_float_query_mixed)
+{
+    check_query("price > 0, qty > 2", "k1 k4");
+    check_query("price < 2, qty < 4", "k1 k2");
+}
+END_TEST
+
+START_TEST (test_float_query_invalid)
+{
+    int n = storage_query(TABLE, "price > cheap", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == -1, "Query with a malformed float didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Query didn't set the errno properly.");
+}
+END_TEST
+
+/*
+ * Float aggregate tests.
+ */
+
+START_TEST (test_float_aggregate)
+{
+    struct storage_aggregate results[MAXRESULTS];
+    int n;
+
+    n = storage_aggregate(TABLE, "SUM", "price", "", "", results, MAXRESULTS, test_conn);
+    fail_unless(n == 1 && fabs(results[0].value - 2.251) < FLOATTOLERANCE, "SUM of prices is wrong.");
+    n = storage_aggregate(TABLE, "MIN", "price", "", "", results, MAXRESULTS, test_conn);
+    fail_unless(n == 1 && fabs(results[0].value + 2.25) < FLOATTOLERANCE, "MIN of prices is wrong.");
+    n = storage_aggregate(TABLE, "MAX", "price", "price < 3", "", results, MAXRESULTS, test_conn);
+    fail_unless(n == 1 && fabs(results[0].value - 1.5) < FLOATTOLERANCE, "MAX of prices is wrong.");
+    n = storage_aggregate(TABLE, "AVG", "price", "price > 1", "", results, MAXRESULTS, test_conn);
+    fail_unless(n == 1 && fabs(results[0].value - 2.25) < FLOATTOLERANCE, "AVG of prices is wrong.");
+}
+END_TEST
+
+/**
+ * @brief This runs the float column tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("float");
+    TCase *tc;
+
+    // Float tests on an in-memory table
+    tc = tcase_create("float memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory_populate, test_teardown);
+    tcase_add_test(tc, test_float_get);
+    tcase_add_test(tc, test_float_update);
+    tcase_add_test(tc, test_float_invalid);
+    tcase_add_test(tc, test_float_invalid_text);
+    tcase_add_test(tc, test_float_query);
+    tcase_add_test(tc, test_float_query_mixed);
+    tcase_add_test(tc, test_float_query_invalid);
+    tcase_add_test(tc, test_float_aggregate);
+    suite_add_tcase(s, tc);
+
+    // Float tests on an on-disk table
+    tc = tcase_create("float disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk_populate, test_teardown);
+    tcase_add_test(tc, test_float_get);
+    tcase_add_test(tc, test_float_update);
+    tcase_add_test(tc, test_float_invalid);
+    tcase_add_test(tc, test_float_query);
+    tcase_add_test(tc, test_float_aggregate);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 30      // How long to wait for each test to run.
+#define MEMORY_CONF     "conf-memory.conf"  // Server configuration file with in-memory tables.
+#define DISK_CONF       "conf-disk.conf"    // Server configuration file with on-disk tables.
+#define LSM_CONF        "conf-lsm.conf"     // Server configuration file with LSM tables.
+#define BTREE_CONF      "conf-btree.conf"   // Server configuration file with btree tables.
+#define NUMLOAD     600         // Number of records loaded into any table.
+#define NUMMANY     1500        // Number of records loaded into tables not held in memory.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table.
+#define MISSINGTABLE    "missingtable"  // A non-existing table.
+
+/// Keys and records loaded by the tests.
+char *load_keys[NUMMANY];
+struct storage_record load_records[NUMMANY];
+
+/**
+ * @brief Fill the first num entries of load_keys and load_records, with
+ * col set to the key's number.
+ */
+void make_load(int num)
+{
+    int i;
+
+    memset(load_records, 0, sizeof load_records);
+    for (i = 0; i < num; i++)
+    {
+        if (load_keys[i] == NULL)
+            load_keys[i] = (char *)malloc(MAX_KEY_LEN);
+        snprintf(load_keys[i], MAX_KEY_LEN, "load%04d", i);
+        snprintf(load_records[i].value, sizeof load_records[i].value, "col %d", i);
+    }
+}
+
+/**
+ * @brief Start the server with a configuration file.
+ */
+void setup(char *config_file, char *serverout_file)
+{
+    test_conn = init_start_connect(config_file, serverout_file, &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with in-memory tables.
+ */
+void test_setup_memory()
+{
+    setup(MEMORY_CONF, "memory.serverout");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with on-disk tables.
+ */
+void test_setup_disk()
+{
+    setup(DISK_CONF, "disk.serverout");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with LSM tables.
+ */
+void test_setup_lsm()
+{
+    setup(LSM_CONF, "lsm.serverout");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with btree tables.
+ */
+void test_setup_btree()
+{
+    setup(BTREE_CONF, "btree.serverout");
+}
+
+/**
+ * @brief Check a few of the records loaded, and the number of records.
+ */
+void check_loaded(int num)
+{
+    struct storage_record record;
+    char value[MAX_VALUE_LEN];
+    int i;
+
+    for (i = 0; i < num; i += num / 7)
+    {
+        fail_unless(storage_get(INTTABLE, load_keys[i], &record, test_conn) == 0, "Couldn't get %s.", load_keys[i]);
+        snprintf(value, sizeof value, "col %d", i);
+        fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", load_keys[i], record.value, value);
+    }
+
+    int n = storage_query_page(INTTABLE, "col > -1", NULL, 0, NULL, test_conn);
+    fail_unless(n == num, "Count found %d records instead of %d.", n, num);
+    n = storage_query_page(INTTABLE, "col > 99", NULL, 0, NULL, test_conn);
+    fail_unless(n == num - 100, "Count found %d records instead of %d.", n, num - 100);
+}
+
+/*
+ * Load tests:
+ *  loaded records read back like set ones
+ *  a load replaces existing records
+ *  an empty load
+ */
+
+START_TEST (test_load)
+{
+    make_load(NUMLOAD);
+    fail_unless(storage_bulk_load(INTTABLE, load_keys, load_records, NUMLOAD, test_conn) == 0, "Load failed.");
+    check_loaded(NUMLOAD);
+}
+END_TEST
+
+START_TEST (test_load_replace)
+{
+    struct storage_record record;
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 99999", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "load0003", &record, test_conn) == 0, "Couldn't set load0003.");
+
+    make_load(NUMLOAD);
+    fail_unless(storage_bulk_load(INTTABLE, load_keys, load_records, NUMLOAD, test_conn) == 0, "Load failed.");
+    check_loaded(NUMLOAD);
+    fail_unless(storage_get(INTTABLE, "load0003", &record, test_conn) == 0, "Couldn't get load0003.");
+    fail_unless(strcmp(record.value, "col 3") == 0, "Load didn't replace load0003.");
+}
+END_TEST
+
+START_TEST (test_load_empty)
+{
+    make_load(1);
+    fail_unless(storage_bulk_load(INTTABLE, load_keys, load_records, 0, test_conn) == 0, "Empty load failed.");
+    int n = storage_query_page(INTTABLE, "col > -1", NULL, 0, NULL, test_conn);
+    fail_unless(n == 0, "Empty load stored %d records.", n);
+}
+END_TEST
+
+/*
+ * Load tests on tables not held in memory:
+ *  more records than an in-memory table holds
+ *  a legacy query returns every match
+ */
+
+START_TEST (test_load_many)
+{
+    int i, n;
+    char **keys = malloc(NUMMANY * sizeof *keys);
+    int seen[NUMMANY] = {0};
+
+    make_load(NUMMANY);
+    fail_unless(storage_bulk_load(INTTABLE, load_keys, load_records, NUMMANY, test_conn) == 0, "Load failed.");
+    check_loaded(NUMMANY);
+
+    for (i = 0; i < NUMMANY; i++)
+    {
+        keys[i] = (char *)malloc(MAX_KEY_LEN);
+        strncpy(keys[i], "", MAX_KEY_LEN);
+    }
+    n = storage_query(INTTABLE, "col > -1", keys, NUMMANY, test_conn);
+    fail_unless(n == NUMMANY, "Query found %d records instead of %d.", n, NUMMANY);
+    for (i = 0; i < NUMMANY; i++)
+    {
+        int num = -1;
+        fail_unless(sscanf(keys[i], "load%d", &num) == 1 && num >= 0 && num < NUMMANY,
+                    "Query returned a bad key %s.", keys[i]);
+        fail_unless(seen[num] == 0, "Query returned %s twice.", keys[i]);
+        seen[num] = 1;
+    }
+}
+END_TEST
+
+/*
+ * Invalid load tests:
+ *  a bad value
+ *  a bad key
+ *  missing table
+ */
+
+START_TEST (test_load_bad_value)
+{
+    make_load(10);
+    strncpy(load_records[5].value, "col abc", sizeof load_records[5].value);
+    fail_unless(storage_bulk_load(INTTABLE, load_keys, load_records, 10, test_conn) == -1,
+                "Load of a bad value didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Load didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_load_bad_key)
+{
+    make_load(10);
+    strncpy(load_keys[5], "bad key", MAX_KEY_LEN);
+    fail_unless(storage_bulk_load(INTTABLE, load_keys, load_records, 10, test_conn) == -1,
+                "Load of a bad key didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Load didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_load_missing_table)
+{
+    make_load(10);
+    fail_unless(storage_bulk_load(MISSINGTABLE, load_keys, load_records, 10, test_conn) == -1,
+                "Load into a missing table didn't fail.");
+    fail_unless(errno == ERR_TABLE_NOT_FOUND, "Load didn't set the errno properly.");
+}
+END_TEST
+
+/**
+ * @brief This runs the load tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("load");
+    TCase *tc;
+
+    // Load tests on in-memory tables
+    tc = tcase_create("load memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory, test_teardown);
+    tcase_add_test(tc, test_load);
+    tcase_add_test(tc, test_load_replace);
+    tcase_add_test(tc, test_load_empty);
+    tcase_add_test(tc, test_load_bad_value);
+    tcase_add_test(tc, test_load_bad_key);
+    tcase_add_test(tc, test_load_missing_table);
+    suite_add_tcase(s, tc);
+
+    // Load tests on on-disk tables
+    tc = tcase_create("load disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk, test_teardown);
+    tcase_add_test(tc, test_load_replace);
+    tcase_add_test(tc, test_load_many);
+    tcase_add_test(tc, test_load_bad_value);
+    suite_add_tcase(s, tc);
+
+    // Load tests on LSM tables
+    tc = tcase_create("load lsm");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_lsm, test_teardown);
+    tcase_add_test(tc, test_load_replace);
+    tcase_add_test(tc, test_load_many);
+    tcase_add_test(tc, test_load_bad_value);
+    suite_add_tcase(s, tc);
+
+    // Load tests on btree tables
+    tc = tcase_create("load btree");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_btree, test_teardown);
+    tcase_add_test(tc, test_load_replace);
+    tcase_add_test(tc, test_load_many);
+    tcase_add_test(tc, test_load_bad_value);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
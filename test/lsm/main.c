@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define LSM_CONF        "conf-lsm.conf"         // Server configuration file with LSM tables.
+#define LSMALWAYS_CONF  "conf-lsm-always.conf"  // Server configuration file with LSM tables syncing every write.
+#define LSMNAMES_CONF   "conf-lsm-names.conf"   // Server configuration file with a table and a column named lsm.
+#define PAGESIZE    4           // Number of keys asked for per call.
+#define NUMKEYS     20          // Number of records the fixtures store.
+#define NUMWRITERS  4           // Number of concurrent writers.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table.
+
+/**
+ * @brief Store NUMKEYS records key00 .. key19, then update the even ones
+ * and delete every fifth one.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 2)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", 1000 + i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't update %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 5)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        fail_unless(storage_set(INTTABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+}
+
+/**
+ * @brief Check the records populate() leaves behind.
+ */
+void check_populated()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        if (i % 5 == 0)
+        {
+            fail_unless(storage_get(INTTABLE, key, &record, test_conn) == -1, "Deleted %s came back.", key);
+            fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+            continue;
+        }
+        fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+        snprintf(value, sizeof value, "col %d", i % 2 ? i : 1000 + i);
+        fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+    }
+
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS - NUMKEYS / 5, "Query found %d records instead of %d.", n, NUMKEYS - NUMKEYS / 5);
+    n = storage_query(INTTABLE, "col > 999", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS / 2 - NUMKEYS / 10, "Query found %d updated records.", n);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with LSM tables.
+ */
+void test_setup_lsm()
+{
+    test_conf = LSM_CONF;
+    test_conn = init_start_connect(test_conf, "lsm.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with LSM tables syncing every write.
+ */
+void test_setup_lsm_always()
+{
+    test_conf = LSMALWAYS_CONF;
+    test_conn = init_start_connect(test_conf, "lsmalways.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/*
+ * LSM tests:
+ *  the newest version of a key wins and deletes hide older versions
+ *  records survive the server being killed
+ */
+
+START_TEST (test_lsm_read)
+{
+    populate();
+    check_populated();
+}
+END_TEST
+
+START_TEST (test_lsm_restart)
+{
+    struct storage_record record;
+
+    populate();
+    restart();
+    check_populated();
+
+    // A key deleted before the restart can be set again.
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 77", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "key05", &record, test_conn) == 0, "Couldn't set key05 again.");
+    restart();
+    fail_unless(storage_get(INTTABLE, "key05", &record, test_conn) == 0, "Couldn't get key05.");
+    fail_unless(strcmp(record.value, "col 77") == 0, "key05 is %s instead of col 77.", record.value);
+}
+END_TEST
+
+/*
+ * LSM walk tests:
+ *  keys come back in order, without deleted ones
+ *  select reads the newest values
+ */
+
+START_TEST (test_lsm_scan)
+{
+    struct storage_iterator it;
+    char expected[MAX_KEY_LEN];
+    int i, n, next = 1;
+
+    populate();
+    fail_unless(storage_scan_begin(&it, INTTABLE, "", "", test_conn) == 0, "Couldn't start the scan.");
+    while ((n = storage_iterator_next(&it, test_keys, PAGESIZE)) > 0)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (next % 5 == 0)
+                next++;
+            snprintf(expected, sizeof expected, "key%02d", next);
+            fail_unless(strcmp(test_keys[i], expected) == 0, "Scan returned %s instead of %s.", test_keys[i], expected);
+            next++;
+        }
+    }
+    fail_unless(n == 0, "Scan failed.");
+    fail_unless(next == NUMKEYS, "Scan stopped before key%02d.", next);
+
+    fail_unless(storage_prefix_begin(&it, INTTABLE, "key1", test_conn) == 0, "Couldn't start the prefix walk.");
+    n = storage_iterator_next(&it, test_keys, MAX_RECORDS_PER_TABLE);
+    fail_unless(n == 8, "Prefix walk returned %d keys instead of 8.", n);
+}
+END_TEST
+
+START_TEST (test_lsm_select)
+{
+    struct storage_record records[NUMKEYS];
+
+    populate();
+    int n = storage_query_records(INTTABLE, "col > 999", "", test_keys, records, NUMKEYS, NULL, test_conn);
+    fail_unless(n == NUMKEYS / 2 - NUMKEYS / 10, "Select found %d updated records.", n);
+    n = storage_query_records(INTTABLE, "col < 20", "", test_keys, records, NUMKEYS, NULL, test_conn);
+    fail_unless(n == NUMKEYS / 2 - NUMKEYS / 10, "Select found %d records that weren't updated.", n);
+}
+END_TEST
+
+/*
+ * Concurrency tests:
+ *  concurrent writers on their own connections all get their writes in
+ */
+
+START_TEST (test_lsm_concurrent)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int w, i, status;
+    pid_t pids[NUMWRITERS];
+
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        pids[w] = fork();
+        fail_unless(pids[w] >= 0, "Couldn't fork a writer.");
+        if (pids[w] == 0)
+        {
+            // The writer.
+            void *conn = storage_connect(SERVERHOST, server_port);
+            if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+                exit(EXIT_FAILURE);
+            memset(&record, 0, sizeof record);
+            for (i = 0; i < NUMKEYS; i++)
+            {
+                snprintf(key, sizeof key, "w%dk%02d", w, i);
+                snprintf(record.value, sizeof record.value, "col %d", w * 100 + i);
+                if (storage_set(INTTABLE, key, &record, conn) != 0)
+                    exit(EXIT_FAILURE);
+            }
+            storage_disconnect(conn);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        fail_unless(waitpid(pids[w], &status, 0) == pids[w], "Couldn't wait for a writer.");
+        fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "Writer %d failed.", w);
+    }
+
+    restart();
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        for (i = 0; i < NUMKEYS; i += 7)
+        {
+            char value[MAX_VALUE_LEN];
+            snprintf(key, sizeof key, "w%dk%02d", w, i);
+            snprintf(value, sizeof value, "col %d", w * 100 + i);
+            fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+            fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+        }
+    }
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMWRITERS * NUMKEYS, "Query found %d records instead of %d.", n, NUMWRITERS * NUMKEYS);
+}
+END_TEST
+
+/*
+ * Config tests:
+ *  lsm is a keyword only as the value of storage_policy
+ */
+
+START_TEST (test_lsm_names)
+{
+    struct storage_record record;
+
+    test_conf = LSMNAMES_CONF;
+    test_conn = init_start_connect(test_conf, "test_lsm_names.serverout", &test_pid);
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "lsm 5", sizeof record.value);
+    fail_unless(storage_set("lsm", "key", &record, test_conn) == 0, "Couldn't set in the table named lsm.");
+    fail_unless(storage_get("lsm", "key", &record, test_conn) == 0, "Couldn't get from the table named lsm.");
+    fail_unless(strcmp(record.value, "lsm 5") == 0, "Get returned %s instead of lsm 5.", record.value);
+
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+END_TEST
+
+/**
+ * @brief This runs the LSM tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("lsm");
+    TCase *tc;
+
+    // LSM tests
+    tc = tcase_create("lsm");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_lsm, test_teardown);
+    tcase_add_test(tc, test_lsm_read);
+    tcase_add_test(tc, test_lsm_restart);
+    tcase_add_test(tc, test_lsm_scan);
+    tcase_add_test(tc, test_lsm_select);
+    tcase_add_test(tc, test_lsm_concurrent);
+    suite_add_tcase(s, tc);
+
+    // LSM tests syncing every write
+    tc = tcase_create("lsm always");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_lsm_always, test_teardown);
+    tcase_add_test(tc, test_lsm_restart);
+    tcase_add_test(tc, test_lsm_concurrent);
+    suite_add_tcase(s, tc);
+
+    // Config tests
+    tc = tcase_create("lsm config");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_lsm_names);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 10      // How long to wait for each test to run.
+#define SIMPLETABLES_CONF       "conf-simpletables.conf"    // Server configuration file with simple tables.
+#define DISKTABLES_CONF         "conf-disktables.conf"      // Server configuration file with simple tables on disk.
+#define NUMKEYS     25          // Number of records the fixtures store.
+#define PAGESIZE    10          // Number of keys asked for per page.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table.
+#define MISSINGTABLE    "missingtable"  // A non-existing table.
+
+/**
+ * @brief Store NUMKEYS records key00 .. key24, with col set to the key's number.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+        snprintf(record.value, sizeof record.value, "col s%d", i % 2);
+        fail_unless(storage_set(STRTABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with in-memory tables and populate them.
+ */
+void test_setup_memory_populate()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "memorydata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with on-disk tables and populate them.
+ */
+void test_setup_disk_populate()
+{
+    test_conn = init_start_connect(DISKTABLES_CONF, "diskdata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Page through a query and check every matching key comes back once.
+ *
+ * @param predicates The predicates to query with.
+ * @param first The number of the first matching key.
+ */
+void check_pages(const char *predicates, int first)
+{
+    char cursor[MAX_CURSOR_LEN] = "";
+    int seen[NUMKEYS] = {0};
+    int total = 0, pages = 0, i, n;
+
+    do
+    {
+        clear_keys();
+        n = storage_query_page(INTTABLE, predicates, test_keys, PAGESIZE, cursor, test_conn);
+        fail_unless(n >= 0 && n <= PAGESIZE, "Query page returned %d keys.", n);
+        fail_unless(strcmp(test_keys[n], "") == 0, "No extra keys should be modified.");
+        for (i = 0; i < n; i++)
+        {
+            int num = -1;
+            fail_unless(sscanf(test_keys[i], "key%d", &num) == 1 && num >= first && num < NUMKEYS,
+                        "Key %s doesn't match the query.", test_keys[i]);
+            fail_unless(seen[num] == 0, "Key %s was returned twice.", test_keys[i]);
+            seen[num] = 1;
+        }
+        total += n;
+        pages++;
+        fail_unless(pages <= NUMKEYS, "Paging didn't stop.");
+    } while (cursor[0] != '\0');
+
+    fail_unless(total == NUMKEYS - first, "Paging returned %d keys instead of %d.", total, NUMKEYS - first);
+}
+
+/*
+ * Query limit tests:
+ *  the total is returned even when the keys array is smaller
+ *  a page stops at the limit and hands back a cursor
+ */
+
+START_TEST (test_query_limit)
+{
+    int foundkeys = storage_query(INTTABLE, "col > -1", test_keys, 3, test_conn);
+    fail_unless(foundkeys == NUMKEYS, "Query didn't return the total number of matches.");
+    fail_unless(strcmp(test_keys[2], "") != 0, "Query didn't fill the keys array.");
+    fail_unless(strcmp(test_keys[3], "") == 0, "No keys past max_keys should be modified.");
+}
+END_TEST
+
+START_TEST (test_page_first)
+{
+    char cursor[MAX_CURSOR_LEN] = "";
+    int n = storage_query_page(INTTABLE, "col > -1", test_keys, PAGESIZE, cursor, test_conn);
+    fail_unless(n == PAGESIZE, "First page didn't stop at the limit.");
+    fail_unless(strcmp(test_keys[PAGESIZE], "") == 0, "No extra keys should be modified.");
+    fail_unless(cursor[0] != '\0', "First page didn't return a cursor.");
+}
+END_TEST
+
+START_TEST (test_page_no_cursor)
+{
+    int n = storage_query_page(INTTABLE, "col > -1", test_keys, PAGESIZE, NULL, test_conn);
+    fail_unless(n == PAGESIZE, "Query without a cursor didn't return the first page.");
+}
+END_TEST
+
+/*
+ * Paging tests:
+ *  every match is returned exactly once across pages
+ *  count-only queries
+ *  bad cursors
+ */
+
+START_TEST (test_page_all)
+{
+    check_pages("col > -1", 0);
+}
+END_TEST
+
+START_TEST (test_page_some)
+{
+    check_pages("col > 6", 7);
+}
+END_TEST
+
+START_TEST (test_page_none)
+{
+    char cursor[MAX_CURSOR_LEN] = "";
+    int n = storage_query_page(INTTABLE, "col > 100", test_keys, PAGESIZE, cursor, test_conn);
+    fail_unless(n == 0, "Query page found keys that don't match.");
+    fail_unless(cursor[0] == '\0', "An empty page shouldn't return a cursor.");
+}
+END_TEST
+
+START_TEST (test_page_count)
+{
+    int n = storage_query_page(INTTABLE, "col > 19", NULL, 0, NULL, test_conn);
+    fail_unless(n == 5, "Count-only query returned %d instead of 5.", n);
+
+    n = storage_query_page(STRTABLE, "col = s1", NULL, 0, NULL, test_conn);
+    fail_unless(n == NUMKEYS / 2, "Count-only query returned %d instead of %d.", n, NUMKEYS / 2);
+}
+END_TEST
+
+START_TEST (test_page_bad_cursor)
+{
+    char cursor[MAX_CURSOR_LEN] = "abc";
+    int n = storage_query_page(INTTABLE, "col > -1", test_keys, PAGESIZE, cursor, test_conn);
+    fail_unless(n == -1, "Query page with a bad cursor didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Query page didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_page_missing_table)
+{
+    char cursor[MAX_CURSOR_LEN] = "";
+    int n = storage_query_page(MISSINGTABLE, "col > -1", test_keys, PAGESIZE, cursor, test_conn);
+    fail_unless(n == -1, "Query page on a missing table didn't fail.");
+    fail_unless(errno == ERR_TABLE_NOT_FOUND, "Query page didn't set the errno properly.");
+}
+END_TEST
+
+/**
+ * @brief This runs the query limit and paging tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("paging");
+    TCase *tc;
+
+    // Paging tests on in-memory tables
+    tc = tcase_create("paging memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory_populate, test_teardown);
+    tcase_add_test(tc, test_query_limit);
+    tcase_add_test(tc, test_page_first);
+    tcase_add_test(tc, test_page_no_cursor);
+    tcase_add_test(tc, test_page_all);
+    tcase_add_test(tc, test_page_some);
+    tcase_add_test(tc, test_page_none);
+    tcase_add_test(tc, test_page_count);
+    tcase_add_test(tc, test_page_bad_cursor);
+    tcase_add_test(tc, test_page_missing_table);
+    suite_add_tcase(s, tc);
+
+    // Paging tests on on-disk tables
+    tc = tcase_create("paging disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk_populate, test_teardown);
+    tcase_add_test(tc, test_query_limit);
+    tcase_add_test(tc, test_page_first);
+    tcase_add_test(tc, test_page_all);
+    tcase_add_test(tc, test_page_some);
+    tcase_add_test(tc, test_page_none);
+    tcase_add_test(tc, test_page_count);
+    tcase_add_test(tc, test_page_bad_cursor);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
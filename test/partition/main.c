@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define PARTITION_CONF  "conf-partition.conf"       // Server configuration file with tables owned by partition workers.
+#define REDO_CONF       "conf-partition-redo.conf"  // Same, syncing a redo log after every change.
+#define NUMKEYS     20          // Number of records the fixtures store.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table.
+
+/**
+ * @brief Store NUMKEYS records key00 .. key19 in a table, then update the
+ * even ones and delete every fifth one.
+ *
+ * @param table The table to store them in.
+ * @param conn The connection to use.
+ * @return 0 if every change succeeded, -1 otherwise.
+ */
+int populate(const char *table, void *conn)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        if (storage_set(table, key, &record, conn) != 0)
+            return -1;
+    }
+    for (i = 0; i < NUMKEYS; i += 2)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", 1000 + i);
+        if (storage_set(table, key, &record, conn) != 0)
+            return -1;
+    }
+    for (i = 0; i < NUMKEYS; i += 5)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        if (storage_set(table, key, NULL, conn) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check the records populate() leaves behind in a table.
+ *
+ * @param table The table populated.
+ */
+void check_populated(const char *table)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        if (i % 5 == 0)
+        {
+            fail_unless(storage_get(table, key, &record, test_conn) == -1, "Deleted %s came back.", key);
+            fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+            continue;
+        }
+        fail_unless(storage_get(table, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+        snprintf(value, sizeof value, "col %d", i % 2 ? i : 1000 + i);
+        fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+    }
+}
+
+/**
+ * @brief Check what QUERY finds in the int table after populate().
+ */
+void check_queries()
+{
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS - NUMKEYS / 5, "Query found %d records instead of %d.", n, NUMKEYS - NUMKEYS / 5);
+    n = storage_query(INTTABLE, "col > 999", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS / 2 - NUMKEYS / 10, "Query found %d updated records.", n);
+    n = storage_query(INTTABLE, "col = 7", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == 1 && strcmp(test_keys[0], "key07") == 0, "Query for col = 7 didn't find key07 alone.");
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with tables owned by partition workers.
+ */
+void test_setup_partition()
+{
+    test_conf = PARTITION_CONF;
+    test_conn = init_start_connect(test_conf, "partition.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with tables owned by
+ * partition workers and a redo log synced after every change.
+ */
+void test_setup_redo()
+{
+    test_conf = REDO_CONF;
+    test_conn = init_start_connect(test_conf, "redo.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/*
+ * Partition tests:
+ *  set, get, query and delete go through the table's owner
+ *  a missing key and a bad value are reported
+ *  clients of tables owned by different workers run at once
+ *  changes come back from the redo log after the server is killed
+ */
+
+START_TEST (test_partition_set_get)
+{
+    fail_unless(populate(INTTABLE, test_conn) == 0, "Couldn't populate %s.", INTTABLE);
+    fail_unless(populate(STRTABLE, test_conn) == 0, "Couldn't populate %s.", STRTABLE);
+    check_populated(INTTABLE);
+    check_populated(STRTABLE);
+}
+END_TEST
+
+START_TEST (test_partition_query)
+{
+    fail_unless(populate(INTTABLE, test_conn) == 0, "Couldn't populate %s.", INTTABLE);
+    check_queries();
+}
+END_TEST
+
+START_TEST (test_partition_errors)
+{
+    struct storage_record record;
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 1", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "key", NULL, test_conn) == -1, "Deleting a missing key succeeded.");
+    fail_unless(errno == ERR_KEY_NOT_FOUND, "Delete didn't set the errno properly.");
+    fail_unless(storage_set(INTTABLE, "key", &record, test_conn) == 0, "Couldn't set key.");
+    fail_unless(storage_set(INTTABLE, "key", NULL, test_conn) == 0, "Couldn't delete key.");
+    fail_unless(storage_get(INTTABLE, "key", &record, test_conn) == -1, "Deleted key came back.");
+    fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+
+    // The server hangs up after a bad value
+    strncpy(record.value, "col x", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "key", &record, test_conn) == -1, "Set with a bad value succeeded.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Set didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_partition_clients)
+{
+    const char *tables[] = { INTTABLE, STRTABLE };
+    pid_t pids[2];
+    int i, status;
+
+    for (i = 0; i < 2; i++)
+    {
+        pids[i] = fork();
+        fail_unless(pids[i] != -1, "Couldn't fork a client.");
+        if (pids[i] == 0)
+        {
+            void *conn = storage_connect(SERVERHOST, server_port);
+            if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+                _exit(EXIT_FAILURE);
+            _exit(populate(tables[i], conn) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < 2; i++)
+    {
+        fail_unless(waitpid(pids[i], &status, 0) == pids[i], "Couldn't wait for client %d.", i);
+        fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "Client of %s failed.", tables[i]);
+    }
+    check_populated(INTTABLE);
+    check_populated(STRTABLE);
+    check_queries();
+}
+END_TEST
+
+START_TEST (test_partition_restart)
+{
+    fail_unless(populate(INTTABLE, test_conn) == 0, "Couldn't populate %s.", INTTABLE);
+    fail_unless(populate(STRTABLE, test_conn) == 0, "Couldn't populate %s.", STRTABLE);
+    restart();
+    check_populated(INTTABLE);
+    check_populated(STRTABLE);
+    check_queries();
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("partition");
+    TCase *tc;
+
+    // Partition tests on in-memory tables
+    tc = tcase_create("partition memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_partition, test_teardown);
+    tcase_add_test(tc, test_partition_set_get);
+    tcase_add_test(tc, test_partition_query);
+    tcase_add_test(tc, test_partition_errors);
+    tcase_add_test(tc, test_partition_clients);
+    suite_add_tcase(s, tc);
+
+    // Partition tests with a redo log
+    tc = tcase_create("partition redo");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_redo, test_teardown);
+    tcase_add_test(tc, test_partition_set_get);
+    tcase_add_test(tc, test_partition_clients);
+    tcase_add_test(tc, test_partition_restart);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
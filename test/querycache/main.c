@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 30      // How long to wait for each test to run.
+#define CACHE_CONF      "conf-cache.conf"   // Server configuration file with a query cache.
+#define CACHE_SERVEROUT "cache.serverout"   // File where the server's output is stored.
+#define NUMKEYS     10          // Number of records the fixture stores.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "inttbl"    // The table to use.
+
+/// Number of times the server has logged its query cache counters.
+int cache_logs;
+
+/**
+ * @brief Text fixture setup.  Start the server with a query cache and store
+ * NUMKEYS records key0 .. key9 with a set to the key's number and b to
+ * the number modulo 3.
+ */
+void test_setup_cache_populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    test_conn = init_start_connect(CACHE_CONF, CACHE_SERVEROUT, &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    cache_logs = 0;
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%d", i);
+        snprintf(record.value, sizeof record.value, "a %d,b %d", i, i % 3);
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+}
+
+/**
+ * @brief Run a query and join the keys it found.
+ *
+ * @param predicates The predicates of the query.
+ * @param found Where to write the keys, separated by spaces.
+ * @return The number of keys found.
+ */
+int query_keys(const char *predicates, char found[MAX_VALUE_LEN])
+{
+    int n, i;
+
+    n = storage_query(TABLE, predicates, test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n >= 0, "Query for %s failed.", predicates);
+    found[0] = '\0';
+    for (i = 0; i < n; i++)
+    {
+        if (i > 0)
+            strcat(found, " ");
+        strcat(found, test_keys[i]);
+    }
+    return n;
+}
+
+/**
+ * @brief Close the connection, read the query cache hits the server logs
+ * when it closes, then connect again.
+ *
+ * @return The number of hits so far, -1 if the server didn't log them.
+ */
+long cache_hits()
+{
+    char line[MAX_VALUE_LEN];
+    long hits = -1, logged;
+    FILE *file;
+    int tries, logs = 0;
+
+    storage_disconnect(test_conn);
+    for (tries = 0; tries < 20 && logs <= cache_logs; tries++)
+    {
+        usleep(100000);
+        file = fopen(CACHE_SERVEROUT, "r");
+        fail_unless(file != NULL, "Couldn't open the server output.");
+        for (logs = 0; fgets(line, sizeof line, file); )
+        {
+            if (sscanf(line, "Query cache: %ld hits", &logged) == 1)
+            {
+                hits = logged;
+                logs++;
+            }
+        }
+        fclose(file);
+    }
+    if (logs <= cache_logs)
+        hits = -1;
+    cache_logs = logs;
+
+    test_conn = storage_connect(SERVERHOST, server_port);
+    fail_unless(test_conn != NULL, "Couldn't connect to server.");
+    fail_unless(storage_auth(SERVERUSERNAME, SERVERPASSWORD, test_conn) == 0, "Authentication failed.");
+    return hits;
+}
+
+/*
+ * Query cache tests:
+ *  a set or delete in the table changes the result of a cached query
+ *  the same predicates in another order hit the same entry
+ */
+
+START_TEST (test_cache_set)
+{
+    struct storage_record record;
+    char found[MAX_VALUE_LEN];
+
+    fail_unless(query_keys("a > 6", found) == 3, "Query found %s.", found);
+    fail_unless(query_keys("a > 6", found) == 3, "Cached query found %s.", found);
+
+    // A new record that matches, then an update that stops one matching
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "a 20,b 0", sizeof record.value);
+    fail_unless(storage_set(TABLE, "key20", &record, test_conn) == 0, "Couldn't set key20.");
+    fail_unless(query_keys("a > 6", found) == 4, "Query after a set found %s.", found);
+    fail_unless(strcmp(found, "key7 key8 key9 key20") == 0, "Query after a set found %s.", found);
+    strncpy(record.value, "a 0,b 0", sizeof record.value);
+    fail_unless(storage_set(TABLE, "key8", &record, test_conn) == 0, "Couldn't update key8.");
+    fail_unless(query_keys("a > 6", found) == 3, "Query after an update found %s.", found);
+    fail_unless(strcmp(found, "key7 key9 key20") == 0, "Query after an update found %s.", found);
+    long hits = cache_hits();
+    fail_unless(hits == 1, "The queries made %ld cache hits instead of 1.", hits);
+}
+END_TEST
+
+START_TEST (test_cache_delete)
+{
+    char found[MAX_VALUE_LEN];
+
+    fail_unless(query_keys("a > 6", found) == 3, "Query found %s.", found);
+    fail_unless(query_keys("a > 6", found) == 3, "Cached query found %s.", found);
+    fail_unless(storage_set(TABLE, "key9", NULL, test_conn) == 0, "Couldn't delete key9.");
+    fail_unless(query_keys("a > 6", found) == 2, "Query after a delete found %s.", found);
+    fail_unless(strcmp(found, "key7 key8") == 0, "Query after a delete found %s.", found);
+    long hits = cache_hits();
+    fail_unless(hits == 1, "The queries made %ld cache hits instead of 1.", hits);
+}
+END_TEST
+
+START_TEST (test_cache_order)
+{
+    char found[MAX_VALUE_LEN], reordered[MAX_VALUE_LEN];
+
+    fail_unless(query_keys("a > 2, b < 1", found) == 3, "Query found %s.", found);
+    fail_unless(strcmp(found, "key3 key6 key9") == 0, "Query found %s.", found);
+    fail_unless(query_keys("b<1,a>2", reordered) == 3, "Reordered query found %s.", reordered);
+    fail_unless(strcmp(found, reordered) == 0, "Reordered query found %s.", reordered);
+    long hits = cache_hits();
+    fail_unless(hits == 1, "The reordered query made %ld cache hits instead of 1.", hits);
+
+    // A different predicate is a different entry
+    fail_unless(query_keys("a > 2, b < 2", found) == 5, "Query found %s.", found);
+    hits = cache_hits();
+    fail_unless(hits == 1, "A different query left %ld cache hits instead of 1.", hits);
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("querycache");
+    TCase *tc;
+
+    // Query cache tests on in-memory tables
+    tc = tcase_create("querycache memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_cache_populate, test_teardown);
+    tcase_add_test(tc, test_cache_set);
+    tcase_add_test(tc, test_cache_delete);
+    tcase_add_test(tc, test_cache_order);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 60      // How long to wait for each test to run.
+#define SNAPSHOT_CONF   "conf-snapshot.conf"    // Server configuration file taking a snapshot every second.
+#define NOSNAPSHOT_CONF "conf-nosnapshot.conf"  // Server configuration file taking no snapshot during a test.
+#define LOCKNAMES_CONF  "conf-lock-names.conf"  // Server configuration file with a data directory named per-table.
+#define LOCKNAMES_DIR   "per-table"             // The data directory of LOCKNAMES_CONF.
+#define NUMKEYS     20          // Number of records the fixtures store.
+#define NUMWRITERS  4           // Number of concurrent writers.
+#define FILELIMIT   1024        // Largest file the server may write in the write error tests.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table.
+
+/**
+ * @brief Store NUMKEYS records key00 .. key19, then update the even ones
+ * and delete every fifth one.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 2)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        snprintf(record.value, sizeof record.value, "col %d", 1000 + i);
+        fail_unless(storage_set(INTTABLE, key, &record, test_conn) == 0, "Couldn't update %s.", key);
+    }
+    for (i = 0; i < NUMKEYS; i += 5)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        fail_unless(storage_set(INTTABLE, key, NULL, test_conn) == 0, "Couldn't delete %s.", key);
+    }
+}
+
+/**
+ * @brief Check the records populate() leaves behind.
+ */
+void check_populated()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "key%02d", i);
+        if (i % 5 == 0)
+        {
+            fail_unless(storage_get(INTTABLE, key, &record, test_conn) == -1, "Deleted %s came back.", key);
+            fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+            continue;
+        }
+        fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+        snprintf(value, sizeof value, "col %d", i % 2 ? i : 1000 + i);
+        fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+    }
+
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS - NUMKEYS / 5, "Query found %d records instead of %d.", n, NUMKEYS - NUMKEYS / 5);
+    n = storage_query(INTTABLE, "col > 999", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMKEYS / 2 - NUMKEYS / 10, "Query found %d updated records.", n);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server taking a snapshot every second.
+ */
+void test_setup_snapshot()
+{
+    test_conf = SNAPSHOT_CONF;
+    test_conn = init_start_connect(test_conf, "snapshot.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server so that only the redo log is replayed.
+ */
+void test_setup_nosnapshot()
+{
+    test_conf = NOSNAPSHOT_CONF;
+    test_conn = init_start_connect(test_conf, "nosnapshot.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/*
+ * Redo log tests:
+ *  in-memory tables come back after the server is killed
+ *  writes made after a snapshot are replayed on top of it
+ */
+
+START_TEST (test_redo_restart)
+{
+    populate();
+    restart();
+    check_populated();
+}
+END_TEST
+
+START_TEST (test_redo_twice)
+{
+    struct storage_record record;
+
+    populate();
+    restart();
+
+    // Write on top of what was restored, then restart again.
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 7", sizeof record.value);
+    fail_unless(storage_set(STRTABLE, "after", &record, test_conn) == 0, "Couldn't set after a restart.");
+    fail_unless(storage_set(INTTABLE, "key01", NULL, test_conn) == 0, "Couldn't delete after a restart.");
+    restart();
+
+    fail_unless(storage_get(STRTABLE, "after", &record, test_conn) == 0, "Couldn't get after a restart.");
+    fail_unless(strcmp(record.value, "col 7") == 0, "Get after a restart returned %s.", record.value);
+    fail_unless(storage_get(INTTABLE, "key01", &record, test_conn) == -1, "Deleted key01 came back.");
+    fail_unless(errno == ERR_KEY_NOT_FOUND, "Get didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_redo_after_snapshot)
+{
+    struct storage_record record;
+
+    populate();
+
+    // Let a snapshot be taken, then change records it holds.
+    sleep(3);
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 5000", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "key03", &record, test_conn) == 0, "Couldn't update key03.");
+    fail_unless(storage_set(INTTABLE, "key04", NULL, test_conn) == 0, "Couldn't delete key04.");
+    restart();
+
+    fail_unless(storage_get(INTTABLE, "key03", &record, test_conn) == 0, "Couldn't get key03.");
+    fail_unless(strcmp(record.value, "col 5000") == 0, "key03 is %s instead of col 5000.", record.value);
+    fail_unless(storage_get(INTTABLE, "key04", &record, test_conn) == -1, "Deleted key04 came back.");
+    fail_unless(storage_get(INTTABLE, "key07", &record, test_conn) == 0, "Couldn't get key07.");
+    fail_unless(strcmp(record.value, "col 7") == 0, "key07 is %s instead of col 7.", record.value);
+}
+END_TEST
+
+/*
+ * Group commit tests:
+ *  concurrent writers on their own connections all get their writes in
+ */
+
+START_TEST (test_redo_concurrent)
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int w, i, status;
+    pid_t pids[NUMWRITERS];
+
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        pids[w] = fork();
+        fail_unless(pids[w] >= 0, "Couldn't fork a writer.");
+        if (pids[w] == 0)
+        {
+            // The writer.
+            void *conn = storage_connect(SERVERHOST, server_port);
+            if (conn == NULL || storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) != 0)
+                exit(EXIT_FAILURE);
+            memset(&record, 0, sizeof record);
+            for (i = 0; i < NUMKEYS; i++)
+            {
+                snprintf(key, sizeof key, "w%dk%02d", w, i);
+                snprintf(record.value, sizeof record.value, "col %d", w * 100 + i);
+                if (storage_set(INTTABLE, key, &record, conn) != 0)
+                    exit(EXIT_FAILURE);
+            }
+            storage_disconnect(conn);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        fail_unless(waitpid(pids[w], &status, 0) == pids[w], "Couldn't wait for a writer.");
+        fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "Writer %d failed.", w);
+    }
+
+    restart();
+    for (w = 0; w < NUMWRITERS; w++)
+    {
+        for (i = 0; i < NUMKEYS; i += 7)
+        {
+            char value[MAX_VALUE_LEN];
+            snprintf(key, sizeof key, "w%dk%02d", w, i);
+            snprintf(value, sizeof value, "col %d", w * 100 + i);
+            fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+            fail_unless(strcmp(record.value, value) == 0, "%s is %s instead of %s.", key, record.value, value);
+        }
+    }
+    int n = storage_query(INTTABLE, "col > -1", test_keys, MAX_RECORDS_PER_TABLE, test_conn);
+    fail_unless(n == NUMWRITERS * NUMKEYS, "Query found %d records instead of %d.", n, NUMWRITERS * NUMKEYS);
+}
+END_TEST
+
+/*
+ * Write error tests:
+ *  a change that cannot be logged is not reported as a success
+ */
+
+START_TEST (test_redo_write_error)
+{
+    struct storage_record record;
+    struct rlimit limit, saved;
+    char key[MAX_KEY_LEN];
+    int i, failed = -1;
+
+    // The server inherits the limit; writing past it fails with EFBIG.
+    signal(SIGXFSZ, SIG_IGN);
+    fail_unless(getrlimit(RLIMIT_FSIZE, &saved) == 0, "Couldn't read the file size limit.");
+    limit = saved;
+    limit.rlim_cur = FILELIMIT;
+    fail_unless(setrlimit(RLIMIT_FSIZE, &limit) == 0, "Couldn't set the file size limit.");
+    test_conf = NOSNAPSHOT_CONF;
+    test_conn = init_start_connect(test_conf, "test_redo_write_error.serverout", &test_pid);
+    setrlimit(RLIMIT_FSIZE, &saved);
+
+    memset(&record, 0, sizeof record);
+    for (i = 0; i < FILELIMIT / 8; i++)
+    {
+        snprintf(key, sizeof key, "key%03d", i);
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        if (storage_set(INTTABLE, key, &record, test_conn) != 0)
+        {
+            fail_unless(errno == ERR_UNKNOWN, "Set didn't set the errno properly.");
+            if (failed == -1)
+                failed = i;
+        }
+        else
+        {
+            fail_unless(failed == -1, "Set of %s succeeded after the log failed.", key);
+        }
+    }
+    fail_unless(failed > 0, "Sets past the file size limit succeeded.");
+
+    // Every change reported as a success is in the log.
+    restart();
+    for (i = 0; i < failed; i++)
+    {
+        snprintf(key, sizeof key, "key%03d", i);
+        fail_unless(storage_get(INTTABLE, key, &record, test_conn) == 0, "Couldn't get %s.", key);
+    }
+
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+END_TEST
+
+/*
+ * Config tests:
+ *  lock scheme values are keywords only after lock_scheme
+ */
+
+START_TEST (test_redo_lock_names)
+{
+    struct storage_record record;
+
+    system("rm -rf " LOCKNAMES_DIR);
+    test_conf = LOCKNAMES_CONF;
+    test_conn = start_connect(test_conf, "test_redo_lock_names.serverout", &test_pid);
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 5", sizeof record.value);
+    fail_unless(storage_set(INTTABLE, "key", &record, test_conn) == 0, "Couldn't set.");
+    restart();
+    fail_unless(storage_get(INTTABLE, "key", &record, test_conn) == 0, "Couldn't get after a restart.");
+    fail_unless(strcmp(record.value, "col 5") == 0, "Get returned %s instead of col 5.", record.value);
+    fail_unless(access(LOCKNAMES_DIR, F_OK) == 0, "The data directory isn't named " LOCKNAMES_DIR ".");
+
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+    system("rm -rf " LOCKNAMES_DIR);
+}
+END_TEST
+
+/**
+ * @brief This runs the redo log and snapshot tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("redolog");
+    TCase *tc;
+
+    // Redo log tests with a snapshot every second
+    tc = tcase_create("redolog snapshot");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_snapshot, test_teardown);
+    tcase_add_test(tc, test_redo_restart);
+    tcase_add_test(tc, test_redo_twice);
+    tcase_add_test(tc, test_redo_after_snapshot);
+    tcase_add_test(tc, test_redo_concurrent);
+    suite_add_tcase(s, tc);
+
+    // Redo log tests replaying the log alone
+    tc = tcase_create("redolog nosnapshot");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_nosnapshot, test_teardown);
+    tcase_add_test(tc, test_redo_restart);
+    tcase_add_test(tc, test_redo_twice);
+    tcase_add_test(tc, test_redo_concurrent);
+    suite_add_tcase(s, tc);
+
+    // Redo log tests with a log that cannot be written
+    tc = tcase_create("redolog write error");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_redo_write_error);
+    suite_add_tcase(s, tc);
+
+    // Config tests
+    tc = tcase_create("redolog config");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_redo_lock_names);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
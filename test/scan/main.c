@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 10      // How long to wait for each test to run.
+#define SIMPLETABLES_CONF       "conf-simpletables.conf"    // Server configuration file with an in-memory table.
+#define DISKTABLES_CONF         "conf-disktables.conf"      // Server configuration file with an on-disk table.
+#define PAGESIZE    3           // Number of keys asked for per call.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "inttbl"    // The table to use.
+#define MISSINGTABLE    "missingtable"  // A non-existing table.
+#define BADKEY      "bad key"   // A bad key name.
+
+/// Keys the fixtures store, out of order.
+const char *test_stored[] = { "b3", "a1", "c", "b0", "a0", "ab", "b10", "a2", "b1", "b2", "aa" };
+
+/**
+ * @brief Store the keys of test_stored.
+ */
+void populate()
+{
+    struct storage_record record;
+    int i;
+
+    for (i = 0; i < sizeof test_stored / sizeof test_stored[0]; i++)
+    {
+        snprintf(record.value, sizeof record.value, "col %d", i);
+        fail_unless(storage_set(TABLE, test_stored[i], &record, test_conn) == 0, "Couldn't set %s.", test_stored[i]);
+    }
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an in-memory table and populate it.
+ */
+void test_setup_memory_populate()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "memorydata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an on-disk table and populate it.
+ */
+void test_setup_disk_populate()
+{
+    test_conn = init_start_connect(DISKTABLES_CONF, "diskdata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Walk an iterator to the end, PAGESIZE keys at a time.
+ *
+ * @param it The iterator to walk.
+ * @param expected The keys expected, in order, separated by spaces.
+ */
+void check_walk(struct storage_iterator *it, const char *expected)
+{
+    char walked[MAX_VALUE_LEN] = "";
+    int n, i, calls = 0;
+
+    while ((n = storage_iterator_next(it, test_keys, PAGESIZE)) > 0)
+    {
+        fail_unless(n <= PAGESIZE, "Iterator returned %d keys.", n);
+        for (i = 0; i < n; i++)
+        {
+            if (walked[0] != '\0')
+                strcat(walked, " ");
+            strcat(walked, test_keys[i]);
+        }
+        calls++;
+        fail_unless(calls < 100, "Iterator didn't stop.");
+    }
+    fail_unless(n == 0, "Iterator failed.");
+    fail_unless(strcmp(walked, expected) == 0, "Iterator returned \"%s\" instead of \"%s\".", walked, expected);
+
+    // A finished walk stays finished.
+    fail_unless(storage_iterator_next(it, test_keys, PAGESIZE) == 0, "Iterator restarted.");
+}
+
+/*
+ * Scan tests:
+ *  every key in order
+ *  ranges with either end open
+ *  deleted and added keys
+ */
+
+START_TEST (test_scan_all)
+{
+    struct storage_iterator it;
+    fail_unless(storage_scan_begin(&it, TABLE, "", "", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "a0 a1 a2 aa ab b0 b1 b10 b2 b3 c");
+}
+END_TEST
+
+START_TEST (test_scan_range)
+{
+    struct storage_iterator it;
+    fail_unless(storage_scan_begin(&it, TABLE, "a2", "b2", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "a2 aa ab b0 b1 b10");
+
+    fail_unless(storage_scan_begin(&it, TABLE, "b", "", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "b0 b1 b10 b2 b3 c");
+
+    fail_unless(storage_scan_begin(&it, TABLE, "", "aa", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "a0 a1 a2");
+}
+END_TEST
+
+START_TEST (test_scan_empty_range)
+{
+    struct storage_iterator it;
+    fail_unless(storage_scan_begin(&it, TABLE, "d", "", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "");
+
+    fail_unless(storage_scan_begin(&it, TABLE, "b2", "b2", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "");
+}
+END_TEST
+
+START_TEST (test_scan_changes)
+{
+    struct storage_iterator it;
+    struct storage_record record;
+
+    fail_unless(storage_set(TABLE, "b1", NULL, test_conn) == 0, "Couldn't delete b1.");
+    strncpy(record.value, "col 100", sizeof record.value);
+    fail_unless(storage_set(TABLE, "b11", &record, test_conn) == 0, "Couldn't set b11.");
+
+    fail_unless(storage_scan_begin(&it, TABLE, "b", "c", test_conn) == 0, "Couldn't start the scan.");
+    check_walk(&it, "b0 b10 b11 b2 b3");
+}
+END_TEST
+
+/*
+ * Prefix tests:
+ *  keys sharing a prefix, in order
+ *  a prefix no key has
+ *  the empty prefix
+ */
+
+START_TEST (test_prefix)
+{
+    struct storage_iterator it;
+    fail_unless(storage_prefix_begin(&it, TABLE, "b1", test_conn) == 0, "Couldn't start the prefix walk.");
+    check_walk(&it, "b1 b10");
+
+    fail_unless(storage_prefix_begin(&it, TABLE, "a", test_conn) == 0, "Couldn't start the prefix walk.");
+    check_walk(&it, "a0 a1 a2 aa ab");
+}
+END_TEST
+
+START_TEST (test_prefix_none)
+{
+    struct storage_iterator it;
+    fail_unless(storage_prefix_begin(&it, TABLE, "ba", test_conn) == 0, "Couldn't start the prefix walk.");
+    check_walk(&it, "");
+}
+END_TEST
+
+START_TEST (test_prefix_all)
+{
+    struct storage_iterator it;
+    fail_unless(storage_prefix_begin(&it, TABLE, "", test_conn) == 0, "Couldn't start the prefix walk.");
+    check_walk(&it, "a0 a1 a2 aa ab b0 b1 b10 b2 b3 c");
+}
+END_TEST
+
+/*
+ * Invalid walk tests:
+ *  bad keys
+ *  missing table
+ */
+
+START_TEST (test_scan_bad_key)
+{
+    struct storage_iterator it;
+    fail_unless(storage_scan_begin(&it, TABLE, BADKEY, "", test_conn) == -1, "Scan from a bad key didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Scan didn't set the errno properly.");
+    fail_unless(storage_prefix_begin(&it, TABLE, BADKEY, test_conn) == -1, "Prefix walk of a bad key didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Prefix walk didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_scan_missing_table)
+{
+    struct storage_iterator it;
+    fail_unless(storage_scan_begin(&it, MISSINGTABLE, "", "", test_conn) == 0, "Couldn't start the scan.");
+    fail_unless(storage_iterator_next(&it, test_keys, PAGESIZE) == -1, "Scan of a missing table didn't fail.");
+    fail_unless(errno == ERR_TABLE_NOT_FOUND, "Scan didn't set the errno properly.");
+}
+END_TEST
+
+/**
+ * @brief This runs the scan and prefix tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("scan");
+    TCase *tc;
+
+    // Scan tests on an in-memory table
+    tc = tcase_create("scan memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory_populate, test_teardown);
+    tcase_add_test(tc, test_scan_all);
+    tcase_add_test(tc, test_scan_range);
+    tcase_add_test(tc, test_scan_empty_range);
+    tcase_add_test(tc, test_scan_changes);
+    tcase_add_test(tc, test_prefix);
+    tcase_add_test(tc, test_prefix_none);
+    tcase_add_test(tc, test_prefix_all);
+    tcase_add_test(tc, test_scan_bad_key);
+    tcase_add_test(tc, test_scan_missing_table);
+    suite_add_tcase(s, tc);
+
+    // Scan tests on an on-disk table
+    tc = tcase_create("scan disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk_populate, test_teardown);
+    tcase_add_test(tc, test_scan_all);
+    tcase_add_test(tc, test_scan_range);
+    tcase_add_test(tc, test_scan_changes);
+    tcase_add_test(tc, test_prefix);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 10      // How long to wait for each test to run.
+#define SIMPLETABLES_CONF       "conf-simpletables.conf"    // Server configuration file with an in-memory table.
+#define DISKTABLES_CONF         "conf-disktables.conf"      // Server configuration file with an on-disk table.
+#define NUMKEYS     12          // Number of records the fixtures store.
+
+// These settings should correspond to what's in the config files.
+#define TABLE       "people"    // The table to use.
+#define MISSINGTABLE    "missingtable"  // A non-existing table.
+
+// Records array used by test fixture.
+struct storage_record test_records[MAX_RECORDS_PER_TABLE];
+
+/**
+ * @brief Store NUMKEYS records p00 .. p11, aged 20 + the key's number.
+ */
+void populate()
+{
+    struct storage_record record;
+    char key[MAX_KEY_LEN];
+    int i;
+
+    for (i = 0; i < NUMKEYS; i++)
+    {
+        snprintf(key, sizeof key, "p%02d", i);
+        snprintf(record.value, sizeof record.value, "name n%d,age %d,city %s", i, 20 + i, i % 3 ? "paris" : "rome");
+        fail_unless(storage_set(TABLE, key, &record, test_conn) == 0, "Couldn't set %s.", key);
+    }
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an in-memory table and populate it.
+ */
+void test_setup_memory_populate()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "memorydata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an on-disk table and populate it.
+ */
+void test_setup_disk_populate()
+{
+    test_conn = init_start_connect(DISKTABLES_CONF, "diskdata.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+    populate();
+}
+
+/**
+ * @brief Find the record returned for a key.
+ * @return The index of the key in test_keys, or -1 if it wasn't returned.
+ */
+int find_key(const char *key, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        if (strcmp(test_keys[i], key) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Select tests:
+ *  whole values and metadata come back with the keys
+ *  columns are projected in the order asked for
+ *  paging with a cursor
+ */
+
+START_TEST (test_select_values)
+{
+    struct storage_record record;
+    int n = storage_query_records(TABLE, "age > 29", "", test_keys, test_records, MAX_RECORDS_PER_TABLE, NULL, test_conn);
+    fail_unless(n == 2, "Select found %d records instead of 2.", n);
+
+    int i = find_key("p10", n);
+    fail_unless(i >= 0, "Select didn't return p10.");
+    fail_unless(strcmp(test_records[i].value, "name n10,age 30,city paris") == 0,
+                "Select returned the wrong value: %s.", test_records[i].value);
+
+    // The metadata is the same as a get's, so the record can be updated safely.
+    fail_unless(storage_get(TABLE, "p10", &record, test_conn) == 0, "Couldn't get p10.");
+    fail_unless(test_records[i].metadata[0] == record.metadata[0], "Select returned the wrong metadata.");
+
+    i = find_key("p11", n);
+    fail_unless(i >= 0, "Select didn't return p11.");
+    fail_unless(strcmp(test_records[i].value, "name n11,age 31,city paris") == 0,
+                "Select returned the wrong value: %s.", test_records[i].value);
+}
+END_TEST
+
+START_TEST (test_select_columns)
+{
+    int n = storage_query_records(TABLE, "city = rome", "age,name", test_keys, test_records, MAX_RECORDS_PER_TABLE,
+                                  NULL, test_conn);
+    fail_unless(n == 4, "Select found %d records instead of 4.", n);
+
+    int i = find_key("p03", n);
+    fail_unless(i >= 0, "Select didn't return p03.");
+    fail_unless(strcmp(test_records[i].value, "age 23,name n3") == 0,
+                "Select didn't project the columns: %s.", test_records[i].value);
+}
+END_TEST
+
+START_TEST (test_select_no_keys)
+{
+    int n = storage_query_records(TABLE, "age = 25", "city", NULL, test_records, MAX_RECORDS_PER_TABLE, NULL, test_conn);
+    fail_unless(n == 1, "Select found %d records instead of 1.", n);
+    fail_unless(strcmp(test_records[0].value, "city paris") == 0, "Select returned the wrong value.");
+}
+END_TEST
+
+START_TEST (test_select_none)
+{
+    char cursor[MAX_CURSOR_LEN] = "";
+    int n = storage_query_records(TABLE, "age > 100", "", test_keys, test_records, MAX_RECORDS_PER_TABLE, cursor,
+                                  test_conn);
+    fail_unless(n == 0, "Select found records that don't match.");
+    fail_unless(strcmp(test_keys[0], "") == 0, "No extra keys should be modified.");
+    fail_unless(cursor[0] == '\0', "An empty select shouldn't return a cursor.");
+}
+END_TEST
+
+START_TEST (test_select_pages)
+{
+    char cursor[MAX_CURSOR_LEN] = "";
+    int seen[NUMKEYS] = {0};
+    int total = 0, pages = 0, i, n;
+
+    do
+    {
+        clear_keys();
+        n = storage_query_records(TABLE, "age > 0", "age", test_keys, test_records, 5, cursor, test_conn);
+        fail_unless(n >= 0 && n <= 5, "Select page returned %d records.", n);
+        for (i = 0; i < n; i++)
+        {
+            int num = -1, age = -1;
+            fail_unless(sscanf(test_keys[i], "p%d", &num) == 1 && num >= 0 && num < NUMKEYS,
+                        "Select returned a bad key %s.", test_keys[i]);
+            fail_unless(seen[num] == 0, "Key %s was returned twice.", test_keys[i]);
+            fail_unless(sscanf(test_records[i].value, "age %d", &age) == 1 && age == 20 + num,
+                        "Select returned the wrong value for %s.", test_keys[i]);
+            seen[num] = 1;
+        }
+        total += n;
+        pages++;
+        fail_unless(pages <= NUMKEYS, "Paging didn't stop.");
+    } while (cursor[0] != '\0');
+
+    fail_unless(total == NUMKEYS, "Select pages returned %d records instead of %d.", total, NUMKEYS);
+}
+END_TEST
+
+/*
+ * Invalid select tests:
+ *  unknown column
+ *  bad predicates
+ *  missing table
+ */
+
+START_TEST (test_select_bad_column)
+{
+    int n = storage_query_records(TABLE, "age > 0", "age,salary", test_keys, test_records, MAX_RECORDS_PER_TABLE,
+                                  NULL, test_conn);
+    fail_unless(n == -1, "Select of an unknown column didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Select didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_select_bad_predicate)
+{
+    int n = storage_query_records(TABLE, "city > rome", "", test_keys, test_records, MAX_RECORDS_PER_TABLE, NULL,
+                                  test_conn);
+    fail_unless(n == -1, "Select with an invalid operator didn't fail.");
+    fail_unless(errno == ERR_INVALID_PARAM, "Select didn't set the errno properly.");
+}
+END_TEST
+
+START_TEST (test_select_missing_table)
+{
+    int n = storage_query_records(MISSINGTABLE, "age > 0", "", test_keys, test_records, MAX_RECORDS_PER_TABLE, NULL,
+                                  test_conn);
+    fail_unless(n == -1, "Select on a missing table didn't fail.");
+    fail_unless(errno == ERR_TABLE_NOT_FOUND, "Select didn't set the errno properly.");
+}
+END_TEST
+
+/**
+ * @brief This runs the select tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("select");
+    TCase *tc;
+
+    // Select tests on an in-memory table
+    tc = tcase_create("select memory");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_memory_populate, test_teardown);
+    tcase_add_test(tc, test_select_values);
+    tcase_add_test(tc, test_select_columns);
+    tcase_add_test(tc, test_select_no_keys);
+    tcase_add_test(tc, test_select_none);
+    tcase_add_test(tc, test_select_pages);
+    tcase_add_test(tc, test_select_bad_column);
+    tcase_add_test(tc, test_select_bad_predicate);
+    tcase_add_test(tc, test_select_missing_table);
+    suite_add_tcase(s, tc);
+
+    // Select tests on an on-disk table
+    tc = tcase_create("select disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk_populate, test_teardown);
+    tcase_add_test(tc, test_select_values);
+    tcase_add_test(tc, test_select_columns);
+    tcase_add_test(tc, test_select_none);
+    tcase_add_test(tc, test_select_pages);
+    tcase_add_test(tc, test_select_bad_column);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include "fixture.h"
+
+#define TESTTIMEOUT 30      // How long to wait for each test to run.
+#define BTREE_CONF      "conf-btree.conf"       // Server configuration file with btree tables.
+#define BTREESERVE_CONF "conf-btree-serve.conf" // Server configuration file with btree tables, serving while they open.
+#define DISK_CONF       "conf-disk.conf"        // Server configuration file with on-disk tables.
+#define DISKSERVE_CONF  "conf-disk-serve.conf"  // Server configuration file with on-disk tables, serving while they open.
+#define NUMTABLES   6           // Number of tables in the config files.
+#define NUMKEYS     8           // Number of records the fixtures store per table.
+#define MAXRETRIES  1000        // Times a command on a table still opening is retried.
+
+// These settings should correspond to what's in the config files.
+#define FAILEDTABLE "t3"        // The table whose file is made unreadable.
+#define FAILEDFILE  DATADIR "/" FAILEDTABLE "_btree.dat"   // The file of that table.
+
+/**
+ * @brief Store NUMKEYS records in every table.
+ */
+void populate()
+{
+    struct storage_record record;
+    char table[MAX_TABLE_LEN], key[MAX_KEY_LEN];
+    int t, i;
+
+    memset(&record, 0, sizeof record);
+    for (t = 1; t <= NUMTABLES; t++)
+    {
+        snprintf(table, sizeof table, "t%d", t);
+        for (i = 0; i < NUMKEYS; i++)
+        {
+            snprintf(key, sizeof key, "key%d", i);
+            snprintf(record.value, sizeof record.value, "col %d", t * 100 + i);
+            fail_unless(storage_set(table, key, &record, test_conn) == 0, "Couldn't set %s in %s.", key, table);
+        }
+    }
+}
+
+/**
+ * @brief Get a record, retrying while its table is still being opened.
+ * @return Return 0 if successful, and -1 otherwise, as for storage_get().
+ */
+int get_retry(const char *table, const char *key, struct storage_record *record)
+{
+    int tries, status = -1;
+
+    for (tries = 0; tries < MAXRETRIES; tries++)
+    {
+        status = storage_get(table, key, record, test_conn);
+        if (status == 0 || errno != ERR_TABLE_LOADING)
+            break;
+        usleep(10000);
+    }
+    return status;
+}
+
+/**
+ * @brief Check every record populate() stored, skipping one table.
+ *
+ * @param skip The number of the table to skip, or 0 to check them all.
+ */
+void check_populated(int skip)
+{
+    struct storage_record record;
+    char table[MAX_TABLE_LEN], key[MAX_KEY_LEN], value[MAX_VALUE_LEN];
+    int t, i;
+
+    for (t = 1; t <= NUMTABLES; t++)
+    {
+        if (t == skip)
+            continue;
+        snprintf(table, sizeof table, "t%d", t);
+        for (i = 0; i < NUMKEYS; i++)
+        {
+            snprintf(key, sizeof key, "key%d", i);
+            snprintf(value, sizeof value, "col %d", t * 100 + i);
+            fail_unless(get_retry(table, key, &record) == 0, "Couldn't get %s from %s.", key, table);
+            fail_unless(strcmp(record.value, value) == 0, "%s in %s is %s instead of %s.", key, table,
+                        record.value, value);
+        }
+    }
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with btree tables and populate them.
+ */
+void test_setup_btree_populate()
+{
+    test_conf = BTREE_CONF;
+    test_conn = init_start_connect(test_conf, "btree.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    populate();
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with on-disk tables and populate them.
+ */
+void test_setup_disk_populate()
+{
+    test_conf = DISK_CONF;
+    test_conn = init_start_connect(test_conf, "disk.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    populate();
+}
+
+/*
+ * Startup tests:
+ *  every table is opened, whether or not the server serves while they open
+ */
+
+START_TEST (test_startup_btree)
+{
+    test_conf = BTREE_CONF;
+    restart();
+    check_populated(0);
+}
+END_TEST
+
+START_TEST (test_startup_btree_serve)
+{
+    test_conf = BTREESERVE_CONF;
+    restart();
+    check_populated(0);
+
+    // Writes go through once the tables are open.
+    struct storage_record record;
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 1", sizeof record.value);
+    fail_unless(storage_set("t6", "after", &record, test_conn) == 0, "Couldn't set after a restart.");
+}
+END_TEST
+
+START_TEST (test_startup_disk)
+{
+    test_conf = DISK_CONF;
+    restart();
+    check_populated(0);
+}
+END_TEST
+
+START_TEST (test_startup_disk_serve)
+{
+    test_conf = DISKSERVE_CONF;
+    restart();
+    check_populated(0);
+}
+END_TEST
+
+/*
+ * Failed table tests:
+ *  without serve_while_loading the server refuses to start
+ *  with it the other tables are served, and the failed one gets errors
+ */
+
+START_TEST (test_startup_failed_refused)
+{
+    system("rm -rf " DATADIR);
+    mkdir(DATADIR, 0777);
+    mkdir(FAILEDFILE, 0777);
+
+    int serverpid = start_server(BTREE_CONF, NULL, "test_startup_failed_refused.serverout");
+    fail_unless(serverpid < 0, "Server should not run with a table it cannot open.");
+}
+END_TEST
+
+START_TEST (test_startup_failed_served)
+{
+    struct storage_record record;
+
+    system("rm -rf " DATADIR);
+    mkdir(DATADIR, 0777);
+    mkdir(FAILEDFILE, 0777);
+
+    test_conn = start_connect(BTREESERVE_CONF, "test_startup_failed_served.serverout", &test_pid);
+
+    memset(&record, 0, sizeof record);
+    strncpy(record.value, "col 5", sizeof record.value);
+    fail_unless(storage_get("t1", "key0", &record, test_conn) == -1, "Get from an empty table didn't fail.");
+    fail_unless(errno == ERR_KEY_NOT_FOUND || errno == ERR_TABLE_LOADING, "Get didn't set the errno properly.");
+    fail_unless(get_retry("t1", "key0", &record) == -1 && errno == ERR_KEY_NOT_FOUND,
+                "Table t1 wasn't opened.");
+    fail_unless(storage_set("t1", "key0", &record, test_conn) == 0, "Couldn't set in t1.");
+    fail_unless(get_retry("t1", "key0", &record) == 0, "Couldn't get from t1.");
+
+    fail_unless(get_retry(FAILEDTABLE, "key0", &record) == -1, "Get from a failed table didn't fail.");
+    fail_unless(errno == ERR_UNKNOWN, "Get from a failed table didn't set the errno properly.");
+    fail_unless(storage_set(FAILEDTABLE, "key0", &record, test_conn) == -1, "Set in a failed table didn't fail.");
+    fail_unless(errno == ERR_UNKNOWN, "Set in a failed table didn't set the errno properly.");
+
+    storage_disconnect(test_conn);
+    kill_server(test_pid);
+}
+END_TEST
+
+/**
+ * @brief This runs the startup tests.
+ */
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("startup");
+    TCase *tc;
+
+    // Startup tests with btree tables
+    tc = tcase_create("startup btree");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_btree_populate, test_teardown);
+    tcase_add_test(tc, test_startup_btree);
+    tcase_add_test(tc, test_startup_btree_serve);
+    suite_add_tcase(s, tc);
+
+    // Startup tests with on-disk tables
+    tc = tcase_create("startup disk");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_disk_populate, test_teardown);
+    tcase_add_test(tc, test_startup_disk);
+    tcase_add_test(tc, test_startup_disk_serve);
+    suite_add_tcase(s, tc);
+
+    // Startup tests with a table that cannot be opened
+    tc = tcase_create("startup failed");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_startup_failed_refused);
+    tcase_add_test(tc, test_startup_failed_served);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}
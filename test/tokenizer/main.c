@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "fixture.h"
+#include "utils.h"
+#include "tokenizer.h"
+#include "schema.h"
+
+#define TESTTIMEOUT 10      // How long to wait for each test to run.
+#define SIMPLETABLES_CONF   "conf-simpletables.conf"    // Server configuration file with an int and a string table.
+#define MAXTOKENS   8           // Room for tokens in the tokenizer tests.
+
+// These settings should correspond to what's in the config files.
+#define INTTABLE    "inttbl"    // The int table.
+#define STRTABLE    "strtbl"    // The string table, holding up to 10 characters.
+
+/**
+ * @brief Check that a token holds a string.
+ */
+#define fail_unless_token(tok, str) \
+    fail_unless(token_equals((tok), (str)), "Token is \"%.*s\" instead of \"%s\".", (tok).len, (tok).start, (str))
+
+/**
+ * @brief Make a token of a whole string.
+ */
+struct token whole(const char *str)
+{
+    struct token tok = { str, strlen(str) };
+    return tok;
+}
+
+/// A table with an int, a char[5] and a float column, for the validator tests.
+struct schema_table test_table;
+
+/**
+ * @brief Add a column to test_table.
+ */
+void add_column(const char *name, int type, int size)
+{
+    struct schema_column *column = &test_table.columns[test_table.num_columns++];
+
+    strcpy(column->name, name);
+    column->hash = schema_hash(name);
+    column->name_len = strlen(name);
+    column->type = type;
+    column->size = size;
+}
+
+/**
+ * @brief Text fixture setup.  Build test_table.
+ */
+void test_setup_table()
+{
+    memset(&test_table, 0, sizeof test_table);
+    strcpy(test_table.name, "tbl");
+    add_column("num", COLUMN_TYPE_INT, 0);
+    add_column("name", COLUMN_TYPE_CHAR, 5);
+    add_column("price", COLUMN_TYPE_FLOAT, 0);
+}
+
+/**
+ * @brief Check a value against test_table.
+ *
+ * @param value The record value.
+ * @return 0 if it matches the table, -1 otherwise.
+ */
+int validate(const char *value)
+{
+    struct schema_field fields[MAX_COLUMNS_PER_TABLE];
+    return schema_parse_value(&test_table, value, fields);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with an int and a string table.
+ */
+void test_setup_simple()
+{
+    test_conn = init_start_connect(SIMPLETABLES_CONF, "simple.serverout", &test_pid);
+    fail_unless(test_conn != NULL, "Couldn't start or connect to server.");
+    clear_keys();
+}
+
+/**
+ * @brief Send a raw command on a connection of its own and read the reply.
+ *
+ * The server hangs up after some errors, so no command shares a connection.
+ *
+ * @param command The command, without its newline.
+ * @param reply Where to store the reply, without its newline.
+ */
+void raw_command(const char *command, char reply[MAX_CMD_LEN])
+{
+    char line[MAX_CMD_LEN];
+    int sock;
+
+    void *conn = storage_connect(SERVERHOST, server_port);
+    fail_unless(conn != NULL, "Couldn't connect to server.");
+    fail_unless(storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn) == 0, "Authentication failed.");
+    sock = (int)(intptr_t)conn;
+    snprintf(line, sizeof line, "%s\n", command);
+    fail_unless(sendall(sock, line, strlen(line)) == 0, "Couldn't send %s.", command);
+    fail_unless(recvline(sock, reply, MAX_CMD_LEN) == 0, "No reply to %s.", command);
+    storage_disconnect(conn);
+}
+
+/**
+ * @brief Check the reply to a raw command.
+ */
+void check_command(const char *command, const char *expected)
+{
+    char reply[MAX_CMD_LEN];
+
+    raw_command(command, reply);
+    fail_unless(strncmp(reply, expected, strlen(expected)) == 0, "%s got %s instead of %s.", command, reply, expected);
+}
+
+/*
+ * Tokenizer tests:
+ *  empty fields, including leading and trailing ones, are kept
+ *  more fields than there is room for is an error
+ *  trimming, copying and number parsing stop at their limits
+ */
+
+START_TEST (test_tokenize_empty_fields)
+{
+    struct token tokens[MAXTOKENS];
+
+    fail_unless(tokenize("a;;b", ';', tokens, MAXTOKENS) == 3, "a;;b didn't give three fields.");
+    fail_unless_token(tokens[0], "a");
+    fail_unless_token(tokens[1], "");
+    fail_unless_token(tokens[2], "b");
+
+    fail_unless(tokenize("", ';', tokens, MAXTOKENS) == 1, "An empty string didn't give one field.");
+    fail_unless_token(tokens[0], "");
+    fail_unless(tokenize(";", ';', tokens, MAXTOKENS) == 2, "A lone ; didn't give two fields.");
+    fail_unless_token(tokens[0], "");
+    fail_unless_token(tokens[1], "");
+    fail_unless(tokenize(";GET;t;", ';', tokens, MAXTOKENS) == 4, "Stray ; didn't give empty fields.");
+    fail_unless_token(tokens[0], "");
+    fail_unless_token(tokens[1], "GET");
+    fail_unless_token(tokens[3], "");
+}
+END_TEST
+
+START_TEST (test_tokenize_too_many)
+{
+    struct token tokens[MAXTOKENS];
+
+    fail_unless(tokenize("a;b;c", ';', tokens, 3) == 3, "Three fields didn't fit in three tokens.");
+    fail_unless(tokenize("a;b;c;", ';', tokens, 3) == -1, "Four fields fit in three tokens.");
+    fail_unless(tokenize(";;;;;;;;", ';', tokens, MAXTOKENS) == -1, "Nine empty fields fit in eight tokens.");
+}
+END_TEST
+
+START_TEST (test_token_split)
+{
+    struct token tokens[MAXTOKENS], name, value;
+    const char *str = "SET;t;k;col 1,name  two words ";
+
+    fail_unless(tokenize(str, ';', tokens, MAXTOKENS) == 4, "Command didn't give four fields.");
+    fail_unless(token_split(tokens[3], ',', tokens, MAXTOKENS) == 2, "Value didn't give two columns.");
+    fail_unless_token(tokens[0], "col 1");
+    token_name_value(token_trim(tokens[1]), &name, &value);
+    fail_unless_token(name, "name");
+    fail_unless_token(value, "two words");
+    token_name_value(whole("col"), &name, &value);
+    fail_unless_token(name, "col");
+    fail_unless(value.len == 0, "A column without a value got one.");
+}
+END_TEST
+
+START_TEST (test_token_trim)
+{
+    fail_unless_token(token_trim(whole("  a b \t")), "a b");
+    fail_unless(token_trim(whole(" \t ")).len == 0, "Trimming whitespace left something.");
+    fail_unless(token_trim(whole("")).len == 0, "Trimming nothing left something.");
+}
+END_TEST
+
+START_TEST (test_token_copy)
+{
+    char buf[4];
+
+    fail_unless(token_copy(whole("abc"), buf, sizeof buf) == 0 && strcmp(buf, "abc") == 0, "abc didn't fit in 4 bytes.");
+    fail_unless(token_copy(whole("abcd"), buf, sizeof buf) == -1, "abcd fit in 4 bytes.");
+    fail_unless(token_copy(whole(""), buf, sizeof buf) == 0 && buf[0] == '\0', "Copying nothing failed.");
+}
+END_TEST
+
+START_TEST (test_token_numbers)
+{
+    double d;
+    int i;
+
+    fail_unless(token_to_int(whole("+12"), &i) == 0 && i == 12, "+12 wasn't parsed.");
+    fail_unless(token_to_int(whole("2147483647"), &i) == 0 && i == 2147483647, "INT_MAX wasn't parsed.");
+    fail_unless(token_to_int(whole("-2147483648"), &i) == 0 && i == -2147483647 - 1, "INT_MIN wasn't parsed.");
+    fail_unless(token_to_int(whole("2147483648"), &i) == -1, "INT_MAX + 1 was parsed.");
+    fail_unless(token_to_int(whole("99999999999999999999"), &i) == -1, "A huge number was parsed.");
+    fail_unless(token_to_int(whole(""), &i) == -1, "An empty int was parsed.");
+    fail_unless(token_to_int(whole("-"), &i) == -1, "A lone sign was parsed.");
+    fail_unless(token_to_int(whole("12a"), &i) == -1, "12a was parsed.");
+
+    fail_unless(token_to_double(whole("-12.5"), &d) == 0 && d == -12.5, "-12.5 wasn't parsed.");
+    fail_unless(token_to_double(whole("3e8"), &d) == 0 && d == 3e8, "3e8 wasn't parsed.");
+    fail_unless(token_to_double(whole(""), &d) == -1, "An empty number was parsed.");
+    fail_unless(token_to_double(whole("0x10"), &d) == -1, "Hex was parsed.");
+    fail_unless(token_to_double(whole("inf"), &d) == -1, "inf was parsed.");
+    fail_unless(token_to_double(whole("nan"), &d) == -1, "nan was parsed.");
+    fail_unless(token_to_double(whole("1e999"), &d) == -1, "An infinite number was parsed.");
+}
+END_TEST
+
+/*
+ * Validator tests:
+ *  every column is split out and converted
+ *  empty and missing columns, and extra ones, are refused
+ *  ints and char[SIZE] values are bounded
+ *  a stray ; is not a column separator
+ */
+
+START_TEST (test_validate_fields)
+{
+    struct schema_field fields[MAX_COLUMNS_PER_TABLE];
+
+    fail_unless(schema_parse_value(&test_table, " num -7 , name a b ,price 2.5", fields) == 0, "A good value was refused.");
+    fail_unless(fields[0].int_value == -7, "num is %d instead of -7.", fields[0].int_value);
+    fail_unless_token(fields[0].value, "-7");
+    fail_unless_token(fields[1].value, "a b");
+    fail_unless(fields[2].float_value == 2.5, "price is %g instead of 2.5.", fields[2].float_value);
+}
+END_TEST
+
+START_TEST (test_validate_empty_fields)
+{
+    fail_unless(validate("") == -1, "An empty value was accepted.");
+    fail_unless(validate("num ,name a,price 1") == -1, "An empty int was accepted.");
+    fail_unless(validate("num 1,name a,price") == -1, "An empty float was accepted.");
+    fail_unless(validate("num 1,name,price 1") == 0, "An empty char column was refused.");
+    fail_unless(validate("num 1,,name a,price 1") == -1, "An empty column was accepted.");
+    fail_unless(validate("num 1,name a,price 1,") == -1, "A trailing comma was accepted.");
+}
+END_TEST
+
+START_TEST (test_validate_columns)
+{
+    fail_unless(validate("num 1,name a") == -1, "Too few columns were accepted.");
+    fail_unless(validate("num 1,name a,price 1,extra 2") == -1, "Too many columns were accepted.");
+    fail_unless(validate("name a,num 1,price 1") == -1, "Columns out of order were accepted.");
+    fail_unless(validate("numb 1,name a,price 1") == -1, "A longer column name was accepted.");
+    fail_unless(validate("nu 1,name a,price 1") == -1, "A shorter column name was accepted.");
+}
+END_TEST
+
+START_TEST (test_validate_limits)
+{
+    fail_unless(validate("num 2147483647,name abcde,price 1") == 0, "The largest values were refused.");
+    fail_unless(validate("num -2147483648,name a,price 1") == 0, "INT_MIN was refused.");
+    fail_unless(validate("num 2147483648,name a,price 1") == -1, "INT_MAX + 1 was accepted.");
+    fail_unless(validate("num 99999999999999999999,name a,price 1") == -1, "A huge int was accepted.");
+    fail_unless(validate("num 1,name abcdef,price 1") == -1, "An over-length char value was accepted.");
+    fail_unless(validate("num 1a,name a,price 1") == -1, "A bad int was accepted.");
+    fail_unless(validate("num 1,name a,price 1e999") == -1, "An infinite float was accepted.");
+}
+END_TEST
+
+START_TEST (test_validate_stray_separator)
+{
+    fail_unless(validate("num 1;name a,price 1") == -1, "A ; between columns was accepted.");
+    fail_unless(validate("num 1,name a;,price 1") == 0, "A ; in a char value was refused.");
+    fail_unless(validate("num 1,name a,price 1;") == -1, "A ; after a float was accepted.");
+}
+END_TEST
+
+/*
+ * Command tests:
+ *  empty keys and values are refused
+ *  keys and values one character too long are refused
+ *  stray ; are refused where they shift fields and ignored at the end
+ */
+
+START_TEST (test_command_empty_fields)
+{
+    check_command("SET;" INTTABLE ";;col 1;0", "ERR_INVALID_PARAM");
+    check_command("SET;" INTTABLE ";k;;0", "ERR_INVALID_PARAM");
+    check_command("SET;;k;col 1;0", "ERR_TABLE_NOT_FOUND");
+    check_command("GET;" INTTABLE ";", "ERR_INVALID_PARAM");
+    check_command("DELETE;" INTTABLE ";;NULL", "ERR_INVALID_PARAM");
+    check_command("GET;" INTTABLE, "ERR_INVALID_PARAM");
+}
+END_TEST
+
+START_TEST (test_command_long_fields)
+{
+    char command[MAX_CMD_LEN], key[MAX_KEY_LEN + 1], value[MAX_VALUE_LEN + 1];
+
+    // The longest key fits, one more character doesn't
+    memset(key, 'k', MAX_KEY_LEN - 1);
+    key[MAX_KEY_LEN - 1] = '\0';
+    snprintf(command, sizeof command, "SET;%s;%s;col 1;0", INTTABLE, key);
+    check_command(command, "SUCCESS");
+    snprintf(command, sizeof command, "GET;%s;%s", INTTABLE, key);
+    check_command(command, "col 1");
+    strcat(key, "k");
+    snprintf(command, sizeof command, "SET;%s;%s;col 1;0", INTTABLE, key);
+    check_command(command, "ERR_INVALID_PARAM");
+
+    // So does the longest char column, and the longest value
+    check_command("SET;" STRTABLE ";s;col 0123456789;0", "SUCCESS");
+    check_command("SET;" STRTABLE ";s;col 0123456789a;0", "ERR_INVALID_PARAM");
+    memset(value, ' ', MAX_VALUE_LEN);
+    memcpy(value, "col 1", 5);
+    value[MAX_VALUE_LEN - 1] = '\0';
+    snprintf(command, sizeof command, "SET;%s;v;%s;0", INTTABLE, value);
+    check_command(command, "SUCCESS");
+    value[MAX_VALUE_LEN - 1] = ' ';
+    value[MAX_VALUE_LEN] = '\0';
+    snprintf(command, sizeof command, "SET;%s;v;%s;0", INTTABLE, value);
+    check_command(command, "ERR_INVALID_PARAM");
+}
+END_TEST
+
+START_TEST (test_command_stray_separators)
+{
+    check_command("SET;" INTTABLE ";k;col 1;0;", "SUCCESS");
+    check_command("GET;" INTTABLE ";k;", "col 1");
+    check_command(";GET;" INTTABLE ";k", "ERR_UNKNOWN");
+    check_command("GET;;" INTTABLE ";k", "ERR_TABLE_NOT_FOUND");
+    check_command("SET;" INTTABLE ";k;col 1;x;y;z", "ERR_INVALID_PARAM");
+    check_command(";", "ERR_UNKNOWN");
+}
+END_TEST
+
+int main(int argc, char *argv[])
+{
+    init_server_port(argc, argv);
+    Suite *s = suite_create("tokenizer");
+    TCase *tc;
+
+    // Tokenizer tests
+    tc = tcase_create("tokenizer");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_test(tc, test_tokenize_empty_fields);
+    tcase_add_test(tc, test_tokenize_too_many);
+    tcase_add_test(tc, test_token_split);
+    tcase_add_test(tc, test_token_trim);
+    tcase_add_test(tc, test_token_copy);
+    tcase_add_test(tc, test_token_numbers);
+    suite_add_tcase(s, tc);
+
+    // Validator tests
+    tc = tcase_create("tokenizer validator");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_table, NULL);
+    tcase_add_test(tc, test_validate_fields);
+    tcase_add_test(tc, test_validate_empty_fields);
+    tcase_add_test(tc, test_validate_columns);
+    tcase_add_test(tc, test_validate_limits);
+    tcase_add_test(tc, test_validate_stray_separator);
+    suite_add_tcase(s, tc);
+
+    // Malformed command tests
+    tc = tcase_create("tokenizer commands");
+    tcase_set_timeout(tc, TESTTIMEOUT);
+    tcase_add_checked_fixture(tc, test_setup_simple, test_teardown);
+    tcase_add_test(tc, test_command_empty_fields);
+    tcase_add_test(tc, test_command_long_fields);
+    tcase_add_test(tc, test_command_stray_separators);
+    suite_add_tcase(s, tc);
+
+    run_suite(s);
+
+    return EXIT_SUCCESS;
+}